@@ -0,0 +1,107 @@
+#!/usr/bin/env python
+# SPDX-License-Identifier: Apache-2.0
+# SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+# ADPCM clip decoder
+# Converts the IMA-ADPCM clip files written by the firmware back to WAV
+
+# A clip starts with a 20 byte little-endian header ("ADPC", u32 sample rate,
+#   u32 time, u32 sample count, i16 initial predictor, u8 initial step index,
+#   one padding byte) followed by the 4-bit codes, two per byte, the first
+#   sample in the low nibble. See adpcm.c.
+
+# ***********************************************************************************
+#
+# Imports
+#
+# ***********************************************************************************
+
+import argparse
+import os.path
+import struct
+import sys
+import wave
+
+HEADER = struct.Struct('<4sIIIhBx')
+
+INDEX_TABLE = (-1, -1, -1, -1, 2, 4, 6, 8,
+               -1, -1, -1, -1, 2, 4, 6, 8)
+
+STEP_TABLE = (
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+    19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+    130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+    337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+    876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+    2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+    5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767)
+
+
+# ***********************************************************************************
+#
+# Decode 4-bit codes to 16-bit samples
+#
+# ***********************************************************************************
+def decode(data, count, predictor=0, index=0):
+    samples = []
+    for byte in data:
+        for code in (byte & 0xF, byte >> 4):
+            if len(samples) == count:
+                return samples
+            step = STEP_TABLE[index]
+            diff = step >> 3
+            if code & 4:
+                diff += step
+            if code & 2:
+                diff += step >> 1
+            if code & 1:
+                diff += step >> 2
+            predictor = predictor - diff if code & 8 else predictor + diff
+            predictor = max(-32768, min(32767, predictor))
+            index = max(0, min(88, index + INDEX_TABLE[code]))
+            samples.append(predictor)
+    return samples
+
+
+# ***********************************************************************************
+#
+# Main program flow
+#
+# ***********************************************************************************
+if __name__ == '__main__':
+
+    parser = argparse.ArgumentParser(
+        description='Convert Artemia ADPCM clips to WAV')
+
+    parser.add_argument('clips', nargs='+', help='clip files copied off the device')
+
+    parser.add_argument('-o', dest='outdir', default='',
+                        help='Directory for the WAV files (default: next to each clip)')
+
+    args = parser.parse_args()
+
+    for path in args.clips:
+        with open(path, mode='rb') as f:
+            data = f.read()
+        magic, rate, time, count, predictor, index = HEADER.unpack_from(data)
+        if magic != b'ADPC':
+            print(path + ': not an ADPCM clip', file=sys.stderr)
+            continue
+
+        # A clip that was never closed has a zero count; decode what is there
+        if count == 0:
+            count = (len(data) - HEADER.size) * 2
+        samples = decode(data[HEADER.size:], count, predictor, index)
+
+        name = os.path.splitext(os.path.basename(path))[0] + '.wav'
+        out = os.path.join(args.outdir or os.path.dirname(path), name)
+        with wave.open(out, 'wb') as wav:
+            wav.setnchannels(1)
+            wav.setsampwidth(2)
+            wav.setframerate(rate)
+            wav.writeframes(struct.pack('<' + str(len(samples)) + 'h', *samples))
+
+        print(out + ': ' + str(len(samples)) + ' samples at ' + str(rate) +
+              ' Hz, recorded at ' + str(time))
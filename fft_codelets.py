@@ -0,0 +1,273 @@
+#!/usr/bin/env python
+# SPDX-License-Identifier: Apache-2.0
+# SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+# FFT codelet generator
+# Writes kiss_fft_codelets.c: one straight-line complex FFT per size, with
+#   the loops unrolled and every twiddle a constant, for kiss_fft_alloc to
+#   use instead of the generic kf_work recursion. The build runs it, see the
+#   fft_codelets meson option.
+
+# Each codelet is a radix-2 decimation in time FFT. Butterflies whose twiddle
+#   is 1, -j or an odd multiple of exp(-j*pi/4) are written without the
+#   general complex multiply. The inverse transform is the forward one with
+#   the real and imaginary parts swapped on the way in and out.
+# Sizes up to the unroll limit are unrolled completely. Past it, code size
+#   grows faster than the time saved, so a codelet runs the half size one on
+#   the even and the odd samples into a buffer on the stack, then unrolls only
+#   its last stage.
+# The float codelets compute the same unscaled transform as kiss_fft. The
+#   FIXED_POINT=16 ones halve every stage, for the same 1/N scaling as the
+#   fixed point kiss_fft, keeping intermediate values in 32 bits and rounding
+#   products and halvings to nearest.
+
+# ***********************************************************************************
+#
+# Imports
+#
+# ***********************************************************************************
+
+import argparse
+import math
+
+SIZES = [16, 32, 64, 128]
+UNROLL = 64
+
+
+def bit_reverse(value, bits):
+    result = 0
+    for _ in range(bits):
+        result = (result << 1) | (value & 1)
+        value >>= 1
+    return result
+
+
+def float_literal(value):
+    return '%.9ff' % value
+
+
+def q15(value):
+    return max(-32768, min(32767, int(round(value * 32768))))
+
+
+# ***********************************************************************************
+#
+# Butterflies, values named v<stage>_<index> with r and i suffixes
+#
+# ***********************************************************************************
+
+# t = b * exp(-j*2*pi*j/m), then out0 = a + t and out1 = a - t
+def butterfly(a, b, out0, out1, j, m, fixed):
+    kind = 'int32_t' if fixed else 'float'
+    eighth = (8 * j) % m == 0 and (8 * j // m) % 2 == 1
+    if j == 0:
+        tr, ti = b + 'r', b + 'i'
+    elif 4 * j == m:
+        tr, ti = b + 'i', '-' + b + 'r'
+    elif eighth:
+        # exp(-j*pi/4) or exp(-j*3*pi/4)
+        if fixed:
+            c = str(q15(math.sqrt(0.5)))
+            s = 'mul_q15(%s, %s)'
+        else:
+            c = float_literal(math.sqrt(0.5))
+            s = '%s * (%s)'
+        if 8 * j == m:
+            tr, ti = s % (c, b + 'r + ' + b + 'i'), s % (c, b + 'i - ' + b + 'r')
+        else:
+            tr, ti = s % (c, b + 'i - ' + b + 'r'), '-' + s % (c, b + 'r + ' + b + 'i')
+    else:
+        phase = -2 * math.pi * j / m
+        if fixed:
+            wr, wi = q15(math.cos(phase)), q15(math.sin(phase))
+            tr = '((%sr * %d - %si * %d + 16384) >> 15)' % (b, wr, b, wi)
+            ti = '((%sr * %d + %si * %d + 16384) >> 15)' % (b, wi, b, wr)
+        else:
+            wr, wi = float_literal(math.cos(phase)), float_literal(math.sin(phase))
+            tr = '%sr * %s - %si * %s' % (b, wr, b, wi)
+            ti = '%sr * %s + %si * %s' % (b, wi, b, wr)
+
+    lines = ['const %s %s_tr = %s;' % (kind, out0, tr),
+             'const %s %s_ti = %s;' % (kind, out0, ti)]
+    for out, op in ((out0, '+'), (out1, '-')):
+        for part in ('r', 'i'):
+            value = '%s%s %s %s_t%s' % (a, part, op, out0, part)
+            if fixed:
+                value = '(%s + 1) >> 1' % value
+            lines.append('const %s %s%s = %s;' % (kind, out, part, value))
+    return lines
+
+
+def store(out, i, fixed):
+    lines = []
+    for part, index in (('r', 'yre'), ('i', 'yim')):
+        value = out + part
+        if fixed:
+            value = 'q15_sat(%s)' % value
+        lines.append('y[%d + %s] = %s;' % (2 * i, index, value))
+    return lines
+
+
+# ***********************************************************************************
+#
+# Codelet bodies. Each reads n complex values from x, stride complex values
+# apart, and writes them contiguously to y, the real and imaginary parts at
+# xre/xim and yre/yim of each pair of scalars
+#
+# ***********************************************************************************
+
+# Completely unrolled. Depth first, each half finished before the stage
+# joining them, so few values are live at once. Every load comes before the
+# last stage, which stores as it goes, so x and y can be the same
+def unrolled_body(n, fixed):
+    bits = n.bit_length() - 1
+    kind = 'int32_t' if fixed else 'float'
+    lines = []
+
+    def block(size, offset, stage):
+        if size == 1:
+            j = bit_reverse(offset, bits)
+            lines.append('const %s v0_%dr = x[%d * stride + xre];' % (kind, offset, 2 * j))
+            lines.append('const %s v0_%di = x[%d * stride + xim];' % (kind, offset, 2 * j))
+            return
+        half = size // 2
+        block(half, offset, stage - 1)
+        block(half, offset + half, stage - 1)
+        for j in range(half):
+            a = 'v%d_%d' % (stage - 1, offset + j)
+            b = 'v%d_%d' % (stage - 1, offset + j + half)
+            out0 = 'v%d_%d' % (stage, offset + j)
+            out1 = 'v%d_%d' % (stage, offset + j + half)
+            lines.extend(butterfly(a, b, out0, out1, j, size, fixed))
+            if stage == bits:
+                lines.extend(store(out0, offset + j, fixed))
+                lines.extend(store(out1, offset + j + half, fixed))
+
+    block(n, 0, bits)
+    return lines
+
+
+# The half size codelet on the even and the odd samples, then the last stage
+def split_body(n, fixed):
+    kind = 'int32_t' if fixed else 'float'
+    half = n // 2
+    lines = ['kiss_fft_scalar t[%d];' % (2 * n),
+             'kf_codelet_%d(x, 2 * stride, xre, xim, t, 0, 1);' % half,
+             'kf_codelet_%d(x + 2 * stride, 2 * stride, xre, xim, t + %d, 0, 1);' % (half, n)]
+    for j in range(half):
+        for name, i in (('a', j), ('b', j + half)):
+            lines.append('const %s %s%dr = t[%d];' % (kind, name, j, 2 * i))
+            lines.append('const %s %s%di = t[%d];' % (kind, name, j, 2 * i + 1))
+        out0, out1 = 'v%d' % j, 'v%d' % (j + half)
+        lines.extend(butterfly('a%d' % j, 'b%d' % j, out0, out1, j, n, fixed))
+        lines.extend(store(out0, j, fixed))
+        lines.extend(store(out1, j + half, fixed))
+    return lines
+
+
+def generate(sizes, unroll):
+    # Every size a split codelet needs, down to one that is unrolled
+    needed = set()
+    for n in sizes:
+        while n > unroll:
+            needed.add(n)
+            n //= 2
+        needed.add(n)
+
+    out = []
+    out.append('// SPDX-License-Identifier: Apache-2.0')
+    out.append('// SPDX-FileCopyrightText: Gabriel Marcano, 2023')
+    out.append('')
+    out.append('// Generated by fft_codelets.py, do not edit')
+    out.append('')
+    out.append('#include "_kiss_fft_guts.h"')
+    out.append('')
+    out.append('#include <stddef.h>')
+    out.append('#include <stdint.h>')
+    out.append('')
+    out.append('#if !defined(FIXED_POINT) || FIXED_POINT == 16')
+    out.append('')
+    out.append('#ifdef FIXED_POINT')
+    out.append('static inline int32_t mul_q15(int32_t w, int32_t x)')
+    out.append('{')
+    out.append('\treturn (w * x + 16384) >> 15;')
+    out.append('}')
+    out.append('')
+    out.append('static inline kiss_fft_scalar q15_sat(int32_t x)')
+    out.append('{')
+    out.append('\treturn x > 32767 ? 32767 : x < -32768 ? -32768 : (kiss_fft_scalar)x;')
+    out.append('}')
+    out.append('#endif')
+    for n in sorted(needed):
+        body = unrolled_body if n <= unroll else split_body
+        out.append('')
+        out.append('static void kf_codelet_%d(const kiss_fft_scalar *x, int stride, int xre, int xim, '
+                   'kiss_fft_scalar *y, int yre, int yim)' % n)
+        out.append('{')
+        out.append('#ifdef FIXED_POINT')
+        out.extend('\t' + line for line in body(n, True))
+        out.append('#else')
+        out.extend('\t' + line for line in body(n, False))
+        out.append('#endif')
+        out.append('}')
+    for n in sizes:
+        out.append('')
+        out.append('static void kf_codelet_cpx_%d(const kiss_fft_cpx *fin, kiss_fft_cpx *fout, int inverse)' % n)
+        out.append('{')
+        out.append('\tconst int re = inverse ? 1 : 0;')
+        out.append('\tkf_codelet_%d((const kiss_fft_scalar *)fin, 1, re, 1 - re, '
+                   '(kiss_fft_scalar *)fout, re, 1 - re);' % n)
+        out.append('}')
+    out.append('')
+    out.append('kiss_fft_codelet kiss_fft_codelet_find(int nfft)')
+    out.append('{')
+    out.append('\tswitch (nfft)')
+    out.append('\t{')
+    for n in sizes:
+        out.append('\tcase %d:' % n)
+        out.append('\t\treturn kf_codelet_cpx_%d;' % n)
+    out.append('\tdefault:')
+    out.append('\t\treturn NULL;')
+    out.append('\t}')
+    out.append('}')
+    out.append('')
+    out.append('#else')
+    out.append('')
+    out.append('kiss_fft_codelet kiss_fft_codelet_find(int nfft)')
+    out.append('{')
+    out.append('\t(void)nfft;')
+    out.append('\treturn NULL;')
+    out.append('}')
+    out.append('')
+    out.append('#endif')
+    return '\n'.join(out) + '\n'
+
+
+# ******************************************************************************
+#
+# Main program flow
+#
+# ******************************************************************************
+if __name__ == '__main__':
+
+    parser = argparse.ArgumentParser(
+        description='Generate straight-line kiss_fft codelets')
+
+    parser.add_argument('-o', dest='output', required=True,
+                        help='C file to write')
+
+    parser.add_argument('-s', dest='sizes', default=','.join(str(n) for n in SIZES),
+                        help='Comma separated powers of two to generate (default %(default)s)')
+
+    parser.add_argument('-u', dest='unroll', type=int, default=UNROLL,
+                        help='Largest size unrolled completely (default %(default)s)')
+
+    args = parser.parse_args()
+
+    sizes = sorted(set(int(n) for n in args.sizes.split(',')))
+    for n in sizes + [args.unroll]:
+        if n < 2 or n & (n - 1):
+            raise SystemExit('sizes must be powers of two, not ' + str(n))
+
+    with open(args.output, 'w') as f:
+        f.write(generate(sizes, args.unroll))
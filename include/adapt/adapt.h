@@ -0,0 +1,93 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+#ifndef ADAPT_H_
+#define ADAPT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/** Most features a channel can compare between samples */
+#define ADAPT_FEATURES 8
+
+/**
+ * Structure representing the sampling schedule of one channel. Configure the
+ * bounds and thresholds, zero the rest; the state can be carried across
+ * resets with adapt_load and adapt_save.
+ *
+ * Each sample is reduced to a few features, scaled by the caller so a change
+ * of 1 is about the smallest change that matters. The activity of a sample is
+ * the mean absolute change of its features since the last sample. Activity at
+ * or above high drops the interval to the minimum right away; activity at or
+ * below low for calm_samples samples in a row doubles it, up to the maximum.
+ * Anything in between keeps the interval, so a channel hovering around a
+ * single threshold does not flip between rates.
+ */
+struct adapt
+{
+	uint32_t min_interval; // s
+	uint32_t max_interval; // s
+	float high;
+	float low; // below high
+	uint8_t calm_samples;
+
+	uint32_t interval; // s, 0 before the first sample
+	uint32_t next; // time the channel is due, s
+	uint8_t calm; // calm samples in a row
+	uint8_t features; // features in reference
+	float reference[ADAPT_FEATURES]; // features of the last sample
+	uint32_t samples; // samples taken
+};
+
+/**
+ * Returns true if the channel should be sampled at time now.
+ */
+bool adapt_due(const struct adapt *adapt, uint32_t now);
+
+/**
+ * Records a sample and schedules the next one.
+ *
+ * @param[in, out] adapt schedule of the channel.
+ * @param[in] now time of the sample, s.
+ * @param[in] features scaled features of the sample.
+ * @param[in] count number of features, at most ADAPT_FEATURES.
+ *
+ * @returns the activity of the sample, 0 for the first one.
+ */
+float adapt_sample(struct adapt *adapt, uint32_t now, const float features[], size_t count);
+
+/**
+ * Returns the time in seconds from now until the first of the channels is
+ * due, 0 if one is due already.
+ *
+ * @param[in] adapts schedules of the channels.
+ * @param[in] count number of channels.
+ * @param[in] now current time, s.
+ */
+uint32_t adapt_wait(const struct adapt adapts[], size_t count, uint32_t now);
+
+/**
+ * Restores schedules saved by adapt_save. The state of a channel whose bounds
+ * changed since is discarded, keeping only its sample count.
+ *
+ * @param[in] path file to load from.
+ * @param[in, out] adapts configured schedules.
+ * @param[in] count number of schedules.
+ *
+ * @returns 0 on success, -1 if there was no usable state.
+ */
+int adapt_load(const char *path, struct adapt adapts[], size_t count);
+
+/**
+ * Saves schedules.
+ *
+ * @param[in] path file to save to, replaced.
+ * @param[in] adapts schedules.
+ * @param[in] count number of schedules.
+ *
+ * @returns 0 on success, -1 on failure.
+ */
+int adapt_save(const char *path, const struct adapt adapts[], size_t count);
+
+#endif//ADAPT_H_
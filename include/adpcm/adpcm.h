@@ -0,0 +1,118 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+#ifndef ADPCM_H_
+#define ADPCM_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/** Bytes of encoded audio buffered in SRAM before a clip is written to flash */
+#define ADPCM_CLIP_BUFFER_SIZE 512
+
+/** Size in bytes of the header at the start of every clip file */
+#define ADPCM_CLIP_HEADER_SIZE 20
+
+/** IMA-ADPCM codec state, carried from one block of samples to the next */
+struct adpcm_state
+{
+	int16_t predictor;
+	uint8_t index;
+};
+
+/**
+ * Structure representing an audio clip being streamed to a file as 4-bit
+ * IMA-ADPCM.
+ *
+ * The file starts with a ADPCM_CLIP_HEADER_SIZE byte little-endian header:
+ * "ADPC", u32 sample rate, u32 time, u32 sample count, and the initial
+ * predictor (i16) and step index (u8) followed by a padding byte. Two samples
+ * are packed per byte, the first one in the low nibble.
+ */
+struct adpcm_clip
+{
+	FILE *fp;
+	struct adpcm_state state;
+	uint32_t samples;
+	size_t used;
+	uint8_t buffer[ADPCM_CLIP_BUFFER_SIZE];
+};
+
+/**
+ * Initializes the codec state to silence.
+ *
+ * @param[out] state state to initialize.
+ */
+void adpcm_init(struct adpcm_state *state);
+
+/**
+ * Encodes 16-bit PCM samples to IMA-ADPCM.
+ *
+ * @param[in, out] state codec state.
+ * @param[in] in samples to encode.
+ * @param[in] count number of samples, must be even.
+ * @param[out] out count/2 bytes of encoded data.
+ *
+ * @returns the number of bytes written to out.
+ */
+size_t adpcm_encode(struct adpcm_state *state, const int16_t in[], size_t count, uint8_t out[]);
+
+/**
+ * Decodes IMA-ADPCM back to 16-bit PCM samples.
+ *
+ * @param[in, out] state codec state.
+ * @param[in] in encoded data.
+ * @param[in] size number of bytes to decode.
+ * @param[out] out size*2 decoded samples.
+ *
+ * @returns the number of samples written to out.
+ */
+size_t adpcm_decode(struct adpcm_state *state, const uint8_t in[], size_t size, int16_t out[]);
+
+/**
+ * Returns the largest absolute sample value, to decide whether a capture
+ * should trigger a clip.
+ *
+ * @param[in] samples samples to check.
+ * @param[in] count number of samples.
+ *
+ * @returns the peak amplitude.
+ */
+uint16_t adpcm_peak_amplitude(const int16_t samples[], size_t count);
+
+/**
+ * Creates a clip file and writes its header.
+ *
+ * @param[out] clip clip to initialize.
+ * @param[in] path path of the file to create.
+ * @param[in] rate sampling rate of the audio.
+ * @param[in] time timestamp of the first sample.
+ *
+ * @returns 0 on success, -1 if the file could not be created.
+ */
+int adpcm_clip_open(struct adpcm_clip *clip, const char *path, uint32_t rate, uint32_t time);
+
+/**
+ * Encodes samples into the clip. Encoded data is kept in the clip's buffer and
+ * written out whenever the buffer fills up.
+ *
+ * @param[in, out] clip clip to append to.
+ * @param[in] samples samples to append.
+ * @param[in] count number of samples, must be even.
+ *
+ * @returns 0 on success, -1 if a write failed.
+ */
+int adpcm_clip_write(struct adpcm_clip *clip, const int16_t samples[], size_t count);
+
+/**
+ * Flushes the remaining encoded data, records the final sample count in the
+ * header and closes the file.
+ *
+ * @param[in, out] clip clip to close.
+ *
+ * @returns 0 on success, -1 if a write failed.
+ */
+int adpcm_clip_close(struct adpcm_clip *clip);
+
+#endif//ADPCM_H_
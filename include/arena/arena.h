@@ -0,0 +1,54 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <stddef.h>
+
+/**
+ * Fixed size allocator for library allocations, FFT plans and buffers. The
+ * memory is one static array of ARENA_SIZE bytes, set at build time through
+ * the arena_size meson option, so it shows up in .bss and cannot grow into the
+ * stack like the heap can. Blocks are handed out first fit, 8 byte aligned,
+ * and neighbouring free blocks are merged again when freed.
+ */
+
+/** Bytes of memory in the arena, including block headers */
+#ifndef ARENA_SIZE
+#define ARENA_SIZE 32768
+#endif
+
+/** Usage figures of the arena */
+struct arena_stats
+{
+	size_t size; // bytes in the arena
+	size_t used; // bytes in allocated blocks, headers included
+	size_t high_water; // most bytes ever in allocated blocks
+	size_t failures; // allocations that did not fit
+};
+
+/**
+ * Allocates a block, like malloc.
+ *
+ * @param[in] size bytes to allocate.
+ *
+ * @returns the block, or NULL if no free block is large enough.
+ */
+void *arena_alloc(size_t size);
+
+/**
+ * Returns a block to the arena, like free. NULL is ignored.
+ *
+ * @param[in] ptr block from arena_alloc.
+ */
+void arena_free(void *ptr);
+
+/**
+ * Gets the usage figures of the arena.
+ *
+ * @param[out] stats usage figures.
+ */
+void arena_get_stats(struct arena_stats *stats);
+
+#endif//ARENA_H_
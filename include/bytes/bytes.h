@@ -0,0 +1,130 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+#ifndef BYTES_H_
+#define BYTES_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Byte order helpers for the files and frames the firmware writes. State
+// files, log indexes and the boot manifest are little-endian; offload frames
+// are big-endian, as offload.py expects.
+
+/** Size of a state file header: magic, version, record count, padding */
+#define BYTES_HEADER_SIZE 8
+
+/**
+ * Reads a little-endian 32 bit value.
+ *
+ * @param[in] buffer the 4 bytes to read.
+ *
+ * @returns the value.
+ */
+static inline uint32_t bytes_get_le32(const uint8_t *buffer)
+{
+	return buffer[0] | (buffer[1] << 8) | (buffer[2] << 16) | ((uint32_t)buffer[3] << 24);
+}
+
+/**
+ * Writes a little-endian 32 bit value.
+ *
+ * @param[out] buffer the 4 bytes to write.
+ * @param[in] value value to write.
+ */
+static inline void bytes_put_le32(uint8_t *buffer, uint32_t value)
+{
+	buffer[0] = value;
+	buffer[1] = value >> 8;
+	buffer[2] = value >> 16;
+	buffer[3] = value >> 24;
+}
+
+/**
+ * Reads a big-endian 32 bit value.
+ *
+ * @param[in] buffer the 4 bytes to read.
+ *
+ * @returns the value.
+ */
+static inline uint32_t bytes_get_be32(const uint8_t *buffer)
+{
+	return ((uint32_t)buffer[0] << 24) | ((uint32_t)buffer[1] << 16) | (buffer[2] << 8) | buffer[3];
+}
+
+/**
+ * Writes a big-endian 32 bit value.
+ *
+ * @param[out] buffer the 4 bytes to write.
+ * @param[in] value value to write.
+ */
+static inline void bytes_put_be32(uint8_t *buffer, uint32_t value)
+{
+	buffer[0] = value >> 24;
+	buffer[1] = value >> 16;
+	buffer[2] = value >> 8;
+	buffer[3] = value;
+}
+
+/**
+ * Returns the bit pattern of a float, to store it with bytes_put_le32.
+ *
+ * @param[in] value float to convert.
+ *
+ * @returns its IEEE 754 bits.
+ */
+static inline uint32_t bytes_float_bits(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+/**
+ * Returns the float with a bit pattern, read with bytes_get_le32.
+ *
+ * @param[in] bits IEEE 754 bits.
+ *
+ * @returns the float.
+ */
+static inline float bytes_bits_float(uint32_t bits)
+{
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+/**
+ * Fills in the header of a state file, followed by count fixed size records.
+ *
+ * @param[out] header BYTES_HEADER_SIZE bytes to fill in.
+ * @param[in] magic 4 characters identifying the file.
+ * @param[in] version format version of the records.
+ * @param[in] count number of records, at most 255.
+ */
+static inline void bytes_put_header(uint8_t header[], const char magic[4], uint8_t version, size_t count)
+{
+	memset(header, 0, BYTES_HEADER_SIZE);
+	memcpy(header, magic, 4);
+	header[4] = version;
+	header[5] = count;
+}
+
+/**
+ * Checks the header of a state file against what its loader expects.
+ *
+ * @param[in] header BYTES_HEADER_SIZE bytes read from the file.
+ * @param[in] magic 4 characters identifying the file.
+ * @param[in] version format version of the records.
+ * @param[in] count number of records expected.
+ *
+ * @returns true if the header matches.
+ */
+static inline bool bytes_check_header(const uint8_t header[], const char magic[4], uint8_t version, size_t count)
+{
+	return memcmp(header, magic, 4) == 0 && header[4] == version && header[5] == count;
+}
+
+#endif//BYTES_H_
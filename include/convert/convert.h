@@ -0,0 +1,49 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+#ifndef CONVERT_H_
+#define CONVERT_H_
+
+#include <stdint.h>
+
+/**
+ * Writes the decimal digits of a number, without a terminator, to the start
+ * of a buffer. Initialize the buffer before calling, like
+ * uint8_t buffer[21] = {0}, so the digits end up terminated.
+ *
+ * Only integer operations are used, so it costs no floating point library
+ * calls on a single precision FPU.
+ *
+ * @param[out] buffer where the digits are written, 20 at most.
+ * @param[in] tv_sec number to write, like a time in seconds.
+ */
+void time_to_string(uint8_t buffer[21], uint64_t tv_sec);
+
+/**
+ * Converts an ADC code to the voltage at the input, rounded to the nearest
+ * microvolt.
+ *
+ * @param[in] code ADC reading, at most full_scale.
+ * @param[in] reference reference voltage in uV, which full_scale reads as.
+ * @param[in] full_scale largest code, like (1 << 14) - 1 for 14 bits, at
+ *  most 65535.
+ *
+ * @returns the input voltage in uV.
+ */
+uint32_t convert_adc_microvolts(uint32_t code, uint32_t reference, uint32_t full_scale);
+
+/**
+ * Resistance of the lower leg of a voltage divider, with a fixed resistor
+ * from the supply to the measured node: fixed * voltage / (supply - voltage),
+ * in single precision and truncated to whole ohms.
+ *
+ * @param[in] voltage voltage at the node in uV.
+ * @param[in] supply supply voltage in uV.
+ * @param[in] fixed resistance of the fixed resistor in ohms.
+ *
+ * @returns the resistance in ohms, UINT32_MAX if voltage is not below supply
+ *  or the result does not fit.
+ */
+uint32_t convert_divider_ohms(uint32_t voltage, uint32_t supply, uint32_t fixed);
+
+#endif//CONVERT_H_
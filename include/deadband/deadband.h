@@ -0,0 +1,98 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+#ifndef DEADBAND_H_
+#define DEADBAND_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/** How a channel decides which readings are worth a record */
+enum deadband_mode
+{
+	/** Every reading is written */
+	DEADBAND_OFF,
+	/**
+	 * A reading is written when it differs from the last written one by more
+	 * than the tolerance. Holding the last written value reconstructs every
+	 * reading within the tolerance.
+	 */
+	DEADBAND_THRESHOLD,
+	/**
+	 * Swinging door compression: a reading is written once no straight line
+	 * from the last written one stays within the tolerance of every reading
+	 * since. Interpolating linearly between written readings reconstructs
+	 * every reading within the tolerance. Readings are written one reading
+	 * late, when the next one closes the door.
+	 */
+	DEADBAND_SWINGING_DOOR,
+};
+
+/** A timestamped reading */
+struct deadband_point
+{
+	uint32_t time; // s
+	int32_t value;
+};
+
+/**
+ * Structure representing the compressor of one channel. Configure mode,
+ * tolerance and heartbeat, zero the rest; the state can be carried across
+ * resets with deadband_load and deadband_save.
+ */
+struct deadband
+{
+	enum deadband_mode mode;
+	int32_t tolerance; // in the units of the readings
+	uint32_t heartbeat; // s, a record is written at least this often, 0 for never
+
+	bool archived_ok;
+	bool held_ok;
+	struct deadband_point archived; // last reading written
+	struct deadband_point held; // last reading seen, not written yet
+	float slope_min; // swinging door bounds on the slope from archived
+	float slope_max;
+
+	uint32_t seen; // readings processed
+	uint32_t written; // records written
+};
+
+/**
+ * Processes one reading.
+ *
+ * @param[in, out] band compressor of the channel.
+ * @param[in] time timestamp of the reading, non-decreasing.
+ * @param[in] value the reading.
+ * @param[out] out reading to write, if any. For swinging door compression
+ *  this is usually an earlier reading.
+ *
+ * @returns true if out holds a reading to write.
+ */
+bool deadband_process(struct deadband *band, uint32_t time, int32_t value, struct deadband_point *out);
+
+/**
+ * Restores the state of compressors saved by deadband_save. The state of a
+ * channel whose mode or tolerance changed since is discarded, keeping only
+ * its counters.
+ *
+ * @param[in] path file to load from.
+ * @param[in, out] bands configured compressors.
+ * @param[in] count number of compressors.
+ *
+ * @returns 0 on success, -1 if there was no usable state.
+ */
+int deadband_load(const char *path, struct deadband bands[], size_t count);
+
+/**
+ * Saves the state of compressors.
+ *
+ * @param[in] path file to save to, replaced.
+ * @param[in] bands compressors.
+ * @param[in] count number of compressors.
+ *
+ * @returns 0 on success, -1 on failure.
+ */
+int deadband_save(const char *path, const struct deadband bands[], size_t count);
+
+#endif//DEADBAND_H_
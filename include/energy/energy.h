@@ -0,0 +1,118 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+#ifndef ENERGY_H_
+#define ENERGY_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** Peripherals whose powered time is accounted for */
+enum energy_peripheral
+{
+	ENERGY_SPI_BUS,
+	ENERGY_PDM,
+	ENERGY_ADC,
+	ENERGY_FLASH,
+	ENERGY_PERIPHERALS,
+};
+
+/** Estimated current draw of each state, in microamps */
+struct energy_currents
+{
+	float active_ua; // MCU awake
+	float sleep_ua; // MCU in deep sleep
+	float peripheral_ua[ENERGY_PERIPHERALS]; // drawn on top while enabled
+	float standby_ua[ENERGY_PERIPHERALS]; // drawn on top while disabled, like an idle flash
+};
+
+/** Returns a tick count from a clock that keeps running in deep sleep */
+typedef uint32_t (*energy_clock)(void);
+
+/**
+ * Structure representing the energy accounting of one wake-up cycle.
+ *
+ * Every sleep entry/exit and peripheral enable/disable closes the interval
+ * since the previous event, and charges it to the MCU state and to every
+ * peripheral that was powered during it. Peripherals that were not are
+ * charged their standby current instead, so a peripheral is only enabled
+ * while it is actually in use.
+ */
+struct energy
+{
+	const struct energy_currents *currents;
+	energy_clock clock;
+	uint32_t frequency;
+	uint32_t start;
+	uint32_t last;
+	bool asleep;
+	uint8_t powered; // bit per enum energy_peripheral
+	uint32_t wakeups;
+	uint64_t awake_ticks;
+	uint64_t asleep_ticks;
+	uint64_t peripheral_ticks[ENERGY_PERIPHERALS];
+};
+
+/**
+ * Energy accounting initialization. Starts the cycle with the MCU awake and
+ * every peripheral off.
+ *
+ * @param[out] energy structure to initialize.
+ * @param[in] currents current table, must outlive energy.
+ * @param[in] clock clock that keeps running in deep sleep.
+ * @param[in] frequency ticks per second of clock.
+ */
+void energy_init(struct energy *energy, const struct energy_currents *currents, energy_clock clock, uint32_t frequency);
+
+/**
+ * Records that the MCU is about to enter deep sleep.
+ *
+ * @param[in, out] energy structure to update.
+ */
+void energy_sleep(struct energy *energy);
+
+/**
+ * Records that the MCU woke up.
+ *
+ * @param[in, out] energy structure to update.
+ */
+void energy_wake(struct energy *energy);
+
+/**
+ * Records that a peripheral was powered on.
+ *
+ * @param[in, out] energy structure to update.
+ * @param[in] peripheral peripheral that was enabled.
+ */
+void energy_enable(struct energy *energy, enum energy_peripheral peripheral);
+
+/**
+ * Records that a peripheral was powered off.
+ *
+ * @param[in, out] energy structure to update.
+ * @param[in] peripheral peripheral that was disabled.
+ */
+void energy_disable(struct energy *energy, enum energy_peripheral peripheral);
+
+/**
+ * Returns the estimated charge used so far in the cycle, in microamp hours.
+ *
+ * @param[in, out] energy structure to read, brought up to date first.
+ */
+float energy_uah(struct energy *energy);
+
+/**
+ * Formats a summary record of the cycle as a CSV line, in the format
+ * "time,awake ms,asleep ms,wakeups,spi ms,pdm ms,adc ms,flash ms,uAh".
+ *
+ * @param[in, out] energy structure to summarize, brought up to date first.
+ * @param[out] line buffer for the line.
+ * @param[in] size size of the buffer.
+ * @param[in] time timestamp of the record, in seconds.
+ *
+ * @returns the length of the line as snprintf does, negative on error.
+ */
+int energy_format_summary(struct energy *energy, char line[], size_t size, uint32_t time);
+
+#endif//ENERGY_H_
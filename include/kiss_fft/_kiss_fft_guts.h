@@ -24,9 +24,19 @@
  4*4*4*2
  */
 
+/* A straight-line transform of one size, from fft_codelets.py. It takes a
+   contiguous input, may be called in place, and does the inverse transform
+   when inverse is non-zero */
+typedef void (*kiss_fft_codelet)(const kiss_fft_cpx *fin, kiss_fft_cpx *fout, int inverse);
+
+/* The codelet for an nfft point transform, or NULL if none was generated.
+   Only built with KISS_FFT_CODELETS */
+kiss_fft_codelet kiss_fft_codelet_find(int nfft);
+
 struct kiss_fft_state{
     int nfft;
     int inverse;
+    kiss_fft_codelet codelet; /* used instead of kf_work when set */
     int factors[2*MAXFACTORS];
     kiss_fft_cpx twiddles[1];
 };
@@ -8,6 +8,7 @@
 
 #include <math.h>
 #include "kiss_fftr.h"
+#include <stdbool.h>
 #include <stdint.h>
 
 /** Structure representing the information of the samples */
@@ -15,6 +16,158 @@ struct fft
 {
 	uint32_t N; // total number of samples (size of file in bytes / 2)
     uint32_t S; // sampling frequency
+    uint32_t D; // decimation before the FFT, S is the rate after it
+};
+
+/** Maximum number of bands a spectrogram frame can be reduced to */
+#define FFT_SPECTROGRAM_MAX_BANDS 64
+
+/** Size in bytes of the header preceding every block of spectrogram frames */
+#define FFT_SPECTROGRAM_HEADER_SIZE 20
+
+/**
+ * Structure describing how a spectrum is reduced to a spectrogram frame: B
+ * log-spaced bands, each quantized to one byte of dB.
+ *
+ * Band b covers spectrum bins [edges[b], edges[b+1]). Byte value q stands for
+ * floor_db + q * step_qdb / 4 dB of summed band power.
+ */
+struct fft_spectrogram
+{
+	uint8_t bands;
+	int8_t floor_db;
+	uint8_t step_qdb; // quantization step in quarter dB
+	uint16_t edges[FFT_SPECTROGRAM_MAX_BANDS + 1];
+};
+
+/**
+ * Fewest lags the pitch estimator evaluates per period of its highest
+ * fundamental; it steps lags as coarsely as this allows. Below 16, pitch_bench
+ * finds octave errors for some upper limits.
+ */
+#define FFT_PITCH_LAGS_PER_PERIOD 16
+
+/**
+ * Structure holding the transforms and buffers of the autocorrelation pitch
+ * estimator.
+ *
+ * The autocorrelation is the inverse FFT of the power spectrum of the frame
+ * zero padded to nfft samples, 3N/2 when N is a multiple of 4 and 2N
+ * otherwise. Without the padding it would be circular, with lag L mixed with
+ * lag N-L, which corrupts exactly the long periods of low fundamentals. With
+ * it, lags up to nfft - N are exact. Lags are evaluated every stride half
+ * samples, as coarsely as FFT_PITCH_LAGS_PER_PERIOD allows for max_hz:
+ *  - stride 1: a second inverse transform gives the autocorrelation half way
+ *    between whole lags, so short periods are found as precisely as long
+ *    ones. Three real transforms of nfft points.
+ *  - stride 2: whole lags, two real transforms of nfft points.
+ *  - stride 4 and up: the power spectrum is folded onto 2*nfft/stride bins,
+ *    which gives exactly every stride/2-th lag from an inverse transform that
+ *    much smaller.
+ */
+struct fft_pitch
+{
+	kiss_fftr_cfg forward; // nfft points
+	kiss_fftr_cfg inverse; // nfft points, 2*nfft/stride above stride 2
+	uint32_t nfft;
+	kiss_fft_scalar *acf; // nfft samples, the padded frame then whole lags
+	kiss_fft_scalar *half; // nfft lags, each half a sample after those in acf, stride 1 only
+	kiss_fft_cpx *spectrum; // nfft/2+1 bins
+	kiss_fft_cpx step; // exp(j*pi/nfft), half a sample of delay per bin
+	uint32_t min_lag; // in half samples
+	uint32_t max_lag; // in half samples
+	uint32_t stride; // half samples between the lags evaluated
+};
+
+/** Most half-band stages of a zoom FFT, so D is at most 2^FFT_ZOOM_MAX_STAGES */
+#define FFT_ZOOM_MAX_STAGES 8
+
+/** Most non-zero taps each side of the center of a zoom FFT half-band stage */
+#define FFT_ZOOM_MAX_PAIRS 16
+
+/** Samples a zoom FFT takes per oscillator phase, stepped on by a table */
+#define FFT_ZOOM_STEPS 128
+
+/** State of one decimate by 2 stage of a zoom FFT */
+struct fft_zoom_stage
+{
+	uint32_t pairs; // non-zero taps on each side of the center, which is 0.5
+	bool flat; // maximally flat rather than Kaiser windowed
+	const float *taps; // pairs taps, at offsets 1, 3, 5... from the center; the first stage has 2*pairs
+	kiss_fft_cpx *input; // the last 4*pairs-2 inputs, then room for a block; NULL for the first stage
+	uint32_t fill; // inputs in input, one more than the history if one is waiting
+};
+
+/**
+ * Structure holding the state of a zoom FFT, which resolves a narrow band
+ * around a center frequency finely without a transform over the whole band.
+ *
+ * Input samples are mixed down by the center frequency to a complex baseband,
+ * low-pass filtered and decimated by D through a chain of half-band stages,
+ * and every nfft decimated samples are windowed and transformed with a
+ * complex kiss_fft. The spectrum spans S/D Hz around the center in bins of
+ * S/(D*nfft) Hz, the resolution of a real transform D times longer, while
+ * memory stays proportional to nfft plus the filter lengths.
+ *
+ * The first stage takes the real samples into zoom->samples and filters them
+ * with its taps shifted up to the center, times cos and then times sin of
+ * the center frequency at their offsets. Only its outputs, at half the input
+ * rate, are mixed down, so nothing runs on complex samples at the full rate.
+ */
+struct fft_zoom
+{
+	float center; // Hz
+	uint32_t decimation; // D, a power of two
+	uint32_t nfft;
+	uint32_t settle; // input samples before the filters' output is valid
+	uint32_t stages; // log2(D)
+	struct fft_zoom_stage stage[FFT_ZOOM_MAX_STAGES];
+	float *filter; // the taps of every stage, then the window
+	float *window; // Hann window, nfft points
+	float *samples; // the first stage's history of real samples, then room for a block
+	kiss_fft_cpx *history; // the histories of every other stage
+	kiss_fft_cpx oscillator; // exp(-j*2*pi*center*n/S) at the start of the steps
+	kiss_fft_cpx steps[FFT_ZOOM_STEPS]; // exp(-j*2*pi*center*k/S), the step k samples on
+	kiss_fft_cpx rotation; // oscillator step per FFT_ZOOM_STEPS samples
+	uint32_t step; // steps into the oscillator of the next sample
+	kiss_fft_cfg cfg;
+	kiss_fft_cpx *buffer; // nfft decimated samples
+	uint32_t count; // decimated samples in buffer
+};
+
+/** Number of recent frames whose median flux sets the onset threshold */
+#define FFT_ONSET_HISTORY 15
+
+/**
+ * Structure holding the state of a spectral flux onset detector.
+ *
+ * Every frame the log magnitude of each bin is compared with the previous
+ * frame's, and only the increases are summed: the half-wave rectified
+ * spectral flux, averaged per bin. A frame is an onset when its flux exceeds
+ * both the median flux of the last FFT_ONSET_HISTORY frames times multiplier
+ * and minimum, and no onset was reported in the hold frames before it. Only
+ * the previous spectrum, N/2+1 values, and the flux history are kept.
+ */
+struct fft_onset
+{
+	float *previous; // log magnitudes of the previous frame, N/2+1 bins
+	uint32_t bins;
+	float history[FFT_ONSET_HISTORY]; // flux of recent frames, a ring
+	uint8_t head; // next slot of history
+	uint8_t filled; // frames in history
+	bool primed; // previous holds a frame
+	float multiplier; // threshold over the median flux, 1.5 by default
+	float minimum; // least flux of an onset, 0.1 by default
+	uint32_t hold; // frames after an onset without another, 2 by default
+	uint32_t quiet; // frames left in the current hold
+};
+
+/** A detected onset */
+struct fft_onset_record
+{
+	uint32_t time; // seconds, as passed to fft_onset_update
+	uint16_t strength; // flux over the threshold, in hundredths
+	uint16_t bin; // bin with the largest increase
 };
 
 /**
@@ -65,6 +218,31 @@ uint32_t fft_get_S(struct fft *fft);
 */
 uint32_t TestFftReal(struct fft *fft, const kiss_fft_scalar in[], kiss_fft_cpx out[]);
 
+/**
+ * Gets the frequency with the highest amplitude using an already allocated
+ * plan, so that callers processing many frames do not pay for an allocation
+ * per frame. Unlike TestFftReal, nothing is printed.
+ *
+ * @param[in] fft FFT structure to get information from.
+ * @param[in] cfg forward real FFT plan of size fft->N.
+ * @param[in] in audio data points, fft->N of them.
+ * @param[out] out spectrum, fft->N/2 + 1 points.
+ *
+ * @returns the frequency with the highest amplitude
+*/
+uint32_t fft_peak(struct fft *fft, kiss_fftr_cfg cfg, const kiss_fft_scalar in[], kiss_fft_cpx out[]);
+
+/**
+ * Sums the spectrum energy (magnitude squared) into equally wide bands from
+ * DC up to the Nyquist frequency. The DC bin is excluded.
+ *
+ * @param[in] fft FFT structure to get information from.
+ * @param[in] out spectrum computed by kiss_fftr, fft->N/2 + 1 points.
+ * @param[out] bands energy per band.
+ * @param[in] count number of bands.
+*/
+void fft_band_energies(struct fft *fft, const kiss_fft_cpx out[], float bands[], size_t count);
+
 /**
  * Reads the audio file and returns the frequency with the highest amplitude
  * 
@@ -76,4 +254,221 @@ uint32_t TestFftReal(struct fft *fft, const kiss_fft_scalar in[], kiss_fft_cpx o
 */
 uint32_t fft_read(struct fft *fft, FILE * fp, uint16_t buffer[]);
 
+/**
+ * Spectrogram initialization. Band edges are spread logarithmically over the
+ * bins above DC, every band covering at least one bin. Quantization defaults
+ * to 0.5 dB steps starting at 20 dB, which spans the full range of 16-bit
+ * input at N=512.
+ *
+ * @param[out] spec spectrogram structure to initialize.
+ * @param[in] fft FFT structure the spectra will come from.
+ * @param[in] bands number of bands, at most FFT_SPECTROGRAM_MAX_BANDS and at
+ *  most fft->N/2.
+ *
+ * @returns 0 on success, -1 if the number of bands is invalid.
+*/
+int fft_spectrogram_init(struct fft_spectrogram *spec, struct fft *fft, uint8_t bands);
+
+/**
+ * Reduces a spectrum to a spectrogram frame.
+ *
+ * @param[in] spec spectrogram configuration.
+ * @param[in] out spectrum computed by kiss_fftr.
+ * @param[out] frame one byte per band.
+*/
+void fft_spectrogram_frame(const struct fft_spectrogram *spec, const kiss_fft_cpx out[], uint8_t frame[]);
+
+/**
+ * Appends a block of spectrogram frames, preceded by its header, to a file.
+ *
+ * The header is FFT_SPECTROGRAM_HEADER_SIZE bytes, little-endian: "SPEC",
+ * u8 version, u8 bands, i8 floor_db, u8 step_qdb, u16 frame count, u16 N,
+ * u32 S, u32 time of the first frame in seconds.
+ *
+ * @param[in] spec spectrogram configuration.
+ * @param[in] fft FFT structure the spectra came from.
+ * @param[in] fp file to append to.
+ * @param[in] time timestamp of the first frame.
+ * @param[in] frames count * spec->bands bytes of frames.
+ * @param[in] count number of frames.
+ *
+ * @returns 0 on success, -1 if the write failed.
+*/
+int fft_spectrogram_write(const struct fft_spectrogram *spec, struct fft *fft, FILE *fp, uint32_t time, const uint8_t frames[], uint16_t count);
+
+/**
+ * Pitch estimator initialization. Allocates the plans and buffers once, for
+ * frames of fft->N samples.
+ *
+ * The search covers periods from 2 samples to just under nfft - N samples,
+ * so with the 3N/2 padding min_hz is raised to about 2*S/N if it is lower.
+ * The lower max_hz, the coarser the lag step and the cheaper each estimate:
+ * at N=512 and S=7813, max_hz up to 488 Hz drops the half sample transform
+ * and up to 244 Hz also halves the inverse one.
+ *
+ * @param[out] pitch estimator to initialize.
+ * @param[in] fft FFT structure the frames will come from.
+ * @param[in] min_hz lowest fundamental to search for.
+ * @param[in] max_hz highest fundamental to search for.
+ *
+ * @returns 0 on success, -1 on an empty search range, an odd or tiny N, or
+ *  if memory ran out.
+*/
+int fft_pitch_init(struct fft_pitch *pitch, struct fft *fft, float min_hz, float max_hz);
+
+/**
+ * Releases the memory held by a pitch estimator.
+ *
+ * @param[in, out] pitch estimator to destroy.
+*/
+void fft_pitch_destroy(struct fft_pitch *pitch);
+
+/**
+ * Estimates the fundamental frequency of a frame from its autocorrelation.
+ * Each lag is scaled up by N/(N-lag), for the products it is missing, and
+ * the shortest lag whose correlation is close to the strongest one in the
+ * search range wins, so a harmonic rich signal reports its fundamental rather
+ * than a subharmonic.
+ *
+ * @param[in, out] pitch estimator to use.
+ * @param[in] fft FFT structure the frame belongs to.
+ * @param[in] in fft->N samples, like those given to fft_peak.
+ * @param[out] confidence normalized correlation at the chosen lag, 0 to 1.
+ *  Periodic signals score close to 1, noise close to 0.
+ *
+ * @returns the fundamental frequency in Hz, or 0 for a silent frame.
+*/
+float fft_pitch_estimate(struct fft_pitch *pitch, struct fft *fft, const kiss_fft_scalar in[], float *confidence);
+
+/**
+ * Zoom FFT initialization. Allocates the filters, buffers and plan once.
+ *
+ * The low-pass filter is a chain of log2(D) half-band stages, each the
+ * shortest that keeps what would alias into the inner 80% of the zoomed
+ * spectrum, within 0.4*S/D of the center, 70 dB down: maximally flat for the
+ * early stages, whose band is narrow next to their rate, and Kaiser windowed
+ * for the last ones. At D=16 they have 2, 3, 5 and 11 non-zero taps each
+ * side of the center, and each stage runs at half the rate of the one before
+ * it, so with the mixing the chain costs at most about 10 multiplies per
+ * input sample, whatever D is. The outermost tenth of the spectrum on each
+ * side takes the aliases of the last stage's transition band, so keep the
+ * band of interest within the middle of it.
+ *
+ * @param[out] zoom zoom FFT to initialize.
+ * @param[in] fft FFT structure the samples come from, for the sampling rate.
+ * @param[in] center frequency in Hz to center the spectrum on.
+ * @param[in] decimation D, a power of two from 2 to 2^FFT_ZOOM_MAX_STAGES.
+ * @param[in] nfft size of the transform, even.
+ *
+ * @returns 0 on success, -1 on invalid parameters or if memory ran out.
+*/
+int fft_zoom_init(struct fft_zoom *zoom, struct fft *fft, float center, uint32_t decimation, uint32_t nfft);
+
+/**
+ * Releases the memory held by a zoom FFT.
+ *
+ * @param[in, out] zoom zoom FFT to destroy.
+*/
+void fft_zoom_destroy(struct fft_zoom *zoom);
+
+/**
+ * Mixes, filters and decimates input samples until the transform buffer is
+ * full. Samples can be pushed in blocks of any size.
+ *
+ * @param[in, out] zoom zoom FFT to feed.
+ * @param[in] in audio data points.
+ * @param[in] count number of points in in.
+ *
+ * @returns the number of points consumed. Fewer than count are consumed only
+ *  if the buffer filled up, see fft_zoom_ready.
+*/
+size_t fft_zoom_push(struct fft_zoom *zoom, const kiss_fft_scalar in[], size_t count);
+
+/**
+ * Returns true if nfft decimated samples are ready to be transformed.
+*/
+bool fft_zoom_ready(const struct fft_zoom *zoom);
+
+/**
+ * Transforms the decimated samples, Hann windowed, and empties the buffer.
+ *
+ * @param[in, out] zoom zoom FFT with a full buffer.
+ * @param[out] out spectrum, nfft points. Point k is at frequency
+ *  fft_zoom_frequency(zoom, fft, k), from S/(2*D) below the center up.
+*/
+void fft_zoom_spectrum(struct fft_zoom *zoom, kiss_fft_cpx out[]);
+
+/**
+ * Returns the frequency in Hz of a point of a zoomed spectrum.
+ *
+ * @param[in] zoom zoom FFT the spectrum came from.
+ * @param[in] fft FFT structure the samples came from.
+ * @param[in] bin point of the spectrum.
+*/
+float fft_zoom_frequency(const struct fft_zoom *zoom, struct fft *fft, uint32_t bin);
+
+/**
+ * Returns the frequency in Hz of a local maximum of a zoomed spectrum,
+ * refined between bins by parabolic interpolation of the log power, which
+ * for the Hann window is within a few hundredths of a bin.
+ *
+ * @param[in] zoom zoom FFT the spectrum came from.
+ * @param[in] fft FFT structure the samples came from.
+ * @param[in] out spectrum from fft_zoom_spectrum.
+ * @param[in] bin point of the maximum, not the first or last one.
+*/
+float fft_zoom_interpolate(const struct fft_zoom *zoom, struct fft *fft, const kiss_fft_cpx out[], uint32_t bin);
+
+/**
+ * Returns the frequency in Hz with the highest amplitude in a zoomed spectrum,
+ * interpolated with fft_zoom_interpolate. Only the inner 80% of the points,
+ * those free of aliases, are searched.
+ *
+ * @param[in] zoom zoom FFT the spectrum came from.
+ * @param[in] fft FFT structure the samples came from.
+ * @param[in] out spectrum from fft_zoom_spectrum.
+*/
+float fft_zoom_peak(const struct fft_zoom *zoom, struct fft *fft, const kiss_fft_cpx out[]);
+
+/**
+ * Onset detector initialization. Allocates the previous spectrum once, for
+ * frames of fft->N samples, and sets the default threshold parameters, which
+ * can be changed in the structure afterwards.
+ *
+ * @param[out] onset detector to initialize.
+ * @param[in] fft FFT structure the spectra will come from.
+ *
+ * @returns 0 on success, -1 if memory ran out.
+*/
+int fft_onset_init(struct fft_onset *onset, struct fft *fft);
+
+/**
+ * Releases the memory held by an onset detector.
+ *
+ * @param[in, out] onset detector to destroy.
+*/
+void fft_onset_destroy(struct fft_onset *onset);
+
+/**
+ * Forgets the previous frame and the flux history, for when frames stop
+ * being contiguous, like between captures.
+ *
+ * @param[in, out] onset detector to reset.
+*/
+void fft_onset_reset(struct fft_onset *onset);
+
+/**
+ * Feeds the spectrum of the next frame to the detector. The first frames
+ * after a reset only fill the state: the first has nothing to compare with,
+ * and no onset is reported until half the flux history is filled.
+ *
+ * @param[in, out] onset detector to update.
+ * @param[in] out spectrum computed by kiss_fftr, fft->N/2 + 1 points.
+ * @param[in] time timestamp of the frame, copied to the record.
+ * @param[out] record the onset, if one was detected.
+ *
+ * @returns true if the frame is an onset.
+*/
+bool fft_onset_update(struct fft_onset *onset, const kiss_fft_cpx out[], uint32_t time, struct fft_onset_record *record);
+
 #endif//FFT_H_
\ No newline at end of file
@@ -0,0 +1,90 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+#ifndef FFT_DECIMATE_H_
+#define FFT_DECIMATE_H_
+
+#include "fft.h"
+#include "kiss_fft.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** Length of the half-band filter of every stage */
+#define FFT_DECIMATE_TAPS 47
+
+/** Non-zero taps on each side of the center, every other one */
+#define FFT_DECIMATE_PAIRS ((FFT_DECIMATE_TAPS + 1) / 4)
+
+/** Most stages, for a factor of 8 */
+#define FFT_DECIMATE_MAX_STAGES 3
+
+/** State of one decimate by 2 stage */
+struct fft_decimate_stage
+{
+	float history[2 * FFT_DECIMATE_TAPS]; // the last taps inputs, twice, so a window never wraps
+	uint8_t head; // slot of the next input
+	bool odd; // an input is waiting for its pair
+};
+
+/**
+ * Structure holding a chain of half-band decimators, each halving the
+ * sampling rate, for a factor of 2, 4 or 8.
+ *
+ * Every stage is a Blackman windowed half-band FIR, flat to within 0.01 dB up
+ * to 0.19 of its input rate and more than 70 dB down from 0.31, where it
+ * aliases into the band below 0.19. Half of a half-band filter's taps are
+ * zero and the rest are symmetric, and only every other output is computed,
+ * so a stage costs FFT_DECIMATE_PAIRS + 1 multiplies per output, about a
+ * quarter of a direct FIR of the same length.
+ *
+ * The rate after the chain is S/D; keep the band of interest under 0.38 of
+ * it, as the top of the band takes some aliasing from the last stage.
+ */
+struct fft_decimate
+{
+	uint32_t rate; // S before the chain; fft->S * fft->D can be short of it
+	uint8_t factor; // D
+	uint8_t stages;
+	float pairs[FFT_DECIMATE_PAIRS]; // taps 1, 3, 5... from the center, which is 0.5
+	struct fft_decimate_stage stage[FFT_DECIMATE_MAX_STAGES];
+};
+
+/**
+ * Decimator initialization. Designs the filter, and updates the FFT
+ * structure to the decimated rate: fft->S is divided by the factor, and
+ * fft->D multiplied by it. The division rounds down, so fft->S * fft->D
+ * is not always the input rate; that is kept in decimate->rate.
+ * fft->N is left alone; pick it for the new rate, like fft->N / factor for
+ * the same resolution as before from the same number of input samples.
+ *
+ * @param[out] decimate decimator to initialize.
+ * @param[in, out] fft FFT structure of the input, updated to the output.
+ * @param[in] factor D, 2, 4 or 8.
+ *
+ * @returns 0 on success, -1 on an invalid factor.
+ */
+int fft_decimate_init(struct fft_decimate *decimate, struct fft *fft, uint8_t factor);
+
+/**
+ * Clears the filter histories, as if only silence had been seen.
+ *
+ * @param[in, out] decimate decimator to reset.
+ */
+void fft_decimate_reset(struct fft_decimate *decimate);
+
+/**
+ * Filters and decimates a block of samples, like a PDM DMA buffer. Blocks
+ * can be any size; inputs left over from one block are carried to the next.
+ *
+ * @param[in, out] decimate decimator to use.
+ * @param[in] in samples at the input rate.
+ * @param[in] count number of samples in in.
+ * @param[out] out room for count / D + 1 samples at the decimated rate.
+ *
+ * @returns the number of samples written to out, count / D when count is a
+ *  multiple of D and no inputs were left over from before.
+ */
+size_t fft_decimate_process(struct fft_decimate *decimate, const int16_t in[], size_t count, kiss_fft_scalar out[]);
+
+#endif//FFT_DECIMATE_H_
@@ -0,0 +1,90 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+#ifndef FFT_FILTER_H_
+#define FFT_FILTER_H_
+
+#include "kiss_fftr.h"
+#include <stdint.h>
+
+/**
+ * Structure representing a streaming FIR filter evaluated with FFT-based
+ * overlap-add fast convolution.
+ *
+ * Each call consumes and produces one block of `block` samples, where
+ * block = nfft - taps + 1. The filter spectrum and both FFT plans are computed
+ * once at initialization and reused for every block.
+ */
+struct fft_filter
+{
+	uint32_t nfft;
+	uint32_t taps;
+	uint32_t block;
+	kiss_fftr_cfg forward;
+	kiss_fftr_cfg inverse;
+	kiss_fft_cpx *spectrum; // filter spectrum, scaled by 1/nfft
+	kiss_fft_cpx *work; // nfft/2+1 bins
+	kiss_fft_scalar *buffer; // nfft samples
+	kiss_fft_scalar *overlap; // taps-1 samples carried to the next block
+};
+
+/**
+ * Filter initialization. All memory is allocated here, once.
+ *
+ * @param[out] filter filter to initialize.
+ * @param[in] taps FIR coefficients.
+ * @param[in] count number of coefficients.
+ * @param[in] nfft FFT size, even and larger than count. A good choice is the
+ *  power of two at least twice count.
+ *
+ * @returns 0 on success, -1 on invalid sizes or if memory ran out.
+ */
+int fft_filter_init(struct fft_filter *filter, const kiss_fft_scalar taps[], uint32_t count, uint32_t nfft);
+
+/**
+ * Releases the memory held by a filter.
+ *
+ * @param[in, out] filter filter to destroy.
+ */
+void fft_filter_destroy(struct fft_filter *filter);
+
+/**
+ * Clears the filter history, as if it had only ever seen silence.
+ *
+ * @param[in, out] filter filter to reset.
+ */
+void fft_filter_reset(struct fft_filter *filter);
+
+/**
+ * Filters the next block of a stream.
+ *
+ * @param[in, out] filter filter to use.
+ * @param[in] in filter->block input samples.
+ * @param[out] out filter->block output samples, may alias in.
+ */
+void fft_filter_process(struct fft_filter *filter, const kiss_fft_scalar in[], kiss_fft_scalar out[]);
+
+/**
+ * Direct-form FIR reference. Filters count samples given the count taps-1
+ * samples before them in history.
+ *
+ * @param[in] taps FIR coefficients.
+ * @param[in] tap_count number of coefficients.
+ * @param[in] in tap_count - 1 samples of history followed by count samples.
+ * @param[out] out count output samples.
+ * @param[in] count number of samples to produce.
+ */
+void fft_filter_direct(const kiss_fft_scalar taps[], uint32_t tap_count, const kiss_fft_scalar in[], kiss_fft_scalar out[], uint32_t count);
+
+/**
+ * Designs a Hamming-windowed sinc band-pass filter.
+ *
+ * @param[out] taps count coefficients.
+ * @param[in] count number of coefficients, odd for a symmetric filter.
+ * @param[in] low lower cutoff frequency in Hz.
+ * @param[in] high upper cutoff frequency in Hz.
+ * @param[in] rate sampling frequency in Hz.
+ */
+void fft_filter_bandpass(kiss_fft_scalar taps[], uint32_t count, float low, float high, uint32_t rate);
+
+#endif//FFT_FILTER_H_
@@ -0,0 +1,103 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+#ifndef FFT_MEL_H_
+#define FFT_MEL_H_
+
+#include "fft.h"
+#include "kiss_fftr.h"
+#include <stdint.h>
+
+/** Largest spectrum, in bins, a filterbank can be built for (N up to 1024) */
+#define FFT_MEL_MAX_BINS 513
+
+/** Maximum number of mel bands */
+#define FFT_MEL_MAX_BANDS 40
+
+/** Maximum number of cepstral coefficients */
+#define FFT_MEL_MAX_COEFFS 20
+
+/**
+ * Types of the filterbank weights and of the features. The float build
+ * reports features in dB. The FIXED_POINT=16 build keeps the whole per-frame
+ * path in integers: weights and DCT coefficients are Q15, and features are in
+ * dB Q8 (256 per dB), relative to a Q15 spectrum.
+ */
+#ifdef FIXED_POINT
+#if FIXED_POINT != 16
+#error "fft_mel supports the float and FIXED_POINT=16 builds only"
+#endif
+typedef int16_t fft_mel_weight;
+typedef int32_t fft_mel_value;
+typedef uint32_t fft_mel_power;
+#else
+typedef float fft_mel_weight;
+typedef float fft_mel_value;
+typedef float fft_mel_power;
+#endif
+
+/**
+ * Structure holding a precomputed mel filterbank and DCT, plus the buffers
+ * they need, so extracting features from a frame allocates nothing.
+ *
+ * The filters are triangles spaced evenly on the mel scale between two
+ * frequencies, each overlapping its neighbours by half. Only their non-zero
+ * weights are stored: band b takes counts[b] consecutive bins from starts[b]
+ * on, with weights from weights[offsets[b]] on. As every bin falls in at most
+ * two triangles, that is at most two weights per bin rather than one per bin
+ * and band.
+ */
+struct fft_mel
+{
+	uint16_t bins; // N/2+1 spectrum bins
+	uint8_t bands;
+	uint8_t coeffs; // cepstral coefficients, 0 without the DCT
+	uint16_t starts[FFT_MEL_MAX_BANDS];
+	uint16_t counts[FFT_MEL_MAX_BANDS];
+	uint16_t offsets[FFT_MEL_MAX_BANDS];
+	fft_mel_weight weights[2 * FFT_MEL_MAX_BINS + FFT_MEL_MAX_BANDS];
+	fft_mel_weight dct[FFT_MEL_MAX_COEFFS * FFT_MEL_MAX_BANDS]; // coeffs rows of bands
+	fft_mel_power power[FFT_MEL_MAX_BINS];
+	fft_mel_value energies[FFT_MEL_MAX_BANDS]; // log band energies of the last frame
+};
+
+/**
+ * Mel filterbank initialization. Computes the filter weights and the DCT
+ * table once.
+ *
+ * A band too narrow to cover any bin, which happens for the lowest bands when
+ * there are many bands for the resolution, takes the bin nearest its center.
+ *
+ * @param[out] mel filterbank to initialize.
+ * @param[in] fft FFT structure the spectra will come from.
+ * @param[in] bands number of mel bands, 2 to FFT_MEL_MAX_BANDS.
+ * @param[in] coeffs number of cepstral coefficients, at most bands and
+ *  FFT_MEL_MAX_COEFFS. 0 skips the DCT, leaving only the log band energies.
+ * @param[in] low_hz lower edge of the lowest band.
+ * @param[in] high_hz upper edge of the highest band, at most fft->S / 2.
+ *
+ * @returns 0 on success, -1 on invalid parameters or if fft->N is too large.
+ */
+int fft_mel_init(struct fft_mel *mel, struct fft *fft, uint8_t bands, uint8_t coeffs, float low_hz, float high_hz);
+
+/**
+ * Computes the log energy of every mel band of a spectrum into
+ * mel->energies.
+ *
+ * @param[in, out] mel filterbank to use.
+ * @param[in] out spectrum computed by kiss_fftr, mel->bins points.
+ */
+void fft_mel_energies(struct fft_mel *mel, const kiss_fft_cpx out[]);
+
+/**
+ * Computes the mel-frequency cepstral coefficients of a spectrum: the log
+ * band energies, as by fft_mel_energies, then an orthonormal DCT-II of them.
+ *
+ * @param[in, out] mel filterbank to use, initialized with coeffs > 0.
+ * @param[in] out spectrum computed by kiss_fftr, mel->bins points.
+ * @param[out] mfcc mel->coeffs coefficients, the first one the mean log
+ *  energy times sqrt(bands).
+ */
+void fft_mel_mfcc(struct fft_mel *mel, const kiss_fft_cpx out[], fft_mel_value mfcc[]);
+
+#endif//FFT_MEL_H_
@@ -0,0 +1,126 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+#ifndef FFT_SDFT_H_
+#define FFT_SDFT_H_
+
+#include "kiss_fft.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** Maximum number of bins a sliding DFT tracks */
+#define FFT_SDFT_MAX_BINS 8
+
+/** How the bins are updated */
+enum fft_sdft_mode
+{
+	/**
+	 * Textbook recursion, X_k = (X_k + x(n) - x(n-N)) * exp(j*2*pi*k/N). The
+	 * rounding of every rotation accumulates, so bins slowly drift from the
+	 * true DFT; only good for short runs.
+	 */
+	FFT_SDFT_CLASSIC,
+	/**
+	 * Modulated sliding DFT. The input is rotated instead of the bins, by
+	 * exact twiddles from a table indexed by k*n mod N, so rounding errors
+	 * only add up rather than compound and the bins stay on the true DFT.
+	 */
+	FFT_SDFT_MODULATED,
+};
+
+/**
+ * Structure holding the state of a sliding DFT, which keeps a few bins of
+ * the N-point DFT of the last N samples up to date on every sample, at a
+ * constant cost per bin, instead of every N samples.
+ */
+struct fft_sdft
+{
+	enum fft_sdft_mode mode;
+	uint32_t n; // N, the window length
+	uint8_t count; // bins tracked
+	uint32_t bins[FFT_SDFT_MAX_BINS];
+	float threshold[FFT_SDFT_MAX_BINS]; // power at which a bin detects, 0 never
+	bool active[FFT_SDFT_MAX_BINS]; // over threshold, until below half of it
+	kiss_fft_cpx values[FFT_SDFT_MAX_BINS]; // bins, modulated in FFT_SDFT_MODULATED
+	uint32_t phase[FFT_SDFT_MAX_BINS]; // k*n mod N of the next sample
+	kiss_fft_cpx *twiddles; // exp(-j*2*pi*i/N), N of them
+	float *history; // the last N samples, a ring
+	uint32_t head; // oldest sample in history
+};
+
+/**
+ * Sliding DFT initialization. Allocates the twiddle table and sample history
+ * once. Every bin starts with a threshold of 0, which never detects.
+ *
+ * @param[out] sdft sliding DFT to initialize.
+ * @param[in] n window length N.
+ * @param[in] bins bins to track, each below N, as for an N-point DFT.
+ * @param[in] count number of bins, 1 to FFT_SDFT_MAX_BINS.
+ * @param[in] mode how the bins are updated.
+ *
+ * @returns 0 on success, -1 on invalid parameters or if memory ran out.
+ */
+int fft_sdft_init(struct fft_sdft *sdft, uint32_t n, const uint32_t bins[], uint8_t count, enum fft_sdft_mode mode);
+
+/**
+ * Releases the memory held by a sliding DFT.
+ *
+ * @param[in, out] sdft sliding DFT to destroy.
+ */
+void fft_sdft_destroy(struct fft_sdft *sdft);
+
+/**
+ * Clears the bins and history, as if only silence had been seen.
+ *
+ * @param[in, out] sdft sliding DFT to reset.
+ */
+void fft_sdft_reset(struct fft_sdft *sdft);
+
+/**
+ * Slides the window by one sample.
+ *
+ * @param[in, out] sdft sliding DFT to update.
+ * @param[in] sample new sample.
+ */
+void fft_sdft_push(struct fft_sdft *sdft, float sample);
+
+/**
+ * Slides the window over a block of samples, like a PDM DMA buffer, stopping
+ * at the first sample after which a bin's power rises to its threshold. A
+ * bin detects again only after its power has fallen below half of the
+ * threshold.
+ *
+ * @param[in, out] sdft sliding DFT to update.
+ * @param[in] samples new samples.
+ * @param[in] count number of samples.
+ * @param[out] used number of samples consumed: count if no bin detected, else
+ *  the position of the detecting sample plus one. Push the rest of the block
+ *  after it to carry on. May be NULL.
+ * @param[out] bin index into sdft->bins of the bin that detected, only written
+ *  if one did. May be NULL.
+ *
+ * @returns true if a bin detected, false if the whole block was consumed
+ *  without a detection.
+ */
+bool fft_sdft_push_block(struct fft_sdft *sdft, const int16_t samples[], size_t count, size_t *used, uint8_t *bin);
+
+/**
+ * Returns the power, magnitude squared, of a tracked bin. It is the same
+ * in both modes.
+ *
+ * @param[in] sdft sliding DFT to read.
+ * @param[in] index index into sdft->bins.
+ */
+float fft_sdft_power(const struct fft_sdft *sdft, uint8_t index);
+
+/**
+ * Returns a tracked bin as the DFT of the last N samples would give it, with
+ * its phase. In FFT_SDFT_MODULATED this undoes the modulation.
+ *
+ * @param[in] sdft sliding DFT to read.
+ * @param[in] index index into sdft->bins.
+ */
+kiss_fft_cpx fft_sdft_bin(const struct fft_sdft *sdft, uint8_t index);
+
+#endif//FFT_SDFT_H_
@@ -47,6 +47,12 @@ extern "C" {
 */
 
 /* User may override KISS_FFT_MALLOC and/or KISS_FFT_FREE. */
+/* Defining KISS_FFT_ARENA routes them to the fixed arena of arena.h */
+#ifdef KISS_FFT_ARENA
+# include "arena.h"
+# define KISS_FFT_MALLOC arena_alloc
+# define KISS_FFT_FREE arena_free
+#endif
 #ifdef USE_SIMD
 # include <xmmintrin.h>
 # define kiss_fft_scalar __m128
@@ -0,0 +1,158 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+#ifndef KISS_FFT_Q15_H_
+#define KISS_FFT_Q15_H_
+
+/*
+ * Packed Q15 complex arithmetic for the FIXED_POINT=16 butterflies.
+ *
+ * A kiss_fft_cpx of int16_t is one little-endian word, the real part in the
+ * low halfword and the imaginary part in the high one. The Cortex-M4 DSP
+ * extension works on both halves at once: SMLSD and SMLADX give the real and
+ * imaginary parts of a complex product in one instruction each, and
+ * QADD16/QSUB16/QASX/QSAX add, subtract and rotate by j with saturation.
+ *
+ * Targets without the DSP extension, like host builds, get C versions of the
+ * same instructions with the same results bit for bit, so output can be
+ * checked on Linux. Define KISS_FFT_Q15_EMULATE to use them on the device too,
+ * and KISS_FFT_Q15_COUNT to count every emulated instruction in
+ * kiss_fft_q15_counts.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+/** Two Q15 values, real part in the low halfword */
+typedef int32_t kiss_q15x2;
+
+#if defined(__ARM_FEATURE_SIMD32) && !defined(KISS_FFT_Q15_EMULATE)
+
+#include <arm_acle.h>
+
+#define q15_smlsd(a, b, acc) __smlsd((a), (b), (acc))
+#define q15_smladx(a, b, acc) __smladx((a), (b), (acc))
+#define q15_shadd16(a, b) __shadd16((a), (b))
+#define q15_qadd16(a, b) __qadd16((a), (b))
+#define q15_qsub16(a, b) __qsub16((a), (b))
+#define q15_qasx(a, b) __qasx((a), (b))
+#define q15_qsax(a, b) __qsax((a), (b))
+
+#else
+
+/** Emulated instructions, indexes into kiss_fft_q15_counts */
+enum kiss_q15_op
+{
+	Q15_SMLSD,
+	Q15_SMLADX,
+	Q15_SHADD16,
+	Q15_QADD16,
+	Q15_QSUB16,
+	Q15_QASX,
+	Q15_QSAX,
+	Q15_PKHBT,
+	Q15_OP_COUNT,
+};
+
+#ifdef KISS_FFT_Q15_COUNT
+extern unsigned long kiss_fft_q15_counts[Q15_OP_COUNT];
+#define Q15_COUNT(op) (++kiss_fft_q15_counts[op])
+#else
+#define Q15_COUNT(op) ((void)0)
+#endif
+
+static inline int32_t q15_lo(kiss_q15x2 x)
+{
+	return (int16_t)(uint16_t)((uint32_t)x & 0xFFFF);
+}
+
+static inline int32_t q15_hi(kiss_q15x2 x)
+{
+	return (int16_t)(uint16_t)((uint32_t)x >> 16);
+}
+
+static inline kiss_q15x2 q15_join(int32_t lo, int32_t hi)
+{
+	return (kiss_q15x2)(((uint32_t)hi << 16) | ((uint32_t)lo & 0xFFFF));
+}
+
+static inline int32_t q15_sat(int32_t x)
+{
+	return x > INT16_MAX ? INT16_MAX : x < INT16_MIN ? INT16_MIN : x;
+}
+
+// The 32 bit accumulations wrap like the hardware does, setting only the Q
+// flag nobody reads
+static inline int32_t q15_smlsd(kiss_q15x2 a, kiss_q15x2 b, int32_t acc)
+{
+	Q15_COUNT(Q15_SMLSD);
+	return (int32_t)((uint32_t)acc + (uint32_t)(q15_lo(a) * q15_lo(b) - q15_hi(a) * q15_hi(b)));
+}
+
+static inline int32_t q15_smladx(kiss_q15x2 a, kiss_q15x2 b, int32_t acc)
+{
+	Q15_COUNT(Q15_SMLADX);
+	return (int32_t)((uint32_t)acc + (uint32_t)(q15_lo(a) * q15_hi(b)) + (uint32_t)(q15_hi(a) * q15_lo(b)));
+}
+
+static inline kiss_q15x2 q15_shadd16(kiss_q15x2 a, kiss_q15x2 b)
+{
+	Q15_COUNT(Q15_SHADD16);
+	return q15_join((q15_lo(a) + q15_lo(b)) >> 1, (q15_hi(a) + q15_hi(b)) >> 1);
+}
+
+static inline kiss_q15x2 q15_qadd16(kiss_q15x2 a, kiss_q15x2 b)
+{
+	Q15_COUNT(Q15_QADD16);
+	return q15_join(q15_sat(q15_lo(a) + q15_lo(b)), q15_sat(q15_hi(a) + q15_hi(b)));
+}
+
+static inline kiss_q15x2 q15_qsub16(kiss_q15x2 a, kiss_q15x2 b)
+{
+	Q15_COUNT(Q15_QSUB16);
+	return q15_join(q15_sat(q15_lo(a) - q15_lo(b)), q15_sat(q15_hi(a) - q15_hi(b)));
+}
+
+static inline kiss_q15x2 q15_qasx(kiss_q15x2 a, kiss_q15x2 b)
+{
+	Q15_COUNT(Q15_QASX);
+	return q15_join(q15_sat(q15_lo(a) - q15_hi(b)), q15_sat(q15_hi(a) + q15_lo(b)));
+}
+
+static inline kiss_q15x2 q15_qsax(kiss_q15x2 a, kiss_q15x2 b)
+{
+	Q15_COUNT(Q15_QSAX);
+	return q15_join(q15_sat(q15_lo(a) + q15_hi(b)), q15_sat(q15_hi(a) - q15_lo(b)));
+}
+
+#endif
+
+/**
+ * Returns the complex product a * b, scaled down by 2^shift on top of the Q15
+ * scaling, rounded. Scaling down the product of full scale inputs by at least
+ * 2 keeps it in range.
+ */
+static inline kiss_q15x2 q15_cmul(kiss_q15x2 a, kiss_q15x2 b, int shift)
+{
+	const int32_t round = 1 << (14 + shift);
+	int32_t r = q15_smlsd(a, b, round) >> (15 + shift);
+	int32_t i = q15_smladx(a, b, round) >> (15 + shift);
+#if !defined(__ARM_FEATURE_SIMD32) || defined(KISS_FFT_Q15_EMULATE)
+	Q15_COUNT(Q15_PKHBT);
+#endif
+	return (kiss_q15x2)(((uint32_t)i << 16) | ((uint32_t)r & 0xFFFF));
+}
+
+static inline kiss_q15x2 q15_load(const void *cpx)
+{
+	kiss_q15x2 x;
+	memcpy(&x, cpx, sizeof(x));
+	return x;
+}
+
+static inline void q15_store(void *cpx, kiss_q15x2 x)
+{
+	memcpy(cpx, &x, sizeof(x));
+}
+
+#endif//KISS_FFT_Q15_H_
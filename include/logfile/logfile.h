@@ -0,0 +1,193 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+#ifndef LOGFILE_H_
+#define LOGFILE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/** Maximum number of log files a boot manifest can describe */
+#define LOG_FILE_MAX 32
+
+/** Longest path of a log segment or state file, including the terminator */
+#define LOG_FILE_PATH_MAX 64
+
+/**
+ * Longest record log_file_query reads back, including the line ending and
+ * the terminator. Longer records are skipped whole.
+ */
+#define LOG_FILE_LINE_MAX 256
+
+/**
+ * Structure representing a CSV log file that is opened lazily, on its first
+ * write, and whose header is only checked when it is not already known to be
+ * present.
+ *
+ * If segment_size is non-zero the log is stored as a ring of segment files
+ * instead of one ever growing file. A path of "fs:/name.csv" then becomes
+ * "fs:/name.<n>.csv" for segment n, each segment starting with the header.
+ * When the current segment cannot take the next record, a new segment is
+ * started and, once more than `segments` exist, the oldest one is removed, so
+ * the log never uses more than about segment_size * segments bytes. The
+ * numbers of the oldest and newest segments are kept in "fs:/name.csv.state",
+ * rewritten only when segments rotate.
+ *
+ * If index_interval is non-zero, every index_interval-th record and the first
+ * record of every segment get an entry in a sparse time index, a side file
+ * named after the data file with ".idx" appended. Entries are a u32 timestamp
+ * and the u32 offset of the record in its file, little-endian. Segment
+ * indexes are removed together with their segment. log_file_query uses them
+ * to seek close to the start of a time range instead of parsing the log from
+ * the beginning.
+ */
+struct log_file
+{
+	const char *path;
+	const char *header;
+	uint32_t segment_size; // 0 for a single unbounded file
+	uint32_t segments; // segments to keep
+	uint32_t index_interval; // 0 for no index
+	FILE *fp;
+	bool header_ok;
+	bool state_ok;
+	uint32_t first; // oldest segment
+	uint32_t last; // segment being appended to
+	uint32_t size; // bytes in the current segment
+	uint32_t unindexed; // records since the last index entry
+};
+
+/**
+ * Called by log_file_query for every record in the range.
+ *
+ * @param[in] context context given to log_file_query.
+ * @param[in] time timestamp of the record.
+ * @param[in] line the record, including its line terminator.
+ *
+ * @returns 0 to continue, anything else to stop the query.
+ */
+typedef int (*log_file_record)(void *context, uint32_t time, const char *line);
+
+/**
+ * Returns the file handle, opening the file for appending if this is the
+ * first use, and writing the header if the file does not start with it.
+ *
+ * @param[in, out] file log file to get.
+ *
+ * @returns the open file, or NULL if it could not be opened.
+ */
+FILE *log_file_get(struct log_file *file);
+
+/**
+ * Appends a record. For segmented logs this starts a new segment first if the
+ * record does not fit in the current one, so records never straddle segments.
+ *
+ * @param[in, out] file log file to append to.
+ * @param[in] time timestamp of the record, which must start with it as
+ *  decimal seconds. Records must be appended in time order.
+ * @param[in] data record to append.
+ * @param[in] size size of the record in bytes.
+ *
+ * @returns 0 on success, -1 on failure.
+ */
+int log_file_write(struct log_file *file, uint32_t time, const char *data, size_t size);
+
+/**
+ * Makes room for a record the caller writes itself, like log_file_write
+ * does: starts a new segment if it does not fit and indexes it, and counts
+ * its size as written.
+ *
+ * @param[in, out] file log file to append to.
+ * @param[in] time timestamp of the record, in time order.
+ * @param[in] size size of the record in bytes, which the caller must write
+ *  in full to the returned file.
+ *
+ * @returns the file to write the record to, or NULL on failure.
+ */
+FILE *log_file_append(struct log_file *file, uint32_t time, size_t size);
+
+/**
+ * Reads back the records with timestamps in [t0, t1), oldest first. With an
+ * index, only the records between the closest preceding index entry and t1
+ * are parsed. Records longer than LOG_FILE_LINE_MAX are skipped.
+ *
+ * @param[in, out] file log file to read.
+ * @param[in] t0 start of the range, inclusive.
+ * @param[in] t1 end of the range, exclusive.
+ * @param[in] callback called for every record in the range.
+ * @param[in] context passed to callback.
+ *
+ * @returns the number of records passed to callback, or -1 on failure.
+ */
+int log_file_query(struct log_file *file, uint32_t t0, uint32_t t1, log_file_record callback, void *context);
+
+/**
+ * Formats the path of one segment of a segmented log.
+ *
+ * @param[in] file log file.
+ * @param[in] segment segment number.
+ * @param[out] path buffer of at least LOG_FILE_PATH_MAX bytes.
+ */
+void log_file_segment_path(const struct log_file *file, uint32_t segment, char path[]);
+
+/**
+ * Starts a new segment of a segmented log for a file written some other
+ * way, like an audio clip, and removes the oldest segments beyond the
+ * budget. The log's own file is not opened. If the current segment was never
+ * created it is reused.
+ *
+ * @param[in, out] file segmented log file.
+ * @param[out] path path of the segment to create, of at least
+ *  LOG_FILE_PATH_MAX bytes.
+ */
+void log_file_next_segment(struct log_file *file, char path[]);
+
+/**
+ * Closes the file if it was ever opened.
+ *
+ * @param[in, out] file log file to close.
+ *
+ * @returns 0 on success or if the file was never opened, EOF on failure.
+ */
+int log_file_close(struct log_file *file);
+
+/**
+ * Loads the boot manifest written at the last clean shutdown and marks the
+ * headers it vouches for as present, so log_file_get can skip reading them.
+ * The segment numbers of segmented logs are restored from it too, so their
+ * state files need not be read either, and so is the count of records since
+ * the last index entry, so the index keeps its interval across boots.
+ *
+ * The manifest is only trusted if it describes exactly the same set of paths
+ * and headers. It is invalidated as soon as it is loaded, so that if this run
+ * does not end cleanly the next boot falls back to checking every header.
+ *
+ * @param[in] path manifest file.
+ * @param[in, out] files log files to update.
+ * @param[in] count number of log files, at most LOG_FILE_MAX.
+ *
+ * @returns true if the manifest was valid and applied.
+ */
+bool boot_manifest_load(const char *path, struct log_file files[], size_t count);
+
+/**
+ * Writes the boot manifest. Call at clean shutdown, after all log files are
+ * closed.
+ *
+ * Layout, little-endian: "BOOT", u8 version, u8 file count, two padding bytes,
+ * u32 FNV-1a hash of every path and header, u32 bitmask of files whose header
+ * is known to be present, u32 bitmask of files whose segment numbers are
+ * known, then for every file u32 first and u32 last segment and u32 records
+ * appended since its last index entry.
+ *
+ * @param[in] path manifest file.
+ * @param[in] files log files to describe.
+ * @param[in] count number of log files, at most LOG_FILE_MAX.
+ *
+ * @returns 0 on success, -1 on failure.
+ */
+int boot_manifest_save(const char *path, const struct log_file files[], size_t count);
+
+#endif//LOGFILE_H_
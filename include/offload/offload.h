@@ -0,0 +1,174 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+#ifndef OFFLOAD_H_
+#define OFFLOAD_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/** Protocol version reported in the HELLO reply */
+#define OFFLOAD_VERSION 1
+
+/** Maximum file bytes carried by one DATA frame */
+#define OFFLOAD_FRAME_SIZE 2048
+
+/** Maximum number of unacknowledged DATA frames in flight */
+#define OFFLOAD_MAX_WINDOW 8
+
+/** Longest path, relative to the offload root, that can be requested */
+#define OFFLOAD_PATH_MAX 64
+
+/** Time to wait for the host before giving up on a frame, in ms */
+#define OFFLOAD_TIMEOUT_MS 500
+
+/** Consecutive timeouts tolerated before the transfer is abandoned */
+#define OFFLOAD_RETRIES 8
+
+// Largest packet payload: command byte, DATA header and frame, CRC
+#define OFFLOAD_PACKET_MAX (1 + 4 + OFFLOAD_FRAME_SIZE + 2)
+
+/**
+ * Packet commands. Numbered after the SVL bootloader commands so both can
+ * share the same framing without being mistaken for one another.
+ */
+enum offload_cmd
+{
+	OFFLOAD_CMD_HELLO = 0x10, // host: u32 baud; device: u16 version, u16 frame size, u8 window, u32 baud
+	OFFLOAD_CMD_OPEN = 0x11, // host: u32 offset, u8 window, path
+	OFFLOAD_CMD_INFO = 0x12, // device: u32 size, u32 offset the transfer starts at
+	OFFLOAD_CMD_DATA = 0x13, // device: u32 offset, data
+	OFFLOAD_CMD_ACK = 0x14, // host: u32 offset of the next byte expected
+	OFFLOAD_CMD_RETRY = 0x15, // host: u32 offset to resend from
+	OFFLOAD_CMD_END = 0x16, // device: u32 size, all data acknowledged
+	OFFLOAD_CMD_ERROR = 0x17, // device: file could not be opened
+	OFFLOAD_CMD_DONE = 0x18, // host: leave offload mode; device: echoed back
+};
+
+/**
+ * Byte transport used by the offload protocol, a UART on target and a pty on
+ * the host.
+ */
+struct offload_io
+{
+	void *context;
+
+	/**
+	 * Reads up to size bytes, waiting at most timeout ms for them to arrive.
+	 * A timeout of 0 only returns what is already buffered.
+	 *
+	 * @returns the number of bytes read.
+	 */
+	size_t (*read)(void *context, uint8_t *data, size_t size, uint32_t timeout);
+
+	/**
+	 * Writes all size bytes.
+	 *
+	 * @returns 0 on success, -1 on failure.
+	 */
+	int (*write)(void *context, const uint8_t *data, size_t size);
+
+	/**
+	 * Switches the transport to a new baud rate, once any pending output has
+	 * been sent. May be NULL if the transport has no baud rate.
+	 */
+	void (*baud)(void *context, uint32_t baud);
+};
+
+/**
+ * Structure representing the device end of the offload protocol.
+ *
+ * Packets use the SVL bootloader framing: a big-endian u16 length counting
+ * the command byte, data and CRC, then the command byte, the data, and a
+ * big-endian CRC16 of the command and data (so the CRC of the whole payload
+ * is 0). Multi-byte fields in the data are big-endian as well.
+ *
+ * A host switches the device into offload mode with a HELLO carrying the baud
+ * rate it wants, which the device clamps to max_baud and echoes back before
+ * both ends switch to it. Each OPEN then streams one file as DATA frames with
+ * up to window frames in flight, go-back-N: the host acknowledges every frame
+ * received in order, and asks once for a RETRY from its current offset when a
+ * frame is corrupt or missing. The device also goes back to the last
+ * acknowledged offset if the host goes quiet. Transfers resume from any
+ * offset, so a partially downloaded file only needs its tail.
+ */
+struct offload
+{
+	struct offload_io io;
+	const char *root; // prepended to requested paths, e.g. "fs:/"
+	uint32_t max_baud;
+	uint8_t packet[OFFLOAD_PACKET_MAX];
+	size_t size; // payload size of the last packet received
+	uint8_t frame[4 + OFFLOAD_FRAME_SIZE]; // DATA frame being sent
+};
+
+/**
+ * Offload initialization.
+ *
+ * @param[out] offload offload to initialize.
+ * @param[in] io transport to use, copied into offload.
+ * @param[in] root prefix for requested paths. Must outlive offload.
+ * @param[in] max_baud highest baud rate the device agrees to.
+ */
+void offload_init(struct offload *offload, const struct offload_io *io, const char *root, uint32_t max_baud);
+
+/**
+ * Computes the CRC16 used by the SVL bootloader, polynomial 0x8005, MSB
+ * first, no reflection.
+ *
+ * @param[in] crc CRC of the preceding data, 0 to start.
+ * @param[in] data data to add to the CRC.
+ * @param[in] size number of bytes in data.
+ *
+ * @returns the updated CRC.
+ */
+uint16_t offload_crc16(uint16_t crc, const uint8_t *data, size_t size);
+
+/**
+ * Sends one packet.
+ *
+ * @param[in, out] offload offload to send through.
+ * @param[in] cmd command byte.
+ * @param[in] data packet data, may be NULL if size is 0.
+ * @param[in] size number of bytes in data.
+ *
+ * @returns 0 on success, -1 on failure.
+ */
+int offload_send_packet(struct offload *offload, uint8_t cmd, const uint8_t *data, size_t size);
+
+/**
+ * Waits for one packet. The payload is left in offload->packet, command byte
+ * first, and its size without the CRC in offload->size.
+ *
+ * @param[in, out] offload offload to receive through.
+ * @param[in] timeout time to wait for the packet to start, in ms.
+ *
+ * @returns the command byte, or -1 on timeout or a bad packet.
+ */
+int offload_wait_packet(struct offload *offload, uint32_t timeout);
+
+/**
+ * Waits for a host to ask for offload mode, and switches baud rate if it
+ * does.
+ *
+ * @param[in, out] offload offload to wait on.
+ * @param[in] timeout time to wait, in ms.
+ *
+ * @returns true if a host is waiting for files.
+ */
+bool offload_wait(struct offload *offload, uint32_t timeout);
+
+/**
+ * Serves file requests until the host sends DONE or goes quiet, then switches
+ * back to the baud rate in use before offload_wait.
+ *
+ * @param[in, out] offload offload to serve on, after offload_wait succeeded.
+ * @param[in] baud baud rate to restore.
+ *
+ * @returns 0 if the host finished with DONE, -1 otherwise.
+ */
+int offload_serve(struct offload *offload, uint32_t baud);
+
+#endif//OFFLOAD_H_
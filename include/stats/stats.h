@@ -0,0 +1,101 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Structure representing streaming statistics of one channel over a window.
+ *
+ * The mean and the sum of squared differences from it are updated with
+ * Welford's method, which stays accurate however many readings are added,
+ * unlike keeping a sum of squares. To get there in single precision, readings
+ * are taken relative to the first one in the window and the sum is
+ * compensated (Kahan).
+ */
+struct stats
+{
+	uint32_t start; // time of the first reading in the window, s
+	uint32_t count;
+	int32_t shift; // first reading in the window
+	float mean; // relative to shift
+	float m2; // sum of squared differences from the mean
+	float m2_error; // compensation for the rounding of m2
+	int32_t min;
+	int32_t max;
+};
+
+/**
+ * Empties the window.
+ *
+ * @param[out] stats statistics to reset.
+ */
+void stats_reset(struct stats *stats);
+
+/**
+ * Adds a reading to the window. The first reading sets the start of the
+ * window.
+ *
+ * @param[in, out] stats statistics to update.
+ * @param[in] time time of the reading, s.
+ * @param[in] value the reading.
+ */
+void stats_add(struct stats *stats, uint32_t time, int32_t value);
+
+/**
+ * Returns the mean of the readings in the window.
+ */
+float stats_mean(const struct stats *stats);
+
+/**
+ * Returns the sample variance of the readings in the window, 0 for fewer than
+ * two readings.
+ */
+float stats_variance(const struct stats *stats);
+
+/**
+ * Returns true if the window holds readings and started at least window
+ * seconds before now.
+ */
+bool stats_window_done(const struct stats *stats, uint32_t now, uint32_t window);
+
+/**
+ * Formats a summary of the window as a CSV record,
+ * "start,name,count,mean,variance,min,max\r\n".
+ *
+ * @param[in] stats statistics to summarize.
+ * @param[in] name channel name.
+ * @param[out] line buffer for the record.
+ * @param[in] size size of line.
+ *
+ * @returns the length of the record, as snprintf.
+ */
+int stats_format(const struct stats *stats, const char *name, char line[], size_t size);
+
+/**
+ * Restores windows saved by stats_save.
+ *
+ * @param[in] path file to load from.
+ * @param[out] stats windows to restore.
+ * @param[in] count number of windows.
+ *
+ * @returns 0 on success, -1 if there was no usable state.
+ */
+int stats_load(const char *path, struct stats stats[], size_t count);
+
+/**
+ * Saves windows, so they can span resets.
+ *
+ * @param[in] path file to save to, replaced.
+ * @param[in] stats windows to save.
+ * @param[in] count number of windows.
+ *
+ * @returns 0 on success, -1 on failure.
+ */
+int stats_save(const char *path, const struct stats stats[], size_t count);
+
+#endif//STATS_H_
@@ -0,0 +1,129 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/** Number of samples kept; once full, the oldest samples are overwritten */
+#define TRACE_CAPACITY 256
+
+/** Maximum number of distinct stages */
+#define TRACE_MAX_STAGES 32
+
+/** One measured interval of a stage */
+struct trace_sample
+{
+	uint32_t begin; // ticks
+	uint32_t duration; // ticks
+	uint8_t stage;
+};
+
+/**
+ * Returns the count of a clock that keeps running in deep sleep.
+ */
+typedef uint32_t (*trace_clock)(void);
+
+/**
+ * Structure representing a ring buffer of stage timings.
+ *
+ * On the Cortex-M4 ticks are core clock cycles from the DWT cycle counter, on
+ * the host they are nanoseconds from CLOCK_MONOTONIC. Both wrap at 32 bits;
+ * durations are computed modulo 2^32 so a single wrap inside a stage is fine.
+ *
+ * The cycle counter stops while the core is in deep sleep, so stages that
+ * sleep are timed with a separate sleep clock instead, see
+ * trace_sleep_clock. Their durations are still recorded in ticks.
+ */
+struct trace
+{
+	const char * const *names;
+	uint8_t stages;
+	uint32_t recorded; // total samples ever recorded
+	uint32_t open[TRACE_MAX_STAGES];
+	trace_clock sleep_clock; // NULL for none
+	uint32_t sleep_frequency; // sleep clock counts per second
+	uint32_t sleep_stages; // bitmask of stages timed with the sleep clock
+	uint32_t sleep_open[TRACE_MAX_STAGES];
+	struct trace_sample samples[TRACE_CAPACITY];
+};
+
+/**
+ * Trace initialization. On target this also enables the DWT cycle counter.
+ *
+ * @param[out] trace trace to initialize.
+ * @param[in] names name of each stage, indexed by stage id. Must outlive the
+ *  trace.
+ * @param[in] stages number of stages, at most TRACE_MAX_STAGES.
+ */
+void trace_init(struct trace *trace, const char * const names[], uint8_t stages);
+
+/**
+ * Times some stages with a clock that keeps running in deep sleep, like the
+ * STIMER, instead of the cycle counter. Their durations are converted to
+ * ticks, at the resolution of the sleep clock.
+ *
+ * @param[in, out] trace trace to configure.
+ * @param[in] clock sleep clock.
+ * @param[in] frequency sleep clock counts per second.
+ * @param[in] stages bitmask of the stage ids to time with it, 1 << stage.
+ */
+void trace_sleep_clock(struct trace *trace, trace_clock clock, uint32_t frequency, uint32_t stages);
+
+/**
+ * Returns the current tick count.
+ */
+uint32_t trace_now(void);
+
+/**
+ * Returns the number of ticks per second.
+ */
+uint32_t trace_frequency(void);
+
+/**
+ * Marks the beginning of a stage.
+ *
+ * @param[in, out] trace trace to record into.
+ * @param[in] stage stage id.
+ */
+void trace_begin(struct trace *trace, uint8_t stage);
+
+/**
+ * Marks the end of a stage, and records the time since its trace_begin.
+ *
+ * @param[in, out] trace trace to record into.
+ * @param[in] stage stage id.
+ */
+void trace_end(struct trace *trace, uint8_t stage);
+
+/**
+ * Writes the trace in its compact binary form.
+ *
+ * Layout, little-endian: "TRCE", u8 version, u8 stage count, u16 sample count,
+ * u32 ticks per second, u32 samples recorded in total (including overwritten
+ * ones), then every stage name NUL-terminated, then each sample oldest first
+ * as u8 stage, u32 begin, u32 duration.
+ *
+ * @param[in] trace trace to dump.
+ * @param[in] fp file to write to, e.g. a littlefs file.
+ *
+ * @returns 0 on success, -1 if a write failed.
+ */
+int trace_dump(const struct trace *trace, FILE *fp);
+
+/**
+ * Writes the same bytes as trace_dump, hex encoded, on lines starting with
+ * "trace: ", so the trace can be captured from a text console such as the
+ * UART.
+ *
+ * @param[in] trace trace to dump.
+ * @param[in] fp file to write to, e.g. stdout.
+ *
+ * @returns 0 on success, -1 if a write failed.
+ */
+int trace_print(const struct trace *trace, FILE *fp);
+
+#endif//TRACE_H_
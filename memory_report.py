@@ -0,0 +1,189 @@
+#!/usr/bin/env python
+# SPDX-License-Identifier: Apache-2.0
+# SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+# Artemia memory budget report
+# Shows where the 384 KB of SRAM go: .data and .bss of the firmware image,
+#   the library arena inside .bss and how much of it was used at most, and
+#   the largest stack frames
+
+# Run it through the memory_report build target, or by hand on the ELF file.
+# The arena high water mark is only known at run time. The firmware prints it
+#   at the end of every cycle ("arena: high water ..."), pass a capture of its
+#   UART output with -u to include it.
+# Stack frames come from the .su files GCC writes with -fstack-usage, which
+#   the stack_usage meson option adds. With LTO they are written for the
+#   link-time units; configure with -Db_lto=false to get one per source file.
+#   Frames marked dynamic grow at run time (VLAs, alloca), and the figures are
+#   per function, not per call chain.
+
+# ***********************************************************************************
+#
+# Imports
+#
+# ***********************************************************************************
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+SRAM_SIZE = 384 * 1024
+
+
+# ***********************************************************************************
+#
+# Sections and symbols of a 32-bit little-endian ELF file
+#
+# ***********************************************************************************
+def read_elf(path):
+    with open(path, mode='rb') as f:
+        data = f.read()
+    if data[:4] != b'\x7fELF' or data[4] != 1 or data[5] != 1:
+        raise ValueError(path + ' is not a 32-bit little-endian ELF file')
+
+    shoff, = struct.unpack_from('<I', data, 0x20)
+    shentsize, shnum, shstrndx = struct.unpack_from('<HHH', data, 0x2E)
+    headers = []
+    for i in range(shnum):
+        name, kind, flags, addr, offset, size, link, info, align, entsize = \
+            struct.unpack_from('<IIIIIIIIII', data, shoff + i * shentsize)
+        headers.append({'name': name, 'type': kind, 'addr': addr, 'offset': offset,
+                        'size': size, 'link': link, 'entsize': entsize})
+
+    def string(table, offset):
+        start = headers[table]['offset'] + offset
+        return data[start:data.index(b'\0', start)].decode(errors='replace')
+
+    sections = []
+    for header in headers:
+        header['name'] = string(shstrndx, header['name'])
+        sections.append(header)
+
+    symbols = []
+    for index, header in enumerate(headers):
+        if header['type'] != 2:  # SHT_SYMTAB
+            continue
+        for offset in range(header['offset'], header['offset'] + header['size'], header['entsize']):
+            name, value, size, info, other, shndx = struct.unpack_from('<IIIBBH', data, offset)
+            if size and (info & 0xF) == 1 and shndx < len(headers):  # STT_OBJECT
+                symbols.append({'name': string(header['link'], name), 'size': size,
+                                'section': headers[shndx]['name']})
+    return sections, symbols
+
+
+# ***********************************************************************************
+#
+# Stack frames from the .su files under a directory, largest first
+#
+# ***********************************************************************************
+def read_stack_usage(directory):
+    frames = []
+    for root, dirs, files in os.walk(directory):
+        for name in files:
+            if not name.endswith('.su'):
+                continue
+            with open(os.path.join(root, name)) as f:
+                for line in f:
+                    fields = line.rstrip('\n').split('\t')
+                    if len(fields) != 3:
+                        continue
+                    function = fields[0].split(':')[-1]
+                    location = ':'.join(fields[0].split(':')[:2])
+                    frames.append((int(fields[1]), function, location, fields[2]))
+    frames.sort(reverse=True)
+    return frames
+
+
+# ***********************************************************************************
+#
+# Arena high water mark from a capture of the firmware's UART output
+#
+# ***********************************************************************************
+def read_arena_log(path):
+    pattern = re.compile(r'arena: high water (\d+) of (\d+) bytes, (\d+) failed')
+    result = None
+    with open(path, errors='replace') as f:
+        for line in f:
+            match = pattern.search(line)
+            if match:
+                high, size, failures = (int(x) for x in match.groups())
+                # Keep the worst cycle in the capture
+                if result is None or high > result[0]:
+                    result = (high, size, failures)
+    return result
+
+
+def kb(size):
+    return '%8d bytes %7.1f KB' % (size, size / 1024)
+
+
+# ******************************************************************************
+#
+# Main program flow
+#
+# ******************************************************************************
+if __name__ == '__main__':
+
+    parser = argparse.ArgumentParser(
+        description='SRAM budget of an Artemia firmware build')
+
+    parser.add_argument('elf', help='Firmware ELF file')
+
+    parser.add_argument('-s', dest='stack_dir', default=None,
+                        help='Directory to search for .su stack usage files (default the ELF file\'s)')
+
+    parser.add_argument('-u', dest='uart_log', default=None,
+                        help='Capture of the firmware UART output, for the arena high water mark')
+
+    parser.add_argument('-n', dest='count', default=15, type=int,
+                        help='Number of stack frames and objects to list (default 15)')
+
+    args = parser.parse_args()
+
+    sections, symbols = read_elf(args.elf)
+    sizes = {section['name']: section['size'] for section in sections}
+    data = sizes.get('.data', 0)
+    bss = sizes.get('.bss', 0)
+    arena = sum(s['size'] for s in symbols if s['name'].split('.')[0] == 'arena' and s['section'] == '.bss')
+
+    print('SRAM              ' + kb(SRAM_SIZE))
+    print('  .data           ' + kb(data))
+    print('  .bss            ' + kb(bss))
+    if arena:
+        print('    arena         ' + kb(arena))
+    left = SRAM_SIZE - data - bss
+    print('  left for stack  ' + kb(left))
+
+    if args.uart_log:
+        usage = read_arena_log(args.uart_log)
+        if usage is None:
+            print('No arena line in ' + args.uart_log)
+        else:
+            high, size, failures = usage
+            print('Arena high water ' + str(high) + ' of ' + str(size) + ' bytes (' +
+                  str(round(100 * high / size)) + '%), ' + str(failures) + ' failed allocations')
+            if failures:
+                print('  raise the arena_size meson option')
+    else:
+        print('Arena high water unknown, pass a capture of the UART output with -u')
+
+    print()
+    print('Largest objects in SRAM:')
+    objects = sorted((s for s in symbols if s['section'] in ('.data', '.bss')),
+                     key=lambda s: s['size'], reverse=True)
+    for s in objects[:args.count]:
+        print('  %8d  %-5s %s' % (s['size'], s['section'], s['name']))
+
+    print()
+    frames = read_stack_usage(args.stack_dir or os.path.dirname(os.path.abspath(args.elf)))
+    if not frames:
+        print('No .su files found, configure with -Dstack_usage=true')
+        sys.exit(0)
+    print('Largest stack frames:')
+    for size, function, location, kind in frames[:args.count]:
+        print('  %8d  %-18s %s (%s)' % (size, kind, function, location))
+    dynamic = [f for f in frames if f[3].startswith('dynamic') and f[3] != 'dynamic,bounded']
+    if dynamic:
+        print('Unbounded dynamic frames: ' + ', '.join(f[1] for f in dynamic))
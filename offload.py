@@ -0,0 +1,287 @@
+#!/usr/bin/env python
+# SPDX-License-Identifier: Apache-2.0
+# SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+# Artemia log offloader
+# Pulls files off the device over its UART at up to 921600 baud
+
+# The firmware listens for a HELLO packet for offload_wait_ms after every
+#   reset. This script keeps sending HELLO at the boot baud rate until the
+#   device answers with the baud rate both sides then switch to.
+# Each file is requested with OPEN, carrying the offset to start from. The
+#   device answers with INFO (file size and the offset it will actually start
+#   at) and then streams DATA frames, keeping up to a window of them in
+#   flight. Every frame received in order is acknowledged with ACK; the first
+#   corrupt or out of order frame gets a single RETRY from the current offset,
+#   and later ones are dropped until the device has gone back to it. Once
+#   everything is acknowledged the device sends END.
+# Files already partially downloaded are resumed from their current size.
+# Packets use the same framing and CRC16 as the SVL bootloader, see svl.py
+#   and offload.h.
+
+# Test without a board with the pty simulator built by the host_tools option:
+#   offload_sim <directory> prints a pty path to pass as the port here.
+
+# ***********************************************************************************
+#
+# Imports
+#
+# ***********************************************************************************
+
+import argparse
+import os
+import struct
+import sys
+import time
+
+import serial
+
+from svl import send_packet, wait_for_packet
+
+# ***********************************************************************************
+#
+# Commands, see enum offload_cmd in offload.h
+#
+# ***********************************************************************************
+OFFLOAD_CMD_HELLO = 0x10
+OFFLOAD_CMD_OPEN = 0x11
+OFFLOAD_CMD_INFO = 0x12
+OFFLOAD_CMD_DATA = 0x13
+OFFLOAD_CMD_ACK = 0x14
+OFFLOAD_CMD_RETRY = 0x15
+OFFLOAD_CMD_END = 0x16
+OFFLOAD_CMD_ERROR = 0x17
+OFFLOAD_CMD_DONE = 0x18
+
+
+def valid(packet):
+    return not packet['timeout'] and packet['crc'] == 0
+
+
+# Throws away input until the line goes quiet. The device stops sending once
+# its window is full of unacknowledged frames, so the next packet after this
+# starts on a packet boundary again.
+def drain(ser):
+    while ser.read(4096):
+        pass
+
+
+# ***********************************************************************************
+#
+# Setup: ask for offload mode and switch baud rate
+#
+# ***********************************************************************************
+def phase_setup(ser):
+    deadline = time.time() + args.wait
+    while time.time() < deadline:
+        ser.reset_input_buffer()
+        send_packet(ser, OFFLOAD_CMD_HELLO, struct.pack('>I', args.offload_baud))
+        packet = wait_for_packet(ser)
+        if valid(packet) and packet['cmd'] == OFFLOAD_CMD_HELLO:
+            version, frame_size, window, baud = struct.unpack('>HHBI', packet['data'])
+            verboseprint('\tProtocol version ' + str(version) + ', ' +
+                         str(frame_size) + ' byte frames, window of ' +
+                         str(window) + ', ' + str(baud) + ' baud')
+            ser.flush()
+            ser.baudrate = baud
+            # Give the device time to switch over as well
+            time.sleep(0.01)
+            return window
+    return 0
+
+
+# ***********************************************************************************
+#
+# Transfer one file
+#
+# ***********************************************************************************
+def phase_transfer(ser, name, window, resume=True):
+    local = os.path.join(args.output, os.path.basename(name))
+    offset = 0
+    if resume and not args.restart and os.path.exists(local):
+        offset = os.path.getsize(local)
+
+    send_packet(ser, OFFLOAD_CMD_OPEN,
+                struct.pack('>IB', offset, window) + name.encode())
+    packet = wait_for_packet(ser)
+    if not valid(packet) or packet['cmd'] != OFFLOAD_CMD_INFO:
+        print('\t' + name + ': not found on the device')
+        return None
+    size, start = struct.unpack('>II', packet['data'])
+
+    start_time = time.time()
+    timeouts = 0
+    bad = 0
+    retry_sent = False
+    expected = start
+    with open(local, 'r+b' if os.path.exists(local) else 'w+b') as out:
+        # The device starts over if its file is smaller than our copy
+        out.truncate(start)
+        out.seek(start)
+        while expected < size:
+            packet = wait_for_packet(ser)
+            if packet['timeout']:
+                timeouts += 1
+                if timeouts > args.retries:
+                    print('\t' + name + ': device stopped responding')
+                    return None
+                # The RETRY or the frames after it may have been lost
+                retry_sent = False
+            else:
+                timeouts = 0
+                bad = 0 if valid(packet) else bad + 1
+
+            if valid(packet) and packet['cmd'] == OFFLOAD_CMD_DATA:
+                position = int.from_bytes(packet['data'][:4], 'big')
+                if position == expected:
+                    out.write(packet['data'][4:])
+                    expected += len(packet['data']) - 4
+                    retry_sent = False
+                    send_packet(ser, OFFLOAD_CMD_ACK, expected.to_bytes(4, 'big'))
+                    continue
+                if position < expected:
+                    # Resent after a lost ACK, let the device catch up
+                    send_packet(ser, OFFLOAD_CMD_ACK, expected.to_bytes(4, 'big'))
+                    continue
+            elif valid(packet) and packet['cmd'] == OFFLOAD_CMD_END:
+                break
+
+            # A corrupt length throws framing off, which shows up as a run of bad
+            # packets. Others only corrupt their own packet.
+            if bad > 1:
+                drain(ser)
+                bad = 0
+                retry_sent = False
+            if not retry_sent:
+                verboseprint('\t\tRetrying from ' + str(expected))
+                send_packet(ser, OFFLOAD_CMD_RETRY, expected.to_bytes(4, 'big'))
+                retry_sent = True
+
+    # END confirms the device saw the last ACK; the data is complete either way
+    if packet['cmd'] != OFFLOAD_CMD_END:
+        wait_for_packet(ser)
+
+    elapsed = time.time() - start_time
+    received = size - start
+    rate = received / elapsed if elapsed > 0 else 0
+    print('\t' + name + ': ' + str(received) + ' of ' + str(size) +
+          ' bytes in ' + str(round(elapsed, 3)) + ' s, ' +
+          str(round(rate)) + ' bytes/s')
+    return received, elapsed
+
+
+# ***********************************************************************************
+#
+# Expand segmented logs into their segment files using their .state file
+#
+# ***********************************************************************************
+def log_segments(ser, name, window):
+    # The state is rewritten in place, so it can never be resumed
+    state = name + '.state'
+    if phase_transfer(ser, state, window, resume=False) is None:
+        return [name]
+    with open(os.path.join(args.output, os.path.basename(state)), 'rb') as f:
+        first, last = struct.unpack('<II', f.read(8))
+    root, ext = os.path.splitext(name)
+    return [root + '.' + str(n) + ext for n in range(first, last + 1)]
+
+
+# ***********************************************************************************
+#
+# Main function
+#
+# ***********************************************************************************
+def main():
+    os.makedirs(args.output, exist_ok=True)
+    with serial.Serial(args.port, args.baud, timeout=args.timeout) as ser:
+        print('Waiting for the device, reset it now')
+        window = phase_setup(ser)
+        if not window:
+            print('Device did not enter offload mode')
+            sys.exit(1)
+        window = min(window, args.window)
+
+        names = list(args.files)
+        for log in args.logs:
+            names.extend(log_segments(ser, log, window))
+
+        total_bytes = 0
+        total_time = 0
+        failed = False
+        for name in names:
+            result = phase_transfer(ser, name, window)
+            if result is None:
+                failed = True
+                continue
+            total_bytes += result[0]
+            total_time += result[1]
+
+        send_packet(ser, OFFLOAD_CMD_DONE, b'')
+        try:
+            wait_for_packet(ser)
+        except serial.SerialException:
+            # The simulator closes its pty right after answering
+            pass
+
+    if total_time > 0:
+        print('Sustained rate: ' + str(round(total_bytes / total_time)) +
+              ' bytes/s over ' + str(total_bytes) + ' bytes')
+    sys.exit(1 if failed else 0)
+
+
+# ******************************************************************************
+#
+# Main program flow
+#
+# ******************************************************************************
+if __name__ == '__main__':
+
+    parser = argparse.ArgumentParser(
+        description='Offload files from an Artemia device over its UART')
+
+    parser.add_argument('port', help='Serial port, or the pty printed by offload_sim')
+
+    parser.add_argument('files', nargs='*',
+                        help='Files to fetch, relative to fs:/')
+
+    parser.add_argument('-l', '--log', dest='logs', action='append', default=[],
+                        help='Segmented CSV log to fetch all segments of, e.g. temperature_data.csv')
+
+    parser.add_argument('-o', dest='output', default='.',
+                        help='Directory to save files to (default is the current one)')
+
+    parser.add_argument('-b', dest='baud', default=115200, type=int,
+                        help='Baud rate the device boots with (default is 115200)')
+
+    parser.add_argument('-B', dest='offload_baud', default=921600, type=int,
+                        help='Baud rate to offload at, capped by the device (default is 921600)')
+
+    parser.add_argument('-w', dest='window', default=8, type=int,
+                        help='Maximum frames in flight (default is 8)')
+
+    parser.add_argument('--restart', action='store_true',
+                        help='Download files from the start instead of resuming')
+
+    parser.add_argument('--wait', default=30.0, type=float,
+                        help='Seconds to wait for the device to enter offload mode (default 30)')
+
+    parser.add_argument('-t', '--timeout', default=0.25, type=float,
+                        help='Communication timeout in seconds (default 0.25)')
+
+    parser.add_argument('-r', '--retries', default=8, type=int,
+                        help='Consecutive timeouts before giving up on a file (default 8)')
+
+    parser.add_argument('-v', '--verbose', default=0, action='store_true',
+                        help='Enable verbose output')
+
+    args = parser.parse_args()
+
+    if args.verbose:
+        def verboseprint(*args):
+            for arg in args:
+                print(arg, end='', flush=True)
+            print()
+    else:
+        verboseprint = lambda *a: None
+
+    main()
@@ -0,0 +1,162 @@
+#!/usr/bin/env python
+# SPDX-License-Identifier: Apache-2.0
+# SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+# Spectrogram decoder
+# Decodes the spectrogram.bin log segments written by the firmware and renders
+#   them
+
+# The log is a sequence of blocks. Each block starts with a 20 byte
+#   little-endian header ("SPEC", u8 version, u8 bands, i8 floor_db,
+#   u8 step_qdb, u16 frames, u16 N, u32 S, u32 time) followed by frames * bands
+#   bytes, one quantized dB value per band. See fft_spectrogram_write in fft.c.
+# Band edges are not stored; they are recomputed from N and the band count the
+#   same way fft_spectrogram_init does.
+
+# ***********************************************************************************
+#
+# Imports
+#
+# ***********************************************************************************
+
+import argparse
+import struct
+import sys
+
+HEADER = struct.Struct('<4sBBbBHHII')
+SHADES = ' .:-=+*#%@'
+
+
+# ***********************************************************************************
+#
+# Recompute the band edges used by the firmware
+#
+# ***********************************************************************************
+def band_edges(N, bands):
+    lo = 1
+    hi = N // 2 + 1
+    edges = [lo]
+    for b in range(1, bands):
+        edge = int(lo * (hi / lo) ** (b / bands) + 0.5)
+        edge = max(edge, edges[b - 1] + 1)
+        edge = min(edge, hi - (bands - b))
+        edges.append(edge)
+    edges.append(hi)
+    return edges
+
+
+# ***********************************************************************************
+#
+# Read all blocks from a spectrogram log
+#
+# ***********************************************************************************
+def read_blocks(data):
+    blocks = []
+    offset = 0
+    while offset + HEADER.size <= len(data):
+        magic, version, bands, floor_db, step_qdb, frames, N, S, time = \
+            HEADER.unpack_from(data, offset)
+        if magic != b'SPEC' or version != 1:
+            print('Bad block header at offset ' + str(offset), file=sys.stderr)
+            break
+        offset += HEADER.size
+        size = frames * bands
+        if offset + size > len(data):
+            print('Truncated block at offset ' + str(offset), file=sys.stderr)
+            break
+        payload = data[offset:offset + size]
+        offset += size
+        blocks.append({
+            'bands': bands, 'floor_db': floor_db, 'step': step_qdb / 4,
+            'N': N, 'S': S, 'time': time,
+            'frames': [list(payload[f * bands:(f + 1) * bands])
+                       for f in range(frames)],
+        })
+    return blocks
+
+
+def to_db(block, q):
+    return block['floor_db'] + q * block['step']
+
+
+# ***********************************************************************************
+#
+# Renderers
+#
+# ***********************************************************************************
+def render_text(blocks):
+    for block in blocks:
+        edges = band_edges(block['N'], block['bands'])
+        print('time ' + str(block['time']) + ', ' + str(len(block['frames'])) +
+              ' frames, N=' + str(block['N']) + ', S=' + str(block['S']))
+        # Highest frequency at the top, one column per frame
+        for b in reversed(range(block['bands'])):
+            hz = edges[b] * block['S'] // block['N']
+            row = ''.join(SHADES[q * (len(SHADES) - 1) // 255]
+                          for q in (frame[b] for frame in block['frames']))
+            print('{:>6} Hz |{}'.format(hz, row))
+
+
+def render_csv(blocks, out):
+    for block in blocks:
+        edges = band_edges(block['N'], block['bands'])
+        for index, frame in enumerate(block['frames']):
+            for b, q in enumerate(frame):
+                out.write('{},{},{},{},{:.2f}\n'.format(
+                    block['time'], index,
+                    edges[b] * block['S'] / block['N'],
+                    edges[b + 1] * block['S'] / block['N'],
+                    to_db(block, q)))
+
+
+def render_pgm(blocks, path):
+    # Frames run left to right, bands bottom to top; all blocks must share a
+    # band count to be drawn side by side
+    frames = [frame for block in blocks for frame in block['frames']]
+    bands = blocks[0]['bands']
+    with open(path, 'wb') as pgm:
+        pgm.write('P5\n{} {}\n255\n'.format(len(frames), bands).encode())
+        for b in reversed(range(bands)):
+            pgm.write(bytes(frame[b] for frame in frames))
+
+
+# ***********************************************************************************
+#
+# Main program flow
+#
+# ***********************************************************************************
+if __name__ == '__main__':
+
+    parser = argparse.ArgumentParser(
+        description='Decode and render an Artemia spectrogram log')
+
+    parser.add_argument('files', nargs='+',
+                        help='spectrogram.<n>.bin segments copied off the device')
+
+    parser.add_argument('--csv', dest='csv', action='store_true',
+                        help='Print time,frame,low Hz,high Hz,dB rows instead of text art')
+
+    parser.add_argument('--pgm', dest='pgm', default='',
+                        help='Also write a grayscale PGM image to this path')
+
+    args = parser.parse_args()
+
+    blocks = []
+    for path in args.files:
+        with open(path, mode='rb') as f:
+            blocks.extend(read_blocks(f.read()))
+    # Segment names do not sort numerically, block times do
+    blocks.sort(key=lambda block: block['time'])
+
+    if not blocks:
+        print('No spectrogram blocks found')
+        sys.exit(1)
+
+    if args.csv:
+        sys.stdout.write('time,frame,low_hz,high_hz,db\n')
+        render_csv(blocks, sys.stdout)
+    else:
+        render_text(blocks)
+
+    if args.pgm:
+        render_pgm(blocks, args.pgm)
@@ -0,0 +1,152 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+#include <adapt.h>
+#include <bytes.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#define ADAPT_RECORD_SIZE (24 + 4 * ADAPT_FEATURES)
+
+bool adapt_due(const struct adapt *adapt, uint32_t now)
+{
+	return !adapt->interval || (int32_t)(now - adapt->next) >= 0;
+}
+
+static float adapt_activity(struct adapt *adapt, const float features[], size_t count)
+{
+	if (count > ADAPT_FEATURES)
+		count = ADAPT_FEATURES;
+	float activity = 0.0f;
+	if (adapt->features == count)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			float change = features[i] - adapt->reference[i];
+			activity += change < 0.0f ? -change : change;
+		}
+		activity /= (float)count;
+	}
+	memcpy(adapt->reference, features, count * sizeof(features[0]));
+	adapt->features = count;
+	return activity;
+}
+
+float adapt_sample(struct adapt *adapt, uint32_t now, const float features[], size_t count)
+{
+	// A change in features leaves nothing to compare against
+	bool fresh = adapt->features != (count > ADAPT_FEATURES ? ADAPT_FEATURES : count);
+	float activity = adapt_activity(adapt, features, count);
+	adapt->samples++;
+
+	// Start fast until the channel has shown it is calm
+	if (fresh || !adapt->interval || activity >= adapt->high)
+	{
+		adapt->interval = adapt->min_interval;
+		adapt->calm = 0;
+	}
+	else if (activity <= adapt->low)
+	{
+		if (++adapt->calm >= adapt->calm_samples)
+		{
+			adapt->calm = 0;
+			adapt->interval = adapt->interval > adapt->max_interval / 2 ?
+				adapt->max_interval : adapt->interval * 2;
+		}
+	}
+	else
+	{
+		adapt->calm = 0;
+	}
+	if (!adapt->interval)
+		adapt->interval = 1;
+	adapt->next = now + adapt->interval;
+	return activity;
+}
+
+uint32_t adapt_wait(const struct adapt adapts[], size_t count, uint32_t now)
+{
+	uint32_t wait = UINT32_MAX;
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (adapt_due(&adapts[i], now))
+			return 0;
+		uint32_t left = adapts[i].next - now;
+		if (left < wait)
+			wait = left;
+	}
+	return wait;
+}
+
+int adapt_load(const char *path, struct adapt adapts[], size_t count)
+{
+	FILE *fp = fopen(path, "r");
+	if (!fp)
+		return -1;
+
+	uint8_t header[BYTES_HEADER_SIZE];
+	if (fread(header, sizeof(header), 1, fp) != 1 ||
+		!bytes_check_header(header, "ADPT", 1, count))
+	{
+		fclose(fp);
+		return -1;
+	}
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		uint8_t record[ADAPT_RECORD_SIZE];
+		if (fread(record, sizeof(record), 1, fp) != 1)
+		{
+			fclose(fp);
+			return -1;
+		}
+		struct adapt *adapt = &adapts[i];
+		adapt->samples = bytes_get_le32(record + 20);
+		// An interval outside the new bounds would stick until the next
+		// change, start over
+		if (bytes_get_le32(record) != adapt->min_interval || bytes_get_le32(record + 4) != adapt->max_interval)
+			continue;
+		adapt->interval = bytes_get_le32(record + 8);
+		adapt->next = bytes_get_le32(record + 12);
+		adapt->calm = record[16];
+		adapt->features = record[17] <= ADAPT_FEATURES ? record[17] : 0;
+		for (size_t j = 0; j < ADAPT_FEATURES; ++j)
+			adapt->reference[j] = bytes_bits_float(bytes_get_le32(record + 24 + 4 * j));
+	}
+	fclose(fp);
+	return 0;
+}
+
+int adapt_save(const char *path, const struct adapt adapts[], size_t count)
+{
+	FILE *fp = fopen(path, "w");
+	if (!fp)
+		return -1;
+
+	uint8_t header[BYTES_HEADER_SIZE];
+	bytes_put_header(header, "ADPT", 1, count);
+	int result = fwrite(header, sizeof(header), 1, fp) == 1 ? 0 : -1;
+	for (size_t i = 0; i < count && !result; ++i)
+	{
+		const struct adapt *adapt = &adapts[i];
+		uint8_t record[ADAPT_RECORD_SIZE] = {0};
+		bytes_put_le32(record, adapt->min_interval);
+		bytes_put_le32(record + 4, adapt->max_interval);
+		bytes_put_le32(record + 8, adapt->interval);
+		bytes_put_le32(record + 12, adapt->next);
+		record[16] = adapt->calm;
+		record[17] = adapt->features;
+		bytes_put_le32(record + 20, adapt->samples);
+		for (size_t j = 0; j < ADAPT_FEATURES; ++j)
+			bytes_put_le32(record + 24 + 4 * j, bytes_float_bits(adapt->reference[j]));
+		if (fwrite(record, sizeof(record), 1, fp) != 1)
+			result = -1;
+	}
+	if (fclose(fp))
+		result = -1;
+	return result;
+}
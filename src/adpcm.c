@@ -0,0 +1,197 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+#include <adpcm.h>
+#include <bytes.h>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+static const int8_t index_table[16] = {
+	-1, -1, -1, -1, 2, 4, 6, 8,
+	-1, -1, -1, -1, 2, 4, 6, 8,
+};
+
+static const int16_t step_table[89] = {
+	7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+	19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+	50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+	130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+	337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+	876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+	2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+	5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+	15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767,
+};
+
+void adpcm_init(struct adpcm_state *state)
+{
+	state->predictor = 0;
+	state->index = 0;
+}
+
+// Updates the predictor and step index with one 4-bit code, shared by the
+// encoder and decoder so both track exactly the same state
+static inline void adpcm_update(int32_t *predictor, int32_t *index, uint8_t code)
+{
+	int32_t step = step_table[*index];
+	int32_t diff = step >> 3;
+	if (code & 4)
+		diff += step;
+	if (code & 2)
+		diff += step >> 1;
+	if (code & 1)
+		diff += step >> 2;
+	int32_t value = (code & 8) ? *predictor - diff : *predictor + diff;
+	if (value > INT16_MAX)
+		value = INT16_MAX;
+	else if (value < INT16_MIN)
+		value = INT16_MIN;
+	*predictor = value;
+
+	int32_t next = *index + index_table[code];
+	if (next < 0)
+		next = 0;
+	else if (next > 88)
+		next = 88;
+	*index = next;
+}
+
+static inline uint8_t adpcm_encode_sample(int32_t *predictor, int32_t *index, int16_t sample)
+{
+	int32_t step = step_table[*index];
+	int32_t diff = sample - *predictor;
+	uint8_t code = 0;
+	if (diff < 0)
+	{
+		code = 8;
+		diff = -diff;
+	}
+	if (diff >= step)
+	{
+		code |= 4;
+		diff -= step;
+	}
+	step >>= 1;
+	if (diff >= step)
+	{
+		code |= 2;
+		diff -= step;
+	}
+	step >>= 1;
+	if (diff >= step)
+		code |= 1;
+
+	adpcm_update(predictor, index, code);
+	return code;
+}
+
+size_t adpcm_encode(struct adpcm_state *state, const int16_t in[], size_t count, uint8_t out[])
+{
+	// Work on locals so the state stays in registers for the whole block
+	int32_t predictor = state->predictor;
+	int32_t index = state->index;
+	size_t size = count / 2;
+	for (size_t i = 0; i < size; ++i)
+	{
+		uint8_t low = adpcm_encode_sample(&predictor, &index, in[2 * i]);
+		uint8_t high = adpcm_encode_sample(&predictor, &index, in[2 * i + 1]);
+		out[i] = low | (high << 4);
+	}
+	state->predictor = predictor;
+	state->index = index;
+	return size;
+}
+
+size_t adpcm_decode(struct adpcm_state *state, const uint8_t in[], size_t size, int16_t out[])
+{
+	int32_t predictor = state->predictor;
+	int32_t index = state->index;
+	for (size_t i = 0; i < size; ++i)
+	{
+		adpcm_update(&predictor, &index, in[i] & 0xF);
+		out[2 * i] = predictor;
+		adpcm_update(&predictor, &index, in[i] >> 4);
+		out[2 * i + 1] = predictor;
+	}
+	state->predictor = predictor;
+	state->index = index;
+	return size * 2;
+}
+
+uint16_t adpcm_peak_amplitude(const int16_t samples[], size_t count)
+{
+	uint16_t peak = 0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		int32_t sample = samples[i];
+		uint16_t amplitude = sample < 0 ? -sample : sample;
+		if (amplitude > peak)
+			peak = amplitude;
+	}
+	return peak;
+}
+
+int adpcm_clip_open(struct adpcm_clip *clip, const char *path, uint32_t rate, uint32_t time)
+{
+	clip->fp = fopen(path, "w");
+	if (!clip->fp)
+		return -1;
+	adpcm_init(&clip->state);
+	clip->samples = 0;
+	clip->used = 0;
+
+	uint8_t header[ADPCM_CLIP_HEADER_SIZE] = {'A', 'D', 'P', 'C'};
+	bytes_put_le32(header + 4, rate);
+	bytes_put_le32(header + 8, time);
+	bytes_put_le32(header + 12, 0); // sample count, patched on close
+	header[16] = clip->state.predictor;
+	header[17] = (uint16_t)clip->state.predictor >> 8;
+	header[18] = clip->state.index;
+	if (fwrite(header, sizeof(header), 1, clip->fp) != 1)
+	{
+		fclose(clip->fp);
+		clip->fp = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+static int adpcm_clip_flush(struct adpcm_clip *clip)
+{
+	if (clip->used && fwrite(clip->buffer, clip->used, 1, clip->fp) != 1)
+		return -1;
+	clip->used = 0;
+	return 0;
+}
+
+int adpcm_clip_write(struct adpcm_clip *clip, const int16_t samples[], size_t count)
+{
+	while (count)
+	{
+		size_t room = (ADPCM_CLIP_BUFFER_SIZE - clip->used) * 2;
+		size_t chunk = count < room ? count : room;
+		clip->used += adpcm_encode(&clip->state, samples, chunk, clip->buffer + clip->used);
+		clip->samples += chunk;
+		samples += chunk;
+		count -= chunk;
+		if (clip->used == ADPCM_CLIP_BUFFER_SIZE && adpcm_clip_flush(clip))
+			return -1;
+	}
+	return 0;
+}
+
+int adpcm_clip_close(struct adpcm_clip *clip)
+{
+	int result = adpcm_clip_flush(clip);
+	uint8_t samples[4];
+	bytes_put_le32(samples, clip->samples);
+	if (fseek(clip->fp, 12, SEEK_SET) || fwrite(samples, sizeof(samples), 1, clip->fp) != 1)
+		result = -1;
+	if (fclose(clip->fp))
+		result = -1;
+	clip->fp = NULL;
+	return result;
+}
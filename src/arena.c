@@ -0,0 +1,103 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+#include <arena.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// Every block starts with a header, and blocks tile the whole arena
+struct arena_block
+{
+	uint32_t size; // bytes, header included, a multiple of 8
+	uint32_t used;
+};
+
+#define ARENA_ALIGN 8
+#define ARENA_HEADER sizeof(struct arena_block)
+
+static union
+{
+	uint8_t bytes[ARENA_SIZE / ARENA_ALIGN * ARENA_ALIGN];
+	uint64_t align;
+} arena;
+
+static bool arena_ready;
+static size_t arena_used;
+static size_t arena_high_water;
+static size_t arena_failures;
+
+static struct arena_block *arena_at(size_t offset)
+{
+	return (struct arena_block *)(arena.bytes + offset);
+}
+
+static void arena_init(void)
+{
+	struct arena_block *block = arena_at(0);
+	block->size = sizeof(arena.bytes);
+	block->used = 0;
+	arena_ready = true;
+}
+
+void *arena_alloc(size_t size)
+{
+	if (!arena_ready)
+		arena_init();
+
+	size_t needed = (size + ARENA_HEADER + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+	for (size_t offset = 0; size < sizeof(arena.bytes) && offset < sizeof(arena.bytes);)
+	{
+		struct arena_block *block = arena_at(offset);
+		if (!block->used && block->size >= needed)
+		{
+			// Split off the rest if it can hold a block of its own
+			if (block->size - needed >= ARENA_HEADER + ARENA_ALIGN)
+			{
+				struct arena_block *rest = arena_at(offset + needed);
+				rest->size = block->size - needed;
+				rest->used = 0;
+				block->size = needed;
+			}
+			block->used = 1;
+			arena_used += block->size;
+			if (arena_used > arena_high_water)
+				arena_high_water = arena_used;
+			return block + 1;
+		}
+		offset += block->size;
+	}
+	arena_failures++;
+	return NULL;
+}
+
+void arena_free(void *ptr)
+{
+	if (!ptr)
+		return;
+	struct arena_block *freed = (struct arena_block *)ptr - 1;
+	freed->used = 0;
+	arena_used -= freed->size;
+
+	// Merge runs of free blocks, so large allocations fit again
+	for (size_t offset = 0; offset < sizeof(arena.bytes);)
+	{
+		struct arena_block *block = arena_at(offset);
+		size_t next = offset + block->size;
+		if (!block->used && next < sizeof(arena.bytes) && !arena_at(next)->used)
+		{
+			block->size += arena_at(next)->size;
+			continue;
+		}
+		offset = next;
+	}
+}
+
+void arena_get_stats(struct arena_stats *stats)
+{
+	stats->size = sizeof(arena.bytes);
+	stats->used = arena_used;
+	stats->high_water = arena_high_water;
+	stats->failures = arena_failures;
+}
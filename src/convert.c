@@ -0,0 +1,49 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+#include <convert.h>
+
+#include <stdint.h>
+
+void time_to_string(uint8_t buffer[21], uint64_t tv_sec)
+{
+	// Digits come out last first. 64 bit divisions are library calls on the
+	// Cortex-M4, so they only run until what is left fits in 32 bits, which
+	// the times logged already do
+	uint8_t digits[20];
+	uint8_t count = 0;
+	uint64_t rest = tv_sec;
+	while (rest > UINT32_MAX)
+	{
+		digits[count++] = '0' + rest % 10;
+		rest /= 10;
+	}
+	uint32_t small = (uint32_t)rest;
+	do
+	{
+		digits[count++] = '0' + small % 10;
+		small /= 10;
+	} while (small);
+	for (uint8_t i = 0; i < count; ++i)
+		buffer[i] = digits[count - 1 - i];
+}
+
+uint32_t convert_adc_microvolts(uint32_t code, uint32_t reference, uint32_t full_scale)
+{
+	// code * reference needs more than 32 bits, and a 64 bit division is a
+	// library call on the Cortex-M4, so the reference is split into a whole
+	// number of uV per step and a remainder, whose product with the code fits
+	const uint32_t step = reference / full_scale;
+	const uint32_t rest = reference % full_scale;
+	return code * step + (code * rest + full_scale / 2) / full_scale;
+}
+
+uint32_t convert_divider_ohms(uint32_t voltage, uint32_t supply, uint32_t fixed)
+{
+	if (voltage >= supply)
+		return UINT32_MAX;
+	// In single precision, which the FPU does in hardware, for the same
+	// reason as above
+	float ohms = (float)fixed * (float)voltage / (float)(supply - voltage);
+	return ohms >= 4294967296.0f ? UINT32_MAX : (uint32_t)ohms;
+}
@@ -0,0 +1,180 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+#include <deadband.h>
+#include <bytes.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#define DEADBAND_RECORD_SIZE 40
+
+static bool deadband_heartbeat(const struct deadband *band, uint32_t time)
+{
+	return band->heartbeat && time - band->archived.time >= band->heartbeat;
+}
+
+// Slope from the archived reading to a reading, and to the edges of the
+// tolerance band around it
+static float deadband_slopes(const struct deadband *band, const struct deadband_point *point, float *low, float *high)
+{
+	uint32_t elapsed = point->time - band->archived.time;
+	float dt = elapsed ? elapsed : 1;
+	float rise = (float)((int64_t)point->value - band->archived.value);
+	*low = (rise - band->tolerance) / dt;
+	*high = (rise + band->tolerance) / dt;
+	return rise / dt;
+}
+
+static void deadband_archive(struct deadband *band, const struct deadband_point *point, struct deadband_point *out)
+{
+	band->archived = *point;
+	band->archived_ok = true;
+	band->written++;
+	*out = *point;
+}
+
+static bool deadband_threshold(struct deadband *band, const struct deadband_point *point, struct deadband_point *out)
+{
+	int64_t difference = (int64_t)point->value - band->archived.value;
+	if (difference < 0)
+		difference = -difference;
+	if (band->archived_ok && difference <= band->tolerance && !deadband_heartbeat(band, point->time))
+		return false;
+	deadband_archive(band, point, out);
+	return true;
+}
+
+static bool deadband_swinging_door(struct deadband *band, const struct deadband_point *point, struct deadband_point *out)
+{
+	if (!band->archived_ok)
+	{
+		deadband_archive(band, point, out);
+		return true;
+	}
+
+	// The door holds the slopes from the archived reading that pass within
+	// the tolerance of every reading since. A reading can end the segment
+	// only if the line to it goes through the door, and the held reading is
+	// always the latest one that can.
+	float low, high;
+	float slope = deadband_slopes(band, point, &low, &high);
+	if (band->held_ok && (slope < band->slope_min || slope > band->slope_max ||
+		deadband_heartbeat(band, point->time)))
+	{
+		struct deadband_point held = band->held;
+		deadband_archive(band, &held, out);
+		deadband_slopes(band, point, &band->slope_min, &band->slope_max);
+		band->held = *point;
+		return true;
+	}
+
+	if (!band->held_ok)
+	{
+		band->slope_min = low;
+		band->slope_max = high;
+		band->held_ok = true;
+	}
+	else
+	{
+		if (low > band->slope_min)
+			band->slope_min = low;
+		if (high < band->slope_max)
+			band->slope_max = high;
+	}
+	band->held = *point;
+	return false;
+}
+
+bool deadband_process(struct deadband *band, uint32_t time, int32_t value, struct deadband_point *out)
+{
+	const struct deadband_point point = { .time = time, .value = value };
+	band->seen++;
+	switch (band->mode)
+	{
+	case DEADBAND_THRESHOLD:
+		return deadband_threshold(band, &point, out);
+	case DEADBAND_SWINGING_DOOR:
+		return deadband_swinging_door(band, &point, out);
+	default:
+		deadband_archive(band, &point, out);
+		return true;
+	}
+}
+
+int deadband_load(const char *path, struct deadband bands[], size_t count)
+{
+	FILE *fp = fopen(path, "r");
+	if (!fp)
+		return -1;
+
+	uint8_t header[BYTES_HEADER_SIZE];
+	if (fread(header, sizeof(header), 1, fp) != 1 ||
+		!bytes_check_header(header, "DBND", 1, count))
+	{
+		fclose(fp);
+		return -1;
+	}
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		uint8_t record[DEADBAND_RECORD_SIZE];
+		if (fread(record, sizeof(record), 1, fp) != 1)
+		{
+			fclose(fp);
+			return -1;
+		}
+		struct deadband *band = &bands[i];
+		band->seen = bytes_get_le32(record + 32);
+		band->written = bytes_get_le32(record + 36);
+		// Readings compressed with other settings carry no guarantee for
+		// these ones, start over
+		if (record[0] != band->mode || (int32_t)bytes_get_le32(record + 4) != band->tolerance)
+			continue;
+		band->archived_ok = record[1] & 1;
+		band->held_ok = record[1] & 2;
+		band->archived.time = bytes_get_le32(record + 8);
+		band->archived.value = bytes_get_le32(record + 12);
+		band->held.time = bytes_get_le32(record + 16);
+		band->held.value = bytes_get_le32(record + 20);
+		band->slope_min = bytes_bits_float(bytes_get_le32(record + 24));
+		band->slope_max = bytes_bits_float(bytes_get_le32(record + 28));
+	}
+	fclose(fp);
+	return 0;
+}
+
+int deadband_save(const char *path, const struct deadband bands[], size_t count)
+{
+	FILE *fp = fopen(path, "w");
+	if (!fp)
+		return -1;
+
+	uint8_t header[BYTES_HEADER_SIZE];
+	bytes_put_header(header, "DBND", 1, count);
+	int result = fwrite(header, sizeof(header), 1, fp) == 1 ? 0 : -1;
+	for (size_t i = 0; i < count && !result; ++i)
+	{
+		const struct deadband *band = &bands[i];
+		uint8_t record[DEADBAND_RECORD_SIZE] = {
+			band->mode, band->archived_ok | (band->held_ok << 1),
+		};
+		bytes_put_le32(record + 4, band->tolerance);
+		bytes_put_le32(record + 8, band->archived.time);
+		bytes_put_le32(record + 12, band->archived.value);
+		bytes_put_le32(record + 16, band->held.time);
+		bytes_put_le32(record + 20, band->held.value);
+		bytes_put_le32(record + 24, bytes_float_bits(band->slope_min));
+		bytes_put_le32(record + 28, bytes_float_bits(band->slope_max));
+		bytes_put_le32(record + 32, band->seen);
+		bytes_put_le32(record + 36, band->written);
+		if (fwrite(record, sizeof(record), 1, fp) != 1)
+			result = -1;
+	}
+	if (fclose(fp))
+		result = -1;
+	return result;
+}
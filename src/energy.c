@@ -0,0 +1,98 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+#include <energy.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Charges the time since the previous event to the current state
+static void energy_advance(struct energy *energy)
+{
+	uint32_t now = energy->clock();
+	uint32_t elapsed = now - energy->last;
+	energy->last = now;
+
+	if (energy->asleep)
+		energy->asleep_ticks += elapsed;
+	else
+		energy->awake_ticks += elapsed;
+
+	for (int i = 0; i < ENERGY_PERIPHERALS; ++i)
+	{
+		if (energy->powered & (1u << i))
+			energy->peripheral_ticks[i] += elapsed;
+	}
+}
+
+void energy_init(struct energy *energy, const struct energy_currents *currents, energy_clock clock, uint32_t frequency)
+{
+	memset(energy, 0, sizeof(*energy));
+	energy->currents = currents;
+	energy->clock = clock;
+	energy->frequency = frequency;
+	energy->start = energy->last = clock();
+}
+
+void energy_sleep(struct energy *energy)
+{
+	energy_advance(energy);
+	energy->asleep = true;
+}
+
+void energy_wake(struct energy *energy)
+{
+	energy_advance(energy);
+	energy->asleep = false;
+	energy->wakeups++;
+}
+
+void energy_enable(struct energy *energy, enum energy_peripheral peripheral)
+{
+	energy_advance(energy);
+	energy->powered |= 1u << peripheral;
+}
+
+void energy_disable(struct energy *energy, enum energy_peripheral peripheral)
+{
+	energy_advance(energy);
+	energy->powered &= ~(1u << peripheral);
+}
+
+float energy_uah(struct energy *energy)
+{
+	energy_advance(energy);
+	const struct energy_currents *currents = energy->currents;
+	// uA * ticks, converted to uAh at the end to keep the precision
+	float charge = currents->active_ua * energy->awake_ticks +
+		currents->sleep_ua * energy->asleep_ticks;
+	uint64_t total = energy->awake_ticks + energy->asleep_ticks;
+	for (int i = 0; i < ENERGY_PERIPHERALS; ++i)
+		charge += currents->peripheral_ua[i] * energy->peripheral_ticks[i] +
+			currents->standby_ua[i] * (total - energy->peripheral_ticks[i]);
+	return charge / energy->frequency / 3600.0f;
+}
+
+static uint32_t energy_ms(const struct energy *energy, uint64_t ticks)
+{
+	return (uint32_t)(ticks * 1000 / energy->frequency);
+}
+
+int energy_format_summary(struct energy *energy, char line[], size_t size, uint32_t time)
+{
+	// energy_uah brings the counters up to date
+	float uah = energy_uah(energy);
+	return snprintf(line, size, "%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%.3f\r\n",
+		(unsigned long)time,
+		(unsigned long)energy_ms(energy, energy->awake_ticks),
+		(unsigned long)energy_ms(energy, energy->asleep_ticks),
+		(unsigned long)energy->wakeups,
+		(unsigned long)energy_ms(energy, energy->peripheral_ticks[ENERGY_SPI_BUS]),
+		(unsigned long)energy_ms(energy, energy->peripheral_ticks[ENERGY_PDM]),
+		(unsigned long)energy_ms(energy, energy->peripheral_ticks[ENERGY_ADC]),
+		(unsigned long)energy_ms(energy, energy->peripheral_ticks[ENERGY_FLASH]),
+		(double)uah);
+}
@@ -8,6 +8,7 @@
 #include <math.h>
 #include "kiss_fftr.h"
 #include <stdint.h>
+#include <string.h>
 
 #include <fft.h>
 
@@ -16,6 +17,7 @@ void fft_init(struct fft *fft)
 {
     fft->N = 512;
     fft->S = 7813;
+    fft->D = 1;
 }
 
 // Change N
@@ -49,27 +51,9 @@ uint32_t TestFftReal(struct fft *fft, const kiss_fft_scalar in[], kiss_fft_cpx o
 
   if ((cfg = kiss_fftr_alloc(fft->N, 0/*is_inverse_fft*/, NULL, NULL)) != NULL)
   {
-    size_t i;
-
-    kiss_fftr(cfg, in, out);
-    free(cfg);
-
-    double data[(fft->N/2)+1];
-    for (i = 0; i < fft->N/2 + 1; i++)
-    {
-        double num = sqrt(out[i].r * out[i].r + out[i].i * out[i].i);
-        data[i] = num;
-    }
-    int max = 0;
-    int bucket = 0;
-    for (int j = 1; j < fft->N/2 + 1; j++){
-      if(data[j] > max){
-        max = data[j];
-        bucket = j;
-      }
-    }
-    int freq = (bucket * fft->S)/fft->N;
-    printf("Frequency: %d\r\n", freq);
+    uint32_t freq = fft_peak(fft, cfg, in, out);
+    kiss_fftr_free(cfg);
+    printf("Frequency: %d\r\n", (int)freq);
     return freq;
   }
   else
@@ -79,21 +63,835 @@ uint32_t TestFftReal(struct fft *fft, const kiss_fft_scalar in[], kiss_fft_cpx o
   }
 }
 
+// Gets the frequency with the highest amplitude with a caller-owned plan
+uint32_t fft_peak(struct fft *fft, kiss_fftr_cfg cfg, const kiss_fft_scalar in[], kiss_fft_cpx out[])
+{
+    kiss_fftr(cfg, in, out);
+
+    // Comparing squared magnitudes gives the same peak without the sqrt. Float
+    // is enough to rank them, and is what the device FPU does in hardware
+    float max = 0;
+    uint32_t bucket = 0;
+    for (uint32_t j = 1; j < fft->N/2 + 1; j++)
+    {
+        float power = (float)out[j].r * (float)out[j].r + (float)out[j].i * (float)out[j].i;
+        if (power > max)
+        {
+            max = power;
+            bucket = j;
+        }
+    }
+    return (uint32_t)(((uint64_t)bucket * fft->S) / fft->N);
+}
+
+// Sums the spectrum energy into equally wide bands
+void fft_band_energies(struct fft *fft, const kiss_fft_cpx out[], float bands[], size_t count)
+{
+    uint32_t bins = fft->N / 2;
+    for (size_t b = 0; b < count; b++)
+    {
+        bands[b] = 0;
+    }
+    for (uint32_t j = 1; j < bins + 1; j++)
+    {
+        size_t b = ((size_t)(j - 1) * count) / bins;
+        bands[b] += (float)out[j].r * out[j].r + (float)out[j].i * out[j].i;
+    }
+}
+
+// Prepares the log-spaced band edges of a spectrogram
+int fft_spectrogram_init(struct fft_spectrogram *spec, struct fft *fft, uint8_t bands)
+{
+    uint32_t lo = 1;
+    uint32_t hi = fft->N / 2 + 1;
+    if (bands == 0 || bands > FFT_SPECTROGRAM_MAX_BANDS || bands > hi - lo)
+        return -1;
+
+    spec->bands = bands;
+    spec->floor_db = 20;
+    spec->step_qdb = 2;
+    spec->edges[0] = lo;
+    for (uint8_t b = 1; b < bands; b++)
+    {
+        uint32_t edge = (uint32_t)(lo * pow((double)hi / lo, (double)b / bands) + 0.5);
+        // Every band needs at least one bin, and enough bins must remain
+        // for the bands after it
+        if (edge < spec->edges[b - 1] + 1u)
+            edge = spec->edges[b - 1] + 1u;
+        if (edge > hi - (bands - b))
+            edge = hi - (bands - b);
+        spec->edges[b] = edge;
+    }
+    spec->edges[bands] = hi;
+    return 0;
+}
+
+// Reduces a spectrum to one quantized dB byte per band
+void fft_spectrogram_frame(const struct fft_spectrogram *spec, const kiss_fft_cpx out[], uint8_t frame[])
+{
+    for (uint8_t b = 0; b < spec->bands; b++)
+    {
+        float power = 0;
+        for (uint16_t j = spec->edges[b]; j < spec->edges[b + 1]; j++)
+        {
+            power += (float)out[j].r * out[j].r + (float)out[j].i * out[j].i;
+        }
+        int q = 0;
+        if (power > 0)
+        {
+            float db = 10.0f * log10f(power);
+            q = (int)((db - spec->floor_db) * 4.0f / spec->step_qdb + 0.5f);
+        }
+        frame[b] = q < 0 ? 0 : (q > UINT8_MAX ? UINT8_MAX : q);
+    }
+}
+
+// Appends a header and a block of spectrogram frames to fp
+int fft_spectrogram_write(const struct fft_spectrogram *spec, struct fft *fft, FILE *fp, uint32_t time, const uint8_t frames[], uint16_t count)
+{
+    uint8_t header[FFT_SPECTROGRAM_HEADER_SIZE] = {
+        'S', 'P', 'E', 'C',
+        1, // version
+        spec->bands,
+        (uint8_t)spec->floor_db,
+        spec->step_qdb,
+        count & 0xFF, count >> 8,
+        fft->N & 0xFF, (fft->N >> 8) & 0xFF,
+        fft->S & 0xFF, (fft->S >> 8) & 0xFF, (fft->S >> 16) & 0xFF, fft->S >> 24,
+        time & 0xFF, (time >> 8) & 0xFF, (time >> 16) & 0xFF, time >> 24,
+    };
+    size_t size = (size_t)count * spec->bands;
+    if (fwrite(header, sizeof(header), 1, fp) != 1)
+        return -1;
+    if (size && fwrite(frames, size, 1, fp) != 1)
+        return -1;
+    return 0;
+}
+
+// Allocates the zero padded transforms and their buffers
+int fft_pitch_init(struct fft_pitch *pitch, struct fft *fft, float min_hz, float max_hz)
+{
+    pitch->forward = NULL;
+    pitch->inverse = NULL;
+    pitch->acf = NULL;
+    pitch->half = NULL;
+    pitch->spectrum = NULL;
+    if (min_hz <= 0 || max_hz <= min_hz || fft->N < 8 || fft->N % 2)
+        return -1;
+
+    // Padding the frame to nfft samples makes the autocorrelation linear up
+    // to lag nfft - N, half a frame, so long periods do not wrap around onto
+    // short ones. 3N/2 is a cheap size for kiss_fftr when N is a power of two
+    pitch->nfft = fft->N % 4 == 0 ? fft->N / 2 * 3 : 2 * fft->N;
+    const uint32_t valid = pitch->nfft - fft->N;
+    const double pi = 3.14159265358979323846;
+    pitch->step.r = (kiss_fft_scalar)cos(pi / pitch->nfft);
+    pitch->step.i = (kiss_fft_scalar)sin(pi / pitch->nfft);
+
+    // Lags must leave room for the neighbours used in interpolation
+    uint32_t min_lag = (uint32_t)((float)(2 * fft->S) / max_hz);
+    uint32_t max_lag = (uint32_t)ceilf((float)(2 * fft->S) / min_hz);
+    if (min_lag < 4)
+        min_lag = 4;
+    if (max_lag > 2 * valid - 2)
+        max_lag = 2 * valid - 2;
+    if (min_lag > max_lag)
+        return -1;
+    pitch->min_lag = min_lag;
+    pitch->max_lag = max_lag;
+
+    // The coarsest lag step that still puts FFT_PITCH_LAGS_PER_PERIOD lags in
+    // the shortest period searched. Every doubling halves the inverse
+    // transform, and above half a sample drops the second one
+    uint32_t stride = 1;
+    while (min_lag >= 2 * stride * FFT_PITCH_LAGS_PER_PERIOD &&
+        pitch->nfft % stride == 0 && (pitch->nfft / stride) % 2 == 0)
+    {
+        stride *= 2;
+    }
+    pitch->stride = stride;
+    const uint32_t points = stride == 1 ? pitch->nfft : 2 * pitch->nfft / stride;
+
+    pitch->forward = kiss_fftr_alloc(pitch->nfft, 0, NULL, NULL);
+    pitch->inverse = kiss_fftr_alloc(points, 1, NULL, NULL);
+    pitch->acf = KISS_FFT_MALLOC(sizeof(kiss_fft_scalar) * pitch->nfft);
+    if (stride == 1)
+        pitch->half = KISS_FFT_MALLOC(sizeof(kiss_fft_scalar) * pitch->nfft);
+    pitch->spectrum = KISS_FFT_MALLOC(sizeof(kiss_fft_cpx) * (pitch->nfft / 2 + 1));
+    if (!pitch->forward || !pitch->inverse || !pitch->acf || (stride == 1 && !pitch->half) || !pitch->spectrum)
+    {
+        fft_pitch_destroy(pitch);
+        return -1;
+    }
+    return 0;
+}
+
+// Frees the zero padded transforms and their buffers
+void fft_pitch_destroy(struct fft_pitch *pitch)
+{
+    kiss_fftr_free(pitch->forward);
+    kiss_fftr_free(pitch->inverse);
+    KISS_FFT_FREE(pitch->acf);
+    KISS_FFT_FREE(pitch->half);
+    KISS_FFT_FREE(pitch->spectrum);
+    pitch->forward = NULL;
+    pitch->inverse = NULL;
+    pitch->acf = NULL;
+    pitch->half = NULL;
+    pitch->spectrum = NULL;
+}
+
+// Autocorrelation at a point of the lag grid, lag point * stride in half
+// samples, scaled up by how many products it sums so every period of a
+// periodic signal correlates about as well
+static float fft_pitch_acf(const struct fft_pitch *pitch, const struct fft *fft, uint32_t point)
+{
+    float value;
+    if (pitch->stride == 1)
+        value = point % 2 ? pitch->half[point / 2] : pitch->acf[point / 2];
+    else
+        value = pitch->acf[point];
+    const float n = (float)(2 * fft->N);
+    return value * (n / (n - (float)(point * pitch->stride)));
+}
+
+// Whether a point of the lag grid is a local maximum of the autocorrelation,
+// and if so the height and offset in points of the parabola through it and
+// its neighbours
+static bool fft_pitch_peak(const struct fft_pitch *pitch, const struct fft *fft, uint32_t point, float *height, float *offset)
+{
+    float left = fft_pitch_acf(pitch, fft, point - 1);
+    float center = fft_pitch_acf(pitch, fft, point);
+    float right = fft_pitch_acf(pitch, fft, point + 1);
+    if (!(center > left && center >= right))
+        return false;
+    float denominator = left - 2 * center + right;
+    float shift = denominator != 0 ? 0.5f * (left - right) / denominator : 0;
+    *height = center - 0.25f * (left - right) * shift;
+    if (offset)
+        *offset = shift;
+    return true;
+}
+
+// Estimates the fundamental frequency from the autocorrelation
+float fft_pitch_estimate(struct fft_pitch *pitch, struct fft *fft, const kiss_fft_scalar in[], float *confidence)
+{
+    *confidence = 0;
+    const uint32_t nfft = pitch->nfft;
+    kiss_fft_cpx *spectrum = pitch->spectrum;
+
+    memcpy(pitch->acf, in, sizeof(kiss_fft_scalar) * fft->N);
+    memset(pitch->acf + fft->N, 0, sizeof(kiss_fft_scalar) * (nfft - fft->N));
+    kiss_fftr(pitch->forward, pitch->acf, spectrum);
+
+    // Wiener-Khinchin: the autocorrelation is the inverse transform of the
+    // power spectrum. Dropping DC removes the mean from the signal.
+    spectrum[0].r = 0;
+    spectrum[0].i = 0;
+    for (uint32_t k = 1; k < nfft / 2 + 1; k++)
+    {
+        spectrum[k].r = spectrum[k].r * spectrum[k].r + spectrum[k].i * spectrum[k].i;
+        spectrum[k].i = 0;
+    }
+
+    if (pitch->stride > 2)
+    {
+        // Only every stride/2-th lag is needed: folding the power spectrum
+        // onto points = 2*nfft/stride bins gives exactly those lags from a
+        // transform that much smaller. Bins past nfft/2 mirror those below,
+        // and only ones at or above points/2 are read before being written
+        const uint32_t points = 2 * nfft / pitch->stride;
+        for (uint32_t j = 0; j <= points / 2; j++)
+        {
+            float sum = 0;
+            for (uint32_t k = j; k < nfft; k += points)
+                sum += spectrum[k <= nfft / 2 ? k : nfft - k].r;
+            spectrum[j].r = sum;
+        }
+    }
+    kiss_fftri(pitch->inverse, spectrum, pitch->acf);
+
+    if (pitch->stride == 1)
+    {
+        // Periods of a few samples fall too far between whole lags for a
+        // parabola to find their peaks, so the autocorrelation is also taken
+        // half way between them: the power spectrum delayed by half a
+        // sample. The Nyquist term is zero there.
+        const kiss_fft_cpx step = pitch->step;
+        kiss_fft_cpx rotation = {1, 0};
+        for (uint32_t k = 1; k < nfft / 2; k++)
+        {
+            const kiss_fft_cpx next = {
+                rotation.r * step.r - rotation.i * step.i,
+                rotation.r * step.i + rotation.i * step.r,
+            };
+            rotation = next;
+            spectrum[k].i = spectrum[k].r * rotation.i;
+            spectrum[k].r = spectrum[k].r * rotation.r;
+        }
+        spectrum[nfft / 2].r = 0;
+        kiss_fftri(pitch->inverse, spectrum, pitch->half);
+    }
+
+    const float energy = pitch->acf[0];
+    if (energy <= 0)
+        return 0;
+
+    // Only local maxima count as candidate periods. Periods fall between
+    // lags, so peaks are compared at their interpolated height; a short
+    // period straddling two lags would otherwise lose to a multiple of it
+    // that happens to land on one
+    const uint32_t stride = pitch->stride;
+    const uint32_t first = pitch->min_lag / stride;
+    const uint32_t last = pitch->max_lag / stride;
+    float best = 0;
+    for (uint32_t point = first; point <= last; point++)
+    {
+        float height;
+        if (fft_pitch_peak(pitch, fft, point, &height, NULL) && height > best)
+            best = height;
+    }
+    if (best <= 0)
+        return 0;
+
+    // Multiples of the period correlate about as well as the period itself,
+    // so take the first peak that comes close to the best one
+    float center = 0, offset = 0;
+    uint32_t point = first;
+    for (; point <= last; point++)
+    {
+        if (fft_pitch_peak(pitch, fft, point, &center, &offset) && center >= 0.9f * best)
+            break;
+    }
+
+    float correlation = center / energy;
+    *confidence = correlation > 1 ? 1 : (correlation < 0 ? 0 : correlation);
+    return (float)(2 * fft->S) / (((float)point + offset) * (float)stride);
+}
+
+// Designs a half-band with pairs taps each side of the center, at offsets
+// 1, 3, 5... from it. A maximally flat one weighs each sample as a
+// polynomial through samples +-1, +-3... +-(2*pairs-1) would at the center,
+// halved; the other is a Kaiser windowed sinc cut off at a quarter of the
+// rate, scaled to unity gain at DC
+static void fft_zoom_design(uint32_t pairs, bool flat, double taps[])
+{
+    const double pi = 3.14159265358979323846;
+    const double beta = 6.8;
+    double sum = 0;
+    for (uint32_t p = 0; p < pairs; p++)
+    {
+        double m = 2 * p + 1;
+        if (flat)
+        {
+            double weight = 1;
+            for (uint32_t j = 0; j < pairs; j++)
+            {
+                double other = 2 * j + 1;
+                if (j != p)
+                    weight *= -other / (m - other);
+                weight *= other / (m + other);
+            }
+            taps[p] = 0.5 * weight;
+        }
+        else
+        {
+            // I0(beta*sqrt(1 - (m/(2*pairs))^2)) by its series, the window's
+            // I0(beta) denominator dropping out with the scaling
+            double x = beta * sqrt(1 - (m / (2 * pairs)) * (m / (2 * pairs))) / 2;
+            double window = 1, term = 1;
+            for (uint32_t k = 1; term > 1e-12 * window; k++)
+            {
+                term *= (x / k) * (x / k);
+                window += term;
+            }
+            taps[p] = sin(pi * m / 2) / (pi * m) * window;
+        }
+        sum += 2 * taps[p];
+    }
+    if (!flat)
+    {
+        for (uint32_t p = 0; p < pairs; p++)
+            taps[p] *= 0.5 / sum;
+    }
+}
+
+// Whether a half-band keeps what would alias onto |f| < edge, a fraction of
+// its input rate, 70 dB down. Its response at 0.5 - f is one minus that at
+// f, so that also bounds the ripple within edge
+static bool fft_zoom_meets(uint32_t pairs, const double taps[], double edge)
+{
+    const double pi = 3.14159265358979323846;
+    for (uint32_t k = 0; k <= 32; k++)
+    {
+        double f = 0.5 - edge * k / 32;
+        double response = 0.5;
+        for (uint32_t p = 0; p < pairs; p++)
+            response += 2 * taps[p] * cos(2 * pi * f * (2 * p + 1));
+        if (fabs(response) > 3.16e-4)
+            return false;
+    }
+    return true;
+}
+
+// Allocates the filters, buffers and plan of a zoom FFT
+int fft_zoom_init(struct fft_zoom *zoom, struct fft *fft, float center, uint32_t decimation, uint32_t nfft)
+{
+    zoom->filter = NULL;
+    zoom->samples = NULL;
+    zoom->history = NULL;
+    zoom->cfg = NULL;
+    zoom->buffer = NULL;
+    if (decimation < 2 || decimation > (1u << FFT_ZOOM_MAX_STAGES) || (decimation & (decimation - 1)) ||
+        nfft < 2 || nfft % 2 || center < 0 || center > fft->S / 2.0f)
+        return -1;
+
+    zoom->center = center;
+    zoom->decimation = decimation;
+    zoom->nfft = nfft;
+    zoom->count = 0;
+    zoom->oscillator.r = 1;
+    zoom->oscillator.i = 0;
+    zoom->step = 0;
+    const double pi = 3.14159265358979323846;
+    const double omega = 2 * pi * (double)center / fft->S;
+    for (uint32_t k = 0; k < FFT_ZOOM_STEPS; k++)
+    {
+        zoom->steps[k].r = (kiss_fft_scalar)cos(omega * k);
+        zoom->steps[k].i = (kiss_fft_scalar)-sin(omega * k);
+    }
+    zoom->rotation.r = (kiss_fft_scalar)cos(omega * FFT_ZOOM_STEPS);
+    zoom->rotation.i = (kiss_fft_scalar)-sin(omega * FFT_ZOOM_STEPS);
+
+    // A stage only has to keep out what would alias into the inner 0.8 of
+    // the final band, |f| < 0.4*S/D, which at its input rate reaches edge.
+    // Each takes the shortest half-band that does: maximally flat for the
+    // early stages, whose band is narrow, and Kaiser windowed for the last
+    // ones, whose transition bands are
+    double design[FFT_ZOOM_MAX_PAIRS];
+    uint32_t taps = 0;
+    uint32_t length = 0;
+    zoom->stages = 0;
+    zoom->settle = 1;
+    for (uint32_t rate = 1; rate < decimation; rate *= 2)
+    {
+        struct fft_zoom_stage *stage = &zoom->stage[zoom->stages++];
+        double edge = 0.4 * rate / decimation;
+        stage->pairs = 0;
+        while (stage->pairs < FFT_ZOOM_MAX_PAIRS)
+        {
+            stage->pairs++;
+            stage->flat = true;
+            fft_zoom_design(stage->pairs, stage->flat, design);
+            if (fft_zoom_meets(stage->pairs, design, edge))
+                break;
+            stage->flat = false;
+            fft_zoom_design(stage->pairs, stage->flat, design);
+            if (fft_zoom_meets(stage->pairs, design, edge))
+                break;
+        }
+        stage->fill = 4 * stage->pairs - 2;
+        taps += stage->pairs;
+        // The history, a block of inputs at this stage's rate, and one
+        // waiting from the previous block
+        if (rate > 1)
+            length += stage->fill + FFT_ZOOM_STEPS / rate + 1;
+        zoom->settle += stage->fill * rate;
+    }
+    const struct fft_zoom_stage *first = &zoom->stage[0];
+    // The first stage's taps come twice, and the Hann window follows them
+    taps += first->pairs + nfft;
+
+    zoom->filter = KISS_FFT_MALLOC(sizeof(float) * taps);
+    zoom->samples = KISS_FFT_MALLOC(sizeof(float) * (first->fill + FFT_ZOOM_STEPS + 1));
+    zoom->history = length ? KISS_FFT_MALLOC(sizeof(kiss_fft_cpx) * length) : NULL;
+    zoom->cfg = kiss_fft_alloc(nfft, 0, NULL, NULL);
+    zoom->buffer = KISS_FFT_MALLOC(sizeof(kiss_fft_cpx) * nfft);
+    if (!zoom->filter || !zoom->samples || (length && !zoom->history) || !zoom->cfg || !zoom->buffer)
+    {
+        fft_zoom_destroy(zoom);
+        return -1;
+    }
+    memset(zoom->samples, 0, sizeof(float) * (first->fill + FFT_ZOOM_STEPS + 1));
+    if (length)
+        memset(zoom->history, 0, sizeof(kiss_fft_cpx) * length);
+
+    float *filter = zoom->filter;
+    kiss_fft_cpx *history = zoom->history;
+    for (uint32_t s = 0, rate = 1; s < zoom->stages; s++, rate *= 2)
+    {
+        struct fft_zoom_stage *stage = &zoom->stage[s];
+        uint32_t span = 4 * stage->pairs - 2;
+        fft_zoom_design(stage->pairs, stage->flat, design);
+        for (uint32_t p = 0; p < stage->pairs; p++)
+            filter[p] = (float)design[p];
+        stage->taps = filter;
+        if (s == 0)
+        {
+            // The first stage filters the real input before it is mixed
+            // down, so its taps are shifted up to the center instead: the
+            // tap at offset m times cos(omega*m), then times sin(omega*m)
+            for (uint32_t p = 0; p < stage->pairs; p++)
+            {
+                double m = 2 * p + 1;
+                filter[p] = (float)(design[p] * cos(omega * m));
+                filter[stage->pairs + p] = (float)(design[p] * sin(omega * m));
+            }
+            filter += 2 * stage->pairs;
+            stage->input = NULL;
+        }
+        else
+        {
+            filter += stage->pairs;
+            stage->input = history;
+            history += span + FFT_ZOOM_STEPS / rate + 1;
+        }
+    }
+
+    zoom->window = filter;
+    for (uint32_t k = 0; k < nfft; k++)
+        zoom->window[k] = (float)(0.5 - 0.5 * cos(2 * pi * k / nfft));
+    return 0;
+}
+
+// Frees the filters, buffers and plan of a zoom FFT
+void fft_zoom_destroy(struct fft_zoom *zoom)
+{
+    KISS_FFT_FREE(zoom->filter);
+    KISS_FFT_FREE(zoom->samples);
+    KISS_FFT_FREE(zoom->history);
+    kiss_fft_free(zoom->cfg);
+    KISS_FFT_FREE(zoom->buffer);
+    zoom->filter = NULL;
+    zoom->samples = NULL;
+    zoom->history = NULL;
+    zoom->cfg = NULL;
+    zoom->buffer = NULL;
+}
+
+// Filters the real samples appended to the first stage, one output every
+// other input, mixes the outputs down to baseband, and keeps the history the
+// next block needs
+static size_t fft_zoom_first_process(struct fft_zoom *zoom, size_t block, kiss_fft_cpx out[])
+{
+    struct fft_zoom_stage *stage = &zoom->stage[0];
+    const uint32_t pairs = stage->pairs;
+    const uint32_t span = 4 * pairs - 2;
+    const float *cosine = stage->taps;
+    const float *sine = stage->taps + pairs;
+    float *input = zoom->samples;
+    size_t produced = stage->fill > span ? (stage->fill - span) / 2 : 0;
+    // Mixing after the filter gives the same outputs as mixing before it,
+    // times a constant phase: for a window centered on sample c,
+    // sum h[d]*x[c+d]*exp(-j*omega*(c+d)) is exp(-j*omega*c) times
+    // 0.5*x[c] + sum h[m]*(cos(omega*m)*(x[c+m] + x[c-m]) + j*sin(omega*m)*(x[c-m] - x[c+m]))
+    // over the odd m. So the oscillator runs at half the input rate, and the
+    // sums take real samples. Each output takes the oscillator one sample
+    // past its window, which is always in this block: the window of output n
+    // ends at input 2n+span, and the block starts at input fill - block
+    const kiss_fft_cpx base = zoom->oscillator;
+    const kiss_fft_cpx *steps = zoom->steps + zoom->step + span + 1 - (stage->fill - block);
+    for (size_t n = 0; n < produced; n++)
+    {
+        // The window is input[2n..2n+span]
+        const float *center = input + 2 * n + span / 2;
+        float r = 0.5f * center[0];
+        float i = 0;
+        for (uint32_t p = 0; p < pairs; p++)
+        {
+            const float early = *(center - (2 * p + 1));
+            const float late = *(center + (2 * p + 1));
+            r += cosine[p] * (early + late);
+            i += sine[p] * (early - late);
+        }
+        const kiss_fft_cpx step = steps[2 * n];
+        float oscillator_r = base.r * step.r - base.i * step.i;
+        float oscillator_i = base.r * step.i + base.i * step.r;
+        out[n].r = r * oscillator_r - i * oscillator_i;
+        out[n].i = r * oscillator_i + i * oscillator_r;
+    }
+    stage->fill -= 2 * produced;
+    memmove(input, input + 2 * produced, sizeof(float) * stage->fill);
+    return produced;
+}
+
+// Filters the inputs appended to a stage, one output every other input, and
+// keeps the history the next block needs
+static size_t fft_zoom_stage_process(struct fft_zoom_stage *stage, kiss_fft_cpx out[])
+{
+    const uint32_t pairs = stage->pairs;
+    const uint32_t span = 4 * pairs - 2;
+    const float *taps = stage->taps;
+    kiss_fft_cpx *input = stage->input;
+    size_t produced = stage->fill > span ? (stage->fill - span) / 2 : 0;
+    for (size_t n = 0; n < produced; n++)
+    {
+        // The window is input[2n..2n+span]
+        const kiss_fft_cpx *center = input + 2 * n + span / 2;
+        float r = 0.5f * center[0].r;
+        float i = 0.5f * center[0].i;
+        for (uint32_t p = 0; p < pairs; p++)
+        {
+            const kiss_fft_cpx early = *(center - (2 * p + 1));
+            const kiss_fft_cpx late = *(center + (2 * p + 1));
+            r += taps[p] * (early.r + late.r);
+            i += taps[p] * (early.i + late.i);
+        }
+        out[n].r = r;
+        out[n].i = i;
+    }
+    stage->fill -= 2 * produced;
+    memmove(input, input + 2 * produced, sizeof(kiss_fft_cpx) * stage->fill);
+    return produced;
+}
+
+// Filters, mixes and decimates samples into the transform buffer
+size_t fft_zoom_push(struct fft_zoom *zoom, const kiss_fft_scalar in[], size_t count)
+{
+    size_t used = 0;
+    while (used < count && zoom->count < zoom->nfft)
+    {
+        // The inputs that make exactly the outputs still missing, so none
+        // past a full buffer is consumed
+        size_t needed = zoom->nfft - zoom->count;
+        for (uint32_t s = zoom->stages; s-- > 0;)
+        {
+            const struct fft_zoom_stage *stage = &zoom->stage[s];
+            needed = 2 * needed - (stage->fill - (4 * stage->pairs - 2));
+        }
+        // Blocks stop at the end of the oscillator table, so the first
+        // stage's outputs all take their phase from one oscillator value
+        size_t block = count - used;
+        if (block > needed)
+            block = needed;
+        if (block > FFT_ZOOM_STEPS - zoom->step)
+            block = FFT_ZOOM_STEPS - zoom->step;
+
+        struct fft_zoom_stage *first = &zoom->stage[0];
+        float *samples = zoom->samples + first->fill;
+        for (size_t n = 0; n < block; n++)
+            samples[n] = in[used + n];
+        first->fill += block;
+        used += block;
+
+        // Each stage appends its outputs to the next one's inputs, and the
+        // last one to the transform buffer
+        for (uint32_t s = 0; s < zoom->stages; s++)
+        {
+            bool last = s + 1 == zoom->stages;
+            uint32_t *fill = last ? &zoom->count : &zoom->stage[s + 1].fill;
+            kiss_fft_cpx *out = (last ? zoom->buffer : zoom->stage[s + 1].input) + *fill;
+            *fill += s == 0 ? fft_zoom_first_process(zoom, block, out) : fft_zoom_stage_process(&zoom->stage[s], out);
+        }
+
+        zoom->step += block;
+        if (zoom->step == FFT_ZOOM_STEPS)
+        {
+            const kiss_fft_cpx base = zoom->oscillator;
+            kiss_fft_cpx next;
+            next.r = base.r * zoom->rotation.r - base.i * zoom->rotation.i;
+            next.i = base.r * zoom->rotation.i + base.i * zoom->rotation.r;
+            // Rounding makes the oscillator drift off the unit circle, pull
+            // it back
+            float magnitude = sqrtf(next.r * next.r + next.i * next.i);
+            zoom->oscillator.r = next.r / magnitude;
+            zoom->oscillator.i = next.i / magnitude;
+            zoom->step = 0;
+        }
+    }
+    return used;
+}
+
+// Whether a full buffer of decimated samples is waiting
+bool fft_zoom_ready(const struct fft_zoom *zoom)
+{
+    return zoom->count == zoom->nfft;
+}
+
+// Windows and transforms the decimated samples, centering the spectrum
+void fft_zoom_spectrum(struct fft_zoom *zoom, kiss_fft_cpx out[])
+{
+    for (uint32_t k = 0; k < zoom->nfft; k++)
+    {
+        zoom->buffer[k].r *= zoom->window[k];
+        zoom->buffer[k].i *= zoom->window[k];
+    }
+    kiss_fft(zoom->cfg, zoom->buffer, out);
+    zoom->count = 0;
+
+    // Negative frequencies first, so the spectrum runs low to high
+    uint32_t half = zoom->nfft / 2;
+    for (uint32_t k = 0; k < half; k++)
+    {
+        kiss_fft_cpx t = out[k];
+        out[k] = out[k + half];
+        out[k + half] = t;
+    }
+}
+
+// Frequency of a point of a zoomed spectrum
+float fft_zoom_frequency(const struct fft_zoom *zoom, struct fft *fft, uint32_t bin)
+{
+    float width = (float)fft->S / ((float)zoom->decimation * zoom->nfft);
+    return zoom->center + ((float)bin - zoom->nfft / 2.0f) * width;
+}
+
+// Frequency of a local maximum of a zoomed spectrum, interpolated between bins
+float fft_zoom_interpolate(const struct fft_zoom *zoom, struct fft *fft, const kiss_fft_cpx out[], uint32_t bin)
+{
+    const kiss_fft_cpx *p = &out[bin];
+    float left = logf(p[-1].r * p[-1].r + p[-1].i * p[-1].i + 1e-30f);
+    float center = logf(p[0].r * p[0].r + p[0].i * p[0].i + 1e-30f);
+    float right = logf(p[1].r * p[1].r + p[1].i * p[1].i + 1e-30f);
+    float denominator = left - 2 * center + right;
+    float offset = denominator != 0 ? 0.5f * (left - right) / denominator : 0;
+    return fft_zoom_frequency(zoom, fft, bin) + offset * (float)fft->S / ((float)zoom->decimation * zoom->nfft);
+}
+
+// Strongest frequency of a zoomed spectrum, interpolated between bins
+float fft_zoom_peak(const struct fft_zoom *zoom, struct fft *fft, const kiss_fft_cpx out[])
+{
+    // The outer tenth on each side is past the filter cutoff and takes the
+    // aliases of its transition band
+    uint32_t first = zoom->nfft / 10;
+    uint32_t last = zoom->nfft - first;
+    uint32_t peak = first;
+    float max = 0;
+    for (uint32_t k = first; k < last; k++)
+    {
+        float power = out[k].r * out[k].r + out[k].i * out[k].i;
+        if (power > max)
+        {
+            max = power;
+            peak = k;
+        }
+    }
+
+    if (peak > first && peak < last - 1)
+        return fft_zoom_interpolate(zoom, fft, out, peak);
+    return fft_zoom_frequency(zoom, fft, peak);
+}
+
+// Allocates the previous spectrum and sets the default thresholds
+int fft_onset_init(struct fft_onset *onset, struct fft *fft)
+{
+    onset->bins = fft->N / 2 + 1;
+    onset->multiplier = 1.5f;
+    onset->minimum = 0.1f;
+    onset->hold = 2;
+    onset->previous = KISS_FFT_MALLOC(sizeof(float) * onset->bins);
+    fft_onset_reset(onset);
+    return onset->previous ? 0 : -1;
+}
+
+// Frees the previous spectrum
+void fft_onset_destroy(struct fft_onset *onset)
+{
+    KISS_FFT_FREE(onset->previous);
+    onset->previous = NULL;
+}
+
+// Starts over as if no frame had been seen
+void fft_onset_reset(struct fft_onset *onset)
+{
+    onset->head = 0;
+    onset->filled = 0;
+    onset->primed = false;
+    onset->quiet = 0;
+}
+
+// Median of the flux history, by insertion sort of a copy
+static float fft_onset_median(const struct fft_onset *onset)
+{
+    float sorted[FFT_ONSET_HISTORY];
+    for (uint8_t i = 0; i < onset->filled; i++)
+    {
+        float value = onset->history[i];
+        uint8_t j = i;
+        for (; j > 0 && sorted[j - 1] > value; j--)
+            sorted[j] = sorted[j - 1];
+        sorted[j] = value;
+    }
+    return sorted[onset->filled / 2];
+}
+
+// Computes the rectified flux against the previous frame, then keeps this one
+bool fft_onset_update(struct fft_onset *onset, const kiss_fft_cpx out[], uint32_t time, struct fft_onset_record *record)
+{
+    float flux = 0;
+    float largest = 0;
+    uint32_t bin = 0;
+    for (uint32_t j = 0; j < onset->bins; j++)
+    {
+        // ln(1 + |X|^2) / 2, about the log magnitude but finite for silence
+        float power = (float)out[j].r * out[j].r + (float)out[j].i * out[j].i;
+        float magnitude = 0.5f * logf(1.0f + power);
+        float rise = magnitude - onset->previous[j];
+        onset->previous[j] = magnitude;
+        if (rise > 0)
+        {
+            flux += rise;
+            if (rise > largest)
+            {
+                largest = rise;
+                bin = j;
+            }
+        }
+    }
+    flux /= onset->bins;
+    if (!onset->primed)
+    {
+        onset->primed = true;
+        return false;
+    }
+
+    bool detected = false;
+    if (onset->quiet)
+        onset->quiet--;
+    else if (onset->filled > FFT_ONSET_HISTORY / 2)
+    {
+        float threshold = onset->multiplier * fft_onset_median(onset);
+        if (threshold < onset->minimum)
+            threshold = onset->minimum;
+        if (flux > threshold)
+        {
+            float strength = 100 * flux / threshold;
+            record->time = time;
+            record->strength = strength > UINT16_MAX ? UINT16_MAX : (uint16_t)strength;
+            record->bin = (uint16_t)bin;
+            onset->quiet = onset->hold;
+            detected = true;
+        }
+    }
+
+    onset->history[onset->head] = flux;
+    onset->head = (onset->head + 1) % FFT_ONSET_HISTORY;
+    if (onset->filled < FFT_ONSET_HISTORY)
+        onset->filled++;
+    return detected;
+}
+
 // read the audio file and get the frequency with the highest amplitude
 uint32_t fft_read(struct fft *fft, FILE * fp, uint16_t buffer[])
 {
   // save contents of out.raw to a buffer
   fread(buffer, 2, fft->N, fp);
   
-  // FFT transform
-  kiss_fft_scalar in[fft->N];
-  kiss_fft_cpx out[fft->N / 2 + 1];
+  // FFT transform, the buffers are too large for the stack
+  kiss_fft_scalar *in = KISS_FFT_MALLOC(sizeof(kiss_fft_scalar) * fft->N);
+  kiss_fft_cpx *out = KISS_FFT_MALLOC(sizeof(kiss_fft_cpx) * (fft->N / 2 + 1));
   size_t i;
+  uint32_t toReturn = 0;
 
-  for (i = 0; i < fft->N; i++){
-    in[i] = buffer[i];
+  if (in && out)
+  {
+    for (i = 0; i < fft->N; i++){
+      in[i] = buffer[i];
+    }
+    toReturn = TestFftReal(fft, in, out);
   }
-  uint32_t toReturn = TestFftReal(fft, in, out);
+  KISS_FFT_FREE(in);
+  KISS_FFT_FREE(out);
   return toReturn;
 }
 
@@ -112,4 +910,4 @@ uint32_t fft_read(struct fft *fft, FILE * fp, uint16_t buffer[])
 
 //     return 0;
     
-// }
\ No newline at end of file
+// }
@@ -0,0 +1,83 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+#include <fft_decimate.h>
+#include <fft.h>
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define CENTER ((FFT_DECIMATE_TAPS - 1) / 2)
+
+int fft_decimate_init(struct fft_decimate *decimate, struct fft *fft, uint8_t factor)
+{
+	memset(decimate, 0, sizeof(*decimate));
+	if (factor != 2 && factor != 4 && factor != 8)
+		return -1;
+	decimate->factor = factor;
+	decimate->stages = factor == 2 ? 1 : factor == 4 ? 2 : 3;
+
+	// Windowed sinc cut off at a quarter of the rate: 0.5 at the center and
+	// 0 at every even offset from it, so only the odd offsets are kept
+	const double pi = 3.14159265358979323846;
+	double sum = 0.0;
+	double pairs[FFT_DECIMATE_PAIRS];
+	for (uint32_t p = 0; p < FFT_DECIMATE_PAIRS; ++p)
+	{
+		double m = 2 * p + 1;
+		double x = 2 * pi * (CENTER + m) / (FFT_DECIMATE_TAPS - 1);
+		double window = 0.42 - 0.5 * cos(x) + 0.08 * cos(2 * x);
+		pairs[p] = sin(pi * m / 2) / (pi * m) * window;
+		sum += 2 * pairs[p];
+	}
+	// Unity gain at DC
+	for (uint32_t p = 0; p < FFT_DECIMATE_PAIRS; ++p)
+		decimate->pairs[p] = (float)(pairs[p] * 0.5 / sum);
+
+	decimate->rate = fft->S;
+	fft->S /= factor;
+	fft->D *= factor;
+	return 0;
+}
+
+void fft_decimate_reset(struct fft_decimate *decimate)
+{
+	memset(decimate->stage, 0, sizeof(decimate->stage));
+}
+
+// Takes one input, and returns true with an output every other one
+static bool fft_decimate_stage_push(const struct fft_decimate *decimate, struct fft_decimate_stage *stage, float in, float *out)
+{
+	stage->history[stage->head] = in;
+	stage->history[stage->head + FFT_DECIMATE_TAPS] = in;
+	if (++stage->head == FFT_DECIMATE_TAPS)
+		stage->head = 0;
+	stage->odd = !stage->odd;
+	if (stage->odd)
+		return false;
+
+	// The oldest input is at head, so the window is history[head..head+taps)
+	const float *center = stage->history + stage->head + CENTER;
+	float sum = 0.5f * center[0];
+	for (uint32_t p = 0; p < FFT_DECIMATE_PAIRS; ++p)
+		sum += decimate->pairs[p] * (center[-(int32_t)(2 * p + 1)] + center[2 * p + 1]);
+	*out = sum;
+	return true;
+}
+
+size_t fft_decimate_process(struct fft_decimate *decimate, const int16_t in[], size_t count, kiss_fft_scalar out[])
+{
+	size_t produced = 0;
+	for (size_t n = 0; n < count; ++n)
+	{
+		float sample = in[n];
+		uint8_t s = 0;
+		while (s < decimate->stages && fft_decimate_stage_push(decimate, &decimate->stage[s], sample, &sample))
+			++s;
+		if (s == decimate->stages)
+			out[produced++] = sample;
+	}
+	return produced;
+}
@@ -0,0 +1,122 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+#include <fft_filter.h>
+#include "kiss_fftr.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+int fft_filter_init(struct fft_filter *filter, const kiss_fft_scalar taps[], uint32_t count, uint32_t nfft)
+{
+	memset(filter, 0, sizeof(*filter));
+	if (!count || nfft <= count || (nfft & 1))
+		return -1;
+
+	filter->nfft = nfft;
+	filter->taps = count;
+	filter->block = nfft - count + 1;
+	filter->forward = kiss_fftr_alloc(nfft, 0, NULL, NULL);
+	filter->inverse = kiss_fftr_alloc(nfft, 1, NULL, NULL);
+	filter->spectrum = KISS_FFT_MALLOC(sizeof(kiss_fft_cpx) * (nfft / 2 + 1));
+	filter->work = KISS_FFT_MALLOC(sizeof(kiss_fft_cpx) * (nfft / 2 + 1));
+	filter->buffer = KISS_FFT_MALLOC(sizeof(kiss_fft_scalar) * nfft);
+	filter->overlap = KISS_FFT_MALLOC(sizeof(kiss_fft_scalar) * count);
+	if (!filter->forward || !filter->inverse || !filter->spectrum ||
+		!filter->work || !filter->buffer || !filter->overlap)
+	{
+		fft_filter_destroy(filter);
+		return -1;
+	}
+
+	// kiss_fftri does not scale, so fold the 1/nfft into the filter spectrum
+	memset(filter->buffer, 0, sizeof(kiss_fft_scalar) * nfft);
+	const float scale = 1.0f / nfft;
+	for (uint32_t i = 0; i < count; ++i)
+		filter->buffer[i] = taps[i] * scale;
+	kiss_fftr(filter->forward, filter->buffer, filter->spectrum);
+
+	fft_filter_reset(filter);
+	return 0;
+}
+
+void fft_filter_destroy(struct fft_filter *filter)
+{
+	kiss_fftr_free(filter->forward);
+	kiss_fftr_free(filter->inverse);
+	KISS_FFT_FREE(filter->spectrum);
+	KISS_FFT_FREE(filter->work);
+	KISS_FFT_FREE(filter->buffer);
+	KISS_FFT_FREE(filter->overlap);
+	memset(filter, 0, sizeof(*filter));
+}
+
+void fft_filter_reset(struct fft_filter *filter)
+{
+	memset(filter->overlap, 0, sizeof(kiss_fft_scalar) * filter->taps);
+}
+
+void fft_filter_process(struct fft_filter *filter, const kiss_fft_scalar in[], kiss_fft_scalar out[])
+{
+	const uint32_t nfft = filter->nfft;
+	const uint32_t block = filter->block;
+	const uint32_t tail = filter->taps - 1;
+	kiss_fft_scalar *buffer = filter->buffer;
+	kiss_fft_scalar *overlap = filter->overlap;
+
+	memcpy(buffer, in, sizeof(kiss_fft_scalar) * block);
+	memset(buffer + block, 0, sizeof(kiss_fft_scalar) * (nfft - block));
+	kiss_fftr(filter->forward, buffer, filter->work);
+
+	for (uint32_t k = 0; k < nfft / 2 + 1; ++k)
+	{
+		kiss_fft_cpx x = filter->work[k];
+		kiss_fft_cpx h = filter->spectrum[k];
+		filter->work[k].r = x.r * h.r - x.i * h.i;
+		filter->work[k].i = x.r * h.i + x.i * h.r;
+	}
+	kiss_fftri(filter->inverse, filter->work, buffer);
+
+	// The first taps-1 outputs still need the tail of the previous block
+	for (uint32_t i = 0; i < block; ++i)
+		out[i] = buffer[i] + (i < tail ? overlap[i] : 0);
+
+	// Carry this block's tail forwards. When the block is shorter than the
+	// tail, part of the old tail is still pending and is carried along too;
+	// overlap[block + i] is always read before it can be overwritten.
+	for (uint32_t i = 0; i < tail; ++i)
+		overlap[i] = buffer[block + i] + (block + i < tail ? overlap[block + i] : 0);
+}
+
+void fft_filter_direct(const kiss_fft_scalar taps[], uint32_t tap_count, const kiss_fft_scalar in[], kiss_fft_scalar out[], uint32_t count)
+{
+	for (uint32_t n = 0; n < count; ++n)
+	{
+		// Newest sample of this output's window
+		const kiss_fft_scalar *x = in + n + tap_count - 1;
+		kiss_fft_scalar acc = 0;
+		for (uint32_t k = 0; k < tap_count; ++k)
+			acc += taps[k] * *(x - k);
+		out[n] = acc;
+	}
+}
+
+void fft_filter_bandpass(kiss_fft_scalar taps[], uint32_t count, float low, float high, uint32_t rate)
+{
+	const double pi = 3.14159265358979323846;
+	const double fl = (double)low / rate;
+	const double fh = (double)high / rate;
+	const double middle = (count - 1) / 2.0;
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		double n = i - middle;
+		double ideal;
+		if (n == 0)
+			ideal = 2 * (fh - fl);
+		else
+			ideal = (sin(2 * pi * fh * n) - sin(2 * pi * fl * n)) / (pi * n);
+		double window = count > 1 ? 0.54 - 0.46 * cos(2 * pi * i / (count - 1)) : 1;
+		taps[i] = ideal * window;
+	}
+}
@@ -0,0 +1,165 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+#include <fft_mel.h>
+#include <fft.h>
+#include "kiss_fftr.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+static float hz_to_mel(float hz)
+{
+	return 2595.0f * log10f(1.0f + hz / 700.0f);
+}
+
+static float mel_to_hz(float mel)
+{
+	return 700.0f * (powf(10.0f, mel / 2595.0f) - 1.0f);
+}
+
+#ifdef FIXED_POINT
+static fft_mel_weight to_weight(float weight)
+{
+	long q = lrintf(weight * 32768.0f);
+	if (q > 32767)
+		return 32767;
+	if (q < -32768)
+		return -32768;
+	return (fft_mel_weight)q;
+}
+
+// log2(1 + i/16) in Q16, to interpolate the fraction of log2 between
+static const uint16_t log2_table[17] = {
+	0, 5732, 11136, 16248, 21098, 25711, 30109, 34312, 38336,
+	42196, 45904, 49472, 52911, 56229, 59434, 62534, 65535,
+};
+
+// log2 of x in Q16, x at least 1
+static int32_t log2_q16(uint64_t x)
+{
+	int32_t exponent = 63 - __builtin_clzll(x);
+	// Mantissa in [1, 2) as Q20, then table index and Q16 remainder
+	uint32_t mantissa = exponent >= 20 ?
+		(uint32_t)(x >> (exponent - 20)) : (uint32_t)(x << (20 - exponent));
+	uint32_t index = (mantissa >> 16) & 0xF;
+	uint32_t rest = mantissa & 0xFFFF;
+	int32_t fraction = log2_table[index] +
+		(int32_t)(((log2_table[index + 1] - log2_table[index]) * rest) >> 16);
+	return exponent * 65536 + fraction;
+}
+#else
+static fft_mel_weight to_weight(float weight)
+{
+	return weight;
+}
+#endif
+
+int fft_mel_init(struct fft_mel *mel, struct fft *fft, uint8_t bands, uint8_t coeffs, float low_hz, float high_hz)
+{
+	memset(mel, 0, sizeof(*mel));
+	uint32_t bins = fft->N / 2 + 1;
+	if (bins > FFT_MEL_MAX_BINS || bands < 2 || bands > FFT_MEL_MAX_BANDS ||
+		coeffs > bands || coeffs > FFT_MEL_MAX_COEFFS ||
+		low_hz < 0.0f || high_hz <= low_hz || high_hz > fft->S / 2.0f)
+		return -1;
+
+	mel->bins = bins;
+	mel->bands = bands;
+	mel->coeffs = coeffs;
+
+	// Band b rises from edges[b] to edges[b+1] and falls to edges[b+2]
+	float edges[FFT_MEL_MAX_BANDS + 2];
+	float low_mel = hz_to_mel(low_hz);
+	float step = (hz_to_mel(high_hz) - low_mel) / (bands + 1);
+	for (uint32_t e = 0; e < bands + 2u; ++e)
+		edges[e] = mel_to_hz(low_mel + step * e);
+
+	const float bin_hz = (float)fft->S / fft->N;
+	uint16_t offset = 0;
+	for (uint32_t b = 0; b < bands; ++b)
+	{
+		float lo = edges[b], center = edges[b + 1], hi = edges[b + 2];
+		mel->starts[b] = (uint16_t)(floorf(lo / bin_hz) + 1);
+		mel->offsets[b] = offset;
+		for (uint32_t k = mel->starts[b]; k < bins && k * bin_hz < hi; ++k)
+		{
+			float f = k * bin_hz;
+			float weight = f <= center ? (f - lo) / (center - lo) : (hi - f) / (hi - center);
+			mel->weights[offset++] = to_weight(weight);
+			mel->counts[b]++;
+		}
+		if (!mel->counts[b])
+		{
+			mel->starts[b] = (uint16_t)lrintf(center / bin_hz);
+			mel->weights[offset++] = to_weight(1.0f);
+			mel->counts[b] = 1;
+		}
+	}
+
+	// Orthonormal DCT-II
+	const float pi = 3.14159265358979323846f;
+	for (uint32_t c = 0; c < coeffs; ++c)
+	{
+		float scale = sqrtf((c ? 2.0f : 1.0f) / bands);
+		for (uint32_t b = 0; b < bands; ++b)
+			mel->dct[c * bands + b] = to_weight(scale * cosf(pi * c * (b + 0.5f) / bands));
+	}
+	return 0;
+}
+
+void fft_mel_energies(struct fft_mel *mel, const kiss_fft_cpx out[])
+{
+	// Every bin feeds up to two bands, so square it once
+	for (uint32_t k = 0; k < mel->bins; ++k)
+	{
+#ifdef FIXED_POINT
+		mel->power[k] = (uint32_t)((int32_t)out[k].r * out[k].r) +
+			(uint32_t)((int32_t)out[k].i * out[k].i);
+#else
+		mel->power[k] = out[k].r * out[k].r + out[k].i * out[k].i;
+#endif
+	}
+
+	for (uint32_t b = 0; b < mel->bands; ++b)
+	{
+		const fft_mel_weight *weights = mel->weights + mel->offsets[b];
+		const fft_mel_power *power = mel->power + mel->starts[b];
+#ifdef FIXED_POINT
+		// Power is Q30 relative to full scale, so the sum is too
+		uint64_t sum = 0;
+		for (uint32_t i = 0; i < mel->counts[b]; ++i)
+			sum += (uint64_t)power[i] * (uint16_t)weights[i];
+		sum >>= 15;
+		// 10 * log10(2) in Q16, to turn Q16 log2 into Q8 dB
+		int64_t log2 = log2_q16(sum ? sum : 1) - 30 * 65536;
+		mel->energies[b] = (fft_mel_value)((log2 * 197283) >> 24);
+#else
+		float sum = 0.0f;
+		for (uint32_t i = 0; i < mel->counts[b]; ++i)
+			sum += power[i] * weights[i];
+		mel->energies[b] = 10.0f * log10f(sum + 1.0f);
+#endif
+	}
+}
+
+void fft_mel_mfcc(struct fft_mel *mel, const kiss_fft_cpx out[], fft_mel_value mfcc[])
+{
+	fft_mel_energies(mel, out);
+	for (uint32_t c = 0; c < mel->coeffs; ++c)
+	{
+		const fft_mel_weight *row = mel->dct + c * mel->bands;
+#ifdef FIXED_POINT
+		int64_t sum = 0;
+		for (uint32_t b = 0; b < mel->bands; ++b)
+			sum += (int64_t)mel->energies[b] * row[b];
+		mfcc[c] = (fft_mel_value)(sum >> 15);
+#else
+		float sum = 0.0f;
+		for (uint32_t b = 0; b < mel->bands; ++b)
+			sum += mel->energies[b] * row[b];
+		mfcc[c] = sum;
+#endif
+	}
+}
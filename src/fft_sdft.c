@@ -0,0 +1,142 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+#include <fft_sdft.h>
+#include "kiss_fft.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+int fft_sdft_init(struct fft_sdft *sdft, uint32_t n, const uint32_t bins[], uint8_t count, enum fft_sdft_mode mode)
+{
+	memset(sdft, 0, sizeof(*sdft));
+	if (n < 2 || !count || count > FFT_SDFT_MAX_BINS)
+		return -1;
+	for (uint8_t i = 0; i < count; ++i)
+	{
+		if (bins[i] >= n)
+			return -1;
+		sdft->bins[i] = bins[i];
+	}
+
+	sdft->mode = mode;
+	sdft->n = n;
+	sdft->count = count;
+	sdft->twiddles = KISS_FFT_MALLOC(sizeof(kiss_fft_cpx) * n);
+	sdft->history = KISS_FFT_MALLOC(sizeof(float) * n);
+	if (!sdft->twiddles || !sdft->history)
+	{
+		fft_sdft_destroy(sdft);
+		return -1;
+	}
+
+	const double pi = 3.14159265358979323846;
+	for (uint32_t i = 0; i < n; ++i)
+	{
+		double phase = -2.0 * pi * i / n;
+		sdft->twiddles[i].r = (kiss_fft_scalar)cos(phase);
+		sdft->twiddles[i].i = (kiss_fft_scalar)sin(phase);
+	}
+	fft_sdft_reset(sdft);
+	return 0;
+}
+
+void fft_sdft_destroy(struct fft_sdft *sdft)
+{
+	KISS_FFT_FREE(sdft->twiddles);
+	KISS_FFT_FREE(sdft->history);
+	sdft->twiddles = NULL;
+	sdft->history = NULL;
+}
+
+void fft_sdft_reset(struct fft_sdft *sdft)
+{
+	memset(sdft->history, 0, sizeof(float) * sdft->n);
+	memset(sdft->values, 0, sizeof(sdft->values));
+	memset(sdft->phase, 0, sizeof(sdft->phase));
+	memset(sdft->active, 0, sizeof(sdft->active));
+	sdft->head = 0;
+}
+
+void fft_sdft_push(struct fft_sdft *sdft, float sample)
+{
+	float delta = sample - sdft->history[sdft->head];
+	sdft->history[sdft->head] = sample;
+	if (++sdft->head == sdft->n)
+		sdft->head = 0;
+
+	for (uint8_t i = 0; i < sdft->count; ++i)
+	{
+		kiss_fft_cpx *value = &sdft->values[i];
+		if (sdft->mode == FFT_SDFT_MODULATED)
+		{
+			// Y_k += (x(n) - x(n-N)) * W^(k*n)
+			const kiss_fft_cpx *w = &sdft->twiddles[sdft->phase[i]];
+			value->r += delta * w->r;
+			value->i += delta * w->i;
+			sdft->phase[i] += sdft->bins[i];
+			if (sdft->phase[i] >= sdft->n)
+				sdft->phase[i] -= sdft->n;
+		}
+		else
+		{
+			// X_k = (X_k + x(n) - x(n-N)) * W^-k
+			const kiss_fft_cpx *w = &sdft->twiddles[sdft->bins[i]];
+			float r = value->r + delta;
+			float im = value->i;
+			value->r = r * w->r + im * w->i;
+			value->i = im * w->r - r * w->i;
+		}
+	}
+}
+
+bool fft_sdft_push_block(struct fft_sdft *sdft, const int16_t samples[], size_t count, size_t *used, uint8_t *bin)
+{
+	for (size_t n = 0; n < count; ++n)
+	{
+		fft_sdft_push(sdft, samples[n]);
+		for (uint8_t i = 0; i < sdft->count; ++i)
+		{
+			if (sdft->threshold[i] <= 0)
+				continue;
+			float power = fft_sdft_power(sdft, i);
+			if (sdft->active[i])
+				sdft->active[i] = power >= sdft->threshold[i] / 2;
+			else if (power >= sdft->threshold[i])
+			{
+				sdft->active[i] = true;
+				if (used)
+					*used = n + 1;
+				if (bin)
+					*bin = i;
+				return true;
+			}
+		}
+	}
+	if (used)
+		*used = count;
+	return false;
+}
+
+float fft_sdft_power(const struct fft_sdft *sdft, uint8_t index)
+{
+	const kiss_fft_cpx *value = &sdft->values[index];
+	return value->r * value->r + value->i * value->i;
+}
+
+kiss_fft_cpx fft_sdft_bin(const struct fft_sdft *sdft, uint8_t index)
+{
+	kiss_fft_cpx value = sdft->values[index];
+	if (sdft->mode == FFT_SDFT_CLASSIC)
+		return value;
+
+	// X_k = Y_k * W^-(k*(n+1)), and phase already holds k*(n+1) mod N
+	const kiss_fft_cpx *w = &sdft->twiddles[sdft->phase[index]];
+	kiss_fft_cpx result = {
+		.r = value.r * w->r + value.i * w->i,
+		.i = value.i * w->r - value.r * w->i,
+	};
+	return result;
+}
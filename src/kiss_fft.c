@@ -12,6 +12,84 @@
  fixed or floating point complex numbers.  It also delares the kf_ internal functions.
  */
 
+#if defined(FIXED_POINT) && (FIXED_POINT == 16) && !defined(KISS_FFT_Q15_SCALAR)
+/* Radix 2 and 4 butterflies on packed Q15 pairs, see kiss_fft_q15.h. Define
+ KISS_FFT_Q15_SCALAR for the generic fixed point ones. */
+#include "kiss_fft_q15.h"
+#define KISS_FFT_Q15_PACKED
+
+#ifdef KISS_FFT_Q15_COUNT
+unsigned long kiss_fft_q15_counts[Q15_OP_COUNT];
+#endif
+
+/* Same scaling by 1/2 as the generic butterfly, but the halving is folded into
+ the rounding of the twiddle product, and the sums saturate instead of
+ wrapping. */
+static void kf_bfly2_q15(
+        kiss_fft_cpx * Fout,
+        const size_t fstride,
+        const kiss_fft_cfg st,
+        int m
+        )
+{
+    kiss_fft_cpx * Fout2 = Fout + m;
+    const kiss_fft_cpx * tw1 = st->twiddles;
+    do{
+        kiss_q15x2 a = q15_shadd16(q15_load(Fout), 0);
+        kiss_q15x2 t = q15_cmul(q15_load(Fout2), q15_load(tw1), 1);
+        tw1 += fstride;
+        q15_store(Fout2, q15_qsub16(a, t));
+        q15_store(Fout, q15_qadd16(a, t));
+        ++Fout2;
+        ++Fout;
+    }while (--m);
+}
+
+/* Scales by 1/4 like the generic butterfly, the rotations by -j (j for the
+ inverse) being a single exchanging add/subtract */
+static void kf_bfly4_q15(
+        kiss_fft_cpx * Fout,
+        const size_t fstride,
+        const kiss_fft_cfg st,
+        const size_t m
+        )
+{
+    const kiss_fft_cpx *tw1,*tw2,*tw3;
+    size_t k=m;
+    const size_t m2=2*m;
+    const size_t m3=3*m;
+
+    tw3 = tw2 = tw1 = st->twiddles;
+
+    do {
+        kiss_q15x2 a0 = q15_load(Fout);
+        a0 = q15_shadd16(q15_shadd16(a0, 0), 0);
+        kiss_q15x2 a1 = q15_cmul(q15_load(&Fout[m]), q15_load(tw1), 2);
+        kiss_q15x2 a2 = q15_cmul(q15_load(&Fout[m2]), q15_load(tw2), 2);
+        kiss_q15x2 a3 = q15_cmul(q15_load(&Fout[m3]), q15_load(tw3), 2);
+        tw1 += fstride;
+        tw2 += fstride*2;
+        tw3 += fstride*3;
+
+        kiss_q15x2 s0 = q15_qadd16(a0, a2);
+        kiss_q15x2 s1 = q15_qsub16(a0, a2);
+        kiss_q15x2 s2 = q15_qadd16(a1, a3);
+        kiss_q15x2 s3 = q15_qsub16(a1, a3);
+
+        q15_store(Fout, q15_qadd16(s0, s2));
+        q15_store(&Fout[m2], q15_qsub16(s0, s2));
+        if(st->inverse) {
+            q15_store(&Fout[m], q15_qasx(s1, s3));
+            q15_store(&Fout[m3], q15_qsax(s1, s3));
+        }else{
+            q15_store(&Fout[m], q15_qsax(s1, s3));
+            q15_store(&Fout[m3], q15_qasx(s1, s3));
+        }
+        ++Fout;
+    }while(--k);
+}
+#endif
+
 static void kf_bfly2(
         kiss_fft_cpx * Fout,
         const size_t fstride,
@@ -19,6 +97,9 @@ static void kf_bfly2(
         int m
         )
 {
+#ifdef KISS_FFT_Q15_PACKED
+    kf_bfly2_q15(Fout, fstride, st, m);
+#else
     kiss_fft_cpx * Fout2;
     kiss_fft_cpx * tw1 = st->twiddles;
     kiss_fft_cpx t;
@@ -33,6 +114,7 @@ static void kf_bfly2(
         ++Fout2;
         ++Fout;
     }while (--m);
+#endif
 }
 
 static void kf_bfly4(
@@ -42,6 +124,9 @@ static void kf_bfly4(
         const size_t m
         )
 {
+#ifdef KISS_FFT_Q15_PACKED
+    kf_bfly4_q15(Fout, fstride, st, m);
+#else
     kiss_fft_cpx *tw1,*tw2,*tw3;
     kiss_fft_cpx scratch[6];
     size_t k=m;
@@ -81,6 +166,7 @@ static void kf_bfly4(
         }
         ++Fout;
     }while(--k);
+#endif
 }
 
 static void kf_bfly3(
@@ -363,6 +449,11 @@ kiss_fft_cfg kiss_fft_alloc(int nfft,int inverse_fft,void * mem,size_t * lenmem
         }
 
         kf_factor(nfft,st->factors);
+#ifdef KISS_FFT_CODELETS
+        st->codelet = kiss_fft_codelet_find(nfft);
+#else
+        st->codelet = NULL;
+#endif
     }
     return st;
 }
@@ -370,6 +461,11 @@ kiss_fft_cfg kiss_fft_alloc(int nfft,int inverse_fft,void * mem,size_t * lenmem
 
 void kiss_fft_stride(kiss_fft_cfg st,const kiss_fft_cpx *fin,kiss_fft_cpx *fout,int in_stride)
 {
+    if (st->codelet && in_stride == 1) {
+        /* Reads all of fin before writing fout, so in place is fine */
+        st->codelet(fin,fout,st->inverse);
+        return;
+    }
     if (fin == fout) {
         //NOTE: this is not really an in-place FFT algorithm.
         //It just performs an out-of-place FFT into a temp buffer
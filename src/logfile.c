@@ -0,0 +1,459 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+#include <logfile.h>
+#include <bytes.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BOOT_MANIFEST_HEADER_SIZE 20
+#define BOOT_MANIFEST_FILE_SIZE 12
+#define BOOT_MANIFEST_VERSION 3
+
+#define LOG_INDEX_ENTRY_SIZE 8
+
+void log_file_segment_path(const struct log_file *file, uint32_t segment, char path[])
+{
+	// Insert the segment number before the extension, if there is one
+	const char *dot = strrchr(file->path, '.');
+	const char *slash = strrchr(file->path, '/');
+	if (!dot || (slash && dot < slash))
+		dot = file->path + strlen(file->path);
+	snprintf(path, LOG_FILE_PATH_MAX, "%.*s.%lu%s", (int)(dot - file->path),
+		file->path, (unsigned long)segment, dot);
+}
+
+// Path of the data file of a segment, or of the only file if not segmented
+static void log_file_data_path(const struct log_file *file, uint32_t segment, char path[])
+{
+	if (file->segment_size)
+		log_file_segment_path(file, segment, path);
+	else
+		snprintf(path, LOG_FILE_PATH_MAX, "%s", file->path);
+}
+
+static void log_file_index_path(const struct log_file *file, uint32_t segment, char path[])
+{
+	char data[LOG_FILE_PATH_MAX];
+	log_file_data_path(file, segment, data);
+	snprintf(path, LOG_FILE_PATH_MAX, "%.*s.idx", LOG_FILE_PATH_MAX - 5, data);
+}
+
+static void log_file_state_path(const struct log_file *file, char path[])
+{
+	snprintf(path, LOG_FILE_PATH_MAX, "%s.state", file->path);
+}
+
+static void log_file_load_state(struct log_file *file)
+{
+	char path[LOG_FILE_PATH_MAX];
+	uint8_t state[8];
+	log_file_state_path(file, path);
+	file->first = 0;
+	file->last = 0;
+	FILE *fp = fopen(path, "r");
+	if (fp)
+	{
+		if (fread(state, sizeof(state), 1, fp) == 1)
+		{
+			file->first = bytes_get_le32(state);
+			file->last = bytes_get_le32(state + 4);
+		}
+		fclose(fp);
+	}
+	file->state_ok = true;
+}
+
+static int log_file_save_state(const struct log_file *file)
+{
+	char path[LOG_FILE_PATH_MAX];
+	uint8_t state[8];
+	log_file_state_path(file, path);
+	bytes_put_le32(state, file->first);
+	bytes_put_le32(state + 4, file->last);
+	FILE *fp = fopen(path, "w");
+	if (!fp)
+		return -1;
+	size_t written = fwrite(state, sizeof(state), 1, fp);
+	if (fclose(fp) || written != 1)
+		return -1;
+	return 0;
+}
+
+// Writes the header if the file does not already start with it
+static void log_file_check_header(struct log_file *file)
+{
+	size_t len = strlen(file->header);
+	char buffer[len];
+	fseek(file->fp, 0, SEEK_SET);
+	size_t read = fread(buffer, 1, len, file->fp);
+	if (read != len || strncmp(file->header, buffer, len) != 0)
+	{
+		fprintf(file->fp, "%s", file->header);
+	}
+	fseek(file->fp, 0, SEEK_END);
+	file->header_ok = true;
+}
+
+FILE *log_file_get(struct log_file *file)
+{
+	if (!file->fp)
+	{
+		char path[LOG_FILE_PATH_MAX];
+		if (file->segment_size && !file->state_ok)
+			log_file_load_state(file);
+		log_file_data_path(file, file->last, path);
+
+		file->fp = fopen(path, "a+");
+		if (!file->fp)
+			return NULL;
+		if (!file->header_ok)
+		{
+			log_file_check_header(file);
+		}
+		else
+		{
+			// Cheap guard against the file having been removed since the
+			// manifest was written: an empty file still needs its header
+			fseek(file->fp, 0, SEEK_END);
+			if (ftell(file->fp) == 0)
+				fprintf(file->fp, "%s", file->header);
+		}
+		long size = ftell(file->fp);
+		file->size = size > 0 ? size : 0;
+	}
+	return file->fp;
+}
+
+// Moves on to a new segment and drops the oldest ones beyond the budget
+static void log_file_advance(struct log_file *file)
+{
+	log_file_close(file);
+	file->last++;
+	file->header_ok = false;
+	// Every segment indexes its first record
+	file->unindexed = 0;
+
+	// Remove before recording the new state: a crash in between leaves the
+	// state pointing at an already removed segment, which is harmless, while
+	// the opposite order could leak a segment forever
+	while (file->last - file->first + 1 > file->segments)
+	{
+		char path[LOG_FILE_PATH_MAX];
+		log_file_segment_path(file, file->first, path);
+		remove(path);
+		log_file_index_path(file, file->first, path);
+		remove(path);
+		file->first++;
+	}
+	log_file_save_state(file);
+}
+
+static int log_file_rotate(struct log_file *file)
+{
+	log_file_advance(file);
+	return log_file_get(file) ? 0 : -1;
+}
+
+void log_file_next_segment(struct log_file *file, char path[])
+{
+	if (!file->state_ok)
+		log_file_load_state(file);
+	// A segment that was never written is still free
+	log_file_segment_path(file, file->last, path);
+	FILE *fp = fopen(path, "r");
+	if (!fp)
+		return;
+	fclose(fp);
+	log_file_advance(file);
+	log_file_segment_path(file, file->last, path);
+}
+
+// Appends an index entry for a record about to be written at file->size
+static void log_file_index(struct log_file *file, uint32_t time)
+{
+	char path[LOG_FILE_PATH_MAX];
+	uint8_t entry[LOG_INDEX_ENTRY_SIZE];
+	bytes_put_le32(entry, time);
+	bytes_put_le32(entry + 4, file->size);
+	log_file_index_path(file, file->last, path);
+	FILE *fp = fopen(path, "a");
+	if (fp)
+	{
+		fwrite(entry, sizeof(entry), 1, fp);
+		fclose(fp);
+	}
+}
+
+FILE *log_file_append(struct log_file *file, uint32_t time, size_t size)
+{
+	if (!log_file_get(file))
+		return NULL;
+	// A segment holding only its header cannot get any emptier, so records
+	// larger than a segment still get written
+	if (file->segment_size && file->size + size > file->segment_size &&
+		file->size > strlen(file->header))
+	{
+		if (log_file_rotate(file))
+			return NULL;
+	}
+	if (file->index_interval)
+	{
+		// The count of records since the last entry comes from the boot
+		// manifest; after a crash the first record is indexed again
+		if (file->unindexed == 0)
+			log_file_index(file, time);
+		if (++file->unindexed == file->index_interval)
+			file->unindexed = 0;
+	}
+	file->size += size;
+	return file->fp;
+}
+
+int log_file_write(struct log_file *file, uint32_t time, const char *data, size_t size)
+{
+	FILE *fp = log_file_append(file, time, size);
+	if (!fp || fwrite(data, size, 1, fp) != 1)
+		return -1;
+	return 0;
+}
+
+// Reads the index entry at position entry of a segment's index, returns
+// false if there is none
+static bool log_file_read_index(FILE *fp, long entry, uint32_t *time, uint32_t *offset)
+{
+	uint8_t buffer[LOG_INDEX_ENTRY_SIZE];
+	if (fseek(fp, entry * LOG_INDEX_ENTRY_SIZE, SEEK_SET) ||
+		fread(buffer, sizeof(buffer), 1, fp) != 1)
+		return false;
+	*time = bytes_get_le32(buffer);
+	*offset = bytes_get_le32(buffer + 4);
+	return true;
+}
+
+// Finds the offset of the last indexed record strictly before t0 in one
+// segment, and whether there is one
+static bool log_file_seek_segment(const struct log_file *file, uint32_t segment, uint32_t t0, uint32_t *offset)
+{
+	char path[LOG_FILE_PATH_MAX];
+	log_file_index_path(file, segment, path);
+	FILE *fp = fopen(path, "r");
+	if (!fp)
+		return false;
+
+	// Binary search over the fixed size entries
+	fseek(fp, 0, SEEK_END);
+	long low = 0;
+	long high = ftell(fp) / LOG_INDEX_ENTRY_SIZE;
+	bool found = false;
+	while (low < high)
+	{
+		long middle = low + (high - low) / 2;
+		uint32_t time, position;
+		if (!log_file_read_index(fp, middle, &time, &position))
+			break;
+		if (time < t0)
+		{
+			*offset = position;
+			found = true;
+			low = middle + 1;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+	fclose(fp);
+	return found;
+}
+
+int log_file_query(struct log_file *file, uint32_t t0, uint32_t t1, log_file_record callback, void *context)
+{
+	// Makes sure the segment state is loaded and everything written so far
+	// can be read back
+	if (!log_file_get(file) || fflush(file->fp))
+		return -1;
+
+	// Records equal to t0 may precede an index entry with that same time, so
+	// start from the last segment that indexes something strictly before t0
+	uint32_t segment = file->first;
+	uint32_t offset = 0;
+	if (file->index_interval)
+	{
+		uint32_t low = file->first;
+		uint32_t high = file->last + 1;
+		while (low < high)
+		{
+			uint32_t middle = low + (high - low) / 2;
+			uint32_t position;
+			if (log_file_seek_segment(file, middle, t0, &position))
+			{
+				segment = middle;
+				offset = position;
+				low = middle + 1;
+			}
+			else
+			{
+				high = middle;
+			}
+		}
+	}
+
+	int count = 0;
+	for (; segment <= file->last; ++segment, offset = 0)
+	{
+		char path[LOG_FILE_PATH_MAX];
+		log_file_data_path(file, segment, path);
+		FILE *fp = fopen(path, "r");
+		if (!fp)
+			continue;
+		fseek(fp, offset, SEEK_SET);
+
+		char line[LOG_FILE_LINE_MAX];
+		while (fgets(line, sizeof(line), fp))
+		{
+			// A record too long for the buffer comes back in pieces, and the
+			// later ones could parse as records of their own
+			if (!strchr(line, '\n') && !feof(fp))
+			{
+				int c;
+				while ((c = fgetc(fp)) != EOF && c != '\n')
+					;
+				continue;
+			}
+			// Skips the header and anything else that is not a record
+			char *end;
+			unsigned long time = strtoul(line, &end, 10);
+			if (end == line || *end != ',')
+				continue;
+			if (time < t0)
+				continue;
+			if (time >= t1)
+			{
+				fclose(fp);
+				return count;
+			}
+			++count;
+			if (callback(context, time, line))
+			{
+				fclose(fp);
+				return count;
+			}
+		}
+		fclose(fp);
+	}
+	return count;
+}
+
+int log_file_close(struct log_file *file)
+{
+	if (!file->fp)
+		return 0;
+	int result = fclose(file->fp);
+	file->fp = NULL;
+	return result;
+}
+
+// Identifies the set of files, so a manifest from a firmware with different
+// files or headers is never trusted
+static uint32_t boot_manifest_hash(const struct log_file files[], size_t count)
+{
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < count; ++i)
+	{
+		const char *strings[2] = {files[i].path, files[i].header};
+		for (size_t s = 0; s < 2; ++s)
+		{
+			// Hash the terminator too, so "ab","c" differs from "a","bc"
+			const char *c = strings[s];
+			do
+			{
+				hash ^= (uint8_t)*c;
+				hash *= 16777619u;
+			} while (*c++);
+		}
+	}
+	return hash;
+}
+
+bool boot_manifest_load(const char *path, struct log_file files[], size_t count)
+{
+	if (count > LOG_FILE_MAX)
+		return false;
+
+	uint8_t manifest[BOOT_MANIFEST_HEADER_SIZE + BOOT_MANIFEST_FILE_SIZE * LOG_FILE_MAX];
+	size_t size = BOOT_MANIFEST_HEADER_SIZE + BOOT_MANIFEST_FILE_SIZE * count;
+	FILE *fp = fopen(path, "r");
+	if (!fp)
+		return false;
+	size_t read = fread(manifest, 1, size, fp);
+	fclose(fp);
+
+	// Truncate it, this boot is not clean until boot_manifest_save says so
+	fp = fopen(path, "w");
+	if (fp)
+		fclose(fp);
+
+	if (read != size || !bytes_check_header(manifest, "BOOT", BOOT_MANIFEST_VERSION, count) ||
+		bytes_get_le32(manifest + 8) != boot_manifest_hash(files, count))
+		return false;
+
+	uint32_t headers = bytes_get_le32(manifest + 12);
+	uint32_t states = bytes_get_le32(manifest + 16);
+	for (size_t i = 0; i < count; ++i)
+	{
+		const uint8_t *entry = manifest + BOOT_MANIFEST_HEADER_SIZE + BOOT_MANIFEST_FILE_SIZE * i;
+		files[i].header_ok = headers & (1u << i);
+		files[i].unindexed = bytes_get_le32(entry + 8);
+		if (files[i].index_interval && files[i].unindexed >= files[i].index_interval)
+			files[i].unindexed = 0;
+		if (files[i].segment_size && (states & (1u << i)))
+		{
+			files[i].first = bytes_get_le32(entry);
+			files[i].last = bytes_get_le32(entry + 4);
+			files[i].state_ok = true;
+		}
+	}
+	return true;
+}
+
+int boot_manifest_save(const char *path, const struct log_file files[], size_t count)
+{
+	if (count > LOG_FILE_MAX)
+		return -1;
+
+	uint8_t manifest[BOOT_MANIFEST_HEADER_SIZE + BOOT_MANIFEST_FILE_SIZE * LOG_FILE_MAX] = {0};
+	bytes_put_header(manifest, "BOOT", BOOT_MANIFEST_VERSION, count);
+	size_t size = BOOT_MANIFEST_HEADER_SIZE + BOOT_MANIFEST_FILE_SIZE * count;
+	uint32_t headers = 0;
+	uint32_t states = 0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		uint8_t *entry = manifest + BOOT_MANIFEST_HEADER_SIZE + BOOT_MANIFEST_FILE_SIZE * i;
+		if (files[i].header_ok)
+			headers |= 1u << i;
+		if (files[i].state_ok)
+		{
+			states |= 1u << i;
+			bytes_put_le32(entry, files[i].first);
+			bytes_put_le32(entry + 4, files[i].last);
+		}
+		bytes_put_le32(entry + 8, files[i].unindexed);
+	}
+	bytes_put_le32(manifest + 8, boot_manifest_hash(files, count));
+	bytes_put_le32(manifest + 12, headers);
+	bytes_put_le32(manifest + 16, states);
+
+	FILE *fp = fopen(path, "w");
+	if (!fp)
+		return -1;
+	size_t written = fwrite(manifest, size, 1, fp);
+	if (fclose(fp) || written != 1)
+		return -1;
+	return 0;
+}
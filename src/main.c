@@ -31,7 +31,173 @@
 #include <power_control.h>
 
 #include <fft.h>
+#include <fft_mel.h>
+#include <fft_sdft.h>
+#include <fft_decimate.h>
+#include <fft_filter.h>
 #include <kiss_fftr.h>
+#include <adpcm.h>
+#include <trace.h>
+#include <energy.h>
+#include <logfile.h>
+#include <offload.h>
+#include <deadband.h>
+#include <stats.h>
+#include <adapt.h>
+#include <arena.h>
+#include <convert.h>
+
+// Number of audio frames recorded into the spectrogram log per run, 0 disables
+// spectrogram logging. Set through the spectrogram_frames meson option.
+#ifndef SPECTROGRAM_FRAMES
+#define SPECTROGRAM_FRAMES 0
+#endif
+
+// Keep every computation per reading and per frame in float or integer, for
+// the single precision FPU; with it the BMP280 readings are compensated with
+// the integer formulas instead of the double ones. The build also makes
+// -Wdouble-promotion an error. Set through the single_precision meson option.
+#ifndef SINGLE_PRECISION
+#define SINGLE_PRECISION 0
+#endif
+
+// Factor the PDM samples are decimated by before the FFT, 1, 2, 4 or 8. Each
+// PDM buffer then makes an FFT that many times shorter with the same bin
+// width, over a band that many times narrower. Set through the decimation
+// meson option.
+#ifndef DECIMATION
+#define DECIMATION 1
+#endif
+
+// Band-pass filter applied to the audio frames before any analysis, cut off
+// at BANDPASS_LOW and BANDPASS_HIGH Hz, with BANDPASS_TAPS taps evaluated by
+// overlap-add FFT convolution. A BANDPASS_HIGH of 0 disables it. Set through
+// the bandpass_low, bandpass_high and bandpass_taps meson options.
+#ifndef BANDPASS_HIGH
+#define BANDPASS_HIGH 0
+#endif
+
+#ifndef BANDPASS_LOW
+#define BANDPASS_LOW 0
+#endif
+
+#ifndef BANDPASS_TAPS
+#define BANDPASS_TAPS 65
+#endif
+
+#if BANDPASS_HIGH > 0 && BANDPASS_TAPS % 2 == 0
+#error "bandpass_taps must be odd"
+#endif
+
+// Range in Hz searched for the fundamental of each audio frame by the
+// autocorrelation pitch estimator, the most confident estimate of every run
+// logged to fs:/pitch_data.csv. A PITCH_MAX_HZ of 0 disables it. Set through
+// the pitch_min_hz and pitch_max_hz meson options.
+#ifndef PITCH_MAX_HZ
+#define PITCH_MAX_HZ 0
+#endif
+
+#ifndef PITCH_MIN_HZ
+#define PITCH_MIN_HZ 40
+#endif
+
+// Number of log-spaced bands per spectrogram frame
+#define SPECTROGRAM_BANDS 24
+
+// Number of mel-frequency cepstral coefficients averaged over the audio frames
+// of each run into fs:/mfcc_data.csv, 0 disables them. Set through the
+// mfcc_coeffs meson option.
+#ifndef MFCC_COEFFS
+#define MFCC_COEFFS 0
+#endif
+
+// Number of mel bands the coefficients are computed from
+#define MEL_BANDS 26
+
+// Number of audio frames per capture searched for the starts of sound events,
+// logged to fs:/onset_data.csv, 0 disables onset detection. Set through the
+// onset_frames meson option.
+#ifndef ONSET_FRAMES
+#define ONSET_FRAMES 0
+#endif
+
+// Frequency in Hz of a tone watched for on every PDM sample with a sliding
+// DFT, detections logged to fs:/tone_data.csv, 0 disables it. The tone counts
+// as present from an amplitude of TONE_THRESHOLD. Set through the tone_hz and
+// tone_threshold meson options.
+#ifndef TONE_HZ
+#define TONE_HZ 0
+#endif
+
+#ifndef TONE_THRESHOLD
+#define TONE_THRESHOLD 4096
+#endif
+
+// Window of the sliding DFT in samples, 8 ms at the default sampling rate
+#define TONE_WINDOW 64
+
+// Number of audio frames stored as an ADPCM clip once a frame's peak amplitude
+// reaches CLIP_THRESHOLD, 0 disables clip capture. Set through the clip_frames
+// and clip_threshold meson options.
+#ifndef CLIP_FRAMES
+#define CLIP_FRAMES 0
+#endif
+
+#ifndef CLIP_THRESHOLD
+#define CLIP_THRESHOLD 16384
+#endif
+
+// Clips kept, as fs:/clip.<n>.adpcm, the oldest removed beyond this. Set
+// through the clip_slots meson option.
+#ifndef CLIP_SLOTS
+#define CLIP_SLOTS 8
+#endif
+
+// Time in ms a host gets at boot to ask for the logs over the UART, and the
+// fastest baud rate agreed to for the transfer, see offload.py. 0 disables
+// offload. Set through the offload_wait_ms and offload_baud meson options.
+#ifndef OFFLOAD_WAIT_MS
+#define OFFLOAD_WAIT_MS 50
+#endif
+
+#ifndef OFFLOAD_BAUD
+#define OFFLOAD_BAUD 921600
+#endif
+
+// Baud rate uart_init sets up
+#define UART_BAUD 115200
+
+// Stages timed by the trace, dumped to fs:/trace.bin and the UART at the end
+// of main. Render them with trace.py.
+enum stage
+{
+	STAGE_MOUNT,
+	STAGE_MANIFEST,
+	STAGE_OFFLOAD,
+	STAGE_TEMPERATURE,
+	STAGE_PRESSURE,
+	STAGE_ADC,
+	STAGE_PDM_WAIT,
+	STAGE_BANDPASS,
+	STAGE_FFT,
+	STAGE_PITCH,
+	STAGE_CSV_WRITE,
+	STAGE_COUNT,
+};
+
+static const char * const stage_names[STAGE_COUNT] = {
+	[STAGE_MOUNT] = "mount",
+	[STAGE_MANIFEST] = "boot_manifest",
+	[STAGE_OFFLOAD] = "offload",
+	[STAGE_TEMPERATURE] = "bmp280_temperature",
+	[STAGE_PRESSURE] = "bmp280_pressure",
+	[STAGE_ADC] = "adc",
+	[STAGE_PDM_WAIT] = "pdm_wait",
+	[STAGE_BANDPASS] = "bandpass",
+	[STAGE_FFT] = "fft",
+	[STAGE_PITCH] = "pitch",
+	[STAGE_CSV_WRITE] = "write_csv_line",
+};
 
 struct uart uart;
 struct spi_bus spi_bus;
@@ -46,6 +212,281 @@ struct pdm pdm;
 struct asimple_littlefs fs;
 struct fft fft;
 struct power_control power_control;
+struct trace trace;
+
+// Size of each log segment, and the flash all logs, the spectrogram and the
+// audio clips may take together. Clips get their slots out of the budget and
+// every log an equal share of the rest, as a whole number of segments; the
+// oldest segment is dropped when a log goes over. Set through the
+// log_segment_size and log_budget meson options.
+#ifndef LOG_SEGMENT_SIZE
+#define LOG_SEGMENT_SIZE 16384
+#endif
+
+#ifndef LOG_BUDGET
+#define LOG_BUDGET 1572864
+#endif
+
+// Records between entries of the sparse time index of each log, trading index
+// size for how much of a segment a time range query has to parse
+#ifndef LOG_INDEX_INTERVAL
+#define LOG_INDEX_INTERVAL 16
+#endif
+
+// The MX25V16066 holds 2 MiB. littlefs needs some of it free to copy blocks on
+// write, and its metadata, the state files, the boot manifest and
+// fs:/trace.bin, rewritten every run, live outside the budget.
+#define FLASH_SIZE (2u * 1024u * 1024u)
+#define FLASH_RESERVE (256u * 1024u)
+
+// littlefs stores every file in whole blocks, every block after the first
+// starting with pointers back to earlier ones, 8 bytes of them on average. A
+// segment's index takes one more block.
+#define FLASH_BLOCK 4096u
+#define FLASH_BLOCKS(bytes) \
+	(((bytes) + (bytes) / FLASH_BLOCK * 8 + FLASH_BLOCK - 1) / FLASH_BLOCK * FLASH_BLOCK)
+
+// Flash a clip can take: its header and 4 bits per sample of CLIP_FRAMES PDM
+// buffers of the 512 samples fft_init sets up
+#define CLIP_BYTES (ADPCM_CLIP_HEADER_SIZE + CLIP_FRAMES * 512u / 2)
+#if CLIP_FRAMES > 0
+#define CLIP_BUDGET (CLIP_SLOTS * FLASH_BLOCKS(CLIP_BYTES))
+#else
+#define CLIP_BUDGET 0
+#endif
+
+#define LOG_SEGMENT_COST (FLASH_BLOCKS(LOG_SEGMENT_SIZE) + (LOG_INDEX_INTERVAL > 0 ? FLASH_BLOCK : 0))
+#define LOG_SEGMENTS ((LOG_BUDGET - CLIP_BUDGET) / LOG_COUNT / LOG_SEGMENT_COST)
+
+// CSV logs, and the spectrogram, opened on first write. Their headers are only
+// checked when the boot manifest written at the last clean shutdown does not
+// vouch for them.
+enum log
+{
+	LOG_TEMPERATURE,
+	LOG_PRESSURE,
+	LOG_LIGHT,
+	LOG_MICROPHONE,
+	LOG_ENERGY,
+	LOG_SUMMARY,
+#if MFCC_COEFFS > 0
+	LOG_MFCC,
+#endif
+#if ONSET_FRAMES > 0
+	LOG_ONSET,
+#endif
+#if TONE_HZ > 0
+	LOG_TONE,
+#endif
+#if PITCH_MAX_HZ > 0
+	LOG_PITCH,
+#endif
+#if SPECTROGRAM_FRAMES > 0
+	LOG_SPECTROGRAM,
+#endif
+	LOG_COUNT,
+};
+
+struct log_file logs[LOG_COUNT] = {
+	[LOG_TEMPERATURE] = { .path = "fs:/temperature_data.csv", .header = "time,temperature data celsius\r\n", .segment_size = LOG_SEGMENT_SIZE, .segments = LOG_SEGMENTS, .index_interval = LOG_INDEX_INTERVAL },
+	[LOG_PRESSURE] = { .path = "fs:/pressure_data.csv", .header = "time,pressure data pascals\r\n", .segment_size = LOG_SEGMENT_SIZE, .segments = LOG_SEGMENTS, .index_interval = LOG_INDEX_INTERVAL },
+	[LOG_LIGHT] = { .path = "fs:/light_data.csv", .header = "time,light data ohms\r\n", .segment_size = LOG_SEGMENT_SIZE, .segments = LOG_SEGMENTS, .index_interval = LOG_INDEX_INTERVAL },
+	[LOG_MICROPHONE] = { .path = "fs:/microphone_data.csv", .header = "time,microphone data Hz\r\n", .segment_size = LOG_SEGMENT_SIZE, .segments = LOG_SEGMENTS, .index_interval = LOG_INDEX_INTERVAL },
+	[LOG_SUMMARY] = { .path = "fs:/summary_data.csv", .header = "time,channel,count,mean,variance,min,max\r\n", .segment_size = LOG_SEGMENT_SIZE, .segments = LOG_SEGMENTS, .index_interval = LOG_INDEX_INTERVAL },
+	[LOG_ENERGY] = { .path = "fs:/energy_data.csv", .header = "time,awake ms,asleep ms,wakeups,spi ms,pdm ms,adc ms,flash ms,uAh\r\n", .segment_size = LOG_SEGMENT_SIZE, .segments = LOG_SEGMENTS, .index_interval = LOG_INDEX_INTERVAL },
+#if MFCC_COEFFS > 0
+	[LOG_MFCC] = { .path = "fs:/mfcc_data.csv", .header = "time,mfcc centi-dB...\r\n", .segment_size = LOG_SEGMENT_SIZE, .segments = LOG_SEGMENTS, .index_interval = LOG_INDEX_INTERVAL },
+#endif
+#if ONSET_FRAMES > 0
+	[LOG_ONSET] = { .path = "fs:/onset_data.csv", .header = "time,ms into capture,strength percent of threshold,dominant bin\r\n", .segment_size = LOG_SEGMENT_SIZE, .segments = LOG_SEGMENTS, .index_interval = LOG_INDEX_INTERVAL },
+#endif
+#if TONE_HZ > 0
+	[LOG_TONE] = { .path = "fs:/tone_data.csv", .header = "time,ms into capture\r\n", .segment_size = LOG_SEGMENT_SIZE, .segments = LOG_SEGMENTS, .index_interval = LOG_INDEX_INTERVAL },
+#endif
+#if PITCH_MAX_HZ > 0
+	[LOG_PITCH] = { .path = "fs:/pitch_data.csv", .header = "time,fundamental centi-Hz,confidence percent\r\n", .segment_size = LOG_SEGMENT_SIZE, .segments = LOG_SEGMENTS, .index_interval = LOG_INDEX_INTERVAL },
+#endif
+#if SPECTROGRAM_FRAMES > 0
+	// Blocks of binary frames, every block starting with its own header
+	[LOG_SPECTROGRAM] = { .path = "fs:/spectrogram.bin", .header = "", .segment_size = LOG_SEGMENT_SIZE, .segments = LOG_SEGMENTS },
+#endif
+};
+
+static_assert(LOG_BUDGET <= FLASH_SIZE - FLASH_RESERVE,
+	"log_budget leaves littlefs too little of the flash");
+static_assert(CLIP_BUDGET < LOG_BUDGET && LOG_SEGMENTS >= 2,
+	"log_budget is too small for two segments of every log next to the clips");
+
+#if CLIP_FRAMES > 0
+// Every clip is a segment of its own, written by adpcm_clip_*
+struct log_file clips = { .path = "fs:/clip.adpcm", .header = "", .segment_size = CLIP_BYTES, .segments = CLIP_SLOTS };
+#endif
+struct energy energy;
+
+// Readings of the slow sensors only make it to their logs when they move
+// beyond a tolerance, or at least every DEADBAND_HEARTBEAT seconds, see
+// deadband.h. Set through the deadband and deadband_heartbeat meson options.
+#ifndef DEADBAND_MODE
+#define DEADBAND_MODE DEADBAND_SWINGING_DOOR
+#endif
+
+#ifndef DEADBAND_HEARTBEAT
+#define DEADBAND_HEARTBEAT 3600
+#endif
+
+enum channel
+{
+	CHANNEL_TEMPERATURE,
+	CHANNEL_PRESSURE,
+	CHANNEL_LIGHT,
+	CHANNEL_COUNT,
+};
+
+static const char * const channel_names[CHANNEL_COUNT] = {
+	[CHANNEL_TEMPERATURE] = "temperature",
+	[CHANNEL_PRESSURE] = "pressure",
+	[CHANNEL_LIGHT] = "light",
+};
+
+static struct log_file * const channel_logs[CHANNEL_COUNT] = {
+	[CHANNEL_TEMPERATURE] = &logs[LOG_TEMPERATURE],
+	[CHANNEL_PRESSURE] = &logs[LOG_PRESSURE],
+	[CHANNEL_LIGHT] = &logs[LOG_LIGHT],
+};
+
+// Tolerances are in the logged units: millidegrees C, Pa and ohms. They sit
+// just above the noise of each reading.
+struct deadband deadbands[CHANNEL_COUNT] = {
+	[CHANNEL_TEMPERATURE] = { .mode = DEADBAND_MODE, .tolerance = 100, .heartbeat = DEADBAND_HEARTBEAT },
+	[CHANNEL_PRESSURE] = { .mode = DEADBAND_MODE, .tolerance = 20, .heartbeat = DEADBAND_HEARTBEAT },
+	[CHANNEL_LIGHT] = { .mode = DEADBAND_MODE, .tolerance = 500, .heartbeat = DEADBAND_HEARTBEAT },
+};
+
+// Estimated current draw per state in uA, from the datasheets at 3.3 V. Replace
+// with bench measurements of the actual board for better estimates.
+static const struct energy_currents energy_currents = {
+	.active_ua = 300.0f, // Apollo3 at 48 MHz, ~6 uA/MHz
+	.sleep_ua = 2.0f, // deep sleep with the 32 kHz crystal running
+	.peripheral_ua = {
+		[ENERGY_SPI_BUS] = 50.0f,
+		[ENERGY_PDM] = 650.0f, // PDM block plus microphone
+		[ENERGY_ADC] = 100.0f,
+		[ENERGY_FLASH] = 4000.0f, // MX25V16066 read/program average
+	},
+	.standby_ua = {
+		[ENERGY_FLASH] = 10.0f, // MX25V16066 standby, between accesses
+	},
+};
+
+// STIMER ticks keep counting in deep sleep, unlike the core cycle counter
+static uint32_t energy_clock_ticks(void)
+{
+	return am_hal_stimer_counter_get();
+}
+
+// The flash is only read or programmed over the SPI bus, so both are charged
+// as in use together, and only around the accesses; the flash idles in
+// standby the rest of the time
+static void energy_flash(bool busy)
+{
+	if (busy)
+	{
+		energy_enable(&energy, ENERGY_SPI_BUS);
+		energy_enable(&energy, ENERGY_FLASH);
+	}
+	else
+	{
+		energy_disable(&energy, ENERGY_FLASH);
+		energy_disable(&energy, ENERGY_SPI_BUS);
+	}
+}
+
+#if SPECTROGRAM_FRAMES > 0
+static_assert(SPECTROGRAM_FRAMES <= UINT16_MAX,
+	"spectrogram block headers count frames in 16 bits");
+struct fft_spectrogram spectrogram;
+uint8_t spectrogram_block[SPECTROGRAM_FRAMES * SPECTROGRAM_BANDS];
+#endif
+#if CLIP_FRAMES > 0
+struct adpcm_clip clip;
+#endif
+#if MFCC_COEFFS > 0
+struct fft_mel mel;
+#endif
+#if ONSET_FRAMES > 0
+struct fft_onset onset;
+#endif
+#if TONE_HZ > 0
+struct fft_sdft tone;
+#endif
+#if DECIMATION > 1
+struct fft_decimate decimate;
+#endif
+#if BANDPASS_HIGH > 0
+struct fft_filter bandpass;
+#endif
+#if PITCH_MAX_HZ > 0
+struct fft_pitch pitch;
+#endif
+
+#if OFFLOAD_WAIT_MS > 0
+struct offload offload;
+
+// Buffers for the UART while offloading, large enough to queue a whole DATA
+// frame so the CPU can read ahead while it drains
+static uint8_t offload_tx_buffer[4096];
+static uint8_t offload_rx_buffer[256];
+
+static size_t offload_uart_read(void *context, uint8_t *data, size_t size, uint32_t timeout)
+{
+	struct uart *uart = context;
+	uint32_t read = 0;
+	const am_hal_uart_transfer_t transfer = {
+		.ui32Direction = AM_HAL_UART_READ,
+		.pui8Data = data,
+		.ui32NumBytes = size,
+		.ui32TimeoutMs = timeout,
+		.pui32BytesTransferred = &read,
+	};
+	am_hal_uart_transfer(uart->handle, &transfer);
+	return read;
+}
+
+static int offload_uart_write(void *context, const uint8_t *data, size_t size)
+{
+	struct uart *uart = context;
+	uint32_t written = 0;
+	const am_hal_uart_transfer_t transfer = {
+		.ui32Direction = AM_HAL_UART_WRITE,
+		.pui8Data = (uint8_t *)data,
+		.ui32NumBytes = size,
+		.ui32TimeoutMs = AM_HAL_UART_WAIT_FOREVER,
+		.pui32BytesTransferred = &written,
+	};
+	if (am_hal_uart_transfer(uart->handle, &transfer) != AM_HAL_STATUS_SUCCESS)
+		return -1;
+	return written == size ? 0 : -1;
+}
+
+static void offload_uart_baud(void *context, uint32_t baud)
+{
+	struct uart *uart = context;
+	am_hal_uart_tx_flush(uart->handle);
+	const am_hal_uart_config_t config = {
+		.ui32BaudRate = baud,
+		.ui32DataBits = AM_HAL_UART_DATA_BITS_8,
+		.ui32Parity = AM_HAL_UART_PARITY_NONE,
+		.ui32StopBits = AM_HAL_UART_ONE_STOP_BIT,
+		.ui32FlowControl = AM_HAL_UART_FLOW_CTRL_NONE,
+		.ui32FifoLevels = AM_HAL_UART_TX_FIFO_1_2 | AM_HAL_UART_RX_FIFO_1_2,
+		.pui8TxBuffer = offload_tx_buffer,
+		.ui32TxBufferSize = sizeof(offload_tx_buffer),
+		.pui8RxBuffer = offload_rx_buffer,
+		.ui32RxBufferSize = sizeof(offload_rx_buffer),
+	};
+	am_hal_uart_configure(uart->handle, &config);
+}
+#endif
 
 __attribute__((constructor))
 static void redboard_init(void)
@@ -74,52 +515,173 @@ static void redboard_shutdown(void)
 	power_control_shutdown(&power_control);
 }
 
-// Add headers to the file if there isn't one already
-void add_headers(char headers[][40], FILE * files[], size_t size)
+// Format a line in the format "time,data\r\n"
+int format_csv_line(char line[], size_t size, uint32_t time, uint32_t data) {
+	uint8_t buffer[21] = {0};
+	time_to_string(buffer, (uint64_t) time);
+	return snprintf(line, size, "%s,%lu\r\n", buffer, data);
+}
+
+// Readings are also summarized per channel over windows of STATS_WINDOW
+// seconds into fs:/summary_data.csv, 0 disables summaries. RAW_LOGS set to 0
+// drops the per-reading logs and keeps only the summaries. Set through the
+// stats_window and raw_logs meson options.
+#ifndef STATS_WINDOW
+#define STATS_WINDOW 3600
+#endif
+
+#ifndef RAW_LOGS
+#define RAW_LOGS 1
+#endif
+
+// Channels summarized. The deadband channels come first, with the same
+// numbers. The sound level and peak frequency are added for every audio frame,
+// the rest once per cycle.
+enum summary
 {
-    for(size_t i = 0; i < size; i++){
-        fseek(files[i], 0, SEEK_SET);
-        int len = strlen(headers[i]);
-        char buffer[len];
-        fread(buffer, len, 1, files[i]);
-        if(strncmp(headers[i], buffer, len) != 0){
-            fprintf(files[i], "%s", headers[i]);
-        }
-        fseek(files[i], 0, SEEK_END);
-    }
+	SUMMARY_TEMPERATURE = CHANNEL_TEMPERATURE,
+	SUMMARY_PRESSURE = CHANNEL_PRESSURE,
+	SUMMARY_LIGHT = CHANNEL_LIGHT,
+	SUMMARY_SOUND = CHANNEL_COUNT,
+	SUMMARY_FREQUENCY,
+	SUMMARY_COUNT,
+};
+
+static const char * const summary_names[SUMMARY_COUNT] = {
+	[SUMMARY_TEMPERATURE] = "temperature",
+	[SUMMARY_PRESSURE] = "pressure",
+	[SUMMARY_LIGHT] = "light",
+	[SUMMARY_SOUND] = "sound_peak",
+	[SUMMARY_FREQUENCY] = "frequency",
+};
+
+struct stats summaries[SUMMARY_COUNT];
+
+// Channels are sampled on schedules of their own, see adapt.h. Each cycle only
+// reads the channels that are due, and sets the RTC to wake the board when the
+// next one is. ADAPTIVE_SAMPLING set to 0 reads every channel every cycle and
+// leaves the wake-up alone. Set through the adaptive_sampling,
+// adapt_min_interval, adapt_max_interval, adapt_high, adapt_low and
+// adapt_calm_samples meson options, the thresholds in hundredths.
+#ifndef ADAPTIVE_SAMPLING
+#define ADAPTIVE_SAMPLING 1
+#endif
+
+#ifndef ADAPT_MIN_INTERVAL
+#define ADAPT_MIN_INTERVAL 60
+#endif
+
+#ifndef ADAPT_MAX_INTERVAL
+#define ADAPT_MAX_INTERVAL 3600
+#endif
+
+#ifndef ADAPT_HIGH
+#define ADAPT_HIGH 200
+#endif
+
+#ifndef ADAPT_LOW
+#define ADAPT_LOW 50
+#endif
+
+#ifndef ADAPT_CALM_SAMPLES
+#define ADAPT_CALM_SAMPLES 3
+#endif
+
+// Features are scaled so a change of 1 is about the smallest one that matters:
+// the deadband tolerances for the BMP280, and in dB the photo resistance and
+// the energy of each audio band
+#define LIGHT_FEATURE_DB 0.5f
+#define AUDIO_FEATURE_DB 3.0f
+
+enum schedule
+{
+	SCHEDULE_BMP280,
+	SCHEDULE_LIGHT,
+	SCHEDULE_AUDIO,
+	SCHEDULE_COUNT,
+};
+
+static const char * const schedule_names[SCHEDULE_COUNT] = {
+	[SCHEDULE_BMP280] = "bmp280",
+	[SCHEDULE_LIGHT] = "light",
+	[SCHEDULE_AUDIO] = "audio",
+};
+
+struct adapt schedules[SCHEDULE_COUNT] = {
+	[SCHEDULE_BMP280] = { .min_interval = ADAPT_MIN_INTERVAL, .max_interval = ADAPT_MAX_INTERVAL, .high = ADAPT_HIGH / 100.0f, .low = ADAPT_LOW / 100.0f, .calm_samples = ADAPT_CALM_SAMPLES },
+	[SCHEDULE_LIGHT] = { .min_interval = ADAPT_MIN_INTERVAL, .max_interval = ADAPT_MAX_INTERVAL, .high = ADAPT_HIGH / 100.0f, .low = ADAPT_LOW / 100.0f, .calm_samples = ADAPT_CALM_SAMPLES },
+	[SCHEDULE_AUDIO] = { .min_interval = ADAPT_MIN_INTERVAL, .max_interval = ADAPT_MAX_INTERVAL, .high = ADAPT_HIGH / 100.0f, .low = ADAPT_LOW / 100.0f, .calm_samples = ADAPT_CALM_SAMPLES },
+};
+
+// Write a line to a log in the format "time,data\r\n"
+void write_csv_record(struct log_file * log, uint32_t time, uint32_t data) {
+	trace_begin(&trace, STAGE_CSV_WRITE);
+	char line[40];
+	int len = format_csv_line(line, sizeof(line), time, data);
+	log_file_write(log, time, line, len);
+	trace_end(&trace, STAGE_CSV_WRITE);
 }
 
-// Convert tv_sec, which is a long representing seconds, to a string in buffer
-// Make sure to initialize buffer before calling
-// uint8_t buffer[21] = {0};
-void time_to_string(uint8_t buffer[21], uint64_t tv_sec) {
-	// This is one way to prepare an uint64_t as a string
-	int max = ceil(log10(tv_sec));
-	uint64_t tmp = tv_sec;
-	for (uint8_t *c = buffer + max - 1; c >= buffer; --c)
-	{
-		*c = '0' + (tmp % 10);
-		tmp /= 10;
-	}
+// Write a line to a log in the format "time,data\r\n"
+// Gets time from the RTC
+void write_csv_line(struct log_file * log, uint32_t data) {
+	write_csv_record(log, am1815_read_time(&rtc).tv_sec, data);
 }
 
-// Write a line to fp in the format "data,time\n"
+// Pass a reading through the deadband of its channel, writing whatever
+// reading it lets through to the channel's log
 // Gets time from the RTC
-void write_csv_line(FILE * fp, uint32_t data) {
-	struct timeval time = am1815_read_time(&rtc);
-	uint8_t buffer[21] = {0};
-	time_to_string(buffer, (uint64_t) time.tv_sec);
-	fprintf(fp, "%s,%lu\r\n", buffer, data);
+void write_channel(enum channel channel, uint32_t data) {
+	uint32_t time = am1815_read_time(&rtc).tv_sec;
+#if STATS_WINDOW > 0
+	stats_add(&summaries[channel], time, (int32_t)data);
+#endif
+	if (!RAW_LOGS)
+		return;
+	struct deadband_point point;
+	if (deadband_process(&deadbands[channel], time, (int32_t)data, &point))
+		write_csv_record(channel_logs[channel], point.time, (uint32_t)point.value);
+}
+
+// Arm the AM1815 countdown timer to raise its interrupt, which powers the
+// board back up, after the given number of seconds. Waits beyond what the
+// 1 Hz timer can count are rounded down to whole minutes; waking early only
+// costs a cycle with nothing due.
+void schedule_wakeup(uint32_t seconds) {
+	uint8_t frequency = 0x2; // 1 Hz
+	uint32_t ticks = seconds;
+	if (ticks > 256)
+	{
+		frequency = 0x3; // 1/60 Hz
+		ticks = seconds / 60 > 256 ? 256 : seconds / 60;
+	}
+	if (!ticks)
+		ticks = 1;
+	am1815_write_register(&rtc, 0x18, 0x00); // stop the timer
+	am1815_write_register(&rtc, 0x19, ticks - 1); // countdown timer
+	am1815_write_register(&rtc, 0x1A, ticks - 1); // timer initial value
+	am1815_write_register(&rtc, 0x12, am1815_read_register(&rtc, 0x12) | 0x08); // TIE
+	am1815_write_register(&rtc, 0x18, 0x80 | frequency); // TE, single shot
 }
 
 int main(void)
 {
+	trace_init(&trace, stage_names, STAGE_COUNT);
+	am_hal_stimer_config(AM_HAL_STIMER_CFG_CLEAR | AM_HAL_STIMER_CFG_FREEZE);
+	am_hal_stimer_config(AM_HAL_STIMER_XTAL_32KHZ);
+	energy_init(&energy, &energy_currents, energy_clock_ticks, 32768);
+	// The PDM wait spends most of its time in deep sleep, where the cycle
+	// counter stops
+	trace_sleep_clock(&trace, energy_clock_ticks, 32768, 1u << STAGE_PDM_WAIT);
+
 	// Initialize all the necessary structs
 	uint8_t pins[] = {16};
 	size_t size = 1;
 	adc_init(&adc, pins, size);
+	energy_enable(&energy, ENERGY_ADC);
 	spi_bus_init(&spi_bus, 0);
 	spi_bus_enable(&spi_bus);
+	energy_enable(&energy, ENERGY_SPI_BUS);
 	spi_bus_init_device(&spi_bus, &flash_spi, SPI_CS_2, 4000000u);
 	spi_bus_init_device(&spi_bus, &bmp280_spi, SPI_CS_1, 4000000u);
 	spi_bus_init_device(&spi_bus, &rtc_spi, SPI_CS_3, 2000000u);
@@ -127,9 +689,12 @@ int main(void)
 	bmp280_init(&temp, &bmp280_spi);
 	flash_init(&flash, &flash_spi);
 	pdm_init(&pdm);
+	energy_enable(&energy, ENERGY_PDM);
 	fft_init(&fft);
 
 	// Mount littlefs
+	trace_begin(&trace, STAGE_MOUNT);
+	energy_enable(&energy, ENERGY_FLASH);
     asimple_littlefs_init(&fs, &flash);
     int err = asimple_littlefs_mount(&fs);
     if (err < 0)
@@ -138,17 +703,40 @@ int main(void)
         asimple_littlefs_mount(&fs);
     }
     syscalls_littlefs_init(&fs);
+	trace_end(&trace, STAGE_MOUNT);
 
-	// Open all the files
-	FILE * tfile = fopen("fs:/temperature_data.csv", "a+");
-	FILE * pfile = fopen("fs:/pressure_data.csv", "a+");
-	FILE * lfile = fopen("fs:/light_data.csv", "a+");
-	FILE * mfile = fopen("fs:/microphone_data.csv", "a+");
-	FILE * files[4] = {tfile, pfile, lfile, mfile};
+	// Trust the CSV headers if the last run shut down cleanly
+	trace_begin(&trace, STAGE_MANIFEST);
+	bool clean = boot_manifest_load("fs:/boot.manifest", logs, LOG_COUNT);
+	trace_end(&trace, STAGE_MANIFEST);
+	am_util_stdio_printf("boot manifest: %s\r\n", clean ? "valid" : "missing, checking headers");
+	deadband_load("fs:/deadband.state", deadbands, CHANNEL_COUNT);
+	adapt_load("fs:/adapt.state", schedules, SCHEDULE_COUNT);
+#if STATS_WINDOW > 0
+	if (stats_load("fs:/stats.state", summaries, SUMMARY_COUNT))
+		for (size_t i = 0; i < SUMMARY_COUNT; ++i)
+			stats_reset(&summaries[i]);
+#endif
 
-	// Add CSV headers
-	char headers[4][40] = {"time,temperature data celsius\r\n", "time,pressure data pascals\r\n", "time,light data ohms\r\n", "time,microphone data Hz\r\n"};
-	add_headers(headers, files, 4);
+#if OFFLOAD_WAIT_MS > 0
+	// Give a host the chance to pull the logs before this cycle adds to them
+	trace_begin(&trace, STAGE_OFFLOAD);
+	const struct offload_io offload_io = {
+		.context = &uart,
+		.read = offload_uart_read,
+		.write = offload_uart_write,
+		.baud = offload_uart_baud,
+	};
+	offload_init(&offload, &offload_io, "fs:/", OFFLOAD_BAUD);
+	energy_flash(false);
+	if (offload_wait(&offload, OFFLOAD_WAIT_MS))
+	{
+		energy_flash(true);
+		offload_serve(&offload, UART_BAUD);
+	}
+	energy_flash(true);
+	trace_end(&trace, STAGE_OFFLOAD);
+#endif
 
 	// print the flash ID to make sure the CS is connected correctly (should be 1520C2)
 	am_util_stdio_printf("flash ID: %02X\r\n", flash_read_id(&flash));
@@ -159,36 +747,166 @@ int main(void)
 	// Print BMP280 ID (should be 58)
     am_util_stdio_printf("BMP280 ID: %02X\r\n", bmp280_read_id(&temp));
 
-	// Read current temperature from BMP280 sensor and write to flash
-	uint32_t raw_temp = bmp280_get_adc_temp(&temp);
-    am_util_stdio_printf("compensate_temp float version: %F\r\n", bmp280_compensate_T_double(&temp, raw_temp));
-	uint32_t compensate_temp = (uint32_t) (bmp280_compensate_T_double(&temp, raw_temp) * 1000);
-	write_csv_line(tfile, compensate_temp);
-
-	// Read current pressure from BMP280 sensor and write to flash
-	uint32_t raw_press = bmp280_get_adc_pressure(&temp);
-    am_util_stdio_printf("compensate_press float version: %F\r\n", bmp280_compensate_P_double(&temp, raw_press, raw_temp));
-	uint32_t compensate_press = (uint32_t) (bmp280_compensate_P_double(&temp, raw_press, raw_temp));
-	write_csv_line(pfile, compensate_press);
-
-	// Read current resistance of the Photo Resistor and write to flash
-	adc_trigger(&adc);
-	uint32_t data[1] = {0};
-	uint32_t resistance;
-	while(!(adc_get_sample(&adc, data, pins, size)));
-	const double reference = 1.5;
-	double voltage = data[0] * reference / ((1 << 14) - 1);
-	am_util_stdio_printf("voltage = <%.3f> (0x%04X)\r\n", voltage, data[0]);
-	resistance = (uint32_t)((10000 * voltage)/(3.3 - voltage));
-	am_util_stdio_printf("resistance = <%d>\r\n", resistance);
-	write_csv_line(lfile, resistance);
+	// Only the channels whose interval is up are read this cycle. The RTC is
+	// read once per wake, over SPI; the audio capture below stamps its
+	// records with this time plus how far into the capture they are
+	uint32_t cycle_time = am1815_read_time(&rtc).tv_sec;
+	bool due[SCHEDULE_COUNT];
+	for (size_t i = 0; i < SCHEDULE_COUNT; ++i)
+		due[i] = !ADAPTIVE_SAMPLING || adapt_due(&schedules[i], cycle_time);
+
+	if (due[SCHEDULE_BMP280])
+	{
+		// Read current temperature from BMP280 sensor and write to flash
+		trace_begin(&trace, STAGE_TEMPERATURE);
+		uint32_t raw_temp = bmp280_get_adc_temp(&temp);
+		trace_end(&trace, STAGE_TEMPERATURE);
+#if SINGLE_PRECISION
+		// The datasheet's integer compensation, in 0.01 C
+		int32_t centi_celsius = bmp280_compensate_T_int32(&temp, raw_temp);
+		am_util_stdio_printf("compensate_temp integer version: %ld\r\n", centi_celsius);
+		uint32_t compensate_temp = (uint32_t)(centi_celsius * 10);
+#else
+		am_util_stdio_printf("compensate_temp float version: %F\r\n", bmp280_compensate_T_double(&temp, raw_temp));
+		uint32_t compensate_temp = (uint32_t) (bmp280_compensate_T_double(&temp, raw_temp) * 1000);
+#endif
+		write_channel(CHANNEL_TEMPERATURE, compensate_temp);
+
+		// Read current pressure from BMP280 sensor and write to flash
+		trace_begin(&trace, STAGE_PRESSURE);
+		uint32_t raw_press = bmp280_get_adc_pressure(&temp);
+		trace_end(&trace, STAGE_PRESSURE);
+#if SINGLE_PRECISION
+		// The datasheet's 64 bit integer compensation, in Pa in Q24.8
+		uint32_t compensate_press = bmp280_compensate_P_int64(&temp, raw_press, raw_temp) / 256;
+		am_util_stdio_printf("compensate_press integer version: %lu\r\n", compensate_press);
+#else
+		am_util_stdio_printf("compensate_press float version: %F\r\n", bmp280_compensate_P_double(&temp, raw_press, raw_temp));
+		uint32_t compensate_press = (uint32_t) (bmp280_compensate_P_double(&temp, raw_press, raw_temp));
+#endif
+		write_channel(CHANNEL_PRESSURE, compensate_press);
+
+		const float features[] = {
+			(float)(int32_t)compensate_temp / (float)deadbands[CHANNEL_TEMPERATURE].tolerance,
+			(float)compensate_press / (float)deadbands[CHANNEL_PRESSURE].tolerance,
+		};
+		adapt_sample(&schedules[SCHEDULE_BMP280], cycle_time, features, 2);
+	}
+
+	if (due[SCHEDULE_LIGHT])
+	{
+		// Read current resistance of the Photo Resistor and write to flash
+		trace_begin(&trace, STAGE_ADC);
+		adc_trigger(&adc);
+		uint32_t data[1] = {0};
+		uint32_t resistance;
+		while(!(adc_get_sample(&adc, data, pins, size)));
+		trace_end(&trace, STAGE_ADC);
+		// 1.5 V reference over 14 bits, photo resistor under 10 kohm from 3.3 V
+		uint32_t voltage = convert_adc_microvolts(data[0], 1500000, (1 << 14) - 1);
+		am_util_stdio_printf("voltage = <%lu.%06lu> (0x%04X)\r\n",
+			voltage / 1000000, voltage % 1000000, data[0]);
+		resistance = convert_divider_ohms(voltage, 3300000, 10000);
+		am_util_stdio_printf("resistance = <%d>\r\n", resistance);
+		write_channel(CHANNEL_LIGHT, resistance);
+
+		const float feature = 10.0f * log10f((float)resistance + 1.0f) / LIGHT_FEATURE_DB;
+		adapt_sample(&schedules[SCHEDULE_LIGHT], cycle_time, &feature, 1);
+	}
 
     // Turn on the PDM and start the first DMA transaction.
     pdm_flush(&pdm);
-    pdm_data_get(&pdm, pdm.g_ui32PDMDataBuffer1);
-    bool toggle = true;
+	bool toggle = due[SCHEDULE_AUDIO];
+	if (toggle)
+	{
+		trace_begin(&trace, STAGE_PDM_WAIT);
+		pdm_data_get(&pdm, pdm.g_ui32PDMDataBuffer1);
+	}
+	// Band energies of the last frame, for the audio schedule
+	float audio_bands[ADAPT_FEATURES] = {0};
 	uint32_t max = 0;
+	// Samples per PDM buffer
+	const uint32_t samples = fft_get_N(&fft);
+#if TONE_HZ > 0 || CLIP_FRAMES > 0 || STATS_WINDOW > 0 || ONSET_FRAMES > 0
+	// Their rate, taken before decimation rounds fft.S down (7813 Hz would
+	// come back as 7812 from fft.S * fft.D)
+	const uint32_t pdm_rate = fft_get_S(&fft);
+#endif
+#if DECIMATION > 1
+	fft_decimate_init(&decimate, &fft, DECIMATION);
+	fft_N(&fft, samples / DECIMATION);
+#endif
 	uint32_t N = fft_get_N(&fft);
+	// The same plan is reused for every frame captured in this run
+	kiss_fftr_cfg cfg = kiss_fftr_alloc(N, 0, NULL, NULL);
+	assert(cfg);
+	// So are the frame buffers, from the arena rather than the stack
+	kiss_fft_scalar *in = arena_alloc(sizeof(kiss_fft_scalar) * N);
+	kiss_fft_cpx *out = arena_alloc(sizeof(kiss_fft_cpx) * (N / 2 + 1));
+	assert(in && out);
+#if BANDPASS_HIGH > 0
+	// Blocks of a power of two samples tile a frame; with an odd number of
+	// taps the transform is then a power of two too
+	uint32_t bandpass_block = 2;
+	while (bandpass_block < BANDPASS_TAPS - 1)
+		bandpass_block *= 2;
+	bool bandpass_ready = false;
+	kiss_fft_scalar *bandpass_taps = arena_alloc(sizeof(kiss_fft_scalar) * BANDPASS_TAPS);
+	if (bandpass_taps && bandpass_block <= N && N % bandpass_block == 0)
+	{
+		fft_filter_bandpass(bandpass_taps, BANDPASS_TAPS, BANDPASS_LOW, BANDPASS_HIGH, fft_get_S(&fft));
+		bandpass_ready = !fft_filter_init(&bandpass, bandpass_taps,
+			BANDPASS_TAPS, bandpass_block + BANDPASS_TAPS - 1);
+	}
+	arena_free(bandpass_taps);
+	if (!bandpass_ready)
+		am_util_stdio_printf("band-pass filter unavailable\r\n");
+#endif
+	uint32_t frame = 0;
+	// Enough frames for everything that consumes them
+	uint32_t frames = 1;
+#if SPECTROGRAM_FRAMES > 0
+	frames = SPECTROGRAM_FRAMES;
+	fft_spectrogram_init(&spectrogram, &fft, SPECTROGRAM_BANDS);
+#endif
+#if ONSET_FRAMES > 0
+	if (frames < ONSET_FRAMES)
+		frames = ONSET_FRAMES;
+	// Captures are hours apart, so each one starts the detector over
+	if (fft_onset_init(&onset, &fft))
+		am_util_stdio_printf("onset detector out of memory\r\n");
+#endif
+#if TONE_HZ > 0
+	const uint32_t tone_bin = (TONE_HZ * TONE_WINDOW + pdm_rate / 2) / pdm_rate;
+	bool tone_ready = !fft_sdft_init(&tone, TONE_WINDOW, &tone_bin, 1, FFT_SDFT_MODULATED);
+	// A sine of amplitude A makes its bin A*N/2 in magnitude
+	const float tone_level = TONE_THRESHOLD * TONE_WINDOW / 2.0f;
+	tone.threshold[0] = tone_level * tone_level;
+	uint32_t tone_samples = 0;
+#endif
+#if PITCH_MAX_HZ > 0
+	// The most confident estimate of the run is the one logged
+	bool pitch_ready = !fft_pitch_init(&pitch, &fft, PITCH_MIN_HZ, PITCH_MAX_HZ);
+	if (!pitch_ready)
+		am_util_stdio_printf("pitch estimator out of memory\r\n");
+	float pitch_hz = 0.0f;
+	float pitch_confidence = 0.0f;
+#endif
+#if MFCC_COEFFS > 0
+	fft_mel_init(&mel, &fft, MEL_BANDS, MFCC_COEFFS, 0.0f, fft_get_S(&fft) / 2.0f);
+	float mfcc_sum[MFCC_COEFFS] = {0};
+#endif
+#if CLIP_FRAMES > 0
+	bool clipping = false;
+	uint32_t clip_end = 0;
+	int16_t *pcm = arena_alloc(sizeof(int16_t) * samples);
+	assert(pcm);
+	// The clip budget assumes buffers of this size
+	assert(ADPCM_CLIP_HEADER_SIZE + CLIP_FRAMES * samples / 2 <= CLIP_BYTES);
+#endif
+	// Most of the capture is spent in deep sleep waiting on the PDM, with the
+	// flash idle; only the log writes below use it
+	energy_flash(false);
     while(toggle)
     {
         am_hal_uart_tx_flush(uart.handle);
@@ -198,28 +916,303 @@ int main(void)
         if (ready)
         {
             ready = false;
+			trace_end(&trace, STAGE_PDM_WAIT);
 			int16_t *pi16PDMData = (int16_t *)pdm.g_ui32PDMDataBuffer1;
 			// FFT transform
-			kiss_fft_scalar in[N];
-			kiss_fft_cpx out[N / 2 + 1];
+#if DECIMATION > 1
+			fft_decimate_process(&decimate, pi16PDMData, samples, in);
+#else
 			for (uint32_t j = 0; j < N; j++){
 				in[j] = pi16PDMData[j];
 			}
-			max = TestFftReal(&fft, in, out);
-			toggle = false;
+#endif
+#if BANDPASS_HIGH > 0
+			// Frames follow each other closely enough to keep the filter
+			// history across them
+			trace_begin(&trace, STAGE_BANDPASS);
+			for (uint32_t j = 0; bandpass_ready && j < N; j += bandpass.block)
+				fft_filter_process(&bandpass, in + j, in + j);
+			trace_end(&trace, STAGE_BANDPASS);
+#endif
+			++frame;
+#if CLIP_FRAMES > 0 || STATS_WINDOW > 0 || ONSET_FRAMES > 0
+			// Where this frame starts in the capture, as buffers follow each
+			// other without gaps
+			uint32_t frame_ms = (uint32_t)((uint64_t)(frame - 1) * samples * 1000 / pdm_rate);
+#endif
+#if CLIP_FRAMES > 0 || STATS_WINDOW > 0
+			// Taken while the samples are still in the DMA buffer, which the
+			// next capture overwrites
+			uint16_t peak = adpcm_peak_amplitude(pi16PDMData, samples);
+#endif
+#if TONE_HZ > 0
+			// Slide over every sample of the buffer, before the DMA reuses it,
+			// logging each sample at which the tone shows up
+			for (size_t used = 0; tone_ready && used < samples;)
+			{
+				size_t pushed;
+				bool hit = fft_sdft_push_block(&tone, pi16PDMData + used, samples - used, &pushed, NULL);
+				used += pushed;
+				if (!hit)
+					continue;
+				uint32_t ms = (uint32_t)((uint64_t)(tone_samples + used) * 1000 / pdm_rate);
+				uint32_t now = cycle_time + ms / 1000;
+				uint8_t stamp[21] = {0};
+				time_to_string(stamp, now);
+				char record[40];
+				int record_len = snprintf(record, sizeof(record), "%s,%lu\r\n", stamp,
+					(unsigned long)ms);
+				energy_flash(true);
+				log_file_write(&logs[LOG_TONE], now, record, record_len);
+				energy_flash(false);
+			}
+			tone_samples += samples;
+#endif
+#if CLIP_FRAMES > 0
+			// Keep the raw samples for the clip, the DMA buffer is about to be
+			// reused
+			bool clip_start = false;
+			if (!clipping && peak >= CLIP_THRESHOLD)
+			{
+				clip_start = true;
+				clipping = true;
+				clip_end = frame + CLIP_FRAMES - 1;
+			}
+			if (clipping)
+				memcpy(pcm, pi16PDMData, sizeof(int16_t) * samples);
+			bool more = frame < frames || (clipping && frame < clip_end);
+#else
+			bool more = frame < frames;
+#endif
+			// The samples are copied out, so the next capture can start
+			if (more)
+			{
+				trace_begin(&trace, STAGE_PDM_WAIT);
+				pdm_data_get(&pdm, pdm.g_ui32PDMDataBuffer1);
+			}
+			else
+				toggle = false;
+
+			if (frame <= frames)
+			{
+				trace_begin(&trace, STAGE_FFT);
+				max = fft_peak(&fft, cfg, in, out);
+				trace_end(&trace, STAGE_FFT);
+#if PITCH_MAX_HZ > 0
+				if (pitch_ready)
+				{
+					trace_begin(&trace, STAGE_PITCH);
+					float confidence;
+					float hz = fft_pitch_estimate(&pitch, &fft, in, &confidence);
+					trace_end(&trace, STAGE_PITCH);
+					if (confidence > pitch_confidence)
+					{
+						pitch_hz = hz;
+						pitch_confidence = confidence;
+					}
+				}
+#endif
+				if (frame == frames)
+					fft_band_energies(&fft, out, audio_bands, ADAPT_FEATURES);
+#if STATS_WINDOW > 0
+				uint32_t now = cycle_time + frame_ms / 1000;
+				stats_add(&summaries[SUMMARY_SOUND], now, peak);
+				stats_add(&summaries[SUMMARY_FREQUENCY], now, max);
+#endif
+#if SPECTROGRAM_FRAMES > 0
+				if (frame <= SPECTROGRAM_FRAMES)
+					fft_spectrogram_frame(&spectrogram, out,
+						spectrogram_block + (frame - 1) * SPECTROGRAM_BANDS);
+#endif
+#if ONSET_FRAMES > 0
+				struct fft_onset_record event;
+				if (onset.previous && frame <= ONSET_FRAMES &&
+					fft_onset_update(&onset, out, cycle_time + frame_ms / 1000, &event))
+				{
+					// The seconds alone can't tell apart onsets a frame apart
+					uint8_t stamp[21] = {0};
+					time_to_string(stamp, event.time);
+					char record[56];
+					int record_len = snprintf(record, sizeof(record), "%s,%lu,%u,%u\r\n",
+						stamp, (unsigned long)frame_ms, event.strength, event.bin);
+					energy_flash(true);
+					log_file_write(&logs[LOG_ONSET], event.time, record, record_len);
+					energy_flash(false);
+				}
+#endif
+#if MFCC_COEFFS > 0
+				fft_mel_value mfcc[MFCC_COEFFS];
+				fft_mel_mfcc(&mel, out, mfcc);
+				for (size_t i = 0; i < MFCC_COEFFS; ++i)
+					mfcc_sum[i] += mfcc[i];
+#endif
+			}
+#if CLIP_FRAMES > 0
+			energy_flash(true);
+			if (clip_start)
+			{
+				uint32_t now = cycle_time + frame_ms / 1000;
+				char path[LOG_FILE_PATH_MAX];
+				log_file_next_segment(&clips, path);
+				if (adpcm_clip_open(&clip, path, pdm_rate, now))
+					clipping = false;
+			}
+			if (clipping)
+				adpcm_clip_write(&clip, pcm, samples);
+			energy_flash(false);
+#endif
         }
+        energy_sleep(&energy);
         am_hal_sysctrl_sleep(AM_HAL_SYSCTRL_SLEEP_DEEP);
+        energy_wake(&energy);
     }
+	energy_flash(true);
+	kiss_fftr_free(cfg);
+	arena_free(in);
+	arena_free(out);
+#if BANDPASS_HIGH > 0
+	if (bandpass_ready)
+		fft_filter_destroy(&bandpass);
+#endif
+#if ONSET_FRAMES > 0
+	fft_onset_destroy(&onset);
+#endif
+#if TONE_HZ > 0
+	fft_sdft_destroy(&tone);
+#endif
+#if PITCH_MAX_HZ > 0
+	if (pitch_ready)
+		fft_pitch_destroy(&pitch);
+#endif
+	if (due[SCHEDULE_AUDIO])
+	{
+		am_util_stdio_printf("Frequency: %d\r\n", max);
+		for (size_t i = 0; i < ADAPT_FEATURES; ++i)
+			audio_bands[i] = 10.0f * log10f(audio_bands[i] + 1.0f) / AUDIO_FEATURE_DB;
+		adapt_sample(&schedules[SCHEDULE_AUDIO], cycle_time, audio_bands, ADAPT_FEATURES);
+	}
+#if CLIP_FRAMES > 0
+	arena_free(pcm);
+	if (clipping)
+		adpcm_clip_close(&clip);
+#endif
+
+#if SPECTROGRAM_FRAMES > 0
+	if (due[SCHEDULE_AUDIO])
+	{
+		FILE * sfile = log_file_append(&logs[LOG_SPECTROGRAM], cycle_time,
+			FFT_SPECTROGRAM_HEADER_SIZE + SPECTROGRAM_FRAMES * SPECTROGRAM_BANDS);
+		if (sfile)
+			fft_spectrogram_write(&spectrogram, &fft, sfile, cycle_time,
+				spectrogram_block, SPECTROGRAM_FRAMES);
+	}
+#endif
+#if MFCC_COEFFS > 0
+	// One record of the coefficients averaged over this run's frames
+	if (due[SCHEDULE_AUDIO])
+	{
+		uint32_t mfcc_time = am1815_read_time(&rtc).tv_sec;
+		uint8_t mfcc_stamp[21] = {0};
+		time_to_string(mfcc_stamp, mfcc_time);
+		char record[32 + 8 * MFCC_COEFFS];
+		static_assert(sizeof(record) <= LOG_FILE_LINE_MAX, "MFCC records must fit log_file_query");
+		int record_len = snprintf(record, sizeof(record), "%s", mfcc_stamp);
+		for (size_t i = 0; i < MFCC_COEFFS; ++i)
+			record_len += snprintf(record + record_len, sizeof(record) - record_len,
+				",%ld", lrintf(mfcc_sum[i] * 100.0f / frames));
+		record_len += snprintf(record + record_len, sizeof(record) - record_len, "\r\n");
+		log_file_write(&logs[LOG_MFCC], mfcc_time, record, record_len);
+	}
+#endif
+#if PITCH_MAX_HZ > 0
+	if (due[SCHEDULE_AUDIO] && pitch_confidence > 0.0f)
+	{
+		uint32_t pitch_time = am1815_read_time(&rtc).tv_sec;
+		uint8_t pitch_stamp[21] = {0};
+		time_to_string(pitch_stamp, pitch_time);
+		char record[48];
+		int record_len = snprintf(record, sizeof(record), "%s,%lu,%lu\r\n", pitch_stamp,
+			(unsigned long)lrintf(pitch_hz * 100.0f), (unsigned long)lrintf(pitch_confidence * 100.0f));
+		log_file_write(&logs[LOG_PITCH], pitch_time, record, record_len);
+	}
+#endif
 	// Save frequency with highest amplitude to flash
-	write_csv_line(mfile, max);
+	if (RAW_LOGS && due[SCHEDULE_AUDIO])
+		write_csv_line(&logs[LOG_MICROPHONE], max);
 
-	write_csv_line(stdout, 0);
+#if STATS_WINDOW > 0
+	// Close the windows that are over, one summary record each
+	uint32_t summary_now = am1815_read_time(&rtc).tv_sec;
+	for (size_t i = 0; i < SUMMARY_COUNT; ++i)
+	{
+		struct stats *stats = &summaries[i];
+		if (!stats_window_done(stats, summary_now, STATS_WINDOW))
+			continue;
+		char record[96];
+		int record_len = stats_format(stats, summary_names[i], record, sizeof(record));
+		log_file_write(&logs[LOG_SUMMARY], stats->start, record, record_len);
+		stats_reset(stats);
+	}
+	stats_save("fs:/stats.state", summaries, SUMMARY_COUNT);
+#endif
+
+	char line[40];
+	format_csv_line(line, sizeof(line), am1815_read_time(&rtc).tv_sec, 0);
+	fputs(line, stdout);
+
+	// Account for this cycle. The ADC and PDM are never powered down
+	// explicitly, they stay on until the board is shut down after main.
+	energy_disable(&energy, ENERGY_ADC);
+	energy_disable(&energy, ENERGY_PDM);
+	char summary[96];
+	uint32_t summary_time = am1815_read_time(&rtc).tv_sec;
+	int summary_len = energy_format_summary(&energy, summary, sizeof(summary), summary_time);
+	log_file_write(&logs[LOG_ENERGY], summary_time, summary, summary_len);
+	am_util_stdio_printf("energy: %.3f uAh\r\n", (double)energy_uah(&energy));
+
+	// Report how many records the deadbands saved so far
+	deadband_save("fs:/deadband.state", deadbands, CHANNEL_COUNT);
+	for (size_t i = 0; i < CHANNEL_COUNT; ++i)
+	{
+		const struct deadband *band = &deadbands[i];
+		uint32_t skipped = band->seen - band->written;
+		am_util_stdio_printf("deadband: %s %lu of %lu readings written, %lu%% fewer records\r\n",
+			channel_names[i], band->written, band->seen,
+			band->seen ? skipped * 100 / band->seen : 0);
+	}
+
+	// Wake up again when the next channel is due
+	adapt_save("fs:/adapt.state", schedules, SCHEDULE_COUNT);
+	for (size_t i = 0; i < SCHEDULE_COUNT; ++i)
+		am_util_stdio_printf("schedule: %s every %lu s, %lu samples\r\n",
+			schedule_names[i], schedules[i].interval, schedules[i].samples);
+	if (ADAPTIVE_SAMPLING)
+	{
+		uint32_t wait = adapt_wait(schedules, SCHEDULE_COUNT, am1815_read_time(&rtc).tv_sec);
+		schedule_wakeup(wait);
+		am_util_stdio_printf("next wake-up in %lu s\r\n", wait);
+	}
+
+	// Close files, and record that this run shut down cleanly
+	for (size_t i = 0; i < LOG_COUNT; ++i)
+		log_file_close(&logs[i]);
+	boot_manifest_save("fs:/boot.manifest", logs, LOG_COUNT);
+
+	// Export the stage timings, to the UART at least if the flash is full
+	FILE * trfile = fopen("fs:/trace.bin", "w");
+	if (trfile)
+	{
+		trace_dump(&trace, trfile);
+		fclose(trfile);
+	}
+	trace_print(&trace, stdout);
 
-	// Close files
-	fclose(tfile);
-	fclose(pfile);
-	fclose(lfile);
-	fclose(mfile);
+	// For memory_report.py, which reads it from a capture of the UART
+	struct arena_stats arena_stats;
+	arena_get_stats(&arena_stats);
+	am_util_stdio_printf("arena: high water %lu of %lu bytes, %lu failed allocations\r\n",
+		(unsigned long)arena_stats.high_water, (unsigned long)arena_stats.size,
+		(unsigned long)arena_stats.failures);
 
 	am_util_stdio_printf("done\r\n");
 
@@ -0,0 +1,268 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+#include <offload.h>
+#include <bytes.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+// Same table as the SVL bootloader and svl.py
+static const uint16_t crc_table[256] = {
+	0x0000, 0x8005, 0x800F, 0x000A, 0x801B, 0x001E, 0x0014, 0x8011,
+	0x8033, 0x0036, 0x003C, 0x8039, 0x0028, 0x802D, 0x8027, 0x0022,
+	0x8063, 0x0066, 0x006C, 0x8069, 0x0078, 0x807D, 0x8077, 0x0072,
+	0x0050, 0x8055, 0x805F, 0x005A, 0x804B, 0x004E, 0x0044, 0x8041,
+	0x80C3, 0x00C6, 0x00CC, 0x80C9, 0x00D8, 0x80DD, 0x80D7, 0x00D2,
+	0x00F0, 0x80F5, 0x80FF, 0x00FA, 0x80EB, 0x00EE, 0x00E4, 0x80E1,
+	0x00A0, 0x80A5, 0x80AF, 0x00AA, 0x80BB, 0x00BE, 0x00B4, 0x80B1,
+	0x8093, 0x0096, 0x009C, 0x8099, 0x0088, 0x808D, 0x8087, 0x0082,
+	0x8183, 0x0186, 0x018C, 0x8189, 0x0198, 0x819D, 0x8197, 0x0192,
+	0x01B0, 0x81B5, 0x81BF, 0x01BA, 0x81AB, 0x01AE, 0x01A4, 0x81A1,
+	0x01E0, 0x81E5, 0x81EF, 0x01EA, 0x81FB, 0x01FE, 0x01F4, 0x81F1,
+	0x81D3, 0x01D6, 0x01DC, 0x81D9, 0x01C8, 0x81CD, 0x81C7, 0x01C2,
+	0x0140, 0x8145, 0x814F, 0x014A, 0x815B, 0x015E, 0x0154, 0x8151,
+	0x8173, 0x0176, 0x017C, 0x8179, 0x0168, 0x816D, 0x8167, 0x0162,
+	0x8123, 0x0126, 0x012C, 0x8129, 0x0138, 0x813D, 0x8137, 0x0132,
+	0x0110, 0x8115, 0x811F, 0x011A, 0x810B, 0x010E, 0x0104, 0x8101,
+	0x8303, 0x0306, 0x030C, 0x8309, 0x0318, 0x831D, 0x8317, 0x0312,
+	0x0330, 0x8335, 0x833F, 0x033A, 0x832B, 0x032E, 0x0324, 0x8321,
+	0x0360, 0x8365, 0x836F, 0x036A, 0x837B, 0x037E, 0x0374, 0x8371,
+	0x8353, 0x0356, 0x035C, 0x8359, 0x0348, 0x834D, 0x8347, 0x0342,
+	0x03C0, 0x83C5, 0x83CF, 0x03CA, 0x83DB, 0x03DE, 0x03D4, 0x83D1,
+	0x83F3, 0x03F6, 0x03FC, 0x83F9, 0x03E8, 0x83ED, 0x83E7, 0x03E2,
+	0x83A3, 0x03A6, 0x03AC, 0x83A9, 0x03B8, 0x83BD, 0x83B7, 0x03B2,
+	0x0390, 0x8395, 0x839F, 0x039A, 0x838B, 0x038E, 0x0384, 0x8381,
+	0x0280, 0x8285, 0x828F, 0x028A, 0x829B, 0x029E, 0x0294, 0x8291,
+	0x82B3, 0x02B6, 0x02BC, 0x82B9, 0x02A8, 0x82AD, 0x82A7, 0x02A2,
+	0x82E3, 0x02E6, 0x02EC, 0x82E9, 0x02F8, 0x82FD, 0x82F7, 0x02F2,
+	0x02D0, 0x82D5, 0x82DF, 0x02DA, 0x82CB, 0x02CE, 0x02C4, 0x82C1,
+	0x8243, 0x0246, 0x024C, 0x8249, 0x0258, 0x825D, 0x8257, 0x0252,
+	0x0270, 0x8275, 0x827F, 0x027A, 0x826B, 0x026E, 0x0264, 0x8261,
+	0x0220, 0x8225, 0x822F, 0x022A, 0x823B, 0x023E, 0x0234, 0x8231,
+	0x8213, 0x0216, 0x021C, 0x8219, 0x0208, 0x820D, 0x8207, 0x0202,
+};
+
+void offload_init(struct offload *offload, const struct offload_io *io, const char *root, uint32_t max_baud)
+{
+	memset(offload, 0, sizeof(*offload));
+	offload->io = *io;
+	offload->root = root;
+	offload->max_baud = max_baud;
+}
+
+uint16_t offload_crc16(uint16_t crc, const uint8_t *data, size_t size)
+{
+	for (size_t i = 0; i < size; ++i)
+		crc = (crc << 8) ^ crc_table[data[i] ^ (crc >> 8)];
+	return crc;
+}
+
+int offload_send_packet(struct offload *offload, uint8_t cmd, const uint8_t *data, size_t size)
+{
+	size_t length = 1 + size + 2;
+	uint8_t header[3] = {length >> 8, length, cmd};
+	uint16_t crc = offload_crc16(offload_crc16(0, &cmd, 1), data, size);
+	uint8_t footer[2] = {crc >> 8, crc};
+	if (offload->io.write(offload->io.context, header, sizeof(header)) ||
+		(size && offload->io.write(offload->io.context, data, size)) ||
+		offload->io.write(offload->io.context, footer, sizeof(footer)))
+		return -1;
+	return 0;
+}
+
+// Reads exactly size bytes unless the transport times out first
+static size_t offload_read(struct offload *offload, uint8_t *data, size_t size, uint32_t timeout)
+{
+	size_t read = 0;
+	while (read < size)
+	{
+		size_t chunk = offload->io.read(offload->io.context, data + read, size - read, timeout);
+		if (!chunk)
+			break;
+		read += chunk;
+	}
+	return read;
+}
+
+// Throws away whatever is left of a bad packet so the next one starts clean
+static void offload_drain(struct offload *offload)
+{
+	uint8_t buffer[32];
+	while (offload->io.read(offload->io.context, buffer, sizeof(buffer), 0))
+		;
+}
+
+int offload_wait_packet(struct offload *offload, uint32_t timeout)
+{
+	uint8_t length[2];
+	if (offload_read(offload, length, 1, timeout) != 1 ||
+		offload_read(offload, length + 1, 1, OFFLOAD_TIMEOUT_MS) != 1)
+		return -1;
+
+	size_t size = (length[0] << 8) | length[1];
+	if (size < 3 || size > OFFLOAD_PACKET_MAX)
+	{
+		offload_drain(offload);
+		return -1;
+	}
+	if (offload_read(offload, offload->packet, size, OFFLOAD_TIMEOUT_MS) != size)
+		return -1;
+	// The CRC over the payload and its own CRC is 0
+	if (offload_crc16(0, offload->packet, size))
+	{
+		offload_drain(offload);
+		return -1;
+	}
+	offload->size = size - 2;
+	return offload->packet[0];
+}
+
+bool offload_wait(struct offload *offload, uint32_t timeout)
+{
+	if (offload_wait_packet(offload, timeout) != OFFLOAD_CMD_HELLO || offload->size < 5)
+		return false;
+
+	uint32_t baud = bytes_get_be32(offload->packet + 1);
+	if (!baud || baud > offload->max_baud)
+		baud = offload->max_baud;
+	uint8_t reply[9] = {
+		OFFLOAD_VERSION >> 8, OFFLOAD_VERSION & 0xFF,
+		OFFLOAD_FRAME_SIZE >> 8, OFFLOAD_FRAME_SIZE & 0xFF,
+		OFFLOAD_MAX_WINDOW,
+	};
+	bytes_put_be32(reply + 5, baud);
+	if (offload_send_packet(offload, OFFLOAD_CMD_HELLO, reply, sizeof(reply)))
+		return false;
+	if (offload->io.baud)
+		offload->io.baud(offload->io.context, baud);
+	return true;
+}
+
+// Streams the file requested by the OPEN packet in offload->packet. Returns
+// -1 only if the host stopped responding; a missing file is reported to the
+// host and the session carries on.
+static int offload_transfer(struct offload *offload)
+{
+	if (offload->size < 1 + 4 + 1 + 1 || offload->size - 6 > OFFLOAD_PATH_MAX)
+		return offload_send_packet(offload, OFFLOAD_CMD_ERROR, NULL, 0);
+
+	uint32_t offset = bytes_get_be32(offload->packet + 1);
+	uint32_t window = offload->packet[5];
+	if (window < 1)
+		window = 1;
+	else if (window > OFFLOAD_MAX_WINDOW)
+		window = OFFLOAD_MAX_WINDOW;
+
+	char path[strlen(offload->root) + OFFLOAD_PATH_MAX + 1];
+	snprintf(path, sizeof(path), "%s%.*s", offload->root,
+		(int)(offload->size - 6), (const char *)offload->packet + 6);
+	FILE *fp = fopen(path, "r");
+	if (!fp)
+		return offload_send_packet(offload, OFFLOAD_CMD_ERROR, NULL, 0);
+
+	fseek(fp, 0, SEEK_END);
+	long end = ftell(fp);
+	uint32_t size = end > 0 ? end : 0;
+	// The file shrank or was replaced since the host's copy, start over
+	if (offset > size)
+		offset = 0;
+
+	uint8_t info[8];
+	bytes_put_be32(info, size);
+	bytes_put_be32(info + 4, offset);
+	if (offload_send_packet(offload, OFFLOAD_CMD_INFO, info, sizeof(info)))
+	{
+		fclose(fp);
+		return -1;
+	}
+
+	// Everything before acked has been received in order; everything before
+	// sent has been sent at least once
+	uint32_t acked = offset;
+	uint32_t sent = offset;
+	unsigned retries = 0;
+	fseek(fp, sent, SEEK_SET);
+	while (acked < size)
+	{
+		uint32_t timeout = OFFLOAD_TIMEOUT_MS;
+		if (sent < size && sent - acked < window * OFFLOAD_FRAME_SIZE)
+		{
+			uint32_t chunk = size - sent < OFFLOAD_FRAME_SIZE ? size - sent : OFFLOAD_FRAME_SIZE;
+			bytes_put_be32(offload->frame, sent);
+			if (fread(offload->frame + 4, chunk, 1, fp) != 1 ||
+				offload_send_packet(offload, OFFLOAD_CMD_DATA, offload->frame, 4 + chunk))
+				break;
+			sent += chunk;
+			// Only poll for acknowledgements while the window has room
+			timeout = 0;
+		}
+
+		int cmd = offload_wait_packet(offload, timeout);
+		if (cmd < 0)
+		{
+			if (timeout == 0)
+				continue;
+			// Nothing heard for a while, go back to what the host has
+			if (++retries > OFFLOAD_RETRIES)
+				break;
+			sent = acked;
+			fseek(fp, sent, SEEK_SET);
+			continue;
+		}
+		retries = 0;
+		if ((cmd != OFFLOAD_CMD_ACK && cmd != OFFLOAD_CMD_RETRY) || offload->size < 5)
+			continue;
+
+		uint32_t position = bytes_get_be32(offload->packet + 1);
+		// Stale acknowledgements from before a rewind are harmless, skip them
+		if (position < acked || position > sent)
+			continue;
+		acked = position;
+		if (cmd == OFFLOAD_CMD_RETRY)
+		{
+			sent = acked;
+			fseek(fp, sent, SEEK_SET);
+		}
+	}
+	fclose(fp);
+	if (acked < size)
+		return -1;
+
+	uint8_t end_size[4];
+	bytes_put_be32(end_size, size);
+	return offload_send_packet(offload, OFFLOAD_CMD_END, end_size, sizeof(end_size));
+}
+
+int offload_serve(struct offload *offload, uint32_t baud)
+{
+	int result = -1;
+	unsigned retries = 0;
+	while (retries <= OFFLOAD_RETRIES)
+	{
+		int cmd = offload_wait_packet(offload, OFFLOAD_TIMEOUT_MS);
+		if (cmd < 0)
+		{
+			++retries;
+			continue;
+		}
+		retries = 0;
+		if (cmd == OFFLOAD_CMD_OPEN)
+		{
+			if (offload_transfer(offload))
+				break;
+		}
+		else if (cmd == OFFLOAD_CMD_DONE)
+		{
+			offload_send_packet(offload, OFFLOAD_CMD_DONE, NULL, 0);
+			result = 0;
+			break;
+		}
+	}
+	if (offload->io.baud)
+		offload->io.baud(offload->io.context, baud);
+	return result;
+}
@@ -0,0 +1,136 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+#include <stats.h>
+#include <bytes.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#define STATS_RECORD_SIZE 32
+
+void stats_reset(struct stats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+}
+
+void stats_add(struct stats *stats, uint32_t time, int32_t value)
+{
+	if (stats->count == 0)
+	{
+		stats->start = time;
+		stats->shift = value;
+		stats->min = value;
+		stats->max = value;
+	}
+	else if (value < stats->min)
+	{
+		stats->min = value;
+	}
+	else if (value > stats->max)
+	{
+		stats->max = value;
+	}
+
+	stats->count++;
+	float x = (float)((int64_t)value - stats->shift);
+	float delta = x - stats->mean;
+	stats->mean += delta / (float)stats->count;
+
+	float term = delta * (x - stats->mean) - stats->m2_error;
+	float m2 = stats->m2 + term;
+	stats->m2_error = (m2 - stats->m2) - term;
+	stats->m2 = m2;
+}
+
+float stats_mean(const struct stats *stats)
+{
+	return (float)stats->shift + stats->mean;
+}
+
+float stats_variance(const struct stats *stats)
+{
+	if (stats->count < 2)
+		return 0.0f;
+	return stats->m2 / (float)(stats->count - 1);
+}
+
+bool stats_window_done(const struct stats *stats, uint32_t now, uint32_t window)
+{
+	return stats->count && now - stats->start >= window;
+}
+
+int stats_format(const struct stats *stats, const char *name, char line[], size_t size)
+{
+	return snprintf(line, size, "%lu,%s,%lu,%.3f,%.3f,%ld,%ld\r\n",
+		(unsigned long)stats->start, name, (unsigned long)stats->count,
+		(double)stats_mean(stats), (double)stats_variance(stats),
+		(long)stats->min, (long)stats->max);
+}
+
+int stats_load(const char *path, struct stats stats[], size_t count)
+{
+	FILE *fp = fopen(path, "r");
+	if (!fp)
+		return -1;
+
+	uint8_t header[BYTES_HEADER_SIZE];
+	if (fread(header, sizeof(header), 1, fp) != 1 ||
+		!bytes_check_header(header, "STAT", 1, count))
+	{
+		fclose(fp);
+		return -1;
+	}
+
+	int result = 0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		uint8_t record[STATS_RECORD_SIZE];
+		if (fread(record, sizeof(record), 1, fp) != 1)
+		{
+			result = -1;
+			break;
+		}
+		stats[i].start = bytes_get_le32(record);
+		stats[i].count = bytes_get_le32(record + 4);
+		stats[i].shift = bytes_get_le32(record + 8);
+		stats[i].mean = bytes_bits_float(bytes_get_le32(record + 12));
+		stats[i].m2 = bytes_bits_float(bytes_get_le32(record + 16));
+		stats[i].m2_error = bytes_bits_float(bytes_get_le32(record + 20));
+		stats[i].min = bytes_get_le32(record + 24);
+		stats[i].max = bytes_get_le32(record + 28);
+	}
+	fclose(fp);
+	return result;
+}
+
+int stats_save(const char *path, const struct stats stats[], size_t count)
+{
+	FILE *fp = fopen(path, "w");
+	if (!fp)
+		return -1;
+
+	uint8_t header[BYTES_HEADER_SIZE];
+	bytes_put_header(header, "STAT", 1, count);
+	int result = fwrite(header, sizeof(header), 1, fp) == 1 ? 0 : -1;
+	for (size_t i = 0; i < count && !result; ++i)
+	{
+		uint8_t record[STATS_RECORD_SIZE];
+		bytes_put_le32(record, stats[i].start);
+		bytes_put_le32(record + 4, stats[i].count);
+		bytes_put_le32(record + 8, stats[i].shift);
+		bytes_put_le32(record + 12, bytes_float_bits(stats[i].mean));
+		bytes_put_le32(record + 16, bytes_float_bits(stats[i].m2));
+		bytes_put_le32(record + 20, bytes_float_bits(stats[i].m2_error));
+		bytes_put_le32(record + 24, stats[i].min);
+		bytes_put_le32(record + 28, stats[i].max);
+		if (fwrite(record, sizeof(record), 1, fp) != 1)
+			result = -1;
+	}
+	if (fclose(fp))
+		result = -1;
+	return result;
+}
@@ -0,0 +1,197 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+// Host builds need clock_gettime
+#if !defined(__arm__)
+#define _POSIX_C_SOURCE 199309L
+#endif
+
+#include <trace.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__arm__)
+
+// Cortex-M4 debug registers, see the ARMv7-M Architecture Reference Manual.
+// Addressed directly so this library does not depend on the Ambiq SDK.
+#define DEMCR (*(volatile uint32_t *)0xE000EDFCu)
+#define DEMCR_TRCENA (1u << 24)
+#define DWT_CTRL (*(volatile uint32_t *)0xE0001000u)
+#define DWT_CTRL_CYCCNTENA (1u << 0)
+#define DWT_CYCCNT (*(volatile uint32_t *)0xE0001004u)
+
+// redboard_init runs the core at AM_HAL_CLKGEN_CONTROL_SYSCLK_MAX
+#define TRACE_FREQUENCY 48000000u
+
+static void trace_clock_init(void)
+{
+	DEMCR |= DEMCR_TRCENA;
+	DWT_CYCCNT = 0;
+	DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+}
+
+uint32_t trace_now(void)
+{
+	return DWT_CYCCNT;
+}
+
+#else
+
+#include <time.h>
+
+#define TRACE_FREQUENCY 1000000000u
+
+static void trace_clock_init(void)
+{
+}
+
+uint32_t trace_now(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint32_t)((uint64_t)now.tv_sec * TRACE_FREQUENCY + now.tv_nsec);
+}
+
+#endif
+
+uint32_t trace_frequency(void)
+{
+	return TRACE_FREQUENCY;
+}
+
+void trace_init(struct trace *trace, const char * const names[], uint8_t stages)
+{
+	memset(trace, 0, sizeof(*trace));
+	trace->names = names;
+	trace->stages = stages < TRACE_MAX_STAGES ? stages : TRACE_MAX_STAGES;
+	trace_clock_init();
+}
+
+void trace_sleep_clock(struct trace *trace, trace_clock clock, uint32_t frequency, uint32_t stages)
+{
+	trace->sleep_clock = clock;
+	trace->sleep_frequency = frequency;
+	trace->sleep_stages = clock && frequency ? stages : 0;
+}
+
+static bool trace_sleeps(const struct trace *trace, uint8_t stage)
+{
+	return trace->sleep_stages & (1u << stage);
+}
+
+void trace_begin(struct trace *trace, uint8_t stage)
+{
+	if (stage >= trace->stages)
+		return;
+	if (trace_sleeps(trace, stage))
+		trace->sleep_open[stage] = trace->sleep_clock();
+	trace->open[stage] = trace_now();
+}
+
+void trace_end(struct trace *trace, uint8_t stage)
+{
+	uint32_t now = trace_now();
+	if (stage >= trace->stages)
+		return;
+	struct trace_sample *sample = &trace->samples[trace->recorded % TRACE_CAPACITY];
+	sample->begin = trace->open[stage];
+	sample->duration = now - trace->open[stage];
+	if (trace_sleeps(trace, stage))
+	{
+		// Sleep clock counts to ticks, saturating rather than wrapping
+		uint64_t ticks = (uint64_t)(trace->sleep_clock() - trace->sleep_open[stage]) *
+			TRACE_FREQUENCY / trace->sleep_frequency;
+		sample->duration = ticks > UINT32_MAX ? UINT32_MAX : (uint32_t)ticks;
+	}
+	sample->stage = stage;
+	trace->recorded++;
+}
+
+// Serializes the trace through a byte sink, shared by the binary and hex
+// dumps so both always carry the same bytes
+typedef int (*trace_sink)(void *context, const uint8_t *data, size_t size);
+
+static int trace_put_u32(trace_sink sink, void *context, uint32_t value)
+{
+	uint8_t bytes[4] = {value, value >> 8, value >> 16, value >> 24};
+	return sink(context, bytes, sizeof(bytes));
+}
+
+static int trace_serialize(const struct trace *trace, trace_sink sink, void *context)
+{
+	uint32_t count = trace->recorded < TRACE_CAPACITY ? trace->recorded : TRACE_CAPACITY;
+	uint8_t header[8] = {'T', 'R', 'C', 'E', 1, trace->stages, count, count >> 8};
+	if (sink(context, header, sizeof(header)) ||
+		trace_put_u32(sink, context, trace_frequency()) ||
+		trace_put_u32(sink, context, trace->recorded))
+		return -1;
+
+	for (uint8_t i = 0; i < trace->stages; ++i)
+	{
+		const char *name = trace->names[i] ? trace->names[i] : "";
+		if (sink(context, (const uint8_t *)name, strlen(name) + 1))
+			return -1;
+	}
+
+	uint32_t first = trace->recorded - count;
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		const struct trace_sample *sample = &trace->samples[(first + i) % TRACE_CAPACITY];
+		if (sink(context, &sample->stage, 1) ||
+			trace_put_u32(sink, context, sample->begin) ||
+			trace_put_u32(sink, context, sample->duration))
+			return -1;
+	}
+	return 0;
+}
+
+static int trace_sink_file(void *context, const uint8_t *data, size_t size)
+{
+	return fwrite(data, 1, size, context) == size ? 0 : -1;
+}
+
+int trace_dump(const struct trace *trace, FILE *fp)
+{
+	return trace_serialize(trace, trace_sink_file, fp);
+}
+
+#define TRACE_HEX_LINE 32
+
+struct trace_hex
+{
+	FILE *fp;
+	size_t column;
+};
+
+static int trace_sink_hex(void *context, const uint8_t *data, size_t size)
+{
+	struct trace_hex *hex = context;
+	for (size_t i = 0; i < size; ++i)
+	{
+		if (hex->column == 0 && fputs("trace: ", hex->fp) < 0)
+			return -1;
+		if (fprintf(hex->fp, "%02X", data[i]) < 0)
+			return -1;
+		if (++hex->column == TRACE_HEX_LINE)
+		{
+			if (fputs("\r\n", hex->fp) < 0)
+				return -1;
+			hex->column = 0;
+		}
+	}
+	return 0;
+}
+
+int trace_print(const struct trace *trace, FILE *fp)
+{
+	struct trace_hex hex = { .fp = fp, .column = 0 };
+	if (trace_serialize(trace, trace_sink_hex, &hex))
+		return -1;
+	if (hex.column && fputs("\r\n", fp) < 0)
+		return -1;
+	return 0;
+}
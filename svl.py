@@ -19,6 +19,15 @@
 #   no longer exit the bootloader. If the host detects a timeout at any point it
 #   will stop bootloading.
 
+# Uploads can be differential: with --cache, the image last flashed through
+#   this port is kept on the host. The bootloader writes frames in order from
+#   the start of the application and erases each flash page as it reaches it,
+#   so the frames after the last changed one can be skipped as long as the
+#   page holding that frame is completed. The cache must match what is on the
+#   board; pass --force after flashing it any other way.
+# Frame packets, CRC included, are built before the bootloader asks for them
+#   so the host answers each request with a single write.
+
 # Notes about PySerial timeout:
 # The timeout operates on whole functions - that is to say that a call to
 #   ser.read(10) will return after ser.timeout, just as will ser.read(1) (assuming
@@ -59,6 +68,9 @@ SVL_CMD_DONE = 0x06  # finished - all data sent
 
 barWidthInCharacters = 50  # Width of progress bar, ie [###### % complete
 
+frame_size = 512*4  # application bytes per frame, the bootloader's buffer size
+page_size = 8192  # Apollo3 flash page, erased by the bootloader as a whole
+
 crcTable = (
     0x0000, 0x8005, 0x800F, 0x000A, 0x801B, 0x001E, 0x0014, 0x8011,
     0x8033, 0x0036, 0x003C, 0x8039, 0x0028, 0x802D, 0x8027, 0x0022,
@@ -126,6 +138,8 @@ def wait_for_packet(ser):
         return packet
 
     packet['len'] = int.from_bytes(n, byteorder='big', signed=False)    #
+    if(packet['len'] < 3):  # too short to hold a cmd and crc
+        return packet
     payload = ser.read(packet['len'])
 
     if(len(payload) != packet['len']):
@@ -149,7 +163,7 @@ def wait_for_packet(ser):
 # ***********************************************************************************
 
 
-def send_packet(ser, cmd, data):
+def make_packet(cmd, data):
     data = bytearray(data)
     num_bytes = 3 + len(data)
     payload = bytearray(cmd.to_bytes(1, 'big'))
@@ -157,8 +171,33 @@ def send_packet(ser, cmd, data):
     crc = get_crc16(payload)
     payload.extend(bytearray(crc.to_bytes(2, 'big')))
 
-    ser.write(num_bytes.to_bytes(2, 'big'))
-    ser.write(bytes(payload))
+    return num_bytes.to_bytes(2, 'big') + bytes(payload)
+
+
+def send_packet(ser, cmd, data):
+    ser.write(make_packet(cmd, data))
+
+
+# ***********************************************************************************
+#
+# Number of frames that need sending, given the image last flashed
+#
+# ***********************************************************************************
+def frames_to_send(application, cached):
+    total_frames = math.ceil(len(application)/frame_size)
+    last_changed = -1
+    for frame in range(total_frames):
+        start = frame*frame_size
+        new = application[start:start+frame_size]
+        if(new != cached[start:start+len(new)]):
+            last_changed = frame
+    if(last_changed < 0):
+        return 0
+
+    # Finish the page the last changed frame is in, the bootloader erased it
+    frames_per_page = page_size // frame_size
+    end = (last_changed // frames_per_page + 1) * frames_per_page
+    return min(end, total_frames)
 
 
 # ***********************************************************************************
@@ -201,7 +240,6 @@ def phase_setup(ser):
 def phase_bootload(ser):
 
     startTime = time.time()
-    frame_size = 512*4
 
     resend_max = 4
     resend_count = 0
@@ -213,6 +251,17 @@ def phase_bootload(ser):
         total_len = len(application)
 
         total_frames = math.ceil(total_len/frame_size)
+        send_frames = total_frames
+        if(args.cache and not args.force and os.path.exists(args.cache)):
+            with open(args.cache, mode='rb') as cachefile:
+                send_frames = frames_to_send(application, cachefile.read())
+            verboseprint('\t' + str(total_frames - send_frames) +
+                         ' trailing frames unchanged since the last upload')
+
+        # Build every packet up front so each request is answered right away
+        frames = [make_packet(SVL_CMD_FRAME,
+                              application[(f*frame_size):((f+1)*frame_size)])
+                  for f in range(send_frames)]
         curr_frame = 0
         progressChars = 0
 
@@ -250,14 +299,15 @@ def phase_bootload(ser):
                 bl_succeeded = False
                 bl_done = True
 
-            if(curr_frame <= total_frames):
-                frame_data = application[(
-                    (curr_frame-1)*frame_size):((curr_frame-1+1)*frame_size)]
+            if(bl_done):
+                break
+
+            if(curr_frame <= send_frames):
                 if(args.verbose):
                     verboseprint('\tSending frame #'+str(curr_frame) +
-                                 ', length: '+str(len(frame_data)))
+                                 ', length: '+str(len(frames[curr_frame-1]) - 5))
                 else:
-                    percentComplete = curr_frame * 100 / total_frames
+                    percentComplete = curr_frame * 100 / send_frames
                     percentCompleteInChars = math.ceil(
                         percentComplete / 100 * barWidthInCharacters)
                     while(progressChars < percentCompleteInChars):
@@ -266,9 +316,11 @@ def phase_bootload(ser):
                     if (percentComplete == 100):
                         print("]", end='')
 
-                send_packet(ser, SVL_CMD_FRAME, frame_data)
+                ser.write(frames[curr_frame-1])
 
             else:
+                if (not args.verbose and send_frames == 0):
+                    print("]", end='')
                 send_packet(ser, SVL_CMD_DONE, b'')
                 bl_done = True
 
@@ -276,9 +328,17 @@ def phase_bootload(ser):
             twopartprint('\n\t', 'Upload complete')
             endTime = time.time()
             bps = total_len / (endTime - startTime)
-            verboseprint('\n\tNominal bootload bps: ' + str(round(bps, 2)))
+            verboseprint('\n\tSent ' + str(send_frames) + ' of ' + str(total_frames) +
+                         ' frames in ' + str(round(endTime - startTime, 3)) + ' s')
+            verboseprint('\tNominal bootload bps: ' + str(round(bps, 2)))
+            if(args.cache):
+                with open(args.cache, mode='wb') as cachefile:
+                    cachefile.write(application)
         else:
             twopartprint('\n\t', 'Upload failed')
+            # Flash is now in an unknown state, the next upload must be full
+            if(args.cache and os.path.exists(args.cache)):
+                os.remove(args.cache)
 
         return bl_succeeded
 
@@ -340,6 +400,13 @@ def main():
 
             with serial.Serial(args.port, args.baud, timeout=args.timeout) as ser:
 
+                # Every frame waits on a round trip, so shorten the USB serial
+                # latency timer where the platform allows it
+                try:
+                    ser.set_low_latency_mode(True)
+                except (AttributeError, NotImplementedError, ValueError):
+                    pass
+
                 # startup time for Artemis bootloader   (experimentally determined - 0.095 sec min delay)
                 t_su = 0.15
 
@@ -390,6 +457,12 @@ if __name__ == '__main__':
     parser.add_argument("-v", "--verbose", default=0, help="Enable verbose output",
                         action="store_true")
 
+    parser.add_argument("-c", "--cache", default='',
+                        help="Keep the last uploaded image here and skip the frames that did not change since")
+
+    parser.add_argument("--force", default=0, action="store_true",
+                        help="Send every frame even if the cache says they are unchanged")
+
     parser.add_argument("-t", "--timeout", default=0.50, help="Communication timeout in seconds (default 0.5)",
                         type=float)
 
@@ -0,0 +1,176 @@
+#!/usr/bin/env python
+# SPDX-License-Identifier: Apache-2.0
+# SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+# Mock SVL bootloader
+# Speaks the Artemis SVL bootloader protocol over a pty, so svl.py uploads can
+#   be tried and timed without a board
+
+# The mock prints the path of a pty to pass to svl.py as its port. It waits
+#   for the baud detection character, answers with its version, and once told
+#   to enter the bootloader requests frames one at a time, like the real one.
+#   Link time is modelled at the given baud rate, 10 bits per byte, and flash
+#   time with a fixed cost per frame programmed and per page erased.
+# Flash contents are kept in a file across runs, so a differential upload
+#   (svl.py --cache) can be checked against what a full upload would leave.
+
+# ***********************************************************************************
+#
+# Imports
+#
+# ***********************************************************************************
+
+import argparse
+import os
+import select
+import time
+import tty
+
+from svl import SVL_CMD_VER, SVL_CMD_BL, SVL_CMD_NEXT, SVL_CMD_FRAME, \
+    SVL_CMD_RETRY, SVL_CMD_DONE, frame_size, page_size, get_crc16, make_packet
+
+MOCK_VERSION = 5
+
+
+# ***********************************************************************************
+#
+# Byte I/O on the pty, with link time modelled at the baud rate
+#
+# ***********************************************************************************
+class Link:
+    def __init__(self, fd, baud):
+        self.fd = fd
+        self.baud = baud
+        self.buffer = b''
+
+    def wire_time(self, count):
+        if self.baud:
+            time.sleep(count * 10 / self.baud)
+
+    def read(self, count, timeout):
+        deadline = time.time() + timeout
+        while len(self.buffer) < count:
+            remaining = deadline - time.time()
+            if remaining <= 0 or not select.select([self.fd], [], [], remaining)[0]:
+                return None
+            self.buffer += os.read(self.fd, 4096)
+        data, self.buffer = self.buffer[:count], self.buffer[count:]
+        return data
+
+    def write(self, data):
+        self.wire_time(len(data))
+        os.write(self.fd, data)
+
+
+# ***********************************************************************************
+#
+# Wait for a packet, returning (cmd, data), or None on timeout or a bad CRC
+#
+# ***********************************************************************************
+def wait_for_packet(link, timeout):
+    n = link.read(2, timeout)
+    if n is None:
+        return None
+    length = int.from_bytes(n, 'big')
+    payload = link.read(length, args.timeout) if length >= 3 else None
+    if payload is None:
+        return None
+    link.wire_time(2 + length)
+    if get_crc16(payload):
+        return (None, b'')
+    return (payload[0], payload[1:-2])
+
+
+# ***********************************************************************************
+#
+# One bootloader session, from baud detection to DONE
+#
+# ***********************************************************************************
+def session(link, flash):
+    while link.read(1, 3600) != b'U':
+        pass
+    link.write(make_packet(SVL_CMD_VER, MOCK_VERSION.to_bytes(4, 'big')))
+
+    packet = wait_for_packet(link, args.timeout)
+    if packet is None or packet[0] != SVL_CMD_BL:
+        print('No bootloader command, back to waiting')
+        return False
+
+    start = time.time()
+    address = 0
+    frames = 0
+    link.write(make_packet(SVL_CMD_NEXT, b''))
+    while True:
+        packet = wait_for_packet(link, args.timeout)
+        if packet is None:
+            print('Host timed out after ' + str(frames) + ' frames')
+            return False
+        cmd, data = packet
+        if cmd == SVL_CMD_DONE:
+            break
+        if cmd != SVL_CMD_FRAME:
+            link.write(make_packet(SVL_CMD_RETRY, b''))
+            continue
+
+        # Pages are erased as the writes reach them
+        if address % page_size == 0:
+            flash[address:address + page_size] = b'\xFF' * page_size
+            time.sleep(args.erase_ms / 1000)
+        flash[address:address + len(data)] = data
+        time.sleep(args.program_ms / 1000)
+        address += len(data)
+        frames += 1
+        link.write(make_packet(SVL_CMD_NEXT, b''))
+
+    elapsed = time.time() - start
+    print('Received ' + str(frames) + ' frames, ' + str(address) +
+          ' bytes in ' + str(round(elapsed, 3)) + ' s')
+    return True
+
+
+# ******************************************************************************
+#
+# Main program flow
+#
+# ******************************************************************************
+if __name__ == '__main__':
+
+    parser = argparse.ArgumentParser(
+        description='Mock Artemis SVL bootloader on a pty')
+
+    parser.add_argument('-f', dest='flash', default='mock_flash.bin',
+                        help='File holding the mock flash contents (default mock_flash.bin)')
+
+    parser.add_argument('-b', dest='baud', default=115200, type=int,
+                        help='Baud rate to model link time at, 0 for none (default 115200)')
+
+    parser.add_argument('--program-ms', dest='program_ms', default=10.0, type=float,
+                        help='Time to program one ' + str(frame_size) + ' byte frame (default 10 ms)')
+
+    parser.add_argument('--erase-ms', dest='erase_ms', default=5.0, type=float,
+                        help='Time to erase one ' + str(page_size) + ' byte page (default 5 ms)')
+
+    parser.add_argument('-n', dest='sessions', default=1, type=int,
+                        help='Uploads to accept before exiting (default 1)')
+
+    parser.add_argument('-t', '--timeout', default=2.0, type=float,
+                        help='Communication timeout in seconds (default 2)')
+
+    args = parser.parse_args()
+
+    flash = bytearray()
+    if os.path.exists(args.flash):
+        with open(args.flash, mode='rb') as f:
+            flash = bytearray(f.read())
+
+    master, slave = os.openpty()
+    tty.setraw(slave)
+    print(os.ttyname(slave), flush=True)
+
+    link = Link(master, args.baud)
+    done = 0
+    while done < args.sessions:
+        if session(link, flash):
+            done += 1
+            with open(args.flash, mode='wb') as f:
+                f.write(flash)
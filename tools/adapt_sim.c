@@ -0,0 +1,391 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+/*
+ * Host tool that replays recorded sensor traces through the adaptive sampling
+ * schedule of the firmware, and compares it with sampling at a fixed rate.
+ *
+ * A trace is a CSV file with one row per reading: a timestamp in seconds and
+ * one or more feature columns, like the logs the device writes or the output
+ * of fft_batch. Header lines and columns that are not numbers are skipped.
+ * A simulated sample sees the latest reading at or before its time, scaled the
+ * same way the firmware scales its features.
+ *
+ * An event is a reading whose features moved by at least the event threshold
+ * since the previous reading; readings closer together than the capture window
+ * count as one event. An event is captured if a sample lands within the
+ * capture window after it. For each schedule the tool reports the number of
+ * wake-ups, the events captured and how long after the event the first sample
+ * came.
+ */
+
+#define _GNU_SOURCE
+
+#include <adapt.h>
+
+#include <getopt.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct reading
+{
+	uint32_t time;
+	float features[ADAPT_FEATURES];
+};
+
+struct trace
+{
+	struct reading *readings;
+	size_t count;
+	size_t features;
+};
+
+struct options
+{
+	int time_column; // -1 for evenly spaced rows
+	float period; // s between rows without a time column
+	size_t first; // first feature column
+	size_t last; // last feature column, 0 for up to ADAPT_FEATURES
+	bool decibels;
+	float scale;
+	float event;
+	uint32_t window;
+	uint32_t fixed;
+};
+
+static float trace_feature(const struct options *options, float value)
+{
+	if (options->decibels)
+		value = 10.0f * log10f(value + 1.0f);
+	return value / options->scale;
+}
+
+// Parses a row into its time and features, returns false for rows holding no
+// reading, like headers
+static bool trace_parse(const struct options *options, char *line, size_t row, struct reading *reading, size_t *features)
+{
+	bool timed = options->time_column < 0;
+	if (timed)
+		reading->time = (uint32_t)(row * options->period);
+	*features = 0;
+	size_t column = 0;
+	for (char *save, *field = strtok_r(line, ",\r\n", &save); field;
+		field = strtok_r(NULL, ",\r\n", &save), ++column)
+	{
+		char *end;
+		double value = strtod(field, &end);
+		if (end == field || *end)
+			continue;
+		if ((int)column == options->time_column)
+		{
+			reading->time = (uint32_t)value;
+			timed = true;
+		}
+		else if (column >= options->first && (!options->last || column <= options->last) &&
+			*features < ADAPT_FEATURES)
+		{
+			reading->features[(*features)++] = trace_feature(options, (float)value);
+		}
+	}
+	return timed && *features;
+}
+
+static int trace_load(const struct options *options, const char *path, struct trace *trace)
+{
+	FILE *fp = fopen(path, "r");
+	if (!fp)
+		return -1;
+	size_t capacity = 1024;
+	trace->readings = malloc(capacity * sizeof(trace->readings[0]));
+	trace->count = 0;
+	trace->features = 0;
+	char line[1024];
+	size_t row = 0;
+	while (trace->readings && fgets(line, sizeof(line), fp))
+	{
+		struct reading reading;
+		size_t features;
+		if (!trace_parse(options, line, row, &reading, &features))
+			continue;
+		++row;
+		// Readings must keep the feature count of the first one and move
+		// forward in time
+		if (trace->count && (features != trace->features ||
+			reading.time < trace->readings[trace->count - 1].time))
+			continue;
+		if (trace->count == capacity)
+		{
+			capacity *= 2;
+			struct reading *readings = realloc(trace->readings, capacity * sizeof(readings[0]));
+			if (!readings)
+			{
+				free(trace->readings);
+				trace->readings = NULL;
+				break;
+			}
+			trace->readings = readings;
+		}
+		trace->features = features;
+		trace->readings[trace->count++] = reading;
+	}
+	fclose(fp);
+	if (!trace->readings || !trace->count)
+	{
+		free(trace->readings);
+		return -1;
+	}
+	return 0;
+}
+
+static float change(const float a[], const float b[], size_t count)
+{
+	float sum = 0.0f;
+	for (size_t i = 0; i < count; ++i)
+		sum += fabsf(a[i] - b[i]);
+	return sum / (float)count;
+}
+
+// Start times of the events in the trace, returns their count
+static size_t trace_events(const struct options *options, const struct trace *trace, uint32_t events[])
+{
+	size_t count = 0;
+	for (size_t i = 1; i < trace->count; ++i)
+	{
+		const struct reading *reading = &trace->readings[i];
+		if (change(reading->features, trace->readings[i - 1].features, trace->features) < options->event)
+			continue;
+		if (count && reading->time - events[count - 1] < options->window)
+			continue;
+		events[count++] = reading->time;
+	}
+	return count;
+}
+
+struct result
+{
+	size_t wakeups;
+	size_t captured;
+	double latency; // s, summed over captured events
+};
+
+// Scores sample times, in order, against the events
+static void score(const struct options *options, const uint32_t samples[], size_t count,
+	const uint32_t events[], size_t event_count, struct result *result)
+{
+	result->wakeups = count;
+	result->captured = 0;
+	result->latency = 0.0;
+	size_t s = 0;
+	for (size_t e = 0; e < event_count; ++e)
+	{
+		while (s < count && samples[s] < events[e])
+			++s;
+		if (s < count && samples[s] - events[e] <= options->window)
+		{
+			result->captured++;
+			result->latency += samples[s] - events[e];
+		}
+	}
+}
+
+// Sample times of a schedule over the trace. A fixed interval of 0 follows the
+// adaptive schedule instead.
+static size_t schedule(const struct trace *trace, struct adapt *adapt, uint32_t fixed, uint32_t samples[], size_t capacity)
+{
+	uint32_t start = trace->readings[0].time;
+	uint32_t end = trace->readings[trace->count - 1].time;
+	size_t count = 0;
+	size_t r = 0;
+	for (uint64_t t = start; t <= end && count < capacity;)
+	{
+		while (r + 1 < trace->count && trace->readings[r + 1].time <= t)
+			++r;
+		samples[count++] = t;
+		if (fixed)
+		{
+			t += fixed;
+			continue;
+		}
+		adapt_sample(adapt, t, trace->readings[r].features, trace->features);
+		t = adapt->next;
+	}
+	return count;
+}
+
+static void report(const char *name, const struct result *result, size_t events)
+{
+	printf("  %-22s %8zu wake-ups %6zu/%zu events captured", name, result->wakeups, result->captured, events);
+	if (result->captured)
+		printf(", %.1f s mean latency", result->latency / result->captured);
+	printf("\n");
+}
+
+static int simulate(const struct options *options, const struct adapt *config, const char *path)
+{
+	struct trace trace;
+	if (trace_load(options, path, &trace))
+	{
+		fprintf(stderr, "%s: no readings\n", path);
+		return -1;
+	}
+
+	// At most one sample per second of trace
+	uint32_t span = trace.readings[trace.count - 1].time - trace.readings[0].time;
+	size_t capacity = (size_t)span + 1;
+	uint32_t *samples = malloc(capacity * sizeof(samples[0]));
+	uint32_t *events = malloc(trace.count * sizeof(events[0]));
+	if (!samples || !events)
+	{
+		fprintf(stderr, "out of memory\n");
+		free(samples);
+		free(events);
+		free(trace.readings);
+		return -1;
+	}
+	size_t event_count = trace_events(options, &trace, events);
+
+	printf("%s: %zu readings over %lu s, %zu features, %zu events\n", path,
+		trace.count, (unsigned long)span, trace.features, event_count);
+
+	struct adapt adapt = *config;
+	struct result adaptive;
+	size_t count = schedule(&trace, &adapt, 0, samples, capacity);
+	score(options, samples, count, events, event_count, &adaptive);
+
+	// Fixed rates at the bounds, at the rate asked for, and at the rate that
+	// costs as many wake-ups as the adaptive schedule
+	const uint32_t fixed[] = {
+		config->min_interval, options->fixed, count ? span / count : 0, config->max_interval,
+	};
+	for (size_t i = 0; i < sizeof(fixed) / sizeof(fixed[0]); ++i)
+	{
+		if (!fixed[i])
+			continue;
+		struct result result;
+		count = schedule(&trace, NULL, fixed[i], samples, capacity);
+		score(options, samples, count, events, event_count, &result);
+		char name[48];
+		snprintf(name, sizeof(name), "fixed %lu s", (unsigned long)fixed[i]);
+		report(name, &result, event_count);
+	}
+	char name[48];
+	snprintf(name, sizeof(name), "adaptive %lu-%lu s",
+		(unsigned long)config->min_interval, (unsigned long)config->max_interval);
+	report(name, &adaptive, event_count);
+
+	free(samples);
+	free(events);
+	free(trace.readings);
+	return 0;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [options] trace.csv...\n"
+		"  -m  shortest sampling interval, s (default 60)\n"
+		"  -M  longest sampling interval, s (default 3600)\n"
+		"  -H  activity that shortens the interval (default 2)\n"
+		"  -L  activity that lengthens the interval (default 0.5)\n"
+		"  -c  calm samples in a row before lengthening (default 3)\n"
+		"  -s  feature change worth an activity of 1 (default 1)\n"
+		"  -d  compare features in dB, 10 log10(x + 1)\n"
+		"  -t  time column, -1 for rows evenly spaced by -p (default 0)\n"
+		"  -p  s between rows without a time column (default 1)\n"
+		"  -f  first feature column (default 1)\n"
+		"  -l  last feature column (default up to %d features)\n"
+		"  -e  activity between readings that is an event (default -H)\n"
+		"  -w  s after an event a sample still captures it (default -m)\n"
+		"  -F  also compare against this fixed interval, s\n", name, ADAPT_FEATURES);
+}
+
+int main(int argc, char *argv[])
+{
+	struct adapt config = {
+		.min_interval = 60,
+		.max_interval = 3600,
+		.high = 2.0f,
+		.low = 0.5f,
+		.calm_samples = 3,
+	};
+	struct options options = {
+		.time_column = 0,
+		.period = 1.0f,
+		.first = 1,
+		.scale = 1.0f,
+		.event = -1.0f,
+	};
+
+	int opt;
+	while ((opt = getopt(argc, argv, "m:M:H:L:c:s:dt:p:f:l:e:w:F:h")) != -1)
+	{
+		switch (opt)
+		{
+		case 'm':
+			config.min_interval = strtoul(optarg, NULL, 0);
+			break;
+		case 'M':
+			config.max_interval = strtoul(optarg, NULL, 0);
+			break;
+		case 'H':
+			config.high = strtof(optarg, NULL);
+			break;
+		case 'L':
+			config.low = strtof(optarg, NULL);
+			break;
+		case 'c':
+			config.calm_samples = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			options.scale = strtof(optarg, NULL);
+			break;
+		case 'd':
+			options.decibels = true;
+			break;
+		case 't':
+			options.time_column = strtol(optarg, NULL, 0);
+			break;
+		case 'p':
+			options.period = strtof(optarg, NULL);
+			break;
+		case 'f':
+			options.first = strtoul(optarg, NULL, 0);
+			break;
+		case 'l':
+			options.last = strtoul(optarg, NULL, 0);
+			break;
+		case 'e':
+			options.event = strtof(optarg, NULL);
+			break;
+		case 'w':
+			options.window = strtoul(optarg, NULL, 0);
+			break;
+		case 'F':
+			options.fixed = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+	if (optind >= argc || !config.min_interval || config.max_interval < config.min_interval ||
+		config.low >= config.high || options.scale <= 0.0f)
+	{
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (options.event < 0.0f)
+		options.event = config.high;
+	if (!options.window)
+		options.window = config.min_interval;
+
+	int result = EXIT_SUCCESS;
+	for (int i = optind; i < argc; ++i)
+		if (simulate(&options, &config, argv[i]))
+			result = EXIT_FAILURE;
+	return result;
+}
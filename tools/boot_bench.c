@@ -0,0 +1,292 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+/*
+ * Host tool that times boot to first sample of the logging layer on the
+ * emulated flash in flash_sim.c, with the filesystem 0%, 50% and 95% full.
+ *
+ * For each fill level the tool formats the flash, writes some records to
+ * every log the firmware always has, then grows a plain fs:/spectrogram.bin
+ * until the target fraction of blocks is in use, and shuts down cleanly,
+ * saving the boot manifest. The firmware's spectrogram log is segmented and
+ * budgeted like the others, into fs:/spectrogram.<n>.bin, so this file is
+ * not one it writes: it stands in for the space every log's segments and the
+ * clips take on a full flash, which is what boot time depends on, without
+ * writing that many records first, and it belongs to no log, so booting does
+ * not open it. From that image it boots the way main.c does, mount,
+ * boot_manifest_load and the first record of the temperature log flushed to
+ * flash, twice: after the clean shutdown, and after a crash, with the
+ * manifest left empty by its load, where every header and segment state is
+ * read back.
+ *
+ * Times are modelled from the flash operations each step makes, at the
+ * flash's SPI clock plus page program and sector erase times; the littlefs
+ * and logfile.c code itself runs much faster on the host than on the device,
+ * so its host time is printed apart. It exits with a failure if any step
+ * fails or a fill level cannot be reached.
+ */
+
+#define _GNU_SOURCE
+
+// The tool's own "fs:/" paths go to the emulated flash too
+#define FLASH_SIM_STDIO
+#include "flash_sim.h"
+
+#include <logfile.h>
+
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// The logs every build of main.c has, with its default segmenting
+static const struct log_file log_defaults[] = {
+	{ .path = "fs:/temperature_data.csv", .header = "time,temperature data celsius\r\n" },
+	{ .path = "fs:/pressure_data.csv", .header = "time,pressure data pascals\r\n" },
+	{ .path = "fs:/light_data.csv", .header = "time,light data ohms\r\n" },
+	{ .path = "fs:/microphone_data.csv", .header = "time,microphone data Hz\r\n" },
+	{ .path = "fs:/summary_data.csv", .header = "time,channel,count,mean,variance,min,max\r\n" },
+	{ .path = "fs:/energy_data.csv", .header = "time,awake ms,asleep ms,wakeups,spi ms,pdm ms,adc ms,flash ms,uAh\r\n" },
+};
+
+#define LOGS (sizeof(log_defaults) / sizeof(log_defaults[0]))
+
+static const unsigned fills[] = {0, 50, 95};
+
+#define FILLS (sizeof(fills) / sizeof(fills[0]))
+
+#define MANIFEST "fs:/boot.manifest"
+
+// Modelled flash time and host time of one boot step
+struct step
+{
+	double flash;
+	double host;
+};
+
+enum step_id
+{
+	STEP_MOUNT,
+	STEP_MANIFEST,
+	STEP_FIRST,
+	STEP_COUNT,
+};
+
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void reset_logs(struct log_file logs[])
+{
+	for (size_t i = 0; i < LOGS; ++i)
+	{
+		logs[i] = log_defaults[i];
+		logs[i].segment_size = 16384;
+		logs[i].segments = 16;
+		logs[i].index_interval = 16;
+	}
+}
+
+static int write_record(struct log_file *log, uint32_t time)
+{
+	char record[32];
+	int len = snprintf(record, sizeof(record), "%lu,%lu\r\n", (unsigned long)time,
+		(unsigned long)(time % 1000));
+	return log_file_write(log, time, record, len);
+}
+
+// Formats the flash and leaves it filled and cleanly shut down
+static bool prepare(struct flash_sim *sim, unsigned records, unsigned fill)
+{
+	struct log_file logs[LOGS];
+	reset_logs(logs);
+	flash_sim_erase(sim);
+	if (flash_sim_mount(sim))
+		return false;
+	for (unsigned r = 0; r < records; ++r)
+		for (size_t i = 0; i < LOGS; ++i)
+			if (write_record(&logs[i], 1700000000u + r * 60))
+				return false;
+	for (size_t i = 0; i < LOGS; ++i)
+		log_file_close(&logs[i]);
+
+	FILE *fp = fopen("fs:/spectrogram.bin", "a");
+	if (!fp)
+		return false;
+	static uint8_t chunk[FLASH_SIM_SECTOR];
+	memset(chunk, 0xA5, sizeof(chunk));
+	while (flash_sim_used(sim) * 100 < fill)
+	{
+		if (fwrite(chunk, sizeof(chunk), 1, fp) != 1 || fflush(fp))
+		{
+			fclose(fp);
+			return false;
+		}
+	}
+	if (fclose(fp))
+		return false;
+
+	if (boot_manifest_save(MANIFEST, logs, LOGS))
+		return false;
+	return !flash_sim_unmount(sim);
+}
+
+// Leaves the manifest as a crash after its load would
+static bool crash(struct flash_sim *sim)
+{
+	if (flash_sim_mount(sim))
+		return false;
+	FILE *fp = fopen(MANIFEST, "w");
+	if (!fp || fclose(fp))
+		return false;
+	return !flash_sim_unmount(sim);
+}
+
+static bool boot(struct flash_sim *sim, struct step steps[])
+{
+	struct log_file logs[LOGS];
+	reset_logs(logs);
+	bool ok = true;
+	for (int s = 0; s < STEP_COUNT; ++s)
+	{
+		flash_sim_reset_stats(sim);
+		double start = now_ns();
+		switch (s)
+		{
+		case STEP_MOUNT:
+			ok = !flash_sim_mount(sim);
+			break;
+		case STEP_MANIFEST:
+			boot_manifest_load(MANIFEST, logs, LOGS);
+			break;
+		case STEP_FIRST:
+			ok = !write_record(&logs[0], 1800000000u) && !fflush(logs[0].fp);
+			break;
+		}
+		steps[s].host = (now_ns() - start) / 1e9;
+		steps[s].flash = sim->stats.time;
+		if (!ok)
+			return false;
+	}
+	for (size_t i = 0; i < LOGS; ++i)
+		log_file_close(&logs[i]);
+	return !flash_sim_unmount(sim);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [-f image] [-n records] [-c hz] [-p us] [-e ms]\n"
+		"  -f  file to keep the flash image in (default RAM)\n"
+		"  -n  records per log ahead of the fill (default 200)\n"
+		"  -c  flash SPI clock, Hz (default 4000000)\n"
+		"  -p  page program time, us (default 500)\n"
+		"  -e  sector erase time, ms (default 30)\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *image = NULL;
+	unsigned records = 200;
+	long spi_hz = 0;
+	double program = -1, erase = -1;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "f:n:c:p:e:h")) != -1)
+	{
+		switch (opt)
+		{
+		case 'f':
+			image = optarg;
+			break;
+		case 'n':
+			records = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			spi_hz = strtol(optarg, NULL, 0);
+			break;
+		case 'p':
+			program = strtod(optarg, NULL) / 1e6;
+			break;
+		case 'e':
+			erase = strtod(optarg, NULL) / 1e3;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+
+	struct flash_sim sim;
+	if (flash_sim_init(&sim, image))
+	{
+		fprintf(stderr, "could not set up the flash image\n");
+		return EXIT_FAILURE;
+	}
+	if (spi_hz > 0)
+		sim.timing.spi_hz = spi_hz;
+	if (program >= 0)
+		sim.timing.page_program = program;
+	if (erase >= 0)
+		sim.timing.sector_erase = erase;
+	flash_sim_route(&sim);
+	uint8_t *snapshot = malloc(FLASH_SIM_SIZE);
+	if (!snapshot)
+	{
+		fprintf(stderr, "out of memory\n");
+		return EXIT_FAILURE;
+	}
+
+	printf("%lu logs of %u records, SPI %lu Hz, page program %.0f us, sector erase %.0f ms\n",
+		(unsigned long)LOGS, records, (unsigned long)sim.timing.spi_hz,
+		sim.timing.page_program * 1e6, sim.timing.sector_erase * 1e3);
+	printf("%5s %5s %-6s %10s %10s %10s %10s %10s\n", "fill", "used", "boot",
+		"mount ms", "manifest", "first", "total ms", "host us");
+	bool ok = true;
+	for (size_t f = 0; f < FILLS; ++f)
+	{
+		if (!prepare(&sim, records, fills[f]))
+		{
+			fprintf(stderr, "could not fill the flash to %u%%\n", fills[f]);
+			ok = false;
+			break;
+		}
+		flash_sim_mount(&sim);
+		double used = flash_sim_used(&sim);
+		flash_sim_unmount(&sim);
+		memcpy(snapshot, sim.image, FLASH_SIM_SIZE);
+
+		for (int clean = 1; clean >= 0; --clean)
+		{
+			memcpy(sim.image, snapshot, FLASH_SIM_SIZE);
+			struct step steps[STEP_COUNT];
+			if ((!clean && !crash(&sim)) || !boot(&sim, steps))
+			{
+				fprintf(stderr, "%s boot at %u%% failed\n", clean ? "clean" : "crash", fills[f]);
+				ok = false;
+				continue;
+			}
+			double total = 0, host = 0;
+			for (int s = 0; s < STEP_COUNT; ++s)
+			{
+				total += steps[s].flash;
+				host += steps[s].host;
+			}
+			printf("%4u%% %4.0f%% %-6s %10.2f %10.2f %10.2f %10.2f %10.1f\n",
+				fills[f], used * 100, clean ? "clean" : "crash",
+				steps[STEP_MOUNT].flash * 1e3, steps[STEP_MANIFEST].flash * 1e3,
+				steps[STEP_FIRST].flash * 1e3, total * 1e3, host * 1e6);
+		}
+	}
+
+	free(snapshot);
+	flash_sim_destroy(&sim);
+	printf("%s\n", ok ? "ok" : "FAILED");
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,286 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+/*
+ * Host tool that checks the straight-line codelets from fft_codelets.py
+ * against the generic kiss_fft, and times both.
+ *
+ * For every size with a codelet, pseudo-random frames go through the forward
+ * and inverse transforms twice, once with the codelet kiss_fft_alloc picked
+ * and once with it cleared, so kf_work runs instead. Both results are
+ * compared with a double precision DFT, scaled by 1/N for FIXED_POINT=16
+ * like the fixed point transform. A kiss_fftr of twice the size, which uses
+ * the codelet for its complex half-size transform, is checked the same way.
+ * The tool exits with a failure if a codelet is both more than 1 dB less
+ * accurate than kf_work and under MIN_SNR, or if kiss_fftr is under MIN_SNR.
+ *
+ * It is built twice: codelet_bench with the float library and
+ * codelet_bench_q15 with FIXED_POINT=16.
+ */
+
+#define _GNU_SOURCE
+
+#include <_kiss_fft_guts.h>
+#include <kiss_fft.h>
+#include <kiss_fftr.h>
+
+#include <getopt.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+#ifdef FIXED_POINT
+#define MIN_SNR 50.0
+#else
+#define MIN_SNR 120.0
+#endif
+
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint64_t now_cycles(void)
+{
+#ifdef HAVE_TSC
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+// Small xorshift generator, so frames are the same on every platform
+static uint32_t next_random(uint32_t *state)
+{
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+static kiss_fft_scalar random_sample(uint32_t *state)
+{
+#ifdef FIXED_POINT
+	return (kiss_fft_scalar)((int32_t)(next_random(state) % 32768) - 16384);
+#else
+	return (kiss_fft_scalar)((double)next_random(state) / UINT32_MAX * 2.0 - 1.0);
+#endif
+}
+
+// DFT with the sign of the exponent given by inverse, scaled like kiss_fft
+static void dft(const kiss_fft_cpx in[], double out[][2], int n, bool inverse)
+{
+#ifdef FIXED_POINT
+	const double scale = 1.0 / n;
+#else
+	const double scale = 1.0;
+#endif
+	for (int k = 0; k < n; ++k)
+	{
+		double re = 0.0, im = 0.0;
+		for (int t = 0; t < n; ++t)
+		{
+			double phase = (inverse ? 2.0 : -2.0) * M_PI * (double)((long)k * t % n) / n;
+			re += in[t].r * cos(phase) - in[t].i * sin(phase);
+			im += in[t].r * sin(phase) + in[t].i * cos(phase);
+		}
+		out[k][0] = re * scale;
+		out[k][1] = im * scale;
+	}
+}
+
+// Accumulates the error of out against ref, for snr
+static void compare(const kiss_fft_cpx out[], double ref[][2], int n, double *signal, double *noise)
+{
+	for (int k = 0; k < n; ++k)
+	{
+		double dr = out[k].r - ref[k][0];
+		double di = out[k].i - ref[k][1];
+		*signal += ref[k][0] * ref[k][0] + ref[k][1] * ref[k][1];
+		*noise += dr * dr + di * di;
+	}
+}
+
+static double snr(double signal, double noise)
+{
+	return noise > 0.0 ? 10 * log10(signal / noise) : INFINITY;
+}
+
+struct timing
+{
+	double ns;
+	double cycles;
+};
+
+static struct timing time_fft(kiss_fft_cfg cfg, const kiss_fft_cpx *in, kiss_fft_cpx *out, int repeat)
+{
+	double start = now_ns();
+	uint64_t cycles = now_cycles();
+	for (int r = 0; r < repeat; ++r)
+		kiss_fft(cfg, in, out);
+	return (struct timing){
+		(now_ns() - start) / repeat,
+		(double)(now_cycles() - cycles) / repeat,
+	};
+}
+
+static struct timing time_fftr(kiss_fftr_cfg cfg, const kiss_fft_scalar *in, kiss_fft_cpx *out, int repeat)
+{
+	double start = now_ns();
+	uint64_t cycles = now_cycles();
+	for (int r = 0; r < repeat; ++r)
+		kiss_fftr(cfg, in, out);
+	return (struct timing){
+		(now_ns() - start) / repeat,
+		(double)(now_cycles() - cycles) / repeat,
+	};
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [-f frames] [-r repeat]\n"
+		"  -f  frames checked per size and direction (default 16)\n"
+		"  -r  transforms per timing (default 200000)\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+	int frames = 16;
+	int repeat = 200000;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "f:r:h")) != -1)
+	{
+		switch (opt)
+		{
+		case 'f':
+			frames = atoi(optarg);
+			break;
+		case 'r':
+			repeat = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+	if (frames < 1 || repeat < 1)
+	{
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	bool ok = true;
+	int sizes = 0;
+	printf("%-9s %4s %10s %10s   %9s %9s   %9s %9s %7s\n", "transform", "n",
+		"snr dB", "generic", "ns", "generic", "cycles", "generic", "speedup");
+	for (int n = 2; n <= 4096; n *= 2)
+	{
+		if (!kiss_fft_codelet_find(n))
+			continue;
+		++sizes;
+
+		kiss_fft_cpx *in = malloc(sizeof(*in) * 2 * n);
+		kiss_fft_cpx *out = malloc(sizeof(*out) * 2 * n);
+		double (*ref)[2] = malloc(sizeof(*ref) * 2 * n);
+		if (!in || !out || !ref)
+		{
+			fprintf(stderr, "out of memory\n");
+			return EXIT_FAILURE;
+		}
+
+		for (int inverse = 0; inverse <= 1; ++inverse)
+		{
+			kiss_fft_cfg codelet = kiss_fft_alloc(n, inverse, NULL, NULL);
+			kiss_fft_cfg generic = kiss_fft_alloc(n, inverse, NULL, NULL);
+			generic->codelet = NULL;
+
+			uint32_t state = 0x2545f491u + n;
+			double signal[2] = {0}, noise[2] = {0};
+			for (int f = 0; f < frames; ++f)
+			{
+				for (int t = 0; t < n; ++t)
+				{
+					in[t].r = random_sample(&state);
+					in[t].i = random_sample(&state);
+				}
+				dft(in, ref, n, inverse);
+				kiss_fft(codelet, in, out);
+				compare(out, ref, n, &signal[0], &noise[0]);
+				kiss_fft(generic, in, out);
+				compare(out, ref, n, &signal[1], &noise[1]);
+				// In place, which kiss_fft otherwise does through a copy
+				kiss_fft(codelet, in, in);
+				compare(in, ref, n, &signal[0], &noise[0]);
+			}
+			double codelet_snr = snr(signal[0], noise[0]);
+			double generic_snr = snr(signal[1], noise[1]);
+			if (codelet_snr < fmin(generic_snr - 1.0, MIN_SNR))
+				ok = false;
+
+			struct timing fast = time_fft(codelet, in, out, repeat);
+			struct timing slow = time_fft(generic, in, out, repeat);
+			printf("%-9s %4d %10.1f %10.1f   %9.1f %9.1f   %9.0f %9.0f %6.2fx\n",
+				inverse ? "ifft" : "fft", n, codelet_snr, generic_snr,
+				fast.ns, slow.ns, fast.cycles, slow.cycles, slow.ns / fast.ns);
+			kiss_fft_free(codelet);
+			kiss_fft_free(generic);
+		}
+
+		// kiss_fftr of 2n points runs an n point complex transform, which
+		// kiss_fftr_alloc gets from kiss_fft_alloc with its codelet
+		kiss_fftr_cfg real = kiss_fftr_alloc(2 * n, 0, NULL, NULL);
+		kiss_fft_scalar *samples = malloc(sizeof(*samples) * 2 * n);
+		if (!samples)
+		{
+			fprintf(stderr, "out of memory\n");
+			return EXIT_FAILURE;
+		}
+		uint32_t state = 0x9e3779b9u + n;
+		double signal = 0.0, noise = 0.0;
+		for (int f = 0; f < frames; ++f)
+		{
+			for (int t = 0; t < 2 * n; ++t)
+			{
+				samples[t] = random_sample(&state);
+				in[t].r = samples[t];
+				in[t].i = 0;
+			}
+			dft(in, ref, 2 * n, false);
+			kiss_fftr(real, samples, out);
+			compare(out, ref, n + 1, &signal, &noise);
+		}
+		double real_snr = snr(signal, noise);
+		if (real_snr < MIN_SNR)
+			ok = false;
+		struct timing fftr = time_fftr(real, samples, out, repeat);
+		printf("%-9s %4d %10.1f %10s   %9.1f %9s   %9.0f %9s\n",
+			"fftr", 2 * n, real_snr, "", fftr.ns, "", fftr.cycles, "");
+		kiss_fftr_free(real);
+
+		free(samples);
+		free(in);
+		free(out);
+		free(ref);
+	}
+
+	if (!sizes)
+	{
+		printf("no codelets in this build\n");
+		return EXIT_FAILURE;
+	}
+	printf("%s\n", ok ? "ok" : "FAILED");
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
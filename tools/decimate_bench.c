@@ -0,0 +1,197 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+/*
+ * Host tool that measures the half-band decimator chain in fft_decimate.c.
+ *
+ * It prints the response of one stage, computed from its taps, then for each
+ * factor D of 2, 4 and 8 the cost per input sample of decimating, and of
+ * decimating plus a kiss_fftr of N/D points per N input samples, against a
+ * kiss_fftr of N points. Both give the same bin width. A low tone plus a
+ * strong one above the decimated band are analyzed both ways, to show the
+ * peak found and how far the out of band tone was pushed down.
+ */
+
+#define _GNU_SOURCE
+
+#include <fft.h>
+#include <fft_decimate.h>
+#include <kiss_fftr.h>
+
+#include <getopt.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint64_t now_cycles(void)
+{
+#ifdef HAVE_TSC
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+// Gain of one stage at a frequency given as a fraction of its input rate
+static double stage_gain(const struct fft_decimate *decimate, double f)
+{
+	double gain = 0.5;
+	for (uint32_t p = 0; p < FFT_DECIMATE_PAIRS; ++p)
+		gain += 2 * decimate->pairs[p] * cos(2 * M_PI * f * (2 * p + 1));
+	return fabs(gain);
+}
+
+// Amplitude of a tone in a signal, by a Hann windowed correlation over all of
+// it, long enough that leakage from other tones does not matter
+static double tone_amplitude(const kiss_fft_scalar x[], size_t count, double hz, double rate)
+{
+	double re = 0.0, im = 0.0, sum = 0.0;
+	for (size_t t = 0; t < count; ++t)
+	{
+		double window = 0.5 - 0.5 * cos(2 * M_PI * t / count);
+		re += window * x[t] * cos(2 * M_PI * hz * t / rate);
+		im += window * x[t] * sin(2 * M_PI * hz * t / rate);
+		sum += window;
+	}
+	return 2 * hypot(re, im) / sum;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [-n nfft] [-a hz] [-b hz]\n"
+		"  -n  transform size without decimation (default 512)\n"
+		"  -a  tone in the decimated band, Hz (default 300)\n"
+		"  -b  tone above it, 20 dB stronger, Hz (default 2500)\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t n = 512;
+	double tone_a = 300.0, tone_b = 2500.0;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "n:a:b:h")) != -1)
+	{
+		switch (opt)
+		{
+		case 'n':
+			n = strtoul(optarg, NULL, 0);
+			break;
+		case 'a':
+			tone_a = strtod(optarg, NULL);
+			break;
+		case 'b':
+			tone_b = strtod(optarg, NULL);
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+	if (n < 16 || n % 16)
+	{
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	struct fft base;
+	fft_init(&base);
+	fft_N(&base, n);
+	struct fft_decimate decimate;
+	struct fft scratch = base;
+	fft_decimate_init(&decimate, &scratch, 2);
+
+	double ripple = 0.0, stopband = -INFINITY;
+	for (double f = 0.0; f <= 0.19; f += 0.0005)
+		ripple = fmax(ripple, fabs(20 * log10(stage_gain(&decimate, f))));
+	for (double f = 0.31; f <= 0.5; f += 0.0005)
+		stopband = fmax(stopband, 20 * log10(stage_gain(&decimate, f)));
+	printf("%d-tap half-band stage: passband to 0.19 within %.4f dB, stopband from 0.31 at most %.1f dB\n",
+		FFT_DECIMATE_TAPS, ripple, stopband);
+
+	const uint32_t samples = 1 << 20;
+	int16_t *stream = malloc(sizeof(*stream) * samples);
+	kiss_fft_scalar *in = malloc(sizeof(*in) * samples);
+	kiss_fft_cpx *out = malloc(sizeof(*out) * (n / 2 + 1));
+	if (!stream || !in || !out)
+	{
+		fprintf(stderr, "out of memory\n");
+		return EXIT_FAILURE;
+	}
+	for (uint32_t t = 0; t < samples; ++t)
+		stream[t] = (int16_t)(1000 * sin(2 * M_PI * tone_a * t / base.S) +
+			10000 * sin(2 * M_PI * tone_b * t / base.S));
+
+	// No decimation, for reference
+	kiss_fftr_cfg cfg = kiss_fftr_alloc(n, 0, NULL, NULL);
+	double start = now_ns();
+	uint64_t cycles = now_cycles();
+	for (uint32_t b = 0; b < samples / n; ++b)
+	{
+		for (uint32_t t = 0; t < n; ++t)
+			in[t] = stream[b * n + t];
+		kiss_fftr(cfg, in, out);
+	}
+	double fft_ns = (now_ns() - start) / samples;
+	double fft_cycles = (double)(now_cycles() - cycles) / samples;
+	printf("D=1 S=%-5lu N=%-4lu %38s %6.2f ns %6.1f cycles  peak %lu Hz\n",
+		(unsigned long)base.S, (unsigned long)n, "fft", fft_ns, fft_cycles,
+		(unsigned long)fft_peak(&base, cfg, in, out));
+	kiss_fftr_free(cfg);
+
+	for (uint8_t factor = 2; factor <= 8; factor *= 2)
+	{
+		struct fft fft = base;
+		fft_decimate_init(&decimate, &fft, factor);
+		fft_N(&fft, n / factor);
+		cfg = kiss_fftr_alloc(fft.N, 0, NULL, NULL);
+
+		start = now_ns();
+		cycles = now_cycles();
+		size_t produced = fft_decimate_process(&decimate, stream, samples, in);
+		double decimate_ns = (now_ns() - start) / samples;
+		double decimate_cycles = (double)(now_cycles() - cycles) / samples;
+
+		start = now_ns();
+		cycles = now_cycles();
+		for (size_t b = 0; b + fft.N <= produced; b += fft.N)
+			kiss_fftr(cfg, in + b, out);
+		double small_ns = (now_ns() - start) / samples;
+		double small_cycles = (double)(now_cycles() - cycles) / samples;
+
+		// The last frame, well past the filters' start up
+		uint32_t peak = fft_peak(&fft, cfg, in + produced - fft.N, out);
+		// Where the out of band tone lands if it aliases, at the exact rate
+		double rate = (double)base.S / factor;
+		double alias = fmod(tone_b, rate);
+		if (alias > rate / 2)
+			alias = rate - alias;
+		double gain = tone_amplitude(in, produced, tone_a, rate) / 1000;
+		double leak = tone_amplitude(in, produced, alias, rate) / 10000;
+		printf("D=%u S=%-5lu N=%-4lu decimate %6.2f ns %6.1f cycles, total %6.2f ns %6.1f cycles  peak %lu Hz\n"
+			"    %.0f Hz gain %.3f dB, %.0f Hz tone aliased to %.0f Hz at %.1f dB\n",
+			factor, (unsigned long)fft.S, (unsigned long)fft.N, decimate_ns, decimate_cycles,
+			decimate_ns + small_ns, decimate_cycles + small_cycles, (unsigned long)peak,
+			tone_a, 20 * log10(gain), tone_b, alias, 20 * log10(leak));
+		kiss_fftr_free(cfg);
+	}
+
+	free(stream);
+	free(in);
+	free(out);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,488 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+/*
+ * Host tool that batch-processes raw audio recordings offloaded from the
+ * device (the same int16 PDM samples fft_read consumes from out.raw).
+ *
+ * Every file is mmapped and split into non-overlapping frames of N samples.
+ * Frames are grouped into chunks, and chunks are distributed across a pool of
+ * worker threads. Each worker owns a deque of chunks: it pops work from the
+ * back of its own deque and, once empty, steals from the front of the other
+ * workers' deques. Every worker keeps one persistent kiss_fftr plan.
+ *
+ * For each frame the tool reports the peak frequency and the energy in a
+ * configurable number of equally wide bands, either as CSV or as a packed
+ * binary record stream.
+ */
+
+#define _GNU_SOURCE
+
+#include <fft.h>
+#include <kiss_fftr.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// Frames per unit of work. Large enough to amortize deque locking, small
+// enough that stealing can still balance the tail of the run.
+#define FRAMES_PER_CHUNK 256
+
+struct recording
+{
+	const char *path;
+	const int16_t *samples;
+	size_t length; // in bytes, for munmap
+	uint64_t frames;
+	uint64_t first_frame; // global index of this file's first frame
+};
+
+struct chunk
+{
+	uint32_t file;
+	uint64_t frame; // first frame within the file
+	uint32_t count;
+};
+
+struct deque
+{
+	pthread_mutex_t lock;
+	struct chunk *chunks;
+	size_t head; // next chunk to steal
+	size_t tail; // one past the next chunk to pop
+};
+
+struct result
+{
+	uint32_t peak;
+	float bands[];
+};
+
+struct batch
+{
+	struct fft fft;
+	struct recording *recordings;
+	size_t recording_count;
+	struct deque *deques;
+	unsigned workers;
+	size_t band_count;
+	unsigned char *results;
+	size_t result_size;
+};
+
+struct worker
+{
+	struct batch *batch;
+	unsigned id;
+	uint64_t processed;
+	uint64_t stolen;
+};
+
+static bool deque_pop(struct deque *deque, struct chunk *chunk)
+{
+	bool found = false;
+	pthread_mutex_lock(&deque->lock);
+	if (deque->head != deque->tail)
+	{
+		*chunk = deque->chunks[--deque->tail];
+		found = true;
+	}
+	pthread_mutex_unlock(&deque->lock);
+	return found;
+}
+
+static bool deque_steal(struct deque *deque, struct chunk *chunk)
+{
+	bool found = false;
+	if (pthread_mutex_trylock(&deque->lock))
+		return false;
+	if (deque->head != deque->tail)
+	{
+		*chunk = deque->chunks[deque->head++];
+		found = true;
+	}
+	pthread_mutex_unlock(&deque->lock);
+	return found;
+}
+
+static struct result *batch_result(struct batch *batch, uint64_t frame)
+{
+	return (struct result *)(batch->results + frame * batch->result_size);
+}
+
+static void process_chunk(struct batch *batch, kiss_fftr_cfg cfg,
+	kiss_fft_scalar in[], kiss_fft_cpx out[], const struct chunk *chunk)
+{
+	const struct recording *rec = &batch->recordings[chunk->file];
+	uint32_t N = batch->fft.N;
+	for (uint32_t f = 0; f < chunk->count; ++f)
+	{
+		uint64_t frame = chunk->frame + f;
+		const int16_t *samples = rec->samples + frame * N;
+		for (uint32_t i = 0; i < N; ++i)
+			in[i] = samples[i];
+
+		struct result *result =
+			batch_result(batch, rec->first_frame + frame);
+		result->peak = fft_peak(&batch->fft, cfg, in, out);
+		fft_band_energies(&batch->fft, out, result->bands, batch->band_count);
+	}
+}
+
+static void *worker_run(void *arg)
+{
+	struct worker *worker = arg;
+	struct batch *batch = worker->batch;
+	uint32_t N = batch->fft.N;
+
+	kiss_fftr_cfg cfg = kiss_fftr_alloc(N, 0, NULL, NULL);
+	kiss_fft_scalar *in = malloc(sizeof(*in) * N);
+	kiss_fft_cpx *out = malloc(sizeof(*out) * (N / 2 + 1));
+	if (!cfg || !in || !out)
+	{
+		fprintf(stderr, "worker %u: out of memory\n", worker->id);
+		exit(EXIT_FAILURE);
+	}
+
+	struct chunk chunk;
+	for (;;)
+	{
+		if (deque_pop(&batch->deques[worker->id], &chunk))
+		{
+			process_chunk(batch, cfg, in, out, &chunk);
+			worker->processed += chunk.count;
+			continue;
+		}
+
+		// Own deque is empty, try to steal. Chunks are only ever removed, so
+		// one full sweep that finds nothing means all work is claimed.
+		bool stole = false;
+		for (unsigned i = 1; i < batch->workers && !stole; ++i)
+		{
+			struct deque *victim =
+				&batch->deques[(worker->id + i) % batch->workers];
+			// trylock may fail spuriously under contention, so retry while
+			// the victim still looks non-empty
+			for (;;)
+			{
+				if (deque_steal(victim, &chunk))
+				{
+					stole = true;
+					break;
+				}
+				pthread_mutex_lock(&victim->lock);
+				bool empty = victim->head == victim->tail;
+				pthread_mutex_unlock(&victim->lock);
+				if (empty)
+					break;
+			}
+		}
+		if (!stole)
+			break;
+		process_chunk(batch, cfg, in, out, &chunk);
+		worker->processed += chunk.count;
+		worker->stolen += 1;
+	}
+
+	free(out);
+	free(in);
+	kiss_fftr_free(cfg);
+	return NULL;
+}
+
+static int recording_open(struct recording *rec, const char *path, uint32_t N)
+{
+	rec->path = path;
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -errno;
+
+	struct stat st;
+	if (fstat(fd, &st) < 0)
+	{
+		int err = -errno;
+		close(fd);
+		return err;
+	}
+	rec->length = st.st_size;
+	rec->frames = rec->length / (sizeof(int16_t) * N);
+	rec->samples = NULL;
+	if (rec->length)
+	{
+		void *map = mmap(NULL, rec->length, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map == MAP_FAILED)
+		{
+			int err = -errno;
+			close(fd);
+			return err;
+		}
+		// Frames are consumed front to back by each chunk
+		madvise(map, rec->length, MADV_SEQUENTIAL);
+		rec->samples = map;
+	}
+	close(fd);
+	return 0;
+}
+
+static void write_csv(FILE *fp, struct batch *batch)
+{
+	fprintf(fp, "file,frame,peak_hz");
+	for (size_t b = 0; b < batch->band_count; ++b)
+		fprintf(fp, ",band%zu", b);
+	fprintf(fp, "\n");
+
+	for (size_t r = 0; r < batch->recording_count; ++r)
+	{
+		const struct recording *rec = &batch->recordings[r];
+		for (uint64_t f = 0; f < rec->frames; ++f)
+		{
+			const struct result *result =
+				batch_result(batch, rec->first_frame + f);
+			fprintf(fp, "%s,%llu,%lu", rec->path, (unsigned long long)f,
+				(unsigned long)result->peak);
+			for (size_t b = 0; b < batch->band_count; ++b)
+				fprintf(fp, ",%g", (double)result->bands[b]);
+			fprintf(fp, "\n");
+		}
+	}
+}
+
+// Binary layout, all little-endian host order:
+//   header: "FFTB", u32 N, u32 S, u32 band count, u32 file count
+//   per file: u32 frame count
+//   per frame: u32 peak, f32 bands[band count]
+static void write_binary(FILE *fp, struct batch *batch)
+{
+	uint32_t header[4] = {
+		batch->fft.N,
+		batch->fft.S,
+		batch->band_count,
+		batch->recording_count,
+	};
+	fwrite("FFTB", 4, 1, fp);
+	fwrite(header, sizeof(header), 1, fp);
+	for (size_t r = 0; r < batch->recording_count; ++r)
+	{
+		uint32_t frames = batch->recordings[r].frames;
+		fwrite(&frames, sizeof(frames), 1, fp);
+	}
+	uint64_t total = 0;
+	for (size_t r = 0; r < batch->recording_count; ++r)
+		total += batch->recordings[r].frames;
+	fwrite(batch->results, batch->result_size, total, fp);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [-n samples] [-s rate] [-j threads] [-B bands] "
+		"[-b] [-o output] file...\n"
+		"  -n  samples per frame (default 512)\n"
+		"  -s  sampling frequency in Hz (default 7813)\n"
+		"  -j  worker threads (default: online CPUs)\n"
+		"  -B  number of energy bands (default 8)\n"
+		"  -b  binary output instead of CSV\n"
+		"  -o  output file (default stdout)\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+	struct batch batch = {0};
+	fft_init(&batch.fft);
+	batch.band_count = 8;
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	batch.workers = cpus > 0 ? cpus : 1;
+	bool binary = false;
+	const char *output = NULL;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "n:s:j:B:bo:h")) != -1)
+	{
+		switch (opt)
+		{
+		case 'n':
+			fft_N(&batch.fft, strtoul(optarg, NULL, 0));
+			break;
+		case 's':
+			fft_S(&batch.fft, strtoul(optarg, NULL, 0));
+			break;
+		case 'j':
+			batch.workers = strtoul(optarg, NULL, 0);
+			break;
+		case 'B':
+			batch.band_count = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			binary = true;
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+
+	uint32_t N = fft_get_N(&batch.fft);
+	if (optind >= argc || N < 2 || (N & 1) || !batch.workers ||
+		!batch.band_count || batch.band_count > N / 2)
+	{
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	batch.recording_count = argc - optind;
+	batch.recordings = calloc(batch.recording_count, sizeof(*batch.recordings));
+	if (!batch.recordings)
+	{
+		fprintf(stderr, "out of memory\n");
+		return EXIT_FAILURE;
+	}
+	uint64_t total_frames = 0;
+	uint64_t total_chunks = 0;
+	for (size_t r = 0; r < batch.recording_count; ++r)
+	{
+		struct recording *rec = &batch.recordings[r];
+		int err = recording_open(rec, argv[optind + r], N);
+		if (err < 0)
+		{
+			fprintf(stderr, "%s: %s\n", argv[optind + r], strerror(-err));
+			return EXIT_FAILURE;
+		}
+		rec->first_frame = total_frames;
+		total_frames += rec->frames;
+		total_chunks += (rec->frames + FRAMES_PER_CHUNK - 1) / FRAMES_PER_CHUNK;
+	}
+
+	batch.result_size = sizeof(struct result) + sizeof(float) * batch.band_count;
+	batch.results = malloc(batch.result_size * (total_frames ? total_frames : 1));
+	batch.deques = calloc(batch.workers, sizeof(*batch.deques));
+	struct chunk *chunks = malloc(sizeof(*chunks) * (total_chunks ? total_chunks : 1));
+	if (!batch.results || !batch.deques || !chunks)
+	{
+		fprintf(stderr, "out of memory\n");
+		return EXIT_FAILURE;
+	}
+
+	// Hand each worker a contiguous run of chunks, so in the common case a
+	// worker walks through its own part of the corpus sequentially and only
+	// steals when it finishes early.
+	size_t next = 0;
+	for (size_t r = 0; r < batch.recording_count; ++r)
+	{
+		const struct recording *rec = &batch.recordings[r];
+		for (uint64_t f = 0; f < rec->frames; f += FRAMES_PER_CHUNK)
+		{
+			uint64_t left = rec->frames - f;
+			chunks[next++] = (struct chunk){
+				.file = r,
+				.frame = f,
+				.count = left < FRAMES_PER_CHUNK ? left : FRAMES_PER_CHUNK,
+			};
+		}
+	}
+	for (unsigned w = 0; w < batch.workers; ++w)
+	{
+		struct deque *deque = &batch.deques[w];
+		pthread_mutex_init(&deque->lock, NULL);
+		size_t begin = (total_chunks * w) / batch.workers;
+		size_t end = (total_chunks * (w + 1)) / batch.workers;
+		deque->chunks = chunks + begin;
+		deque->head = 0;
+		// Pop from the back in reverse so the owner still reads forwards
+		deque->tail = end - begin;
+		for (size_t i = 0; i < (end - begin) / 2; ++i)
+		{
+			struct chunk tmp = deque->chunks[i];
+			deque->chunks[i] = deque->chunks[end - begin - 1 - i];
+			deque->chunks[end - begin - 1 - i] = tmp;
+		}
+	}
+
+	pthread_t *threads = malloc(sizeof(*threads) * batch.workers);
+	struct worker *workers = calloc(batch.workers, sizeof(*workers));
+	if (!threads || !workers)
+	{
+		fprintf(stderr, "out of memory\n");
+		return EXIT_FAILURE;
+	}
+
+	struct timespec start, stop;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	// Every worker steals from every deque, so the ones that did start still
+	// drain the deques of any that could not be created
+	unsigned started = 0;
+	for (; started < batch.workers; ++started)
+	{
+		workers[started].batch = &batch;
+		workers[started].id = started;
+		int err = pthread_create(&threads[started], NULL, worker_run, &workers[started]);
+		if (err)
+		{
+			fprintf(stderr, "could not start worker %u: %s\n", started, strerror(err));
+			break;
+		}
+	}
+	if (!started)
+		worker_run(&workers[0]);
+	uint64_t stolen = 0;
+	for (unsigned w = 0; w < batch.workers; ++w)
+	{
+		if (w < started)
+			pthread_join(threads[w], NULL);
+		stolen += workers[w].stolen;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+	double seconds = (stop.tv_sec - start.tv_sec) +
+		(stop.tv_nsec - start.tv_nsec) / 1e9;
+	double bytes = (double)total_frames * N * sizeof(int16_t);
+	fprintf(stderr,
+		"%llu frames from %zu files on %u threads in %.3f s "
+		"(%.1f MB/s, %llu chunks stolen)\n",
+		(unsigned long long)total_frames, batch.recording_count,
+		started ? started : 1, seconds, seconds > 0 ? bytes / seconds / 1e6 : 0.0,
+		(unsigned long long)stolen);
+
+	FILE *fp = output ? fopen(output, binary ? "wb" : "w") : stdout;
+	if (!fp)
+	{
+		fprintf(stderr, "%s: %s\n", output, strerror(errno));
+		return EXIT_FAILURE;
+	}
+	if (binary)
+		write_binary(fp, &batch);
+	else
+		write_csv(fp, &batch);
+	if (fp != stdout)
+		fclose(fp);
+
+	for (size_t r = 0; r < batch.recording_count; ++r)
+	{
+		struct recording *rec = &batch.recordings[r];
+		if (rec->samples)
+			munmap((void *)rec->samples, rec->length);
+	}
+	for (unsigned w = 0; w < batch.workers; ++w)
+		pthread_mutex_destroy(&batch.deques[w].lock);
+	free(workers);
+	free(threads);
+	free(chunks);
+	free(batch.deques);
+	free(batch.results);
+	free(batch.recordings);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,189 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+/*
+ * Host tool that compares the overlap-add FIR filter in fft_filter.c with the
+ * direct-form FIR it replaces, for tap counts from 16 to 512.
+ *
+ * For each tap count, a band-pass filter designed with fft_filter_bandpass
+ * runs over the same pseudo-random stream both ways. The tool prints the time
+ * per output sample of each, in nanoseconds and, on x86, TSC cycles, and the
+ * largest difference between the two outputs relative to the largest output.
+ * The overlap-add FFT size is the power of two at least twice the tap count,
+ * as fft_filter.h suggests. It exits with a failure if the outputs differ by
+ * more than rounding.
+ */
+
+#define _GNU_SOURCE
+
+#include <fft_filter.h>
+
+#include <getopt.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+// Largest difference allowed between the two outputs, relative to the
+// largest output, from float rounding in the transforms
+#define MAX_ERROR 1e-4
+
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint64_t now_cycles(void)
+{
+#ifdef HAVE_TSC
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+// Small xorshift generator, so streams are the same on every platform
+static uint32_t next_random(uint32_t *state)
+{
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [-t taps] [-m samples] [-s rate] [-l low] [-u high]\n"
+		"  -t  only this tap count (default 16 to 512)\n"
+		"  -m  samples filtered per timing (default 262144)\n"
+		"  -s  sampling rate, Hz (default 7813)\n"
+		"  -l  lower cutoff of the band-pass, Hz (default 300)\n"
+		"  -u  upper cutoff of the band-pass, Hz (default 3000)\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t only = 0;
+	uint32_t samples = 1 << 18;
+	uint32_t rate = 7813;
+	float low = 300.0f, high = 3000.0f;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "t:m:s:l:u:h")) != -1)
+	{
+		switch (opt)
+		{
+		case 't':
+			only = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			samples = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			rate = strtoul(optarg, NULL, 0);
+			break;
+		case 'l':
+			low = strtof(optarg, NULL);
+			break;
+		case 'u':
+			high = strtof(optarg, NULL);
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+	if (only == 1 || samples < 1024 || !rate || low < 0 || high <= low || high > rate / 2.0f)
+	{
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	// Room for the history of the longest filter ahead of the stream
+	const uint32_t longest = only ? only : 512;
+	kiss_fft_scalar *input = malloc(sizeof(*input) * (samples + longest));
+	kiss_fft_scalar *direct = malloc(sizeof(*direct) * samples);
+	kiss_fft_scalar *fast = malloc(sizeof(*fast) * samples);
+	kiss_fft_scalar *taps = malloc(sizeof(*taps) * longest);
+	if (!input || !direct || !fast || !taps)
+	{
+		fprintf(stderr, "out of memory\n");
+		return EXIT_FAILURE;
+	}
+	// Silence as history, so both start from the same state
+	memset(input, 0, sizeof(*input) * longest);
+	uint32_t state = 0x2545f491u;
+	for (uint32_t t = 0; t < samples; ++t)
+		input[longest + t] = (kiss_fft_scalar)((double)next_random(&state) / UINT32_MAX * 2.0 - 1.0);
+
+	printf("band-pass %.0f to %.0f Hz at %lu Hz, %lu samples\n", (double)low, (double)high,
+		(unsigned long)rate, (unsigned long)samples);
+	printf("%5s %6s %12s %12s %12s %12s %8s %10s\n", "taps", "nfft", "direct ns",
+		"fft ns", "direct cyc", "fft cyc", "speedup", "max error");
+	bool ok = true;
+	for (uint32_t count = only ? only : 16; count <= longest; count *= 2)
+	{
+		uint32_t nfft = 2;
+		while (nfft < 2 * count)
+			nfft *= 2;
+		fft_filter_bandpass(taps, count, low, high, rate);
+		struct fft_filter filter;
+		if (fft_filter_init(&filter, taps, count, nfft))
+		{
+			fprintf(stderr, "out of memory\n");
+			return EXIT_FAILURE;
+		}
+
+		double start = now_ns();
+		uint64_t cycles = now_cycles();
+		fft_filter_direct(taps, count, input + longest - (count - 1), direct, samples);
+		double direct_ns = (now_ns() - start) / samples;
+		double direct_cycles = (double)(now_cycles() - cycles) / samples;
+
+		// Whole blocks only, the rest of the stream is left unfiltered
+		const uint32_t blocks = samples / filter.block;
+		const uint32_t filtered = blocks * filter.block;
+		start = now_ns();
+		cycles = now_cycles();
+		for (uint32_t b = 0; b < blocks; ++b)
+			fft_filter_process(&filter, input + longest + b * filter.block, fast + b * filter.block);
+		double fast_ns = (now_ns() - start) / filtered;
+		double fast_cycles = (double)(now_cycles() - cycles) / filtered;
+
+		double peak = 0.0, error = 0.0;
+		for (uint32_t t = 0; t < filtered; ++t)
+		{
+			peak = fmax(peak, fabs(direct[t]));
+			error = fmax(error, fabs((double)fast[t] - direct[t]));
+		}
+		error /= peak;
+		if (error > MAX_ERROR)
+			ok = false;
+
+		printf("%5lu %6lu %12.2f %12.2f %12.1f %12.1f %7.2fx %10.2e\n",
+			(unsigned long)count, (unsigned long)nfft, direct_ns, fast_ns,
+			direct_cycles, fast_cycles, direct_ns / fast_ns, error);
+		fft_filter_destroy(&filter);
+		if (only)
+			break;
+	}
+
+	free(input);
+	free(direct);
+	free(fast);
+	free(taps);
+	printf("%s\n", ok ? "ok" : "FAILED");
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,330 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+#define _GNU_SOURCE
+
+#include "flash_sim.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Command and address bytes ahead of every read, program and erase, plus the
+// write enable ahead of programs and erases
+#define FLASH_SIM_COMMAND 4u
+#define FLASH_SIM_WRITE_ENABLE 1u
+
+static struct flash_sim *routed;
+
+static double flash_sim_transfer(const struct flash_sim *sim, size_t bytes)
+{
+	return bytes * 8.0 / sim->timing.spi_hz;
+}
+
+static int flash_sim_read(const struct lfs_config *config, lfs_block_t block,
+	lfs_off_t offset, void *buffer, lfs_size_t size)
+{
+	struct flash_sim *sim = config->context;
+	memcpy(buffer, sim->image + block * FLASH_SIM_SECTOR + offset, size);
+	sim->stats.reads++;
+	sim->stats.read_bytes += size;
+	sim->stats.time += flash_sim_transfer(sim, FLASH_SIM_COMMAND + size);
+	return 0;
+}
+
+static int flash_sim_program(const struct lfs_config *config, lfs_block_t block,
+	lfs_off_t offset, const void *buffer, lfs_size_t size)
+{
+	struct flash_sim *sim = config->context;
+	const uint8_t *data = buffer;
+	uint32_t address = block * FLASH_SIM_SECTOR + offset;
+	while (size)
+	{
+		// One program command per page touched
+		uint32_t chunk = FLASH_SIM_PAGE - address % FLASH_SIM_PAGE;
+		if (chunk > size)
+			chunk = size;
+		// NOR flash only clears bits
+		for (uint32_t i = 0; i < chunk; ++i)
+			sim->image[address + i] &= data[i];
+		sim->stats.programs++;
+		sim->stats.program_bytes += chunk;
+		sim->stats.time += flash_sim_transfer(sim,
+			FLASH_SIM_WRITE_ENABLE + FLASH_SIM_COMMAND + chunk) + sim->timing.page_program;
+		address += chunk;
+		data += chunk;
+		size -= chunk;
+	}
+	return 0;
+}
+
+static int flash_sim_erase_block(const struct lfs_config *config, lfs_block_t block)
+{
+	struct flash_sim *sim = config->context;
+	memset(sim->image + block * FLASH_SIM_SECTOR, 0xFF, FLASH_SIM_SECTOR);
+	sim->stats.erases++;
+	sim->stats.time += flash_sim_transfer(sim, FLASH_SIM_WRITE_ENABLE + FLASH_SIM_COMMAND) +
+		sim->timing.sector_erase;
+	return 0;
+}
+
+static int flash_sim_sync(const struct lfs_config *config)
+{
+	(void)config;
+	return 0;
+}
+
+int flash_sim_init(struct flash_sim *sim, const char *path)
+{
+	memset(sim, 0, sizeof(*sim));
+	sim->fd = -1;
+	bool fresh = true;
+	if (path)
+	{
+		sim->fd = open(path, O_RDWR | O_CREAT, 0644);
+		if (sim->fd < 0)
+			return -1;
+		off_t size = lseek(sim->fd, 0, SEEK_END);
+		fresh = size != FLASH_SIM_SIZE;
+		if (ftruncate(sim->fd, FLASH_SIM_SIZE))
+		{
+			close(sim->fd);
+			return -1;
+		}
+		sim->image = mmap(NULL, FLASH_SIM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, sim->fd, 0);
+	}
+	else
+	{
+		sim->image = mmap(NULL, FLASH_SIM_SIZE, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	}
+	if (sim->image == MAP_FAILED)
+	{
+		if (sim->fd >= 0)
+			close(sim->fd);
+		return -1;
+	}
+	if (fresh)
+		flash_sim_erase(sim);
+
+	// The SPI clock main.c runs the flash at
+	sim->timing.spi_hz = 4000000;
+	sim->timing.page_program = 0.5e-3;
+	sim->timing.sector_erase = 30e-3;
+
+	sim->config = (struct lfs_config){
+		.context = sim,
+		.read = flash_sim_read,
+		.prog = flash_sim_program,
+		.erase = flash_sim_erase_block,
+		.sync = flash_sim_sync,
+		.read_size = 16,
+		.prog_size = 16,
+		.block_size = FLASH_SIM_SECTOR,
+		.block_count = FLASH_SIM_SIZE / FLASH_SIM_SECTOR,
+		.block_cycles = 500,
+		.cache_size = FLASH_SIM_PAGE,
+		.lookahead_size = FLASH_SIM_SIZE / FLASH_SIM_SECTOR / 8,
+	};
+	return 0;
+}
+
+void flash_sim_destroy(struct flash_sim *sim)
+{
+	if (sim->mounted)
+		flash_sim_unmount(sim);
+	if (routed == sim)
+		routed = NULL;
+	munmap(sim->image, FLASH_SIM_SIZE);
+	if (sim->fd >= 0)
+		close(sim->fd);
+}
+
+void flash_sim_erase(struct flash_sim *sim)
+{
+	memset(sim->image, 0xFF, FLASH_SIM_SIZE);
+}
+
+int flash_sim_mount(struct flash_sim *sim)
+{
+	int err = lfs_mount(&sim->lfs, &sim->config);
+	if (err < 0)
+	{
+		err = lfs_format(&sim->lfs, &sim->config);
+		if (!err)
+			err = lfs_mount(&sim->lfs, &sim->config);
+	}
+	sim->mounted = !err;
+	return err;
+}
+
+int flash_sim_unmount(struct flash_sim *sim)
+{
+	sim->mounted = false;
+	return lfs_unmount(&sim->lfs);
+}
+
+double flash_sim_used(struct flash_sim *sim)
+{
+	lfs_ssize_t blocks = lfs_fs_size(&sim->lfs);
+	return blocks < 0 ? 1.0 : (double)blocks / sim->config.block_count;
+}
+
+void flash_sim_reset_stats(struct flash_sim *sim)
+{
+	memset(&sim->stats, 0, sizeof(sim->stats));
+}
+
+void flash_sim_route(struct flash_sim *sim)
+{
+	routed = sim;
+}
+
+// Path on the routed flash, NULL if it is a host path
+static const char *flash_sim_path(const char *path)
+{
+	if (strncmp(path, "fs:/", 4) != 0)
+		return NULL;
+	return path + 3;
+}
+
+struct flash_sim_file
+{
+	struct flash_sim *sim;
+	lfs_file_t file;
+};
+
+static ssize_t flash_sim_file_read(void *cookie, char *buffer, size_t size)
+{
+	struct flash_sim_file *file = cookie;
+	lfs_ssize_t result = lfs_file_read(&file->sim->lfs, &file->file, buffer, size);
+	if (result < 0)
+	{
+		errno = -result;
+		return -1;
+	}
+	return result;
+}
+
+static ssize_t flash_sim_file_write(void *cookie, const char *buffer, size_t size)
+{
+	struct flash_sim_file *file = cookie;
+	lfs_ssize_t result = lfs_file_write(&file->sim->lfs, &file->file, buffer, size);
+	if (result < 0)
+	{
+		// A full filesystem, as on the device
+		errno = -result;
+		return 0;
+	}
+	return result;
+}
+
+static int flash_sim_file_seek(void *cookie, off64_t *offset, int whence)
+{
+	struct flash_sim_file *file = cookie;
+	// LFS_SEEK_SET, CUR and END match SEEK_SET, CUR and END
+	lfs_soff_t result = lfs_file_seek(&file->sim->lfs, &file->file, *offset, whence);
+	if (result < 0)
+	{
+		errno = -result;
+		return -1;
+	}
+	*offset = result;
+	return 0;
+}
+
+static int flash_sim_file_close(void *cookie)
+{
+	struct flash_sim_file *file = cookie;
+	int result = lfs_file_close(&file->sim->lfs, &file->file);
+	free(file);
+	if (result < 0)
+	{
+		errno = -result;
+		return -1;
+	}
+	return 0;
+}
+
+#undef fopen
+#undef remove
+
+FILE *flash_sim_fopen(const char *path, const char *mode)
+{
+	const char *lfs_path = flash_sim_path(path);
+	if (!lfs_path)
+		return fopen(path, mode);
+	if (!routed)
+	{
+		errno = ENODEV;
+		return NULL;
+	}
+
+	int flags;
+	bool update = strchr(mode, '+');
+	switch (mode[0])
+	{
+	case 'r':
+		flags = update ? LFS_O_RDWR : LFS_O_RDONLY;
+		break;
+	case 'w':
+		flags = (update ? LFS_O_RDWR : LFS_O_WRONLY) | LFS_O_CREAT | LFS_O_TRUNC;
+		break;
+	case 'a':
+		flags = (update ? LFS_O_RDWR : LFS_O_WRONLY) | LFS_O_CREAT | LFS_O_APPEND;
+		break;
+	default:
+		errno = EINVAL;
+		return NULL;
+	}
+
+	struct flash_sim_file *file = malloc(sizeof(*file));
+	if (!file)
+		return NULL;
+	file->sim = routed;
+	int err = lfs_file_open(&routed->lfs, &file->file, lfs_path, flags);
+	if (err < 0)
+	{
+		free(file);
+		errno = -err;
+		return NULL;
+	}
+	cookie_io_functions_t io = {
+		.read = flash_sim_file_read,
+		.write = flash_sim_file_write,
+		.seek = flash_sim_file_seek,
+		.close = flash_sim_file_close,
+	};
+	FILE *fp = fopencookie(file, mode, io);
+	if (!fp)
+	{
+		lfs_file_close(&routed->lfs, &file->file);
+		free(file);
+	}
+	return fp;
+}
+
+int flash_sim_remove(const char *path)
+{
+	const char *lfs_path = flash_sim_path(path);
+	if (!lfs_path)
+		return remove(path);
+	if (!routed)
+	{
+		errno = ENODEV;
+		return -1;
+	}
+	int err = lfs_remove(&routed->lfs, lfs_path);
+	if (err < 0)
+	{
+		errno = -err;
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,147 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+#ifndef FLASH_SIM_H_
+#define FLASH_SIM_H_
+
+#include <lfs.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Emulated MX25V16066 for the host tools: littlefs over a RAM or file-backed
+ * image of the 2 MB flash, with every read, page program and sector erase
+ * counted and turned into the time the device would spend on it over its
+ * SPI bus.
+ *
+ * Built with FLASH_SIM_STDIO defined, and this header forced in with
+ * -include, fopen and remove of "fs:/" paths go to the littlefs of the
+ * routed flash_sim, the way the asimple syscalls route them on the device,
+ * so logfile.c and the like run unchanged on top of it.
+ */
+
+/** Size of the MX25V16066 in bytes */
+#define FLASH_SIM_SIZE (2u * 1024u * 1024u)
+
+/** Erase sector size, the littlefs block size */
+#define FLASH_SIM_SECTOR 4096u
+
+/** Program page size, a program command cannot cross a page boundary */
+#define FLASH_SIM_PAGE 256u
+
+/** Timing model of the flash, defaults in flash_sim_init */
+struct flash_sim_timing
+{
+	uint32_t spi_hz; // SPI clock
+	double page_program; // seconds per page program command
+	double sector_erase; // seconds per sector erase
+};
+
+/** Flash operations since the last flash_sim_reset_stats */
+struct flash_sim_stats
+{
+	uint64_t reads; // read commands
+	uint64_t read_bytes;
+	uint64_t programs; // page program commands
+	uint64_t program_bytes;
+	uint64_t erases; // sector erases
+	double time; // modelled seconds spent on all of them
+};
+
+struct flash_sim
+{
+	uint8_t *image;
+	int fd; // backing file, -1 for RAM
+	struct flash_sim_timing timing;
+	struct flash_sim_stats stats;
+	struct lfs_config config;
+	lfs_t lfs;
+	bool mounted;
+};
+
+/**
+ * Initializes an erased flash.
+ *
+ * @param[out] sim flash to initialize.
+ * @param[in] path file to keep the image in, or NULL for RAM. An existing
+ *  image is kept, so it can be mounted again.
+ *
+ * @returns 0 on success, -1 on failure.
+ */
+int flash_sim_init(struct flash_sim *sim, const char *path);
+
+/**
+ * Unmounts and releases the image.
+ *
+ * @param[in, out] sim flash to release.
+ */
+void flash_sim_destroy(struct flash_sim *sim);
+
+/**
+ * Erases the whole image, without counting it.
+ *
+ * @param[in, out] sim flash to erase, must not be mounted.
+ */
+void flash_sim_erase(struct flash_sim *sim);
+
+/**
+ * Mounts littlefs, formatting and mounting again if that fails, like main.c.
+ *
+ * @param[in, out] sim flash to mount.
+ *
+ * @returns 0 on success, a negative littlefs error on failure.
+ */
+int flash_sim_mount(struct flash_sim *sim);
+
+/**
+ * Unmounts littlefs.
+ *
+ * @param[in, out] sim flash to unmount.
+ *
+ * @returns 0 on success, a negative littlefs error on failure.
+ */
+int flash_sim_unmount(struct flash_sim *sim);
+
+/**
+ * Returns the fraction of the blocks littlefs has in use, 0 to 1.
+ *
+ * @param[in, out] sim mounted flash.
+ */
+double flash_sim_used(struct flash_sim *sim);
+
+/**
+ * Clears the operation counts and modelled time.
+ *
+ * @param[in, out] sim flash.
+ */
+void flash_sim_reset_stats(struct flash_sim *sim);
+
+/**
+ * Makes "fs:/" paths of fopen and remove refer to this flash, which must be
+ * mounted while they are used.
+ *
+ * @param[in] sim flash to route to, NULL for none.
+ */
+void flash_sim_route(struct flash_sim *sim);
+
+/**
+ * fopen, for "fs:/" paths on the routed flash and for anything else on the
+ * host. Modes are those of fopen, without "x".
+ */
+FILE *flash_sim_fopen(const char *path, const char *mode);
+
+/**
+ * remove, for "fs:/" paths on the routed flash and for anything else on the
+ * host.
+ */
+int flash_sim_remove(const char *path);
+
+#ifdef FLASH_SIM_STDIO
+#define fopen flash_sim_fopen
+#define remove flash_sim_remove
+#endif
+
+#endif//FLASH_SIM_H_
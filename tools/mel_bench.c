@@ -0,0 +1,235 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+/*
+ * Host tool that times the mel filterbank and MFCC stage of fft_mel.c per
+ * frame, next to the kiss_fftr it runs after, and checks it against a double
+ * precision evaluation of the same filterbank.
+ *
+ * The tool is built twice: mel_bench with the float library, like the
+ * device build, and mel_bench_q15 with FIXED_POINT=16, where everything after
+ * the filterbank setup runs in integers. Times are averages over all frames;
+ * on x86 they are also given in TSC cycles, a rough guide only as the
+ * Cortex-M4 has neither the host's caches nor its float throughput.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+
+#include <fft.h>
+#include <fft_mel.h>
+#include <kiss_fftr.h>
+
+#include <getopt.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint64_t now_cycles(void)
+{
+#ifdef HAVE_TSC
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+// Small xorshift generator, so frames are the same on every platform
+static uint32_t next_random(uint32_t *state)
+{
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+#ifdef FIXED_POINT
+#define WEIGHT_SCALE 32768.0
+#define VALUE_SCALE 256.0 // dB Q8
+#define POWER_SCALE 1073741824.0 // Q30
+#else
+#define WEIGHT_SCALE 1.0
+#define VALUE_SCALE 1.0
+#define POWER_SCALE 1.0
+#endif
+
+// The same filterbank and DCT in double precision, from the stored weights
+static void reference(const struct fft_mel *mel, const kiss_fft_cpx out[], double energies[], double mfcc[])
+{
+	for (uint32_t b = 0; b < mel->bands; ++b)
+	{
+		double sum = 0.0;
+		for (uint32_t i = 0; i < mel->counts[b]; ++i)
+		{
+			const kiss_fft_cpx *bin = &out[mel->starts[b] + i];
+			double power = (double)bin->r * bin->r + (double)bin->i * bin->i;
+			sum += power * mel->weights[mel->offsets[b] + i] / WEIGHT_SCALE;
+		}
+#ifdef FIXED_POINT
+		energies[b] = 10.0 * log10((sum > 1.0 ? sum : 1.0) / POWER_SCALE);
+#else
+		energies[b] = 10.0 * log10(sum + 1.0);
+#endif
+	}
+	for (uint32_t c = 0; c < mel->coeffs; ++c)
+	{
+		mfcc[c] = 0.0;
+		for (uint32_t b = 0; b < mel->bands; ++b)
+			mfcc[c] += energies[b] * mel->dct[c * mel->bands + b] / WEIGHT_SCALE;
+	}
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [-n nfft] [-s rate] [-b bands] [-c coeffs] [-f frames]\n"
+		"  -n  transform size, up to 1024 (default 512)\n"
+		"  -s  sampling rate, Hz (default 7813)\n"
+		"  -b  mel bands (default 26)\n"
+		"  -c  cepstral coefficients (default 13)\n"
+		"  -f  frames to time (default 2000)\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+	struct fft fft = { .N = 512, .S = 7813, .D = 1 };
+	int bands = 26, coeffs = 13, frames = 2000;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "n:s:b:c:f:h")) != -1)
+	{
+		switch (opt)
+		{
+		case 'n':
+			fft.N = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			fft.S = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			bands = atoi(optarg);
+			break;
+		case 'c':
+			coeffs = atoi(optarg);
+			break;
+		case 'f':
+			frames = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+
+	static struct fft_mel mel;
+	if (frames < 1 || bands < 0 || bands > 255 || coeffs < 1 || coeffs > 255 || fft.N % 2 ||
+		fft_mel_init(&mel, &fft, (uint8_t)bands, (uint8_t)coeffs, 0.0f, fft.S / 2.0f))
+	{
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	uint32_t weights = 0;
+	for (int b = 0; b < bands; ++b)
+		weights += mel.counts[b];
+
+	kiss_fftr_cfg cfg = kiss_fftr_alloc(fft.N, 0, NULL, NULL);
+	kiss_fft_scalar *in = malloc(sizeof(*in) * fft.N * frames);
+	kiss_fft_cpx *out = malloc(sizeof(*out) * (fft.N / 2 + 1) * frames);
+	fft_mel_value *mfcc = malloc(sizeof(*mfcc) * coeffs * frames);
+	if (!cfg || !in || !out || !mfcc)
+	{
+		fprintf(stderr, "out of memory\n");
+		return EXIT_FAILURE;
+	}
+
+	// A sweeping tone over noise, so every band sees some change
+	uint32_t state = 0x12345678;
+	for (int f = 0; f < frames; ++f)
+		for (uint32_t t = 0; t < fft.N; ++t)
+		{
+			double hz = 100.0 + (fft.S / 2.0 - 200.0) * f / frames;
+			double x = 0.5 * sin(2.0 * M_PI * hz * t / fft.S) +
+				((int32_t)(next_random(&state) % 65536) - 32768) / 262144.0;
+			in[f * fft.N + t] = (kiss_fft_scalar)lrint(x * 32767);
+		}
+
+	// Each stage over all frames at once, so the timer is read rarely
+	double start = now_ns();
+	uint64_t cycles = now_cycles();
+	for (int f = 0; f < frames; ++f)
+		kiss_fftr(cfg, in + f * fft.N, out + f * (fft.N / 2 + 1));
+	double fft_ns = (now_ns() - start) / frames;
+	double fft_cycles = (double)(now_cycles() - cycles) / frames;
+
+	start = now_ns();
+	cycles = now_cycles();
+	for (int f = 0; f < frames; ++f)
+		fft_mel_energies(&mel, out + f * (fft.N / 2 + 1));
+	double mel_ns = (now_ns() - start) / frames;
+	double mel_cycles = (double)(now_cycles() - cycles) / frames;
+
+	start = now_ns();
+	cycles = now_cycles();
+	for (int f = 0; f < frames; ++f)
+		fft_mel_mfcc(&mel, out + f * (fft.N / 2 + 1), mfcc + f * coeffs);
+	double mfcc_ns = (now_ns() - start) / frames;
+	double mfcc_cycles = (double)(now_cycles() - cycles) / frames;
+
+	// Worst deviation from the double precision filterbank, in dB
+	double energy_error = 0.0, mfcc_error = 0.0;
+	double energies[FFT_MEL_MAX_BANDS], expected[FFT_MEL_MAX_COEFFS];
+	for (int f = 0; f < frames; ++f)
+	{
+		const kiss_fft_cpx *spectrum = out + f * (fft.N / 2 + 1);
+		fft_mel_energies(&mel, spectrum);
+		reference(&mel, spectrum, energies, expected);
+		for (int b = 0; b < bands; ++b)
+			energy_error = fmax(energy_error, fabs(mel.energies[b] / VALUE_SCALE - energies[b]));
+		for (int c = 0; c < coeffs; ++c)
+			mfcc_error = fmax(mfcc_error, fabs(mfcc[f * coeffs + c] / VALUE_SCALE - expected[c]));
+	}
+
+#ifdef FIXED_POINT
+	const char *build = "FIXED_POINT=16";
+#else
+	const char *build = "float";
+#endif
+	printf("%s, nfft %lu, %d bands (%lu weights, %lu dense), %d coefficients, %d frames\n",
+		build, (unsigned long)fft.N, bands, (unsigned long)weights,
+		(unsigned long)(bands * (fft.N / 2 + 1)), coeffs, frames);
+	printf("  %-22s %9.2f us", "kiss_fftr", fft_ns / 1000);
+#ifdef HAVE_TSC
+	printf(" %9.0f cycles", fft_cycles);
+#endif
+	printf("\n  %-22s %9.2f us", "fft_mel_energies", mel_ns / 1000);
+#ifdef HAVE_TSC
+	printf(" %9.0f cycles", mel_cycles);
+#endif
+	printf("\n  %-22s %9.2f us", "fft_mel_mfcc", mfcc_ns / 1000);
+#ifdef HAVE_TSC
+	printf(" %9.0f cycles", mfcc_cycles);
+#endif
+	printf("\n  largest error: log energies %.4f dB, MFCCs %.4f dB\n", energy_error, mfcc_error);
+	printf("  struct fft_mel %zu bytes\n", sizeof(mel));
+
+	free(mfcc);
+	free(out);
+	free(in);
+	kiss_fftr_free(cfg);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,198 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+/*
+ * Host tool that plays the device end of the offload protocol over a pty, so
+ * offload.py can be exercised end to end without a board.
+ *
+ * The tool creates a pty pair, prints the path of the side offload.py should
+ * open, and serves files from a directory standing in for the littlefs root
+ * with the same offload.c the firmware uses. Writes are paced to the byte
+ * rate of the negotiated baud rate so transfer rates are realistic, and every
+ * Nth DATA frame can be corrupted to exercise the retry path.
+ */
+
+#define _GNU_SOURCE
+
+#include <offload.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+struct sim
+{
+	int fd;
+	bool pace;
+	uint32_t baud;
+	struct timespec next; // when the link is done sending what was written
+	unsigned corrupt; // corrupt every Nth DATA frame, 0 for never
+	unsigned frames;
+};
+
+static size_t sim_read(void *context, uint8_t *data, size_t size, uint32_t timeout)
+{
+	struct sim *sim = context;
+	struct pollfd fds = { .fd = sim->fd, .events = POLLIN };
+	if (poll(&fds, 1, timeout) <= 0)
+		return 0;
+	ssize_t result = read(sim->fd, data, size);
+	return result > 0 ? result : 0;
+}
+
+// Sleeps until a UART at the current baud rate would have sent size more
+// bytes, 10 bits each
+static void sim_pace(struct sim *sim, size_t size)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (now.tv_sec > sim->next.tv_sec ||
+		(now.tv_sec == sim->next.tv_sec && now.tv_nsec > sim->next.tv_nsec))
+		sim->next = now;
+	uint64_t ns = (uint64_t)size * 10 * 1000000000u / sim->baud;
+	ns += sim->next.tv_nsec;
+	sim->next.tv_sec += ns / 1000000000u;
+	sim->next.tv_nsec = ns % 1000000000u;
+	clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &sim->next, NULL);
+}
+
+static int sim_write(void *context, const uint8_t *data, size_t size)
+{
+	struct sim *sim = context;
+	uint8_t copy[OFFLOAD_PACKET_MAX];
+	// Only DATA frames carry this much in a single write
+	if (sim->corrupt && size > 16 && size <= sizeof(copy) &&
+		++sim->frames % sim->corrupt == 0)
+	{
+		memcpy(copy, data, size);
+		copy[size / 2] ^= 0x55;
+		data = copy;
+	}
+	if (sim->pace)
+		sim_pace(sim, size);
+	while (size)
+	{
+		ssize_t written = write(sim->fd, data, size);
+		if (written < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		data += written;
+		size -= written;
+	}
+	return 0;
+}
+
+static void sim_baud(void *context, uint32_t baud)
+{
+	struct sim *sim = context;
+	tcdrain(sim->fd);
+	sim->baud = baud;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [-b baud] [-m max baud] [-e frames] [-n sessions] directory\n"
+		"  -b  baud rate before offload, 0 to not pace writes (default 115200)\n"
+		"  -m  highest baud rate to agree to (default 921600)\n"
+		"  -e  corrupt every Nth DATA frame (default 0, never)\n"
+		"  -n  offload sessions to serve before exiting (default 1)\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+	struct sim sim = { .pace = true, .baud = 115200 };
+	uint32_t max_baud = 921600;
+	unsigned sessions = 1;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "b:m:e:n:h")) != -1)
+	{
+		switch (opt)
+		{
+		case 'b':
+			sim.baud = strtoul(optarg, NULL, 0);
+			sim.pace = sim.baud != 0;
+			break;
+		case 'm':
+			max_baud = strtoul(optarg, NULL, 0);
+			break;
+		case 'e':
+			sim.corrupt = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			sessions = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+	if (optind + 1 != argc || !max_baud)
+	{
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	// The root is prepended to requested paths as is, like "fs:/" on target
+	char root[4096];
+	snprintf(root, sizeof(root), "%s/", argv[optind]);
+
+	sim.fd = posix_openpt(O_RDWR | O_NOCTTY);
+	if (sim.fd < 0 || grantpt(sim.fd) || unlockpt(sim.fd))
+	{
+		perror("posix_openpt");
+		return EXIT_FAILURE;
+	}
+	// Keep the other side open and raw, so nothing is echoed back before
+	// offload.py opens it and reads do not fail after it closes it
+	const char *path = ptsname(sim.fd);
+	int peer = open(path, O_RDWR | O_NOCTTY);
+	struct termios termios;
+	if (peer < 0 || tcgetattr(peer, &termios))
+	{
+		perror(path);
+		return EXIT_FAILURE;
+	}
+	cfmakeraw(&termios);
+	tcsetattr(peer, TCSANOW, &termios);
+	printf("%s\n", path);
+	fflush(stdout);
+
+	struct offload offload;
+	const struct offload_io io = {
+		.context = &sim,
+		.read = sim_read,
+		.write = sim_write,
+		.baud = sim_baud,
+	};
+	offload_init(&offload, &io, root, max_baud);
+
+	uint32_t baud = sim.baud;
+	int result = EXIT_SUCCESS;
+	for (unsigned i = 0; i < sessions; ++i)
+	{
+		while (!offload_wait(&offload, 1000))
+			;
+		if (offload_serve(&offload, baud))
+		{
+			fprintf(stderr, "offload session %u failed\n", i + 1);
+			result = EXIT_FAILURE;
+		}
+	}
+	close(peer);
+	close(sim.fd);
+	return result;
+}
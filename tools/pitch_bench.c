@@ -0,0 +1,316 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+/*
+ * Host tool that checks the autocorrelation pitch estimator in fft.c on
+ * synthetic harmonic signals, and times it against the peak detector.
+ *
+ * Fundamentals are swept over the search range, each with three timbres: a
+ * falling harmonic series, one whose second harmonic is the strongest, and one
+ * missing its fundamental altogether, with random phases and some white
+ * noise. For each the tool counts estimates off by more than the tolerance,
+ * for the estimator and, for comparison, for the strongest bin that fft_peak
+ * reports and for the same estimator without zero padding, whose circular
+ * autocorrelation folds lag N-L onto lag L. It also checks that white noise
+ * scores a low confidence.
+ *
+ * Timing is per frame, for fft_peak alone and for the estimator, in
+ * microseconds and, on x86, TSC cycles, next to the frame period at the
+ * sampling rate. It exits with a failure if any estimate is off or noise
+ * scores high.
+ */
+
+#define _GNU_SOURCE
+
+#include <fft.h>
+#include <kiss_fftr.h>
+
+#include <getopt.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+// Largest error of an estimate, relative to the fundamental
+#define TOLERANCE 0.02
+
+// Highest confidence white noise may score
+#define NOISE_CONFIDENCE 0.5f
+
+// Number of fundamentals swept, log spaced over the search range
+#define FUNDAMENTALS 48
+
+// Harmonic amplitudes of each timbre, the first entry the fundamental
+#define HARMONICS 6
+static const double timbres[][HARMONICS] = {
+	{1.0, 0.5, 0.33, 0.25, 0.2, 0.17},
+	{0.3, 1.0, 0.7, 0.5, 0.3, 0.2},
+	{0.0, 1.0, 0.8, 0.6, 0.4, 0.3},
+};
+
+static const char * const timbre_names[] = {
+	"falling",
+	"strong 2nd",
+	"no fundamental",
+};
+
+#define TIMBRES (sizeof(timbres) / sizeof(timbres[0]))
+
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint64_t now_cycles(void)
+{
+#ifdef HAVE_TSC
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+// Small xorshift generator, so signals are the same on every platform
+static uint32_t next_random(uint32_t *state)
+{
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+static double uniform(uint32_t *state)
+{
+	return (double)next_random(state) / UINT32_MAX;
+}
+
+// A frame of harmonics of f0 with random phases, plus white noise, at about
+// the level of the PDM samples
+static void synthesize(kiss_fft_scalar in[], uint32_t n, uint32_t rate, double f0,
+	const double amplitudes[], double noise, uint32_t *state)
+{
+	double phases[HARMONICS];
+	for (int h = 0; h < HARMONICS; ++h)
+		phases[h] = 2 * M_PI * uniform(state);
+	for (uint32_t t = 0; t < n; ++t)
+	{
+		double x = 0;
+		for (int h = 0; h < HARMONICS; ++h)
+		{
+			double f = f0 * (h + 1);
+			if (f < rate / 2.0)
+				x += amplitudes[h] * sin(2 * M_PI * f * t / rate + phases[h]);
+		}
+		x += noise * (2 * uniform(state) - 1);
+		in[t] = (kiss_fft_scalar)(4000 * x);
+	}
+}
+
+// The estimator as it was before zero padding, from the circular
+// autocorrelation of the frame's own N point spectrum
+static float circular_estimate(struct fft *fft, kiss_fftr_cfg inverse, const kiss_fft_cpx out[],
+	kiss_fft_cpx power[], kiss_fft_scalar acf[], uint32_t min_lag, uint32_t max_lag)
+{
+	power[0].r = power[0].i = 0;
+	for (uint32_t k = 1; k < fft->N / 2 + 1; ++k)
+	{
+		power[k].r = out[k].r * out[k].r + out[k].i * out[k].i;
+		power[k].i = 0;
+	}
+	kiss_fftri(inverse, power, acf);
+	if (acf[0] <= 0)
+		return 0;
+	float best = 0;
+	for (uint32_t lag = min_lag; lag <= max_lag; ++lag)
+		if (acf[lag] > acf[lag - 1] && acf[lag] >= acf[lag + 1] && acf[lag] > best)
+			best = acf[lag];
+	uint32_t lag = min_lag;
+	for (; lag <= max_lag; ++lag)
+		if (acf[lag] > acf[lag - 1] && acf[lag] >= acf[lag + 1] && acf[lag] >= 0.9f * best)
+			break;
+	if (best <= 0 || lag > max_lag)
+		return 0;
+	float left = acf[lag - 1], center = acf[lag], right = acf[lag + 1];
+	float denominator = left - 2 * center + right;
+	float offset = denominator != 0 ? 0.5f * (left - right) / denominator : 0;
+	return (float)fft->S / ((float)lag + offset);
+}
+
+static bool close_to(double estimate, double f0)
+{
+	return fabs(estimate - f0) <= TOLERANCE * f0;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [-n samples] [-s rate] [-l low] [-u high] [-z noise] [-r repeat]\n"
+		"  -n  samples per frame (default 512)\n"
+		"  -s  sampling rate, Hz (default 7813)\n"
+		"  -l  lowest fundamental searched, Hz (default 40)\n"
+		"  -u  highest fundamental searched, Hz (default 1000)\n"
+		"  -z  white noise amplitude, relative to the strongest harmonic (default 0.3)\n"
+		"  -r  frames per timing (default 2000)\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+	struct fft fft;
+	fft_init(&fft);
+	float low = 40.0f, high = 1000.0f;
+	double noise = 0.3;
+	int repeat = 2000;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "n:s:l:u:z:r:h")) != -1)
+	{
+		switch (opt)
+		{
+		case 'n':
+			fft_N(&fft, strtoul(optarg, NULL, 0));
+			break;
+		case 's':
+			fft_S(&fft, strtoul(optarg, NULL, 0));
+			break;
+		case 'l':
+			low = strtof(optarg, NULL);
+			break;
+		case 'u':
+			high = strtof(optarg, NULL);
+			break;
+		case 'z':
+			noise = strtod(optarg, NULL);
+			break;
+		case 'r':
+			repeat = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+	const uint32_t n = fft_get_N(&fft);
+	const uint32_t rate = fft_get_S(&fft);
+	struct fft_pitch pitch;
+	if (n < 8 || n % 2 || !rate || noise < 0 || repeat < 1 ||
+		fft_pitch_init(&pitch, &fft, low, high))
+	{
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	// The search range as the estimator clamped it
+	const double lowest = 2.0 * rate / pitch.max_lag;
+	const double highest = fmin(high, 2.0 * rate / pitch.min_lag);
+
+	kiss_fftr_cfg cfg = kiss_fftr_alloc(n, 0, NULL, NULL);
+	kiss_fftr_cfg inverse = kiss_fftr_alloc(n, 1, NULL, NULL);
+	kiss_fft_scalar *in = malloc(sizeof(*in) * n);
+	kiss_fft_scalar *acf = malloc(sizeof(*acf) * n);
+	kiss_fft_cpx *out = malloc(sizeof(*out) * (n / 2 + 1));
+	kiss_fft_cpx *power = malloc(sizeof(*power) * (n / 2 + 1));
+	if (!cfg || !inverse || !in || !acf || !out || !power)
+	{
+		fprintf(stderr, "out of memory\n");
+		return EXIT_FAILURE;
+	}
+
+	printf("N %lu at %lu Hz, padded to %lu, lags every %.1f samples, fundamentals %.1f to %.1f Hz, tolerance %.0f%%\n",
+		(unsigned long)n, (unsigned long)rate, (unsigned long)pitch.nfft, pitch.stride / 2.0,
+		lowest, highest, TOLERANCE * 100);
+	printf("%-15s %8s %10s %10s %10s %10s\n", "timbre", "frames", "estimator",
+		"peak bin", "circular", "confidence");
+	bool ok = true;
+	uint32_t state = 0x2545f491u;
+	for (size_t timbre = 0; timbre < TIMBRES; ++timbre)
+	{
+		unsigned wrong = 0, peak_wrong = 0, circular_wrong = 0;
+		float least_confidence = 1;
+		for (int i = 0; i < FUNDAMENTALS; ++i)
+		{
+			// Not quite at the ends, where interpolation runs out of lags
+			double f0 = lowest * 1.02 * pow(highest / lowest / 1.04, (double)i / (FUNDAMENTALS - 1));
+			synthesize(in, n, rate, f0, timbres[timbre], noise, &state);
+			float confidence;
+			float estimate = fft_pitch_estimate(&pitch, &fft, in, &confidence);
+			uint32_t peak = fft_peak(&fft, cfg, in, out);
+			float circular = circular_estimate(&fft, inverse, out, power, acf,
+				pitch.min_lag / 2, pitch.max_lag / 2);
+			if (!close_to(estimate, f0))
+			{
+				++wrong;
+				printf("  %s at %.1f Hz: estimated %.1f Hz\n", timbre_names[timbre], f0, (double)estimate);
+			}
+			// The peak bin is only as fine as a bin, give it that much slack
+			if (fabs(peak - f0) > fmax(TOLERANCE * f0, (double)rate / n))
+				++peak_wrong;
+			if (!close_to(circular, f0))
+				++circular_wrong;
+			if (confidence < least_confidence)
+				least_confidence = confidence;
+		}
+		printf("%-15s %8d %10u %10u %10u %10.2f\n", timbre_names[timbre], FUNDAMENTALS,
+			wrong, peak_wrong, circular_wrong, (double)least_confidence);
+		if (wrong)
+			ok = false;
+	}
+
+	// White noise has no period
+	float noise_confidence = 0;
+	for (int i = 0; i < 100; ++i)
+	{
+		for (uint32_t t = 0; t < n; ++t)
+			in[t] = (kiss_fft_scalar)(4000 * (2 * uniform(&state) - 1));
+		float confidence;
+		fft_pitch_estimate(&pitch, &fft, in, &confidence);
+		if (confidence > noise_confidence)
+			noise_confidence = confidence;
+	}
+	printf("white noise: highest confidence %.2f of %.2f allowed\n",
+		(double)noise_confidence, (double)NOISE_CONFIDENCE);
+	if (noise_confidence > NOISE_CONFIDENCE)
+		ok = false;
+
+	// Per frame cost, against the frame period
+	synthesize(in, n, rate, 220.0, timbres[0], noise, &state);
+	double start = now_ns();
+	uint64_t cycles = now_cycles();
+	for (int r = 0; r < repeat; ++r)
+		fft_peak(&fft, cfg, in, out);
+	double peak_ns = (now_ns() - start) / repeat;
+	double peak_cycles = (double)(now_cycles() - cycles) / repeat;
+	float confidence;
+	start = now_ns();
+	cycles = now_cycles();
+	for (int r = 0; r < repeat; ++r)
+		fft_pitch_estimate(&pitch, &fft, in, &confidence);
+	double pitch_ns = (now_ns() - start) / repeat;
+	double pitch_cycles = (double)(now_cycles() - cycles) / repeat;
+	printf("per frame: fft_peak %.1f us, estimator %.1f us (%.2fx), frame period %.1f ms\n",
+		peak_ns / 1000, pitch_ns / 1000, pitch_ns / peak_ns, 1000.0 * n / rate);
+#ifdef HAVE_TSC
+	printf("per frame: fft_peak %.0f cycles, estimator %.0f cycles\n", peak_cycles, pitch_cycles);
+#else
+	(void)peak_cycles;
+	(void)pitch_cycles;
+#endif
+
+	fft_pitch_destroy(&pitch);
+	kiss_fftr_free(cfg);
+	kiss_fftr_free(inverse);
+	free(in);
+	free(acf);
+	free(out);
+	free(power);
+	printf("%s\n", ok ? "ok" : "FAILED");
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
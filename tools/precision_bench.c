@@ -0,0 +1,405 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+/*
+ * Host tool that checks the float and integer versions of the computations
+ * the single_precision build uses against the double ones they replace, and
+ * times both.
+ *
+ *  - time_to_string, digits counted in integers, against the ceil(log10())
+ *    version main.c had and snprintf.
+ *  - convert_adc_microvolts and convert_divider_ohms, for every 14-bit code,
+ *    against the double voltage and resistance math main.c had.
+ *  - fft_peak, with float powers, against the same search in double.
+ *  - The BMP280 integer compensation the firmware uses with single_precision,
+ *    against the double one, both as the Bosch datasheet gives them, with the
+ *    calibration of the datasheet example over a range of raw readings.
+ *
+ * The tool exits with a failure if any of them is out of tolerance. On a host
+ * double precision is in hardware, so the times only show the integer and
+ * float versions cost no more; on the Apollo3, every double operation is a
+ * library call.
+ */
+
+#define _GNU_SOURCE
+
+#include <convert.h>
+#include <fft.h>
+#include <kiss_fftr.h>
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Small xorshift generator, so runs are the same on every platform
+static uint32_t next_random(uint32_t *state)
+{
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+// Keeps results alive so timed loops are not optimized away
+static volatile uint64_t sink;
+
+static bool report(const char *name, const char *error, double ns, double reference_ns, bool ok)
+{
+	printf("%-22s %-30s %8.1f ns %8.1f ns  %s\n", name, error, ns, reference_ns, ok ? "ok" : "FAILED");
+	return ok;
+}
+
+// ***************************************************************************
+// time_to_string
+
+static void time_to_string_log10(uint8_t buffer[21], uint64_t tv_sec)
+{
+	int max = ceil(log10(tv_sec));
+	uint64_t tmp = tv_sec;
+	for (int i = max - 1; i >= 0; --i)
+	{
+		buffer[i] = '0' + (tmp % 10);
+		tmp /= 10;
+	}
+}
+
+static bool check_time_to_string(int repeat)
+{
+	// Every power of ten and its neighbours, then random times
+	uint64_t values[64 + 1024];
+	size_t count = 0;
+	values[count++] = 0;
+	for (uint64_t p = 1; p <= UINT64_MAX / 10; p *= 10)
+	{
+		values[count++] = p - 1 ? p - 1 : 1;
+		values[count++] = p;
+	}
+	values[count++] = UINT64_MAX;
+	uint32_t state = 0x2545f491u;
+	while (count < sizeof(values) / sizeof(*values))
+		values[count++] = next_random(&state);
+
+	size_t wrong = 0, wrong_log10 = 0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		char expected[21];
+		snprintf(expected, sizeof(expected), "%" PRIu64, values[i]);
+		uint8_t buffer[21] = {0};
+		time_to_string(buffer, values[i]);
+		wrong += strcmp((const char *)buffer, expected) != 0;
+		// The log10 version writes before the buffer for 0
+		if (values[i])
+		{
+			uint8_t old[21] = {0};
+			time_to_string_log10(old, values[i]);
+			wrong_log10 += strcmp((const char *)old, expected) != 0;
+		}
+		else
+			wrong_log10++;
+	}
+
+	// Timed on the 32 bit times the firmware logs
+	uint8_t buffer[21] = {0};
+	double start = now_ns();
+	for (int r = 0; r < repeat; ++r)
+	{
+		time_to_string(buffer, 1700000000u + r);
+		sink += buffer[9];
+	}
+	double ns = (now_ns() - start) / repeat;
+	start = now_ns();
+	for (int r = 0; r < repeat; ++r)
+	{
+		time_to_string_log10(buffer, 1700000000u + r);
+		sink += buffer[9];
+	}
+	double log10_ns = (now_ns() - start) / repeat;
+
+	char error[64];
+	snprintf(error, sizeof(error), "%zu/%zu wrong, log10 %zu", wrong, count, wrong_log10);
+	return report("time_to_string", error, ns, log10_ns, wrong == 0);
+}
+
+// ***************************************************************************
+// ADC voltage and photo resistor
+
+static bool check_adc(int repeat)
+{
+	const uint32_t full_scale = (1 << 14) - 1;
+	double voltage_error = 0.0;
+	int64_t ohms_error = 0;
+	for (uint32_t code = 0; code <= full_scale; ++code)
+	{
+		const double reference = 1.5;
+		double voltage = code * reference / full_scale;
+		uint32_t resistance = (uint32_t)((10000 * voltage) / (3.3 - voltage));
+
+		uint32_t microvolts = convert_adc_microvolts(code, 1500000, full_scale);
+		voltage_error = fmax(voltage_error, fabs(microvolts - voltage * 1e6));
+		int64_t diff = (int64_t)convert_divider_ohms(microvolts, 3300000, 10000) - resistance;
+		ohms_error = diff < 0 ? (-diff > ohms_error ? -diff : ohms_error) : (diff > ohms_error ? diff : ohms_error);
+	}
+
+	double start = now_ns();
+	for (int r = 0; r < repeat; ++r)
+	{
+		uint32_t microvolts = convert_adc_microvolts(r & full_scale, 1500000, full_scale);
+		sink += convert_divider_ohms(microvolts, 3300000, 10000);
+	}
+	double ns = (now_ns() - start) / repeat;
+	start = now_ns();
+	for (int r = 0; r < repeat; ++r)
+	{
+		volatile double reference = 1.5;
+		double voltage = (r & full_scale) * reference / full_scale;
+		sink += (uint32_t)((10000 * voltage) / (3.3 - voltage));
+	}
+	double double_ns = (now_ns() - start) / repeat;
+
+	char error[64];
+	snprintf(error, sizeof(error), "%.2f uV, %" PRId64 " ohm", voltage_error, ohms_error);
+	// Rounding to the microvolt, then truncation to the ohm
+	return report("adc voltage/ohms", error, ns, double_ns, voltage_error <= 0.5 && ohms_error <= 1);
+}
+
+// ***************************************************************************
+// fft_peak
+
+static uint32_t fft_peak_double(struct fft *fft, kiss_fftr_cfg cfg, const kiss_fft_scalar in[], kiss_fft_cpx out[])
+{
+	kiss_fftr(cfg, in, out);
+	double max = 0;
+	uint32_t bucket = 0;
+	for (uint32_t j = 1; j < fft->N / 2 + 1; j++)
+	{
+		double power = (double)out[j].r * out[j].r + (double)out[j].i * out[j].i;
+		if (power > max)
+		{
+			max = power;
+			bucket = j;
+		}
+	}
+	return (uint32_t)(((uint64_t)bucket * fft->S) / fft->N);
+}
+
+static bool check_fft_peak(int repeat)
+{
+	struct fft fft;
+	fft_init(&fft);
+	kiss_fftr_cfg cfg = kiss_fftr_alloc(fft.N, 0, NULL, NULL);
+	kiss_fft_scalar *in = malloc(sizeof(*in) * fft.N);
+	kiss_fft_cpx *out = malloc(sizeof(*out) * (fft.N / 2 + 1));
+	if (!cfg || !in || !out)
+	{
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// Tones at every bin, some between bins, in noise as loud as they are
+	const int frames = 1000;
+	int wrong = 0;
+	uint32_t state = 0x9e3779b9u;
+	for (int f = 0; f < frames; ++f)
+	{
+		double hz = (double)fft.S / fft.N * (1 + f % (fft.N / 2 - 1)) * (1 + (f % 3) * 0.17);
+		for (uint32_t t = 0; t < fft.N; ++t)
+			in[t] = (kiss_fft_scalar)(8000 * sin(2 * M_PI * hz * t / fft.S) +
+				(int32_t)(next_random(&state) % 16000) - 8000);
+		wrong += fft_peak(&fft, cfg, in, out) != fft_peak_double(&fft, cfg, in, out);
+	}
+
+	double start = now_ns();
+	for (int r = 0; r < repeat; ++r)
+		sink += fft_peak(&fft, cfg, in, out);
+	double ns = (now_ns() - start) / repeat;
+	start = now_ns();
+	for (int r = 0; r < repeat; ++r)
+		sink += fft_peak_double(&fft, cfg, in, out);
+	double double_ns = (now_ns() - start) / repeat;
+
+	kiss_fftr_free(cfg);
+	free(in);
+	free(out);
+
+	char error[64];
+	snprintf(error, sizeof(error), "%d/%d peaks differ", wrong, frames);
+	return report("fft_peak", error, ns, double_ns, wrong == 0);
+}
+
+// ***************************************************************************
+// BMP280 compensation, from the datasheet (BST-BMP280-DS001), section 3.11.3
+// for the integer versions and section 8.2 for the double ones
+
+struct bmp280_calibration
+{
+	uint16_t T1;
+	int16_t T2, T3;
+	uint16_t P1;
+	int16_t P2, P3, P4, P5, P6, P7, P8, P9;
+};
+
+// The datasheet example
+static const struct bmp280_calibration calibration = {
+	27504, 26435, -1000,
+	36477, -10685, 3024, 2855, 140, -7, 15500, -14600, 6000,
+};
+
+// 0.01 C
+static int32_t compensate_T_int32(const struct bmp280_calibration *c, int32_t adc_T, int32_t *t_fine)
+{
+	int32_t var1 = ((((adc_T >> 3) - ((int32_t)c->T1 << 1))) * ((int32_t)c->T2)) >> 11;
+	int32_t var2 = (((((adc_T >> 4) - ((int32_t)c->T1)) * ((adc_T >> 4) - ((int32_t)c->T1))) >> 12) *
+		((int32_t)c->T3)) >> 14;
+	*t_fine = var1 + var2;
+	return (*t_fine * 5 + 128) >> 8;
+}
+
+// Pa in Q24.8. Shifts of signed values are written as multiplications
+static uint32_t compensate_P_int64(const struct bmp280_calibration *c, int32_t adc_P, int32_t t_fine)
+{
+	int64_t var1 = (int64_t)t_fine - 128000;
+	int64_t var2 = var1 * var1 * c->P6;
+	var2 = var2 + var1 * c->P5 * (INT64_C(1) << 17);
+	var2 = var2 + (int64_t)c->P4 * (INT64_C(1) << 35);
+	var1 = ((var1 * var1 * c->P3) >> 8) + var1 * c->P2 * (INT64_C(1) << 12);
+	var1 = ((INT64_C(1) << 47) + var1) * c->P1 >> 33;
+	if (var1 == 0)
+		return 0;
+	int64_t p = 1048576 - adc_P;
+	p = ((p * (INT64_C(1) << 31) - var2) * 3125) / var1;
+	var1 = ((int64_t)c->P9 * (p >> 13) * (p >> 13)) >> 25;
+	var2 = ((int64_t)c->P8 * p) >> 19;
+	p = ((p + var1 + var2) >> 8) + (int64_t)c->P7 * 16;
+	return (uint32_t)p;
+}
+
+// C
+static double compensate_T_double(const struct bmp280_calibration *c, int32_t adc_T, int32_t *t_fine)
+{
+	double var1 = (adc_T / 16384.0 - c->T1 / 1024.0) * c->T2;
+	double var2 = (adc_T / 131072.0 - c->T1 / 8192.0) * (adc_T / 131072.0 - c->T1 / 8192.0) * c->T3;
+	*t_fine = (int32_t)(var1 + var2);
+	return (var1 + var2) / 5120.0;
+}
+
+// Pa
+static double compensate_P_double(const struct bmp280_calibration *c, int32_t adc_P, int32_t t_fine)
+{
+	double var1 = t_fine / 2.0 - 64000.0;
+	double var2 = var1 * var1 * c->P6 / 32768.0;
+	var2 = var2 + var1 * c->P5 * 2.0;
+	var2 = var2 / 4.0 + c->P4 * 65536.0;
+	var1 = (c->P3 * var1 * var1 / 524288.0 + c->P2 * var1) / 524288.0;
+	var1 = (1.0 + var1 / 32768.0) * c->P1;
+	if (var1 == 0.0)
+		return 0;
+	double p = 1048576.0 - adc_P;
+	p = (p - var2 / 4096.0) * 6250.0 / var1;
+	var1 = c->P9 * p * p / 2147483648.0;
+	var2 = p * c->P8 / 32768.0;
+	return p + (var1 + var2 + c->P7) / 16.0;
+}
+
+static bool check_bmp280(int repeat)
+{
+	// Raw readings for about -40 C to 85 C, and 300 hPa to 1100 hPa
+	int64_t temp_error = 0;
+	double press_error = 0.0;
+	int32_t t_fine, t_fine_double;
+	for (int32_t adc_T = 380000; adc_T <= 620000; adc_T += 977)
+	{
+		int32_t centi = compensate_T_int32(&calibration, adc_T, &t_fine);
+		double celsius = compensate_T_double(&calibration, adc_T, &t_fine_double);
+		// As logged: m C, truncated toward zero by the double build
+		int64_t diff = (int64_t)centi * 10 - (int32_t)(celsius * 1000);
+		temp_error = llabs(diff) > temp_error ? llabs(diff) : temp_error;
+
+		for (int32_t adc_P = 200000; adc_P <= 600000; adc_P += 4999)
+		{
+			double pa = compensate_P_double(&calibration, adc_P, t_fine_double);
+			if (pa < 30000.0 || pa > 110000.0)
+				continue;
+			uint32_t q8 = compensate_P_int64(&calibration, adc_P, t_fine);
+			press_error = fmax(press_error, fabs(q8 / 256.0 - pa));
+		}
+	}
+
+	double start = now_ns();
+	for (int r = 0; r < repeat; ++r)
+	{
+		int32_t adc = 519888 + (r & 1023);
+		sink += compensate_T_int32(&calibration, adc, &t_fine);
+		sink += compensate_P_int64(&calibration, 415148 + (r & 1023), t_fine) / 256;
+	}
+	double ns = (now_ns() - start) / repeat;
+	start = now_ns();
+	for (int r = 0; r < repeat; ++r)
+	{
+		int32_t adc = 519888 + (r & 1023);
+		sink += (uint32_t)(compensate_T_double(&calibration, adc, &t_fine) * 1000);
+		sink += (uint32_t)compensate_P_double(&calibration, 415148 + (r & 1023), t_fine);
+	}
+	double double_ns = (now_ns() - start) / repeat;
+
+	char error[64];
+	snprintf(error, sizeof(error), "%" PRId64 " mC, %.2f Pa", temp_error, press_error);
+	// The integer temperature has 10 mC steps, and the pressure about 1/256 Pa
+	// but coarser intermediate steps
+	return report("bmp280 compensation", error, ns, double_ns, temp_error <= 10 && press_error <= 1.0);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [-r repeat]\n"
+		"  -r  calls per timing (default 1000000)\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+	int repeat = 1000000;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "r:h")) != -1)
+	{
+		switch (opt)
+		{
+		case 'r':
+			repeat = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+	if (repeat < 1)
+	{
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	printf("%-22s %-30s %11s %11s\n", "function", "largest error", "new", "double");
+	bool ok = true;
+	ok &= check_time_to_string(repeat);
+	ok &= check_adc(repeat);
+	// A 512-point transform per call
+	ok &= check_fft_peak(repeat / 100 + 1);
+	ok &= check_bmp280(repeat);
+	printf("%s\n", ok ? "ok" : "FAILED");
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,171 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+/*
+ * Host tool that checks the FIXED_POINT=16 kiss_fft against a double
+ * precision DFT, and counts the DSP instructions its packed Q15 butterflies
+ * execute.
+ *
+ * The tool is built twice: q15_bench with the packed butterflies, their
+ * instructions emulated in C as they are on any target without the Cortex-M4
+ * DSP extension, and q15_bench_scalar with the generic fixed point ones. Both
+ * transform the same pseudo-random frames and report the SNR of the result,
+ * scaled by 1/N like the fixed point transform, and a checksum of the output.
+ * The emulation is bit exact, so the packed checksum is also what a device
+ * build should produce for the same frames.
+ */
+
+#define _GNU_SOURCE
+
+#include <kiss_fft.h>
+
+#include <getopt.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef KISS_FFT_Q15_COUNT
+#include <kiss_fft_q15.h>
+
+static const char * const op_names[Q15_OP_COUNT] = {
+	[Q15_SMLSD] = "smlsd",
+	[Q15_SMLADX] = "smladx",
+	[Q15_SHADD16] = "shadd16",
+	[Q15_QADD16] = "qadd16",
+	[Q15_QSUB16] = "qsub16",
+	[Q15_QASX] = "qasx",
+	[Q15_QSAX] = "qsax",
+	[Q15_PKHBT] = "pkhbt",
+};
+#endif
+
+// Small xorshift generator, so frames are the same on every platform
+static uint32_t next_random(uint32_t *state)
+{
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+static void dft(const kiss_fft_cpx in[], double out[][2], int n)
+{
+	for (int k = 0; k < n; ++k)
+	{
+		double re = 0.0, im = 0.0;
+		for (int t = 0; t < n; ++t)
+		{
+			double phase = -2.0 * M_PI * (double)((long)k * t % n) / n;
+			re += in[t].r * cos(phase) - in[t].i * sin(phase);
+			im += in[t].r * sin(phase) + in[t].i * cos(phase);
+		}
+		out[k][0] = re / n;
+		out[k][1] = im / n;
+	}
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [-n nfft] [-f frames] [-a amplitude]\n"
+		"  -n  transform size (default 256)\n"
+		"  -f  frames to transform (default 16)\n"
+		"  -a  peak input amplitude, up to 32767 (default 16384)\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+	int n = 256;
+	int frames = 16;
+	int amplitude = 16384;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "n:f:a:h")) != -1)
+	{
+		switch (opt)
+		{
+		case 'n':
+			n = atoi(optarg);
+			break;
+		case 'f':
+			frames = atoi(optarg);
+			break;
+		case 'a':
+			amplitude = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+	if (n < 2 || frames < 1 || amplitude < 1 || amplitude > 32767)
+	{
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	kiss_fft_cfg cfg = kiss_fft_alloc(n, 0, NULL, NULL);
+	kiss_fft_cpx *in = malloc(n * sizeof(*in));
+	kiss_fft_cpx *out = malloc(n * sizeof(*out));
+	double (*reference)[2] = malloc(n * sizeof(*reference));
+	if (!cfg || !in || !out || !reference)
+	{
+		fprintf(stderr, "out of memory\n");
+		return EXIT_FAILURE;
+	}
+
+	uint32_t state = 0x12345678;
+	uint32_t checksum = 2166136261u; // FNV-1a
+	double signal = 0.0, noise = 0.0;
+	for (int f = 0; f < frames; ++f)
+	{
+		// A tone on top of noise, so both the peak and the floor count
+		for (int t = 0; t < n; ++t)
+		{
+			double tone = 0.5 * cos(2.0 * M_PI * (f + 3) * t / n);
+			double re = tone + ((int32_t)(next_random(&state) % 65536) - 32768) / 65536.0;
+			double im = ((int32_t)(next_random(&state) % 65536) - 32768) / 65536.0;
+			in[t].r = (kiss_fft_scalar)lrint(re * amplitude);
+			in[t].i = (kiss_fft_scalar)lrint(im * amplitude);
+		}
+		kiss_fft(cfg, in, out);
+		dft(in, reference, n);
+		for (int k = 0; k < n; ++k)
+		{
+			double dr = out[k].r - reference[k][0];
+			double di = out[k].i - reference[k][1];
+			signal += reference[k][0] * reference[k][0] + reference[k][1] * reference[k][1];
+			noise += dr * dr + di * di;
+			const uint16_t values[2] = { (uint16_t)out[k].r, (uint16_t)out[k].i };
+			for (int v = 0; v < 2; ++v)
+				for (int b = 0; b < 2; ++b)
+				{
+					checksum ^= (values[v] >> (8 * b)) & 0xFF;
+					checksum *= 16777619u;
+				}
+		}
+	}
+
+	printf("nfft %d, %d frames, amplitude %d\n", n, frames, amplitude);
+	printf("SNR %.2f dB, checksum %08lx\n", 10.0 * log10(signal / (noise ? noise : 1e-30)),
+		(unsigned long)checksum);
+#ifdef KISS_FFT_Q15_COUNT
+	unsigned long total = 0;
+	printf("DSP instructions per transform:\n");
+	for (int i = 0; i < Q15_OP_COUNT; ++i)
+	{
+		printf("  %-8s %lu\n", op_names[i], kiss_fft_q15_counts[i] / frames);
+		total += kiss_fft_q15_counts[i];
+	}
+	printf("  %-8s %lu\n", "total", total / frames);
+#endif
+
+	free(reference);
+	free(out);
+	free(in);
+	kiss_fft_free(cfg);
+	return EXIT_SUCCESS;
+}
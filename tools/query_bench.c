@@ -0,0 +1,284 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+/*
+ * Host tool that measures time range queries over a log against the log's
+ * size, with and without the sparse time index, on the emulated flash in
+ * flash_sim.c.
+ *
+ * For each size the tool formats the flash and appends records a minute
+ * apart to one segmented log, closing it every cycle the way main.c does,
+ * once with an index entry every 16 records and once without an index. It
+ * then reads back the last 6 hours and a set of random 1 hour windows with
+ * log_file_query. Times are modelled from the flash operations each step
+ * makes. Next to the query times it prints what maintaining the index added
+ * to the time spent writing the log, and the number of index entries, which
+ * only stays at one every 16 records plus the first of each segment if the
+ * boot manifest carries the interval across reboots.
+ *
+ * It exits with a failure if a query returns the wrong records, if there are
+ * more index entries than that, or if the indexed queries of the largest log
+ * are not faster than parsing it.
+ */
+
+#define _GNU_SOURCE
+
+#define FLASH_SIM_STDIO
+#include "flash_sim.h"
+
+#include <logfile.h>
+
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define START_TIME 1700000000u
+#define RECORD_INTERVAL 60u
+#define MANIFEST "fs:/boot.manifest"
+
+// Record counts measured, from about one segment to thirty-two
+static const uint32_t sizes[] = {1000, 2000, 4000, 8000, 16000, 32000};
+
+#define SIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+// Small xorshift generator, so windows are the same on every platform
+static uint32_t next_random(uint32_t *state)
+{
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+struct query
+{
+	uint32_t expected; // timestamp of the next record in the range
+	bool ordered;
+};
+
+static int check_record(void *context, uint32_t time, const char *line)
+{
+	(void)line;
+	struct query *query = context;
+	if (time != query->expected)
+		query->ordered = false;
+	query->expected = time + RECORD_INTERVAL;
+	return 0;
+}
+
+// Runs one query, returns whether it gave exactly the records in [t0, t1)
+static bool query_range(struct log_file *log, uint32_t records, uint32_t t0, uint32_t t1)
+{
+	const uint32_t end = START_TIME + records * RECORD_INTERVAL;
+	uint32_t first = t0 < START_TIME ? START_TIME :
+		START_TIME + (t0 - START_TIME + RECORD_INTERVAL - 1) / RECORD_INTERVAL * RECORD_INTERVAL;
+	uint32_t last = t1 < end ? t1 : end;
+	int expected = first < last ? (last - first + RECORD_INTERVAL - 1) / RECORD_INTERVAL : 0;
+
+	struct query query = { .expected = first, .ordered = true };
+	int count = log_file_query(log, t0, t1, check_record, &query);
+	return count == expected && query.ordered;
+}
+
+struct result
+{
+	uint32_t entries; // index entries of every segment
+	uint32_t segments;
+	double write; // flash time writing the whole log
+	double recent; // flash time of the last 6 hours query
+	double window; // mean flash time of the 1 hour queries
+	bool ok;
+};
+
+// Writes a log of the given number of records, rebooting cleanly every
+// reboot_cycles cycles, and queries it
+static struct result measure(struct flash_sim *sim, uint32_t records, uint32_t index_interval,
+	unsigned cycle_records, unsigned reboot_cycles, unsigned windows)
+{
+	struct result result = { .ok = true };
+	struct log_file log = {
+		.path = "fs:/temperature_data.csv",
+		.header = "time,temperature data celsius\r\n",
+		.segment_size = 16384,
+		.segments = 1000,
+		.index_interval = index_interval,
+	};
+	const struct log_file blank = log;
+	flash_sim_erase(sim);
+	if (flash_sim_mount(sim))
+	{
+		result.ok = false;
+		return result;
+	}
+
+	flash_sim_reset_stats(sim);
+	unsigned cycles = 0;
+	for (uint32_t r = 0; r < records; ++r)
+	{
+		uint32_t time = START_TIME + r * RECORD_INTERVAL;
+		char record[32];
+		int len = snprintf(record, sizeof(record), "%lu,%lu\r\n", (unsigned long)time,
+			(unsigned long)(time % 4000));
+		if (log_file_write(&log, time, record, len))
+			result.ok = false;
+		if ((r + 1) % cycle_records == 0 && ++cycles % reboot_cycles == 0)
+		{
+			// A clean shutdown and boot, through the manifest
+			log_file_close(&log);
+			boot_manifest_save(MANIFEST, &log, 1);
+			log = blank;
+			boot_manifest_load(MANIFEST, &log, 1);
+		}
+		else if ((r + 1) % cycle_records == 0)
+		{
+			log_file_close(&log);
+		}
+	}
+	log_file_close(&log);
+	result.write = sim->stats.time;
+
+	result.segments = log.last - log.first + 1;
+	for (uint32_t segment = log.first; segment <= log.last; ++segment)
+	{
+		char path[LOG_FILE_PATH_MAX];
+		log_file_segment_path(&log, segment, path);
+		strcat(path, ".idx");
+		FILE *fp = fopen(path, "r");
+		if (!fp)
+			continue;
+		fseek(fp, 0, SEEK_END);
+		result.entries += ftell(fp) / 8;
+		fclose(fp);
+	}
+
+	// The newest 6 hours, the query the index is for
+	const uint32_t end = START_TIME + records * RECORD_INTERVAL;
+	flash_sim_reset_stats(sim);
+	result.ok &= query_range(&log, records, end - 6 * 3600, end);
+	result.recent = sim->stats.time;
+	log_file_close(&log);
+
+	uint32_t state = 0x2545f491u;
+	double total = 0;
+	for (unsigned w = 0; w < windows; ++w)
+	{
+		uint32_t t0 = START_TIME + next_random(&state) % (records * RECORD_INTERVAL);
+		flash_sim_reset_stats(sim);
+		result.ok &= query_range(&log, records, t0, t0 + 3600);
+		total += sim->stats.time;
+		log_file_close(&log);
+	}
+	result.window = windows ? total / windows : 0;
+	result.ok &= !flash_sim_unmount(sim);
+	return result;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [-f image] [-k records] [-b cycles] [-w windows] [-c hz] [-p us] [-e ms]\n"
+		"  -f  file to keep the flash image in (default RAM)\n"
+		"  -k  records per cycle, between closes of the log (default 8)\n"
+		"  -b  cycles between clean reboots (default 4)\n"
+		"  -w  random 1 hour windows queried per size (default 20)\n"
+		"  -c  flash SPI clock, Hz (default 4000000)\n"
+		"  -p  page program time, us (default 500)\n"
+		"  -e  sector erase time, ms (default 30)\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *image = NULL;
+	unsigned cycle_records = 8, reboot_cycles = 4, windows = 20;
+	long spi_hz = 0;
+	double program = -1, erase = -1;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "f:k:b:w:c:p:e:h")) != -1)
+	{
+		switch (opt)
+		{
+		case 'f':
+			image = optarg;
+			break;
+		case 'k':
+			cycle_records = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			reboot_cycles = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			windows = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			spi_hz = strtol(optarg, NULL, 0);
+			break;
+		case 'p':
+			program = strtod(optarg, NULL) / 1e6;
+			break;
+		case 'e':
+			erase = strtod(optarg, NULL) / 1e3;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+	if (!cycle_records || !reboot_cycles)
+	{
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	struct flash_sim sim;
+	if (flash_sim_init(&sim, image))
+	{
+		fprintf(stderr, "could not set up the flash image\n");
+		return EXIT_FAILURE;
+	}
+	if (spi_hz > 0)
+		sim.timing.spi_hz = spi_hz;
+	if (program >= 0)
+		sim.timing.page_program = program;
+	if (erase >= 0)
+		sim.timing.sector_erase = erase;
+	flash_sim_route(&sim);
+
+	printf("records a minute apart, %u per cycle, clean reboot every %u cycles\n",
+		cycle_records, reboot_cycles);
+	printf("%8s %12s %12s %12s %12s %12s %8s\n", "records", "6 h indexed", "6 h parsed",
+		"1 h indexed", "1 h parsed", "index write", "entries");
+	bool ok = true;
+	struct result indexed, parsed;
+	for (size_t s = 0; s < SIZES; ++s)
+	{
+		indexed = measure(&sim, sizes[s], 16, cycle_records, reboot_cycles, windows);
+		parsed = measure(&sim, sizes[s], 0, cycle_records, reboot_cycles, windows);
+		if (!indexed.ok || !parsed.ok)
+		{
+			fprintf(stderr, "wrong records queried from %lu records\n", (unsigned long)sizes[s]);
+			ok = false;
+		}
+		if (indexed.entries > (sizes[s] + 15) / 16 + indexed.segments)
+		{
+			fprintf(stderr, "%lu index entries for %lu records\n",
+				(unsigned long)indexed.entries, (unsigned long)sizes[s]);
+			ok = false;
+		}
+		printf("%8lu %9.2f ms %9.2f ms %9.2f ms %9.2f ms %11.1f%% %8lu\n", (unsigned long)sizes[s],
+			indexed.recent * 1e3, parsed.recent * 1e3, indexed.window * 1e3,
+			parsed.window * 1e3, (indexed.write / parsed.write - 1) * 100,
+			(unsigned long)indexed.entries);
+	}
+	if (indexed.recent >= parsed.recent || indexed.window >= parsed.window)
+		ok = false;
+
+	flash_sim_destroy(&sim);
+	printf("%s\n", ok ? "ok" : "FAILED");
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
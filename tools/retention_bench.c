@@ -0,0 +1,316 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+/*
+ * Host tool that measures write latency of the logs as the flash fills, on
+ * the emulated flash in flash_sim.c, kept in a file by default.
+ *
+ * Each cycle appends some records to every log the firmware always has and
+ * closes them, as one run of main.c does, and its latency is the modelled
+ * time of the flash operations it makes. The logs are run twice from a
+ * freshly formatted flash: as rings of segments sharing the log budget the
+ * way main.c shares it out, until every ring has wrapped around twice, and as
+ * single unbounded files, the way they were stored before, for as many
+ * cycles or until writes fail.
+ *
+ * Cycles are grouped by how full the filesystem was, with the mean, 99th
+ * percentile and worst latency of each group, and for the rings also by
+ * whether segments were being evicted yet. It exits with a failure if a ring
+ * write fails or cycles got more than twice as slow at the 99th percentile
+ * once evicting.
+ */
+
+#define _GNU_SOURCE
+
+#define FLASH_SIM_STDIO
+#include "flash_sim.h"
+
+#include <logfile.h>
+
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The logs every build of main.c has
+static const struct log_file log_defaults[] = {
+	{ .path = "fs:/temperature_data.csv", .header = "time,temperature data celsius\r\n" },
+	{ .path = "fs:/pressure_data.csv", .header = "time,pressure data pascals\r\n" },
+	{ .path = "fs:/light_data.csv", .header = "time,light data ohms\r\n" },
+	{ .path = "fs:/microphone_data.csv", .header = "time,microphone data Hz\r\n" },
+	{ .path = "fs:/summary_data.csv", .header = "time,channel,count,mean,variance,min,max\r\n" },
+	{ .path = "fs:/energy_data.csv", .header = "time,awake ms,asleep ms,wakeups,spi ms,pdm ms,adc ms,flash ms,uAh\r\n" },
+};
+
+#define LOGS (sizeof(log_defaults) / sizeof(log_defaults[0]))
+
+// Upper ends of the fill groups, in percent of the blocks in use
+static const unsigned groups[] = {25, 50, 75, 90, 101};
+
+#define GROUPS (sizeof(groups) / sizeof(groups[0]))
+
+// Cycle latencies of one group, in seconds
+struct latencies
+{
+	double *values;
+	size_t count;
+	size_t capacity;
+	unsigned failures;
+};
+
+static bool latencies_add(struct latencies *latencies, double value)
+{
+	if (latencies->count == latencies->capacity)
+	{
+		size_t capacity = latencies->capacity ? 2 * latencies->capacity : 1024;
+		double *values = realloc(latencies->values, sizeof(*values) * capacity);
+		if (!values)
+			return false;
+		latencies->values = values;
+		latencies->capacity = capacity;
+	}
+	latencies->values[latencies->count++] = value;
+	return true;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+// Sorts the latencies, and returns their 99th percentile
+static double latencies_p99(struct latencies *latencies)
+{
+	if (!latencies->count)
+		return 0;
+	qsort(latencies->values, latencies->count, sizeof(double), compare_double);
+	return latencies->values[(latencies->count - 1) * 99 / 100];
+}
+
+static void latencies_print(struct latencies *latencies, const char *mode, const char *group)
+{
+	double sum = 0;
+	for (size_t i = 0; i < latencies->count; ++i)
+		sum += latencies->values[i];
+	double p99 = latencies_p99(latencies);
+	double worst = latencies->count ? latencies->values[latencies->count - 1] : 0;
+	printf("%-9s %-10s %8zu %10.2f %10.2f %10.2f %8u\n", mode, group, latencies->count,
+		latencies->count ? sum / latencies->count * 1e3 : 0.0, p99 * 1e3, worst * 1e3,
+		latencies->failures);
+}
+
+// Segments per log out of the budget, the way main.c shares it out: whole
+// littlefs blocks for the segment and its skip-list pointers, and one for its
+// index
+static uint32_t budget_segments(uint32_t budget, uint32_t segment_size)
+{
+	uint32_t bytes = segment_size + segment_size / FLASH_SIM_SECTOR * 8;
+	uint32_t cost = (bytes + FLASH_SIM_SECTOR - 1) / FLASH_SIM_SECTOR + 1;
+	return budget / LOGS / (cost * FLASH_SIM_SECTOR);
+}
+
+struct run
+{
+	uint32_t segment_size; // 0 for unbounded files
+	uint32_t segments;
+	unsigned records; // per log per cycle
+	unsigned cycles;
+};
+
+// Runs the logs from an empty flash; ring runs stop once every log wrapped
+// around twice, unbounded ones after max_cycles or when writes fail
+static bool run_logs(struct flash_sim *sim, struct run *run, unsigned max_cycles,
+	struct latencies by_fill[], struct latencies by_phase[2])
+{
+	struct log_file logs[LOGS];
+	for (size_t i = 0; i < LOGS; ++i)
+	{
+		logs[i] = log_defaults[i];
+		logs[i].segment_size = run->segment_size;
+		logs[i].segments = run->segments;
+		logs[i].index_interval = 16;
+	}
+	flash_sim_erase(sim);
+	if (flash_sim_mount(sim))
+		return false;
+
+	bool ok = true;
+	uint32_t time = 1700000000u;
+	for (run->cycles = 0; run->cycles < max_cycles; ++run->cycles)
+	{
+		flash_sim_reset_stats(sim);
+		bool failed = false;
+		for (size_t i = 0; i < LOGS; ++i)
+		{
+			for (unsigned r = 0; r < run->records; ++r)
+			{
+				char record[32];
+				int len = snprintf(record, sizeof(record), "%lu,%lu\r\n",
+					(unsigned long)time, (unsigned long)(time % 100000));
+				if (log_file_write(&logs[i], time, record, len))
+					failed = true;
+			}
+			if (log_file_close(&logs[i]))
+				failed = true;
+		}
+		double latency = sim->stats.time;
+		time += 60;
+
+		bool evicting = false, wrapped = true;
+		for (size_t i = 0; i < LOGS; ++i)
+		{
+			evicting |= logs[i].first > 0;
+			wrapped &= logs[i].first >= 2 * run->segments;
+		}
+		unsigned used = flash_sim_used(sim) * 100;
+		size_t g = 0;
+		while (used >= groups[g])
+			++g;
+		ok &= latencies_add(&by_fill[g], latency);
+		if (run->segment_size)
+			ok &= latencies_add(&by_phase[evicting], latency);
+		if (failed)
+		{
+			by_fill[g].failures++;
+			if (run->segment_size)
+			{
+				by_phase[evicting].failures++;
+				ok = false;
+			}
+			else
+			{
+				// The flash is full
+				++run->cycles;
+				break;
+			}
+		}
+		if (run->segment_size && wrapped)
+		{
+			++run->cycles;
+			break;
+		}
+	}
+	ok &= !flash_sim_unmount(sim);
+	return ok;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [-f image] [-b budget] [-s size] [-k records] [-c hz] [-p us] [-e ms]\n"
+		"  -f  file to keep the flash image in (default retention_bench.img)\n"
+		"  -b  log budget, bytes (default 1572864)\n"
+		"  -s  segment size, bytes (default 16384)\n"
+		"  -k  records per log per cycle (default 8)\n"
+		"  -c  flash SPI clock, Hz (default 4000000)\n"
+		"  -p  page program time, us (default 500)\n"
+		"  -e  sector erase time, ms (default 30)\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *image = "retention_bench.img";
+	uint32_t budget = 1572864;
+	struct run ring = { .segment_size = 16384, .records = 8 };
+	long spi_hz = 0;
+	double program = -1, erase = -1;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "f:b:s:k:c:p:e:h")) != -1)
+	{
+		switch (opt)
+		{
+		case 'f':
+			image = optarg;
+			break;
+		case 'b':
+			budget = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			ring.segment_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'k':
+			ring.records = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			spi_hz = strtol(optarg, NULL, 0);
+			break;
+		case 'p':
+			program = strtod(optarg, NULL) / 1e6;
+			break;
+		case 'e':
+			erase = strtod(optarg, NULL) / 1e3;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+	ring.segments = budget_segments(budget, ring.segment_size);
+	if (ring.segment_size < 256 || ring.segments < 2 || !ring.records ||
+		budget > FLASH_SIM_SIZE - FLASH_SIM_SIZE / 8)
+	{
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	struct flash_sim sim;
+	if (flash_sim_init(&sim, image))
+	{
+		fprintf(stderr, "could not set up the flash image %s\n", image);
+		return EXIT_FAILURE;
+	}
+	if (spi_hz > 0)
+		sim.timing.spi_hz = spi_hz;
+	if (program >= 0)
+		sim.timing.page_program = program;
+	if (erase >= 0)
+		sim.timing.sector_erase = erase;
+	flash_sim_route(&sim);
+
+	struct latencies ring_fill[GROUPS] = {0}, ring_phase[2] = {0};
+	struct latencies single_fill[GROUPS] = {0};
+	bool ok = run_logs(&sim, &ring, UINT32_MAX, ring_fill, ring_phase);
+	struct run single = { .records = ring.records };
+	run_logs(&sim, &single, ring.cycles, single_fill, NULL);
+
+	printf("%lu logs, %u records per cycle each, budget %lu bytes: %lu segments of %lu bytes\n",
+		(unsigned long)LOGS, ring.records, (unsigned long)budget,
+		(unsigned long)ring.segments, (unsigned long)ring.segment_size);
+	printf("ring: %u cycles, unbounded: %u cycles\n", ring.cycles, single.cycles);
+	printf("%-9s %-10s %8s %10s %10s %10s %8s\n", "store", "used", "cycles",
+		"mean ms", "p99 ms", "worst ms", "failed");
+	for (int mode = 0; mode < 2; ++mode)
+	{
+		struct latencies *fill = mode ? single_fill : ring_fill;
+		unsigned low = 0;
+		for (size_t g = 0; g < GROUPS; ++g)
+		{
+			char group[16];
+			snprintf(group, sizeof(group), "%u-%u%%", low, groups[g] > 100 ? 100 : groups[g]);
+			low = groups[g];
+			if (fill[g].count)
+				latencies_print(&fill[g], mode ? "unbounded" : "ring", group);
+		}
+	}
+	latencies_print(&ring_phase[0], "ring", "filling");
+	latencies_print(&ring_phase[1], "ring", "evicting");
+	double filling = latencies_p99(&ring_phase[0]);
+	double evicting = latencies_p99(&ring_phase[1]);
+	if (!ring_phase[1].count || evicting > 2 * filling)
+		ok = false;
+
+	for (size_t g = 0; g < GROUPS; ++g)
+	{
+		free(ring_fill[g].values);
+		free(single_fill[g].values);
+	}
+	free(ring_phase[0].values);
+	free(ring_phase[1].values);
+	flash_sim_destroy(&sim);
+	printf("%s\n", ok ? "ok" : "FAILED");
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,243 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+/*
+ * Host tool that measures the sliding DFT in fft_sdft.c: how soon it detects
+ * a tone compared with a block kiss_fftr every N samples, what it costs per
+ * sample, and how far each mode drifts from the true DFT over a long run.
+ *
+ * Latency: a tone at bin k appears over noise at a sample that is not on a
+ * block boundary. Both detectors use the same window length N and the same
+ * threshold, a fraction of the bin's full power. The sliding DFT checks after
+ * every sample, the block FFT after every N samples, as the device does with
+ * one PDM DMA buffer per frame.
+ */
+
+#define _GNU_SOURCE
+
+#include <fft_sdft.h>
+#include <kiss_fftr.h>
+
+#include <getopt.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint64_t now_cycles(void)
+{
+#ifdef HAVE_TSC
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+// Small xorshift generator, so runs are the same on every platform
+static uint32_t next_random(uint32_t *state)
+{
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+static int16_t noise(uint32_t *state, int amplitude)
+{
+	return (int16_t)(((int32_t)(next_random(state) % 65536) - 32768) * amplitude / 32768);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [-n length] [-s rate] [-k bin] [-t fraction] [-m samples]\n"
+		"  -n  window length N (default 512)\n"
+		"  -s  sampling rate, Hz (default 7813)\n"
+		"  -k  bin of the tone (default 66)\n"
+		"  -t  detection threshold, fraction of the tone's full bin magnitude (default 0.5)\n"
+		"  -m  samples of the drift run (default 10000000)\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t n = 512, rate = 7813, k = 66;
+	double fraction = 0.5;
+	long drift_samples = 10000000;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "n:s:k:t:m:h")) != -1)
+	{
+		switch (opt)
+		{
+		case 'n':
+			n = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			rate = strtoul(optarg, NULL, 0);
+			break;
+		case 'k':
+			k = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			fraction = strtod(optarg, NULL);
+			break;
+		case 'm':
+			drift_samples = atol(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+	if (n < 4 || n % 2 || k == 0 || k >= n / 2 || fraction <= 0 || fraction >= 1 || drift_samples < n)
+	{
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	// Latency, the tone starting a third of the way into a block
+	const int amplitude = 4000;
+	const uint32_t blocks = 16;
+	const uint32_t start = 8 * n + n / 3;
+	int16_t *signal = malloc(sizeof(*signal) * blocks * n);
+	kiss_fft_scalar *in = malloc(sizeof(*in) * n);
+	kiss_fft_cpx *out = malloc(sizeof(*out) * (n / 2 + 1));
+	kiss_fftr_cfg cfg = kiss_fftr_alloc(n, 0, NULL, NULL);
+	if (!signal || !in || !out || !cfg)
+	{
+		fprintf(stderr, "out of memory\n");
+		return EXIT_FAILURE;
+	}
+	uint32_t state = 1;
+	for (uint32_t t = 0; t < blocks * n; ++t)
+	{
+		double tone = t >= start ? amplitude * sin(2 * M_PI * k * (t - start) / n) : 0;
+		signal[t] = (int16_t)(tone + noise(&state, 200));
+	}
+	double full = amplitude * n / 2.0;
+	float threshold = (float)(fraction * full * fraction * full);
+	printf("N %lu at %lu Hz (%.1f ms window), tone at bin %lu (%.1f Hz) from sample %lu, threshold %.2f of full\n",
+		(unsigned long)n, (unsigned long)rate, 1000.0 * n / rate, (unsigned long)k,
+		(double)k * rate / n, (unsigned long)start, fraction);
+
+	struct fft_sdft sdft;
+	if (fft_sdft_init(&sdft, n, &k, 1, FFT_SDFT_MODULATED))
+	{
+		fprintf(stderr, "out of memory\n");
+		return EXIT_FAILURE;
+	}
+	sdft.threshold[0] = threshold;
+	long sdft_latency = -1;
+	size_t used;
+	if (fft_sdft_push_block(&sdft, signal, blocks * n, &used, NULL))
+		sdft_latency = (long)used - start;
+	fft_sdft_destroy(&sdft);
+
+	long block_latency = -1;
+	for (uint32_t b = 0; b < blocks && block_latency < 0; ++b)
+	{
+		for (uint32_t t = 0; t < n; ++t)
+			in[t] = signal[b * n + t];
+		kiss_fftr(cfg, in, out);
+		if (out[k].r * out[k].r + out[k].i * out[k].i >= threshold)
+			block_latency = (long)((b + 1) * n) - start;
+	}
+	printf("  sliding DFT %6ld samples %8.2f ms\n", sdft_latency, 1000.0 * sdft_latency / rate);
+	printf("  block FFT   %6ld samples %8.2f ms\n", block_latency, 1000.0 * block_latency / rate);
+
+	// Cost per sample, with 1 to FFT_SDFT_MAX_BINS bins
+	const uint32_t samples = 1 << 20;
+	int16_t *stream = malloc(sizeof(*stream) * samples);
+	if (!stream)
+	{
+		fprintf(stderr, "out of memory\n");
+		return EXIT_FAILURE;
+	}
+	for (uint32_t t = 0; t < samples; ++t)
+		stream[t] = noise(&state, 8000);
+	uint32_t bins[FFT_SDFT_MAX_BINS];
+	for (uint8_t i = 0; i < FFT_SDFT_MAX_BINS; ++i)
+		bins[i] = (k + 3 * i) % (n / 2);
+	printf("Cost per sample:\n");
+	static const char * const mode_names[] = {
+		[FFT_SDFT_CLASSIC] = "classic",
+		[FFT_SDFT_MODULATED] = "modulated",
+	};
+	for (int mode = FFT_SDFT_CLASSIC; mode <= FFT_SDFT_MODULATED; ++mode)
+		for (uint8_t count = 1; count <= FFT_SDFT_MAX_BINS; count *= 2)
+		{
+			fft_sdft_init(&sdft, n, bins, count, mode);
+			sdft.threshold[0] = 1e30f; // checked, but never reached
+			double begin = now_ns();
+			uint64_t cycles = now_cycles();
+			fft_sdft_push_block(&sdft, stream, samples, NULL, NULL);
+			double ns = (now_ns() - begin) / samples;
+			printf("  %-9s %u bins %7.2f ns", mode_names[mode], count, ns);
+#ifdef HAVE_TSC
+			printf(" %6.1f cycles", (double)(now_cycles() - cycles) / samples);
+#endif
+			printf("\n");
+			fft_sdft_destroy(&sdft);
+		}
+	{
+		double begin = now_ns();
+		uint64_t cycles = now_cycles();
+		for (uint32_t b = 0; b < samples / n; ++b)
+		{
+			for (uint32_t t = 0; t < n; ++t)
+				in[t] = stream[b * n + t];
+			kiss_fftr(cfg, in, out);
+		}
+		double ns = (now_ns() - begin) / samples;
+		printf("  block FFT, all bins %7.2f ns", ns);
+#ifdef HAVE_TSC
+		printf(" %6.1f cycles", (double)(now_cycles() - cycles) / samples);
+#endif
+		printf("\n");
+	}
+
+	// Drift against a direct DFT of the final window
+	printf("Error after %ld samples, relative to the bin magnitude:\n", drift_samples);
+	for (int mode = FFT_SDFT_CLASSIC; mode <= FFT_SDFT_MODULATED; ++mode)
+	{
+		fft_sdft_init(&sdft, n, &k, 1, mode);
+		state = 7;
+		for (long t = 0; t < drift_samples; ++t)
+		{
+			double tone = amplitude * sin(2 * M_PI * k * (t % n) / n);
+			fft_sdft_push(&sdft, (float)(int16_t)(tone + noise(&state, 2000)));
+		}
+		double re = 0.0, im = 0.0;
+		for (uint32_t m = 0; m < n; ++m)
+		{
+			double x = sdft.history[(sdft.head + m) % n];
+			re += x * cos(-2 * M_PI * (double)k * m / n);
+			im += x * sin(-2 * M_PI * (double)k * m / n);
+		}
+		kiss_fft_cpx value = fft_sdft_bin(&sdft, 0);
+		double error = hypot(value.r - re, value.i - im) / hypot(re, im);
+		printf("  %-9s %.2e\n", mode_names[mode], error);
+		fft_sdft_destroy(&sdft);
+	}
+
+	free(stream);
+	free(signal);
+	free(in);
+	free(out);
+	kiss_fftr_free(cfg);
+	return EXIT_SUCCESS;
+}
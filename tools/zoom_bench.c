@@ -0,0 +1,264 @@
+// SPDX-License-Identifier: Apache-2.0
+// SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+/*
+ * Host tool that compares the zoom FFT in fft.c with a real FFT long enough
+ * to give the same resolution.
+ *
+ * Two tones close together in a narrow band, plus some noise, are analyzed
+ * both ways: by fft_zoom over D*nfft samples, and by kiss_fftr over the same
+ * D*nfft samples at once. For each the tool reports the two strongest peaks
+ * found in the band, interpolated between bins, the fastest time per
+ * analysis and the memory it needed, plans, buffers and window included. The
+ * two take turns, so a busy machine slows both alike, and the zoom is timed
+ * streaming, as the firmware would run it.
+ *
+ * It exits with a failure if the zoom misplaces either tone by more than a
+ * tenth of a bin, or is not faster than the kiss_fftr.
+ */
+
+#define _GNU_SOURCE
+
+#include <fft.h>
+#include <kiss_fft.h>
+#include <kiss_fftr.h>
+
+#include <getopt.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Peak position in bins, refined by a parabola through the log power of the
+// bins around it, as fft_zoom_interpolate does
+static double interpolate(const float power[], size_t bin)
+{
+	double left = log(power[bin - 1] + 1e-30);
+	double center = log(power[bin] + 1e-30);
+	double right = log(power[bin + 1] + 1e-30);
+	double denominator = left - 2 * center + right;
+	return bin + (denominator != 0 ? 0.5 * (left - right) / denominator : 0);
+}
+
+// The two strongest local maxima of power[first..last], as bin indexes
+static void two_peaks(const float power[], size_t first, size_t last, size_t peaks[2])
+{
+	peaks[0] = peaks[1] = first;
+	float best[2] = { -1, -1 };
+	for (size_t k = first + 1; k < last; ++k)
+	{
+		if (power[k] <= power[k - 1] || power[k] < power[k + 1])
+			continue;
+		if (power[k] > best[0])
+		{
+			best[1] = best[0];
+			peaks[1] = peaks[0];
+			best[0] = power[k];
+			peaks[0] = k;
+		}
+		else if (power[k] > best[1])
+		{
+			best[1] = power[k];
+			peaks[1] = k;
+		}
+	}
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [-c center] [-d decimation] [-n nfft] [-a hz] [-b hz] [-r runs]\n"
+		"  -c  center of the band, Hz (default 1000)\n"
+		"  -d  decimation D (default 16)\n"
+		"  -n  zoom transform size (default 512)\n"
+		"  -a  first tone, Hz (default 1000.3)\n"
+		"  -b  second tone, Hz, 10 dB below the first (default 1004.2)\n"
+		"  -r  analyses to time (default 200)\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+	float center = 1000.0f;
+	uint32_t decimation = 16;
+	uint32_t nfft = 512;
+	double tone_a = 1000.3, tone_b = 1004.2;
+	int runs = 200;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "c:d:n:a:b:r:h")) != -1)
+	{
+		switch (opt)
+		{
+		case 'c':
+			center = strtof(optarg, NULL);
+			break;
+		case 'd':
+			decimation = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			nfft = strtoul(optarg, NULL, 0);
+			break;
+		case 'a':
+			tone_a = strtod(optarg, NULL);
+			break;
+		case 'b':
+			tone_b = strtod(optarg, NULL);
+			break;
+		case 'r':
+			runs = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+
+	struct fft fft;
+	fft_init(&fft);
+	uint32_t total = decimation * nfft;
+	if (runs < 1 || total % 2)
+	{
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	struct fft_zoom zoom;
+	if (fft_zoom_init(&zoom, &fft, center, decimation, nfft))
+	{
+		fprintf(stderr, "invalid zoom parameters\n");
+		return EXIT_FAILURE;
+	}
+
+	// Enough samples to fill the filters before the first analysis too
+	uint32_t lead = zoom.settle;
+	kiss_fft_scalar *samples = malloc(sizeof(*samples) * (lead + total));
+	float *power = malloc(sizeof(*power) * (total / 2 + 1));
+	if (!samples || !power)
+	{
+		fprintf(stderr, "out of memory\n");
+		return EXIT_FAILURE;
+	}
+	uint32_t seed = 1;
+	for (uint32_t t = 0; t < lead + total; ++t)
+	{
+		double x = 8000 * sin(2 * M_PI * tone_a * t / fft.S) +
+			2530 * sin(2 * M_PI * tone_b * t / fft.S);
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		x += ((int32_t)(seed & 0xFFFF) - 32768) / 32.0;
+		samples[t] = (kiss_fft_scalar)x;
+	}
+	double width = (double)fft.S / total;
+	printf("band %.1f Hz +- %.1f Hz, %.3f Hz bins, tones at %.2f and %.2f Hz\n",
+		center, fft.S / (2.0 * decimation), width, tone_a, tone_b);
+
+	// The zoom's memory is the structure, its taps, window and histories, its
+	// plan and the spectrum
+	kiss_fft_cpx *zoomed = malloc(sizeof(*zoomed) * nfft);
+	size_t zoom_cfg = 0;
+	kiss_fft_alloc(nfft, 0, NULL, &zoom_cfg);
+	size_t zoom_memory = sizeof(zoom) + zoom_cfg + 2 * nfft * sizeof(kiss_fft_cpx) +
+		(zoom.stage[0].pairs + nfft + zoom.stage[0].fill + FFT_ZOOM_STEPS + 1) * sizeof(float);
+	for (uint32_t s = 0, rate = 1; s < zoom.stages; ++s, rate *= 2)
+	{
+		zoom_memory += zoom.stage[s].pairs * sizeof(float);
+		if (s > 0)
+			zoom_memory += (zoom.stage[s].fill + FFT_ZOOM_STEPS / rate + 1) * sizeof(kiss_fft_cpx);
+	}
+
+	// A real FFT over the same samples, Hann windowed like the zoom, the
+	// window computed once as the zoom's is
+	size_t real_cfg = 0;
+	kiss_fftr_alloc(total, 0, NULL, &real_cfg);
+	kiss_fftr_cfg cfg = kiss_fftr_alloc(total, 0, NULL, NULL);
+	float *window = malloc(sizeof(*window) * total);
+	kiss_fft_scalar *in = malloc(sizeof(*in) * total);
+	kiss_fft_cpx *out = malloc(sizeof(*out) * (total / 2 + 1));
+	if (!zoomed || !cfg || !window || !in || !out)
+	{
+		fprintf(stderr, "out of memory\n");
+		return EXIT_FAILURE;
+	}
+	for (uint32_t t = 0; t < total; ++t)
+		window[t] = (float)(0.5 - 0.5 * cos(2 * M_PI * t / total));
+	size_t real_memory = real_cfg + total * (sizeof(*window) + sizeof(*in)) + (total / 2 + 1) * sizeof(*out);
+
+	// Take turns, and keep the fastest run of each, so both see the same
+	// machine. The zoom streams, its filters carrying over from one
+	// analysis to the next
+	fft_zoom_push(&zoom, samples, lead);
+	zoom.count = 0;
+	double zoom_ns = INFINITY, real_ns = INFINITY;
+	for (int r = 0; r < runs; ++r)
+	{
+		double start = now_ns();
+		fft_zoom_push(&zoom, samples + lead, total);
+		fft_zoom_spectrum(&zoom, zoomed);
+		double zoom_run = now_ns() - start;
+		if (zoom_run < zoom_ns)
+			zoom_ns = zoom_run;
+
+		start = now_ns();
+		for (uint32_t t = 0; t < total; ++t)
+			in[t] = samples[lead + t] * window[t];
+		kiss_fftr(cfg, in, out);
+		double real_run = now_ns() - start;
+		if (real_run < real_ns)
+			real_ns = real_run;
+	}
+
+	// Then one zoom analysis of the samples alone, the filters primed with
+	// the lead-in, for the peaks
+	fft_zoom_destroy(&zoom);
+	if (fft_zoom_init(&zoom, &fft, center, decimation, nfft))
+	{
+		fprintf(stderr, "out of memory\n");
+		return EXIT_FAILURE;
+	}
+	fft_zoom_push(&zoom, samples, lead);
+	zoom.count = 0;
+	fft_zoom_push(&zoom, samples + lead, total);
+	fft_zoom_spectrum(&zoom, zoomed);
+	for (uint32_t k = 0; k < nfft; ++k)
+		power[k] = zoomed[k].r * zoomed[k].r + zoomed[k].i * zoomed[k].i;
+	size_t peaks[2];
+	two_peaks(power, nfft / 8, nfft - nfft / 8, peaks);
+	double zoom_a = fft_zoom_interpolate(&zoom, &fft, zoomed, peaks[0]);
+	double zoom_b = fft_zoom_interpolate(&zoom, &fft, zoomed, peaks[1]);
+	printf("  zoom D=%-4lu nfft=%-5lu %9.1f us %7zu bytes  peaks %.2f, %.2f Hz\n",
+		(unsigned long)decimation, (unsigned long)nfft, zoom_ns / 1000, zoom_memory,
+		zoom_a, zoom_b);
+	fft_zoom_destroy(&zoom);
+	free(zoomed);
+
+	for (uint32_t k = 0; k < total / 2 + 1; ++k)
+		power[k] = out[k].r * out[k].r + out[k].i * out[k].i;
+	size_t first = (size_t)((center - fft.S / (2.0 * decimation)) / width);
+	size_t last = (size_t)((center + fft.S / (2.0 * decimation)) / width);
+	two_peaks(power, first, last < total / 2 ? last : total / 2, peaks);
+	printf("  kiss_fftr N=%-12lu %9.1f us %7zu bytes  peaks %.2f, %.2f Hz\n",
+		(unsigned long)total, real_ns / 1000, real_memory,
+		interpolate(power, peaks[0]) * width, interpolate(power, peaks[1]) * width);
+
+	bool ok = fabs(zoom_a - tone_a) < width / 10 && fabs(zoom_b - tone_b) < width / 10 &&
+		zoom_ns < real_ns;
+	printf("zoom %.1fx the speed of kiss_fftr: %s\n", real_ns / zoom_ns, ok ? "ok" : "FAILED");
+
+	free(window);
+	free(in);
+	free(out);
+	kiss_fftr_free(cfg);
+	free(samples);
+	free(power);
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
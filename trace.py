@@ -0,0 +1,145 @@
+#!/usr/bin/env python
+# SPDX-License-Identifier: Apache-2.0
+# SPDX-FileCopyrightText: Gabriel Marcano, 2023
+
+# Stage trace viewer
+# Turns the stage timing trace written by the firmware into per-stage
+#   statistics and histograms
+
+# The trace is either the binary fs:/trace.bin file, or a UART capture
+#   containing the "trace: " hex lines printed at the end of main. See
+#   trace_dump in trace.c for the layout.
+
+# ***********************************************************************************
+#
+# Imports
+#
+# ***********************************************************************************
+
+import argparse
+import math
+import struct
+import sys
+
+HEADER = struct.Struct('<4sBBHII')
+SAMPLE = struct.Struct('<BII')
+
+barWidthInCharacters = 40
+
+
+# ***********************************************************************************
+#
+# Load a trace from a binary dump or a UART capture
+#
+# ***********************************************************************************
+def load(path):
+    with open(path, mode='rb') as f:
+        data = f.read()
+    if data.startswith(b'TRCE'):
+        return data
+
+    # Otherwise assume a console log, and collect the hex lines
+    hexdata = ''
+    for line in data.decode('ascii', errors='replace').splitlines():
+        index = line.find('trace: ')
+        if index >= 0:
+            hexdata += line[index + len('trace: '):].strip()
+    return bytes.fromhex(hexdata)
+
+
+def parse(data):
+    magic, version, stages, count, frequency, recorded = HEADER.unpack_from(data)
+    if magic != b'TRCE' or version != 1:
+        raise ValueError('not a trace')
+    offset = HEADER.size
+
+    names = []
+    for _ in range(stages):
+        end = data.index(b'\0', offset)
+        names.append(data[offset:end].decode())
+        offset = end + 1
+
+    samples = []
+    for _ in range(count):
+        stage, begin, duration = SAMPLE.unpack_from(data, offset)
+        offset += SAMPLE.size
+        samples.append((stage, begin, duration))
+
+    return {'names': names, 'frequency': frequency, 'recorded': recorded,
+            'samples': samples}
+
+
+def percentile(values, fraction):
+    index = min(len(values) - 1, int(fraction * len(values)))
+    return values[index]
+
+
+# ***********************************************************************************
+#
+# Per-stage statistics, durations in microseconds
+#
+# ***********************************************************************************
+def report(trace):
+    per_stage = {}
+    for stage, _, duration in trace['samples']:
+        us = duration * 1e6 / trace['frequency']
+        per_stage.setdefault(stage, []).append(us)
+
+    print('{} samples ({} recorded, {} Hz ticks)'.format(
+        len(trace['samples']), trace['recorded'], trace['frequency']))
+    print('{:<20} {:>6} {:>12} {:>12} {:>12} {:>12} {:>12}'.format(
+        'stage', 'count', 'total us', 'min us', 'p50 us', 'p90 us', 'max us'))
+    for stage in sorted(per_stage):
+        values = sorted(per_stage[stage])
+        name = trace['names'][stage] if stage < len(trace['names']) else str(stage)
+        print('{:<20} {:>6} {:>12.1f} {:>12.1f} {:>12.1f} {:>12.1f} {:>12.1f}'.format(
+            name, len(values), sum(values), values[0],
+            percentile(values, 0.5), percentile(values, 0.9), values[-1]))
+    return per_stage
+
+
+def histograms(trace, per_stage):
+    # Power of two buckets, so stages from microseconds to seconds all fit
+    for stage in sorted(per_stage):
+        values = per_stage[stage]
+        name = trace['names'][stage] if stage < len(trace['names']) else str(stage)
+        buckets = {}
+        for us in values:
+            bucket = 0 if us < 1 else int(math.log2(us)) + 1
+            buckets[bucket] = buckets.get(bucket, 0) + 1
+        most = max(buckets.values())
+        print('\n' + name)
+        for bucket in range(min(buckets), max(buckets) + 1):
+            count = buckets.get(bucket, 0)
+            low = 0 if bucket == 0 else 2 ** (bucket - 1)
+            bar = '#' * math.ceil(count * barWidthInCharacters / most)
+            print('  {:>10} us | {:<{width}} {}'.format(
+                '>=' + str(low), bar, count, width=barWidthInCharacters))
+
+
+# ***********************************************************************************
+#
+# Main program flow
+#
+# ***********************************************************************************
+if __name__ == '__main__':
+
+    parser = argparse.ArgumentParser(
+        description='Summarize an Artemia stage timing trace')
+
+    parser.add_argument('file', help='trace.bin or a UART capture with trace lines')
+
+    parser.add_argument('--no-histogram', dest='histogram', action='store_false',
+                        help='Only print the per-stage table')
+
+    args = parser.parse_args()
+
+    try:
+        trace = parse(load(args.file))
+    except (ValueError, struct.error) as e:
+        print(args.file + ': ' + str(e))
+        sys.exit(1)
+
+    per_stage = report(trace)
+    if args.histogram:
+        histograms(trace, per_stage)